@@ -73,6 +73,7 @@ check_symbol_exists("ntohs" "arpa/inet.h" HAVE_NTOHS)
 check_symbol_exists("htonl" "arpa/inet.h" HAVE_HTONL)
 check_symbol_exists("htonl" "arpa/inet.h" HAVE_HTONL)
 check_symbol_exists("recvmsg" "sys/socket.h" HAVE_RECVMSG)
+check_symbol_exists("sendmsg" "sys/socket.h" HAVE_SENDMSG)
 check_symbol_exists("close" "unistd.h" HAVE_CLOSE)
 
 # When _POSIX_C_SOURCE is defined, but none of _BSD_SOURCE, _SVID_SOURCE and
@@ -92,4 +93,12 @@ else()
     message(STATUS "Checking if IN6_IS_ADDR_V4MAPPED is usable - no")
 endif()
 
+# GNU extensions, used opportunistically if available
+set(CMAKE_REQUIRED_DEFINITIONS ${STORED_REQUIRED_DEFINITIONS} -D_GNU_SOURCE)
+check_symbol_exists("recvmmsg" "sys/socket.h" HAVE_RECVMMSG)
+check_symbol_exists("sendmmsg" "sys/socket.h" HAVE_SENDMMSG)
+check_symbol_exists("epoll_create1" "sys/epoll.h" HAVE_EPOLL)
+check_symbol_exists("sendfile" "sys/sendfile.h" HAVE_SENDFILE)
+check_include_files("linux/filter.h" HAVE_LINUX_FILTER_H)
+
 set(CMAKE_REQUIRED_DEFINITIONS "${STORED_REQUIRED_DEFINITIONS}")
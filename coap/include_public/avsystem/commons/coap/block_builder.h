@@ -28,12 +28,20 @@ extern "C" {
 /**
  * A builder object used to split a stream of data into multiple CoAP BLOCK
  * messages.
+ *
+ * Payload buffer is used as a ring buffer, so that appending more payload
+ * never moves data that has already been stored.
  */
 typedef struct avs_coap_block_builder {
     void *payload_buffer;
     size_t payload_capacity;
 
+    /* Offset of the first unread byte within payload_buffer */
     size_t read_offset;
+    /* Offset one past the last unread byte; write_offset - read_offset is
+     * always the number of unread bytes. It exceeds payload_capacity if the
+     * stored payload wraps around the buffer end, in which case the data
+     * continues from the beginning of payload_buffer. */
     size_t write_offset;
 } avs_coap_block_builder_t;
 
@@ -98,9 +106,9 @@ void avs_coap_block_builder_next(avs_coap_block_builder_t *builder,
  * @param payload_size Number of bytes to append.
  *
  * @returns Number of bytes successfully written. If the value is not equal to
- *          passed @p payload_size, the builder has to be emptied by calling
- *          @p avs_coap_block_builder_build_next before more payload can be
- *          inserted into @p builder.
+ *          passed @p payload_size, some of the payload has to be consumed by
+ *          calling @ref avs_coap_block_builder_next before more payload can
+ *          be inserted into @p builder.
  */
 size_t avs_coap_block_builder_append_payload(avs_coap_block_builder_t *builder,
                                              const void *payload,
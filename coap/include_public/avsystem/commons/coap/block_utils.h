@@ -21,6 +21,7 @@
 #include <stdint.h>
 
 #include <avsystem/commons/coap/msg.h>
+#include <avsystem/commons/coap/msg_opt.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -91,6 +92,14 @@ int avs_coap_get_block_info(const avs_coap_msg_t *msg,
                             avs_coap_block_type_t type,
                             avs_coap_block_info_t *out_info);
 
+/**
+ * Equivalent of @ref avs_coap_get_block_info that uses a prebuilt @p index
+ * instead of parsing the message.
+ */
+int avs_coap_msg_index_get_block_info(const avs_coap_msg_index_t *index,
+                                      avs_coap_block_type_t type,
+                                      avs_coap_block_info_t *out_info);
+
 /**
  * @returns true if @p size is an acceptable CoAP BLOCK size (i.e. power of 2
  *          between @ref AVS_COAP_MSG_BLOCK_MIN_SIZE and @ref
@@ -17,7 +17,11 @@
 #ifndef AVS_COMMONS_COAP_CTX_H
 #define AVS_COMMONS_COAP_CTX_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include <avsystem/commons/coap/msg.h>
+#include <avsystem/commons/coap/stats.h>
 #include <avsystem/commons/coap/tx_params.h>
 
 #ifdef __cplusplus
@@ -94,6 +98,94 @@ typedef struct avs_coap_ctx avs_coap_ctx_t;
  */
 int avs_coap_ctx_create(avs_coap_ctx_t **ctx, size_t msg_cache_size);
 
+/**
+ * Storage engines available for the internal message cache.
+ */
+typedef enum {
+    /**
+     * Single contiguous buffer, in which entries are ordered by expiration
+     * time. Makes the best use of available memory, but making room for
+     * a large message may require evicting many small, still valid ones.
+     */
+    AVS_COAP_MSG_CACHE_ENGINE_FIFO,
+
+    /**
+     * Memory is split between size classes of fixed-size slots, each twice as
+     * large as the previous one, with larger classes getting a bigger share.
+     * The largest slot fits a message of a typical Ethernet MTU size, but
+     * takes no more than half of the cache. An entry is stored in the
+     * smallest class with a free slot large enough for it; if there is none,
+     * the oldest entry among such classes is evicted. Large messages thus
+     * never evict small ones from small slots, and no data is ever moved.
+     * Messages that do not fit in the largest slot are not cached.
+     */
+    AVS_COAP_MSG_CACHE_ENGINE_SLAB
+} avs_coap_msg_cache_engine_t;
+
+/**
+ * Configuration of a CoAP context, used by
+ * @ref avs_coap_ctx_create_with_config .
+ */
+typedef struct {
+    /**
+     * Size in bytes of the internal message cache. 0 disables the cache. See
+     * @ref avs_coap_ctx_create for details.
+     */
+    size_t msg_cache_size;
+
+    /**
+     * Storage engine to use for the message cache. Ignored if
+     * @ref avs_coap_ctx_config_t#msg_cache_size is 0.
+     */
+    avs_coap_msg_cache_engine_t msg_cache_engine;
+
+    /**
+     * If true, the context may be used by multiple threads at once, e.g. each
+     * of them receiving from its own socket bound to the same port with
+     * <c>SO_REUSEPORT</c>. The message cache, traffic counters and
+     * statistics are then split into
+     * @ref avs_coap_ctx_config_t#msg_cache_shards independently locked
+     * shards, so that duplicates are detected regardless of which thread
+     * receives them and concurrent threads rarely contend.
+     *
+     * Changing transmission parameters or enabling statistics is still not
+     * thread-safe and should be done before the context is shared.
+     *
+     * Requires the library to be compiled with threading support
+     * (<c>WITH_AVS_COMPAT_THREADING</c>).
+     */
+    bool thread_safe;
+
+    /**
+     * Number of shards in a thread-safe context. Each message cache shard
+     * gets an equal part of @ref avs_coap_ctx_config_t#msg_cache_size , and
+     * each statistics shard an equal part of the limits passed to
+     * @ref avs_coap_ctx_enable_stats_with_config . 0 means
+     * @ref AVS_COAP_CTX_DEFAULT_MSG_CACHE_SHARDS . Ignored if
+     * @ref avs_coap_ctx_config_t#thread_safe is false.
+     */
+    size_t msg_cache_shards;
+} avs_coap_ctx_config_t;
+
+/**
+ * Default value of @ref avs_coap_ctx_config_t#msg_cache_shards .
+ */
+#define AVS_COAP_CTX_DEFAULT_MSG_CACHE_SHARDS 16
+
+/**
+ * Creates a new CoAP context, as @ref avs_coap_ctx_create does, with
+ * additional options.
+ *
+ * @param ctx    Pointer to a variable that the newly created context handle
+ *               will be assigned to.
+ *
+ * @param config Context configuration.
+ *
+ * @returns 0 on success, negative value on error.
+ */
+int avs_coap_ctx_create_with_config(avs_coap_ctx_t **ctx,
+                                    const avs_coap_ctx_config_t *config);
+
 /**
  * Destroys the CoAP context, releases any resources allocated for it, and sets
  * <c>*ctx</c> to NULL.
@@ -117,6 +209,50 @@ int avs_coap_ctx_send(avs_coap_ctx_t *ctx,
                       avs_net_abstract_socket_t *socket,
                       const avs_coap_msg_t *msg);
 
+/**
+ * Single message used by @ref avs_coap_ctx_send_batch .
+ */
+typedef struct {
+    /** Message to send. Set by the caller. */
+    const avs_coap_msg_t *msg;
+    /** Host name or IP address of the recipient. Set by the caller. */
+    const char *host;
+    /** Port of the recipient. Set by the caller. */
+    const char *port;
+    /**
+     * Result of sending this message - the value that
+     * @ref avs_coap_ctx_send would return for it. Set by the library.
+     */
+    int result;
+} avs_coap_ctx_send_slot_t;
+
+/**
+ * Sends multiple CoAP messages, possibly to different recipients, via
+ * a specified network socket, using as few system calls as possible. This is
+ * intended for fanning out notifications from a single unconnected socket.
+ *
+ * Each message is handled as if it was sent using @ref avs_coap_ctx_send ,
+ * except that it is addressed explicitly. Responses are recorded in the
+ * message cache under the address the socket actually sent them to, as
+ * reported in the <c>resolved_endpoint</c> field of
+ * @ref avs_net_socket_send_to_msg_t , so that retransmitted requests coming
+ * from that address are matched. If the socket does not report that address,
+ * the response is not cached at all.
+ *
+ * @param ctx    CoAP context to operate on.
+ * @param socket Network socket to send the messages through.
+ * @param slots  Array of messages to send.
+ * @param count  Number of entries in @p slots .
+ *
+ * @returns 0 if all the messages have been sent, or a negative value if at
+ *          least one of them failed, in which case the <c>result</c> fields of
+ *          @p slots indicate which ones.
+ */
+int avs_coap_ctx_send_batch(avs_coap_ctx_t *ctx,
+                            avs_net_abstract_socket_t *socket,
+                            avs_coap_ctx_send_slot_t *slots,
+                            size_t count);
+
 /**
  * Receives a datagram from the specified network socket and decodes it as a
  * CoAP message. If a message can be identified as a duplicate or a CoAP ping,
@@ -140,6 +276,54 @@ int avs_coap_ctx_recv(avs_coap_ctx_t *ctx,
                       avs_coap_msg_t *out_msg,
                       size_t msg_capacity);
 
+/**
+ * Single message slot used by @ref avs_coap_ctx_recv_batch .
+ */
+typedef struct {
+    /** Output buffer to store the message in. Set by the caller. */
+    avs_coap_msg_t *msg;
+    /**
+     * Number of bytes allocated for the @ref msg structure, with the same
+     * semantics as the <c>msg_capacity</c> argument to
+     * @ref avs_coap_ctx_recv . Set by the caller.
+     */
+    size_t capacity;
+    /**
+     * Result of receiving this message - the value that
+     * @ref avs_coap_ctx_recv would return for it. Set by the library.
+     */
+    int result;
+} avs_coap_ctx_recv_slot_t;
+
+/**
+ * Receives multiple datagrams from the specified network socket at once, and
+ * handles each of them in the same way as @ref avs_coap_ctx_recv does,
+ * including automatic responses to duplicates and CoAP pings.
+ *
+ * Waits until at least one datagram is available, then fills as many
+ * consecutive entries of @p slots as can be received without blocking. On
+ * sockets that do not support batched receiving (e.g. DTLS), at most one
+ * message is received per call.
+ *
+ * @param ctx          CoAP context to operate on.
+ * @param socket       Network socket to receive the messages from.
+ * @param slots        Array of message slots to fill.
+ * @param count        Number of entries in @p slots . Must be greater than
+ *                     zero.
+ * @param out_received Number of leading entries of @p slots that have been
+ *                     filled. Each of them has its <c>result</c> field set.
+ *
+ * @returns 0 if at least one datagram has been received (note that the
+ *          per-message results may still indicate errors), or a negative value
+ *          (possibly one of the <c>AVS_COAP_CTX_ERR_*</c> constants) in case
+ *          of a network error.
+ */
+int avs_coap_ctx_recv_batch(avs_coap_ctx_t *ctx,
+                            avs_net_abstract_socket_t *socket,
+                            avs_coap_ctx_recv_slot_t *slots,
+                            size_t count,
+                            size_t *out_received);
+
 /**
  * Gets the CoAP transmission parameters used by the CoAP context.
  *
@@ -255,6 +439,9 @@ avs_coap_ctx_get_num_incoming_retransmissions(avs_coap_ctx_t *ctx);
  *
  * @returns Number of packets sent through the ctx that were already cached as
  *          well as requests which the CoAP client did not get any response to.
+ *          The latter are detected by comparing each request with the
+ *          previous one sent through any socket of the context or, in
+ *          thread-safe contexts, through sockets of the same shard.
  *
  * NOTE: When <c>WITH_AVS_COAP_NET_STATS</c> is disabled, this function always
  * returns 0.
@@ -262,6 +449,51 @@ avs_coap_ctx_get_num_incoming_retransmissions(avs_coap_ctx_t *ctx);
 uint64_t
 avs_coap_ctx_get_num_outgoing_retransmissions(avs_coap_ctx_t *ctx);
 
+/**
+ * Enables collection of detailed traffic statistics: per-endpoint counters,
+ * per-code counters, request latency histograms and message cache counters.
+ * Calling this function again resets all gathered statistics.
+ *
+ * @param ctx           CoAP context to operate on.
+ * @param max_endpoints Maximum number of remote endpoints to keep separate
+ *                      counters for. Traffic of any further endpoints is only
+ *                      accounted for in aggregated counters.
+ *
+ * @returns 0 on success, a negative value if there is not enough memory.
+ *
+ * NOTE: When <c>WITH_AVS_COAP_STATS</c> is disabled, this function always
+ * fails.
+ */
+int avs_coap_ctx_enable_stats(avs_coap_ctx_t *ctx, size_t max_endpoints);
+
+/**
+ * Variant of @ref avs_coap_ctx_enable_stats that allows tuning all parameters
+ * of statistics collection.
+ *
+ * @param ctx    CoAP context to operate on.
+ * @param config Statistics configuration.
+ *
+ * @returns 0 on success, a negative value if there is not enough memory.
+ *
+ * NOTE: When <c>WITH_AVS_COAP_STATS</c> is disabled, this function always
+ * fails.
+ */
+int avs_coap_ctx_enable_stats_with_config(
+        avs_coap_ctx_t *ctx, const avs_coap_stats_config_t *config);
+
+/**
+ * Retrieves a snapshot of statistics gathered since the call to
+ * @ref avs_coap_ctx_enable_stats .
+ *
+ * @param ctx       CoAP context to operate on.
+ * @param out_stats Structure to fill. On success, it needs to be freed using
+ *                  @ref avs_coap_stats_cleanup .
+ *
+ * @returns 0 on success, a negative value if statistics are not enabled or
+ *          there is not enough memory to copy per-endpoint counters.
+ */
+int avs_coap_ctx_get_stats(avs_coap_ctx_t *ctx, avs_coap_stats_t *out_stats);
+
 /** @} */
 
 #ifdef __cplusplus
@@ -31,6 +31,14 @@ extern "C" {
 /** Internal, opaque struct that holds a single CoAP option. */
 typedef struct avs_coap_msg_info_opt avs_coap_msg_info_opt_t;
 
+/**
+ * Number of bytes of an option arena (see
+ * @ref avs_coap_msg_info_init_with_arena ) consumed by an option with
+ * @p DataSize bytes of value.
+ */
+#define AVS_COAP_MSG_INFO_ARENA_OPT_SIZE(DataSize) \
+    (4 + (((size_t) (DataSize) + 1) & ~(size_t) 1))
+
 /** Unserialized form of CoAP message header + token + options. */
 typedef struct avs_coap_msg_info {
     avs_coap_msg_type_t type;
@@ -40,6 +48,10 @@ typedef struct avs_coap_msg_info {
     /* Fields below are NOT meant to be modified directly. Use provided
      * accessor functions instead. */
     AVS_LIST(avs_coap_msg_info_opt_t) options_;
+    /* If not NULL, options are stored in this buffer instead of options_ */
+    void *arena_;
+    size_t arena_capacity_;
+    size_t arena_used_;
 } avs_coap_msg_info_t;
 
 /**
@@ -52,13 +64,41 @@ static inline avs_coap_msg_info_t avs_coap_msg_info_init() {
             .msg_id = 0,
             .token = { 0, "" },
         },
-        .options_ = NULL
+        .options_ = NULL,
+        .arena_ = NULL,
+        .arena_capacity_ = 0,
+        .arena_used_ = 0
     };
 }
 
+/**
+ * Initializes a @ref avs_coap_header_msg_info_t that stores its options in
+ * a fixed-capacity, caller-provided buffer instead of allocating memory for
+ * each of them.
+ *
+ * Adding an option that does not fit in the remaining space of @p arena fails.
+ * Each option uses @ref AVS_COAP_MSG_INFO_ARENA_OPT_SIZE bytes of the arena.
+ *
+ * @param arena      Buffer to store options in. MUST be aligned at least as
+ *                   a <c>uint16_t</c> and live at least as long as the
+ *                   returned object.
+ * @param arena_size Number of bytes available in @p arena .
+ */
+static inline avs_coap_msg_info_t
+avs_coap_msg_info_init_with_arena(void *arena, size_t arena_size) {
+    avs_coap_msg_info_t info = avs_coap_msg_info_init();
+    assert(arena);
+    info.arena_ = arena;
+    info.arena_capacity_ = arena_size;
+    return info;
+}
+
 /**
  * Frees any memory allocated for temporary storage required by the info object.
  * Resets all header fields to defaults.
+ *
+ * If @p info was initialized with @ref avs_coap_msg_info_init_with_arena ,
+ * the arena is emptied and remains in use.
  */
 void avs_coap_msg_info_reset(avs_coap_msg_info_t *info);
 
@@ -146,7 +186,10 @@ int avs_coap_msg_info_opt_block(avs_coap_msg_info_t *info,
  *
  * @return 0 on success, -1 in case of error:
  *         - the message code is set to @ref AVS_COAP_CODE_EMPTY, which must
- *           not contain any options.
+ *           not contain any options,
+ *         - there is not enough memory, or not enough space left in the arena
+ *           if @p info was initialized with
+ *           @ref avs_coap_msg_info_init_with_arena .
  */
 int avs_coap_msg_info_opt_opaque(avs_coap_msg_info_t *info,
                                  uint16_t opt_number,
@@ -146,6 +146,118 @@ int avs_coap_msg_get_option_string_it(const avs_coap_msg_t *msg,
 int avs_coap_msg_get_content_format(const avs_coap_msg_t *msg,
                                     uint16_t *out_value);
 
+/**
+ * Maximum number of options that can be stored in @ref avs_coap_msg_index_t .
+ */
+#define AVS_COAP_MSG_INDEX_MAX_OPTIONS 16
+
+/** Location of a single option within an indexed message. */
+typedef struct {
+    /** Offset of the option header, relative to <c>msg->content</c>. */
+    uint32_t offset;
+    /** Length of the option value. */
+    uint32_t length;
+    /** Option number. */
+    uint16_t number;
+} avs_coap_msg_index_entry_t;
+
+/**
+ * Index of options present in a CoAP message, allowing them to be looked up
+ * without re-parsing the message each time.
+ *
+ * The index is only valid as long as the message it was built for is neither
+ * freed nor modified.
+ */
+typedef struct {
+    /** Indexed message. */
+    const avs_coap_msg_t *msg;
+    /** Number of valid entries in @ref options . */
+    size_t num_options;
+    /**
+     * True if the message contains more than
+     * @ref AVS_COAP_MSG_INDEX_MAX_OPTIONS options. Lookups of option numbers
+     * not smaller than the last indexed one fall back to parsing the message
+     * in such case.
+     */
+    bool truncated;
+    /** Offset of the payload, relative to <c>msg->content</c>. */
+    uint32_t payload_offset;
+    /** Indexed options, sorted by option number. */
+    avs_coap_msg_index_entry_t options[AVS_COAP_MSG_INDEX_MAX_OPTIONS];
+} avs_coap_msg_index_t;
+
+/**
+ * Builds an option index of @p msg in a single pass over its options.
+ *
+ * @param[in]  msg       Valid CoAP message to index.
+ * @param[out] out_index Index to fill.
+ */
+void avs_coap_msg_index_build(const avs_coap_msg_t *msg,
+                              avs_coap_msg_index_t *out_index);
+
+/**
+ * Checks whether @p msg is a valid CoAP message, as
+ * @ref avs_coap_msg_is_valid does, and builds its option index during the
+ * same pass over the message.
+ *
+ * @param[in]  msg       Message to validate.
+ * @param[out] out_index Index to fill, or NULL if only validation is
+ *                       required. Contents are unspecified if the message is
+ *                       not valid.
+ *
+ * @returns true if the message is valid, false otherwise.
+ */
+bool avs_coap_msg_validate_and_index(const avs_coap_msg_t *msg,
+                                     avs_coap_msg_index_t *out_index);
+
+/**
+ * Equivalent of @ref avs_coap_msg_find_unique_opt that uses a prebuilt
+ * @p index instead of parsing the message.
+ */
+int avs_coap_msg_index_find_unique_opt(const avs_coap_msg_index_t *index,
+                                       uint16_t opt_number,
+                                       const avs_coap_opt_t **out_opt);
+
+/**
+ * Equivalent of @ref avs_coap_msg_get_option_uint that uses a prebuilt
+ * @p index instead of parsing the message.
+ */
+int avs_coap_msg_index_get_option_uint(const avs_coap_msg_index_t *index,
+                                       uint16_t option_number,
+                                       void *out_fmt,
+                                       size_t out_fmt_size);
+
+/**
+ * Equivalent of @ref avs_coap_msg_get_option_u16 that uses a prebuilt
+ * @p index instead of parsing the message.
+ */
+static inline int
+avs_coap_msg_index_get_option_u16(const avs_coap_msg_index_t *index,
+                                  uint16_t option_number,
+                                  uint16_t *out_value) {
+    return avs_coap_msg_index_get_option_uint(index, option_number, out_value,
+                                              sizeof(*out_value));
+}
+
+/**
+ * Equivalent of @ref avs_coap_msg_get_option_u32 that uses a prebuilt
+ * @p index instead of parsing the message.
+ */
+static inline int
+avs_coap_msg_index_get_option_u32(const avs_coap_msg_index_t *index,
+                                  uint16_t option_number,
+                                  uint32_t *out_value) {
+    return avs_coap_msg_index_get_option_uint(index, option_number, out_value,
+                                              sizeof(*out_value));
+}
+
+/**
+ * Equivalent of @ref avs_coap_msg_get_content_format that uses a prebuilt
+ * @p index instead of parsing the message.
+ */
+int avs_coap_msg_index_get_content_format(const avs_coap_msg_index_t *index,
+                                          uint16_t *out_value);
+
 /**
  * A callback that determines whether given option number is appropriate for
  * a message with specific CoAP code.
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AVS_COMMONS_COAP_MSG_TEMPLATE_H
+#define AVS_COMMONS_COAP_MSG_TEMPLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <avsystem/commons/coap/msg_builder.h>
+#include <avsystem/commons/coap/msg_identity.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Pre-serialized message, used to send many messages that only differ in
+ * message ID, token and value of the Observe option, e.g. notifications about
+ * a single resource sent to multiple observers.
+ *
+ * All options (except the Observe value) and the payload are serialized only
+ * once, when the template is created. Filling the template for a single
+ * recipient is then a matter of copying these bytes and patching the header.
+ */
+typedef struct avs_coap_msg_template avs_coap_msg_template_t;
+
+/**
+ * Creates a message template.
+ *
+ * @param[out] out_template Created template.
+ * @param[in]  info         Message type, code and options shared by all
+ *                          messages. If the Observe option is present, its
+ *                          value is replaced by the one passed to
+ *                          @ref avs_coap_msg_template_fill . Message ID and
+ *                          token are ignored.
+ * @param[in]  payload      Payload shared by all messages.
+ * @param[in]  payload_size Number of bytes in @p payload .
+ *
+ * @returns 0 on success, a negative value in case of error.
+ */
+int avs_coap_msg_template_create(avs_coap_msg_template_t **out_template,
+                                 const avs_coap_msg_info_t *info,
+                                 const void *payload,
+                                 size_t payload_size);
+
+/**
+ * Frees the template and sets <c>*template_ptr</c> to NULL.
+ */
+void avs_coap_msg_template_cleanup(avs_coap_msg_template_t **template_ptr);
+
+/**
+ * @returns Number of bytes that a buffer passed to
+ *          @ref avs_coap_msg_template_fill needs to be able to hold any
+ *          message constructed from @p tpl .
+ */
+size_t avs_coap_msg_template_storage_size(const avs_coap_msg_template_t *tpl);
+
+/**
+ * Constructs a message from @p tpl in @p buffer .
+ *
+ * @param tpl         Template to use.
+ * @param identity    Message ID and token of the message.
+ * @param observe     Value of the Observe option. Only the lowest 24 bits are
+ *                    used. Ignored if the template has no Observe option.
+ * @param buffer      Storage for the constructed message.
+ * @param buffer_size @p buffer capacity in bytes.
+ *
+ * @returns A pointer to the message constructed inside @p buffer on success,
+ *          NULL if @p buffer is too small.
+ */
+const avs_coap_msg_t *
+avs_coap_msg_template_fill(const avs_coap_msg_template_t *tpl,
+                           const avs_coap_msg_identity_t *identity,
+                           uint32_t observe,
+                           avs_coap_aligned_msg_buffer_t *buffer,
+                           size_t buffer_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AVS_COMMONS_COAP_MSG_TEMPLATE_H
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AVS_COMMONS_COAP_RETX_SCHEDULER_H
+#define AVS_COMMONS_COAP_RETX_SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <avsystem/commons/net.h>
+#include <avsystem/commons/time.h>
+
+#include <avsystem/commons/coap/ctx.h>
+#include <avsystem/commons/coap/msg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Retransmission scheduler for outstanding Confirmable messages.
+ *
+ * Keeps copies of sent Confirmable messages, retransmits them with
+ * exponential backoff derived from transmission parameters of the CoAP
+ * context they were sent through, until either they are cancelled (e.g. after
+ * receiving a matching ACK or RST) or MAX_RETRANSMIT is exceeded.
+ *
+ * Deadlines are tracked using a hierarchical timer wheel, so that scheduling,
+ * cancelling and firing a retransmission take constant time regardless of the
+ * number of outstanding exchanges.
+ */
+typedef struct avs_coap_retx_scheduler avs_coap_retx_scheduler_t;
+
+/**
+ * Function called when a Confirmable message has not been acknowledged after
+ * all retransmissions.
+ *
+ * @param arg    Opaque argument passed to @ref avs_coap_retx_scheduler_create .
+ * @param ctx    CoAP context the message was sent through.
+ * @param socket Socket the message was sent through.
+ * @param msg    Timed out message. Only valid until the handler returns.
+ */
+typedef void avs_coap_retx_timeout_handler_t(void *arg,
+                                             avs_coap_ctx_t *ctx,
+                                             avs_net_abstract_socket_t *socket,
+                                             const avs_coap_msg_t *msg);
+
+/**
+ * Creates a retransmission scheduler.
+ *
+ * @param[out] out_scheduler  Created scheduler.
+ * @param[in]  tick           Timer resolution. Deadlines are rounded up to
+ *                            a multiple of it. Must be positive.
+ * @param[in]  on_timeout     Function to call for timed out messages. May be
+ *                            NULL.
+ * @param[in]  on_timeout_arg Opaque argument to pass to @p on_timeout .
+ *
+ * @returns 0 on success, a negative value in case of error.
+ */
+int avs_coap_retx_scheduler_create(avs_coap_retx_scheduler_t **out_scheduler,
+                                   avs_time_duration_t tick,
+                                   avs_coap_retx_timeout_handler_t *on_timeout,
+                                   void *on_timeout_arg);
+
+/**
+ * Frees all resources used by the scheduler, dropping all outstanding
+ * messages without calling the timeout handler, and sets
+ * <c>*scheduler</c> to NULL.
+ */
+void avs_coap_retx_scheduler_cleanup(avs_coap_retx_scheduler_t **scheduler);
+
+/**
+ * Sends @p msg using @ref avs_coap_ctx_send and, if it is a Confirmable
+ * message, schedules its retransmissions.
+ *
+ * @returns Value returned by @ref avs_coap_ctx_send , or a negative value if
+ *          a message with the same ID is already outstanding on @p socket or
+ *          there is not enough memory.
+ */
+int avs_coap_retx_scheduler_send(avs_coap_retx_scheduler_t *scheduler,
+                                 avs_coap_ctx_t *ctx,
+                                 avs_net_abstract_socket_t *socket,
+                                 const avs_coap_msg_t *msg);
+
+/**
+ * Stops retransmitting the outstanding message with @p msg_id sent through
+ * @p socket . Should be called upon reception of a matching ACK or RST.
+ *
+ * @returns 0 if a message was found and cancelled, a negative value otherwise.
+ */
+int avs_coap_retx_scheduler_cancel(avs_coap_retx_scheduler_t *scheduler,
+                                   avs_net_abstract_socket_t *socket,
+                                   uint16_t msg_id);
+
+/**
+ * @returns Number of outstanding messages.
+ */
+size_t avs_coap_retx_scheduler_size(const avs_coap_retx_scheduler_t *scheduler);
+
+/**
+ * @returns Time at which @ref avs_coap_retx_scheduler_fire_expired should be
+ *          called next, or @ref AVS_TIME_MONOTONIC_INVALID if there are no
+ *          outstanding messages. The returned value may be earlier than the
+ *          actual deadline of any message, but never later.
+ */
+avs_time_monotonic_t
+avs_coap_retx_scheduler_next_deadline(const avs_coap_retx_scheduler_t *scheduler);
+
+/**
+ * Retransmits all messages whose deadline has passed, and drops the ones that
+ * exceeded MAX_RETRANSMIT, calling the timeout handler for each of them.
+ */
+void avs_coap_retx_scheduler_fire_expired(avs_coap_retx_scheduler_t *scheduler);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AVS_COMMONS_COAP_RETX_SCHEDULER_H
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AVS_COMMONS_COAP_STATS_H
+#define AVS_COMMONS_COAP_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <avsystem/commons/list.h>
+#include <avsystem/commons/net.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Number of buckets in @ref avs_coap_latency_histogram_t .
+ */
+#define AVS_COAP_STATS_LATENCY_BUCKETS 16
+
+/**
+ * Default value of @ref avs_coap_stats_config_t#max_pending_requests .
+ */
+#define AVS_COAP_STATS_DEFAULT_MAX_PENDING_REQUESTS 32
+
+/** Configuration of statistics collection. */
+typedef struct {
+    /**
+     * Maximum number of remote endpoints to keep separate counters for.
+     * Traffic of any further endpoints is only accounted for in aggregated
+     * counters.
+     */
+    size_t max_endpoints;
+    /**
+     * Number of requests awaiting a response that are tracked for latency
+     * measurements. When exceeded, the oldest ones are forgotten and counted
+     * in @ref avs_coap_stats_t#dropped_latency_samples . If 0,
+     * @ref AVS_COAP_STATS_DEFAULT_MAX_PENDING_REQUESTS is used.
+     */
+    size_t max_pending_requests;
+} avs_coap_stats_config_t;
+
+/** Message and byte counters for a single direction pair. */
+typedef struct {
+    /** Number of datagrams received. */
+    uint64_t rx_msgs;
+    /** Number of datagrams sent. */
+    uint64_t tx_msgs;
+    /** Number of CoAP bytes received, not counting lower layer headers. */
+    uint64_t rx_bytes;
+    /** Number of CoAP bytes sent, not counting lower layer headers. */
+    uint64_t tx_bytes;
+    /** Number of received requests that were identified as duplicates. */
+    uint64_t incoming_retransmissions;
+    /**
+     * Number of sent messages that were identified as retransmissions of
+     * a request or a cached response.
+     */
+    uint64_t outgoing_retransmissions;
+} avs_coap_traffic_stats_t;
+
+/** Traffic counters of a single remote endpoint. */
+typedef struct {
+    /**
+     * Opaque identifier of the remote endpoint - either a raw socket address,
+     * or the textual host and port separated with a nullbyte, depending on
+     * what the socket in use supports.
+     */
+    avs_net_resolved_endpoint_t endpoint;
+    avs_coap_traffic_stats_t traffic;
+} avs_coap_endpoint_stats_t;
+
+/**
+ * Histogram of request-response latencies. Bucket 0 counts latencies below
+ * 1 ms, bucket <c>i</c> counts latencies in range
+ * <c>[2^(i-1) ms, 2^i ms)</c>, and the last bucket additionally counts all
+ * longer ones.
+ */
+typedef struct {
+    uint64_t buckets[AVS_COAP_STATS_LATENCY_BUCKETS];
+} avs_coap_latency_histogram_t;
+
+/** Message cache effectiveness counters. */
+typedef struct {
+    /** Number of duplicate requests answered from the cache. */
+    uint64_t hits;
+    /** Number of cache lookups that did not find a response. */
+    uint64_t misses;
+    /** Number of responses dropped before expiry to make room for others. */
+    uint64_t evictions;
+    /** Number of responses dropped after expiry. */
+    uint64_t expirations;
+} avs_coap_cache_stats_t;
+
+/** Snapshot of all statistics gathered by a CoAP context. */
+typedef struct {
+    /** Counters aggregated over all endpoints. */
+    avs_coap_traffic_stats_t total;
+    /** Number of received messages, indexed by CoAP code. */
+    uint64_t rx_by_code[256];
+    /** Number of sent messages, indexed by CoAP code. */
+    uint64_t tx_by_code[256];
+    /**
+     * Time between sending a request and receiving the matching response.
+     */
+    avs_coap_latency_histogram_t outgoing_request_latency;
+    /**
+     * Time between receiving a request and sending the matching response.
+     */
+    avs_coap_latency_histogram_t incoming_request_latency;
+    /**
+     * Number of requests that were never accounted for in the latency
+     * histograms because too many others were awaiting a response at the
+     * same time. See @ref avs_coap_stats_config_t#max_pending_requests .
+     */
+    uint64_t dropped_latency_samples;
+    /** Message cache counters. All zeros if the context has no cache. */
+    avs_coap_cache_stats_t cache;
+    /**
+     * Per-endpoint counters. Endpoints seen after the limit passed to
+     * @ref avs_coap_ctx_enable_stats had been reached are only accounted for
+     * in @ref total .
+     */
+    AVS_LIST(avs_coap_endpoint_stats_t) endpoints;
+} avs_coap_stats_t;
+
+/**
+ * Frees the per-endpoint list owned by @p stats .
+ */
+void avs_coap_stats_cleanup(avs_coap_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AVS_COMMONS_COAP_STATS_H
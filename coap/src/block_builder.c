@@ -50,38 +50,32 @@ avs_coap_block_builder_init(avs_coap_msg_builder_t *msg_builder) {
     return block_builder;
 }
 
-static void *payload_read_ptr(avs_coap_block_builder_t *builder) {
-    return (uint8_t*)builder->payload_buffer + builder->read_offset;
+static uint8_t *payload_at(avs_coap_block_builder_t *builder, size_t offset) {
+    return (uint8_t *) builder->payload_buffer + offset;
 }
 
-static void *payload_write_ptr(avs_coap_block_builder_t *builder) {
-    return (uint8_t*)builder->payload_buffer + builder->write_offset;
-}
-
-static void shift_payload(avs_coap_block_builder_t *builder) {
-    if (builder->read_offset == 0) {
-        return;
+static size_t wrap_offset(const avs_coap_block_builder_t *builder,
+                          size_t offset) {
+    if (offset >= builder->payload_capacity) {
+        offset -= builder->payload_capacity;
     }
-
-    size_t unread_bytes = avs_coap_block_builder_payload_remaining(builder);
-    if (unread_bytes > 0) {
-        memmove(builder->payload_buffer, payload_read_ptr(builder),
-                unread_bytes);
-    }
-
-    builder->read_offset = 0;
-    builder->write_offset = unread_bytes;
+    return offset;
 }
 
 size_t avs_coap_block_builder_append_payload(avs_coap_block_builder_t *builder,
                                              const void *payload,
                                              size_t payload_size) {
-    shift_payload(builder);
-
-    size_t bytes_available = builder->payload_capacity - builder->write_offset;
+    size_t bytes_available = builder->payload_capacity
+            - avs_coap_block_builder_payload_remaining(builder);
     size_t bytes_to_write = AVS_MIN(bytes_available, payload_size);
 
-    memcpy(payload_write_ptr(builder), payload, bytes_to_write);
+    // free space may wrap around the buffer end
+    size_t write_offset = wrap_offset(builder, builder->write_offset);
+    size_t first_chunk = AVS_MIN(bytes_to_write,
+                                 builder->payload_capacity - write_offset);
+    memcpy(payload_at(builder, write_offset), payload, first_chunk);
+    memcpy(payload_at(builder, 0), (const uint8_t *) payload + first_chunk,
+           bytes_to_write - first_chunk);
     builder->write_offset += bytes_to_write;
 
     return bytes_to_write;
@@ -90,6 +84,8 @@ size_t avs_coap_block_builder_append_payload(avs_coap_block_builder_t *builder,
 size_t avs_coap_block_builder_payload_remaining(
         const avs_coap_block_builder_t *builder) {
     assert(builder->read_offset <= builder->write_offset);
+    assert(builder->write_offset - builder->read_offset
+           <= builder->payload_capacity);
     return builder->write_offset - builder->read_offset;
 }
 
@@ -126,10 +122,19 @@ avs_coap_block_builder_build(avs_coap_block_builder_t *builder,
                                   msg_builder_payload_remaining);
     }
     size_t bytes_to_write = AVS_MIN(bytes_available, block_size);
-    assert(builder->read_offset + bytes_to_write <= builder->write_offset);
 
+    // block may consist of two segments if it wraps around the buffer end
+    size_t first_chunk =
+            AVS_MIN(bytes_to_write,
+                    builder->payload_capacity - builder->read_offset);
     size_t bytes_written = avs_coap_msg_builder_payload(
-            &msg_builder, payload_read_ptr(builder), bytes_to_write);
+            &msg_builder, payload_at(builder, builder->read_offset),
+            first_chunk);
+    if (bytes_written == first_chunk && first_chunk < bytes_to_write) {
+        bytes_written += avs_coap_msg_builder_payload(
+                &msg_builder, payload_at(builder, 0),
+                bytes_to_write - first_chunk);
+    }
 
     if (bytes_to_write != bytes_written) {
         AVS_UNREACHABLE("Could not flush the payload");
@@ -143,4 +148,16 @@ void avs_coap_block_builder_next(avs_coap_block_builder_t *builder,
                                  size_t block_size) {
     builder->read_offset =
             AVS_MIN(builder->read_offset + block_size, builder->write_offset);
+    if (builder->read_offset == builder->write_offset) {
+        // keep the data contiguous for as long as possible
+        builder->read_offset = 0;
+        builder->write_offset = 0;
+    } else if (builder->read_offset >= builder->payload_capacity) {
+        builder->read_offset -= builder->payload_capacity;
+        builder->write_offset -= builder->payload_capacity;
+    }
 }
+
+#ifdef AVS_UNIT_TESTING
+#include "test/block_builder.c"
+#endif // AVS_UNIT_TESTING
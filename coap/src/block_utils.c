@@ -25,19 +25,18 @@
 
 VISIBILITY_SOURCE_BEGIN
 
-int avs_coap_get_block_info(const avs_coap_msg_t *msg,
-                            avs_coap_block_type_t type,
-                            avs_coap_block_info_t *out_info) {
-    assert(msg);
-    assert(out_info);
-    uint16_t opt_number = type == AVS_COAP_BLOCK1
-            ? AVS_COAP_OPT_BLOCK1
-            : AVS_COAP_OPT_BLOCK2;
-    const avs_coap_opt_t *opt;
+static uint16_t block_opt_number(avs_coap_block_type_t type) {
+    return type == AVS_COAP_BLOCK1 ? AVS_COAP_OPT_BLOCK1 : AVS_COAP_OPT_BLOCK2;
+}
+
+static int get_block_info(int find_result,
+                          const avs_coap_opt_t *opt,
+                          avs_coap_block_type_t type,
+                          avs_coap_block_info_t *out_info) {
     memset(out_info, 0, sizeof(*out_info));
-    if (avs_coap_msg_find_unique_opt(msg, opt_number, &opt)) {
+    if (find_result) {
         if (opt) {
-            int num = opt_number == AVS_COAP_OPT_BLOCK1 ? 1 : 2;
+            int num = type == AVS_COAP_BLOCK1 ? 1 : 2;
             LOG(ERROR, "multiple BLOCK%d options found", num);
             return -1;
         }
@@ -51,6 +50,28 @@ int avs_coap_get_block_info(const avs_coap_msg_t *msg,
     return out_info->valid ? 0 : -1;
 }
 
+int avs_coap_get_block_info(const avs_coap_msg_t *msg,
+                            avs_coap_block_type_t type,
+                            avs_coap_block_info_t *out_info) {
+    assert(msg);
+    assert(out_info);
+    const avs_coap_opt_t *opt;
+    int result = avs_coap_msg_find_unique_opt(msg, block_opt_number(type),
+                                              &opt);
+    return get_block_info(result, opt, type, out_info);
+}
+
+int avs_coap_msg_index_get_block_info(const avs_coap_msg_index_t *index,
+                                      avs_coap_block_type_t type,
+                                      avs_coap_block_info_t *out_info) {
+    assert(index);
+    assert(out_info);
+    const avs_coap_opt_t *opt;
+    int result = avs_coap_msg_index_find_unique_opt(
+            index, block_opt_number(type), &opt);
+    return get_block_info(result, opt, type, out_info);
+}
+
 bool avs_coap_is_valid_block_size(uint16_t size) {
     return avs_is_power_of_2(size)
             && size <= AVS_COAP_MSG_BLOCK_MAX_SIZE
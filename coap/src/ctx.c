@@ -21,27 +21,78 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <avsystem/commons/errno.h>
 #include <avsystem/commons/list.h>
 #include <avsystem/commons/memory.h>
 
+#ifdef WITH_AVS_COMPAT_THREADING
+#include <avsystem/commons/mutex.h>
+#endif // WITH_AVS_COMPAT_THREADING
+
 #include "coap_log.h"
 #include "msg_cache.h"
+#include "stats.h"
 
 VISIBILITY_SOURCE_BEGIN
 
-struct avs_coap_ctx {
-    avs_coap_tx_params_t tx_params;
-    coap_msg_cache_t *msg_cache;
+#ifdef WITH_AVS_COMPAT_THREADING
+#define WITH_THREAD_SAFE_CTX
+#endif
+
 #ifdef WITH_AVS_COAP_NET_STATS
+/**
+ * Cached result of packet_overhead(). Querying MTUs may involve several
+ * getsockopt() calls, so it is only recalculated if the socket changes state,
+ * a different socket is used, or the value gets older than
+ * PACKET_OVERHEAD_CACHE_LIFETIME.
+ */
+typedef struct {
+    /* socket the value was computed for; NULL if nothing is cached */
+    const avs_net_abstract_socket_t *socket;
+    avs_net_socket_state_t socket_state;
+    avs_time_monotonic_t valid_until;
+    size_t overhead;
+} packet_overhead_cache_t;
+
+static const avs_time_duration_t PACKET_OVERHEAD_CACHE_LIFETIME = { 5, 0 };
+
+/**
+ * Network traffic counters. Thread-safe contexts keep one of these per shard,
+ * each guarded by its own lock, and sum them on read, so that threads sending
+ * or receiving at the same time rarely contend. Each socket is assigned to
+ * a single shard, so that the per-socket state below stays meaningful.
+ */
+typedef struct {
+#ifdef WITH_THREAD_SAFE_CTX
+    // NULL in contexts that are not thread-safe
+    avs_mutex_t *mutex;
+#endif // WITH_THREAD_SAFE_CTX
     uint64_t rx_bytes;
     uint64_t tx_bytes;
     uint64_t num_incoming_retransmissions;
     uint64_t num_outgoing_retransmissions;
+    // identity of the last request sent through a socket of this shard
     avs_coap_msg_identity_t last_request_identity;
-#endif
+    packet_overhead_cache_t packet_overhead;
+} net_stats_shard_t;
+#endif // WITH_AVS_COAP_NET_STATS
+
+struct avs_coap_ctx {
+    avs_coap_tx_params_t tx_params;
+    coap_msg_cache_t *msg_cache;
+    coap_stats_t *stats;
+    // if set, the message cache, statistics and net_stats are split into
+    // num_shards independently locked shards
+    bool thread_safe;
+    size_t num_shards;
+#ifdef WITH_AVS_COAP_NET_STATS
+    // array of num_shards elements
+    net_stats_shard_t *net_stats;
+#endif // WITH_AVS_COAP_NET_STATS
 };
 
 static const avs_coap_tx_params_t DEFAULT_TX_PARAMS = {
@@ -51,16 +102,91 @@ static const avs_coap_tx_params_t DEFAULT_TX_PARAMS = {
 };
 
 int avs_coap_ctx_create(avs_coap_ctx_t **ctx, size_t msg_cache_size) {
+    const avs_coap_ctx_config_t config = {
+        .msg_cache_size = msg_cache_size,
+        .msg_cache_engine = AVS_COAP_MSG_CACHE_ENGINE_FIFO
+    };
+    return avs_coap_ctx_create_with_config(ctx, &config);
+}
+
+static coap_msg_cache_t *create_msg_cache(avs_coap_ctx_t *ctx,
+                                          const avs_coap_ctx_config_t *config) {
+    if (ctx->thread_safe) {
+        return _avs_coap_msg_cache_create_sharded(config->msg_cache_size,
+                                                  config->msg_cache_engine,
+                                                  ctx->num_shards);
+    }
+    return _avs_coap_msg_cache_create_with_engine(config->msg_cache_size,
+                                                  config->msg_cache_engine);
+}
+
+#ifdef WITH_AVS_COAP_NET_STATS
+static int create_net_stats(avs_coap_ctx_t *ctx) {
+    ctx->net_stats = (net_stats_shard_t *)
+            avs_calloc(ctx->num_shards, sizeof(*ctx->net_stats));
+    if (!ctx->net_stats) {
+        return -1;
+    }
+#ifdef WITH_THREAD_SAFE_CTX
+    for (size_t i = 0; ctx->thread_safe && i < ctx->num_shards; ++i) {
+        if (avs_mutex_create(&ctx->net_stats[i].mutex)) {
+            return -1;
+        }
+    }
+#endif // WITH_THREAD_SAFE_CTX
+    return 0;
+}
+
+static void release_net_stats(avs_coap_ctx_t *ctx) {
+    if (!ctx->net_stats) {
+        return;
+    }
+#ifdef WITH_THREAD_SAFE_CTX
+    for (size_t i = 0; i < ctx->num_shards; ++i) {
+        avs_mutex_cleanup(&ctx->net_stats[i].mutex);
+    }
+#endif // WITH_THREAD_SAFE_CTX
+    avs_free(ctx->net_stats);
+    ctx->net_stats = NULL;
+}
+#else // WITH_AVS_COAP_NET_STATS
+#define create_net_stats(...) 0
+#define release_net_stats(...) ((void) 0)
+#endif // WITH_AVS_COAP_NET_STATS
+
+int avs_coap_ctx_create_with_config(avs_coap_ctx_t **ctx,
+                                    const avs_coap_ctx_config_t *config) {
+#ifndef WITH_THREAD_SAFE_CTX
+    if (config->thread_safe) {
+        LOG(ERROR, "thread-safe contexts require threading support");
+        return -1;
+    }
+#endif // WITH_THREAD_SAFE_CTX
+
     *ctx = (avs_coap_ctx_t *) avs_calloc(1, sizeof(avs_coap_ctx_t));
     if (!*ctx) {
         return -1;
     }
 
-    if (msg_cache_size > 0) {
-        (*ctx)->msg_cache = _avs_coap_msg_cache_create(msg_cache_size);
+    (*ctx)->thread_safe = config->thread_safe;
+    (*ctx)->num_shards = 1;
+    if (config->thread_safe) {
+        (*ctx)->num_shards = config->msg_cache_shards
+                                     ? config->msg_cache_shards
+                                     : AVS_COAP_CTX_DEFAULT_MSG_CACHE_SHARDS;
+    }
+
+    if (create_net_stats(*ctx)) {
+        LOG(ERROR, "could not create context counters");
+        avs_coap_ctx_cleanup(ctx);
+        return -1;
+    }
+
+    if (config->msg_cache_size > 0) {
+        (*ctx)->msg_cache = create_msg_cache(*ctx, config);
         if (!(*ctx)->msg_cache) {
             LOG(ERROR, "could not create message cache");
-            avs_free(*ctx);
+            avs_coap_ctx_cleanup(ctx);
             return -1;
         }
     }
@@ -69,9 +195,64 @@ int avs_coap_ctx_create(avs_coap_ctx_t **ctx, size_t msg_cache_size) {
     return 0;
 }
 
+#ifdef WITH_AVS_COAP_NET_STATS
+static inline int net_stats_lock(net_stats_shard_t *shard) {
+#ifdef WITH_THREAD_SAFE_CTX
+    if (shard->mutex && avs_mutex_lock(shard->mutex)) {
+        LOG(ERROR, "could not lock context counters");
+        return -1;
+    }
+#else // WITH_THREAD_SAFE_CTX
+    (void) shard;
+#endif // WITH_THREAD_SAFE_CTX
+    return 0;
+}
+
+static inline void net_stats_unlock(net_stats_shard_t *shard) {
+#ifdef WITH_THREAD_SAFE_CTX
+    if (shard->mutex) {
+        avs_mutex_unlock(shard->mutex);
+    }
+#else // WITH_THREAD_SAFE_CTX
+    (void) shard;
+#endif // WITH_THREAD_SAFE_CTX
+}
+
+/**
+ * Locks the net_stats shard of @p ctx that @p socket is assigned to and
+ * returns it, or returns NULL if locking failed. Threads of a thread-safe
+ * context usually have sockets of their own, so they rarely contend.
+ */
+static net_stats_shard_t *
+net_stats_acquire(avs_coap_ctx_t *ctx,
+                  const avs_net_abstract_socket_t *socket) {
+    net_stats_shard_t *shard =
+            &ctx->net_stats[(size_t) ((uintptr_t) socket >> 4)
+                            % ctx->num_shards];
+    return net_stats_lock(shard) ? NULL : shard;
+}
+
+/**
+ * @return Sum of the counter at @p counter_offset within
+ *         @ref net_stats_shard_t over all shards of @p ctx .
+ */
+static uint64_t read_counter(avs_coap_ctx_t *ctx, size_t counter_offset) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < ctx->num_shards; ++i) {
+        net_stats_shard_t *shard = &ctx->net_stats[i];
+        if (!net_stats_lock(shard)) {
+            value += *(const uint64_t *) ((const char *) shard
+                                          + counter_offset);
+            net_stats_unlock(shard);
+        }
+    }
+    return value;
+}
+#endif // WITH_AVS_COAP_NET_STATS
+
 uint64_t avs_coap_ctx_get_rx_bytes(avs_coap_ctx_t *ctx) {
 #ifdef WITH_AVS_COAP_NET_STATS
-    return ctx->rx_bytes;
+    return read_counter(ctx, offsetof(net_stats_shard_t, rx_bytes));
 #else
     (void) ctx;
     return 0;
@@ -80,7 +261,7 @@ uint64_t avs_coap_ctx_get_rx_bytes(avs_coap_ctx_t *ctx) {
 
 uint64_t avs_coap_ctx_get_tx_bytes(avs_coap_ctx_t *ctx) {
 #ifdef WITH_AVS_COAP_NET_STATS
-    return ctx->tx_bytes;
+    return read_counter(ctx, offsetof(net_stats_shard_t, tx_bytes));
 #else
     (void) ctx;
     return 0;
@@ -90,7 +271,7 @@ uint64_t avs_coap_ctx_get_tx_bytes(avs_coap_ctx_t *ctx) {
 uint64_t
 avs_coap_ctx_get_num_incoming_retransmissions(avs_coap_ctx_t *ctx) {
 #ifdef WITH_AVS_COAP_NET_STATS
-    return ctx->num_incoming_retransmissions;
+    return read_counter(ctx, offsetof(net_stats_shard_t, num_incoming_retransmissions));
 #else
     (void) ctx;
     return 0;
@@ -100,43 +281,141 @@ avs_coap_ctx_get_num_incoming_retransmissions(avs_coap_ctx_t *ctx) {
 uint64_t
 avs_coap_ctx_get_num_outgoing_retransmissions(avs_coap_ctx_t *ctx) {
 #ifdef WITH_AVS_COAP_NET_STATS
-    return ctx->num_outgoing_retransmissions;
+    return read_counter(ctx, offsetof(net_stats_shard_t, num_outgoing_retransmissions));
 #else
     (void) ctx;
     return 0;
 #endif // WITH_AVS_COAP_NET_STATS
 }
 
+int avs_coap_ctx_enable_stats(avs_coap_ctx_t *ctx, size_t max_endpoints) {
+    const avs_coap_stats_config_t config = {
+        .max_endpoints = max_endpoints
+    };
+    return avs_coap_ctx_enable_stats_with_config(ctx, &config);
+}
+
+int avs_coap_ctx_enable_stats_with_config(
+        avs_coap_ctx_t *ctx, const avs_coap_stats_config_t *config) {
+#ifdef WITH_AVS_COAP_STATS
+    const size_t max_pending_requests =
+            config->max_pending_requests
+                    ? config->max_pending_requests
+                    : AVS_COAP_STATS_DEFAULT_MAX_PENDING_REQUESTS;
+    coap_stats_t *stats =
+            ctx->thread_safe
+                    ? _avs_coap_stats_create_sharded(config->max_endpoints,
+                                                     max_pending_requests,
+                                                     ctx->num_shards)
+                    : _avs_coap_stats_create(config->max_endpoints,
+                                             max_pending_requests);
+    if (!stats) {
+        return -1;
+    }
+    _avs_coap_stats_release(&ctx->stats);
+    ctx->stats = stats;
+    return 0;
+#else
+    (void) ctx;
+    (void) config;
+    LOG(ERROR, "statistics support disabled");
+    return -1;
+#endif // WITH_AVS_COAP_STATS
+}
+
+int avs_coap_ctx_get_stats(avs_coap_ctx_t *ctx, avs_coap_stats_t *out_stats) {
+    if (!ctx->stats) {
+        LOG(ERROR, "statistics not enabled");
+        return -1;
+    }
+    if (_avs_coap_stats_snapshot(ctx->stats, out_stats)) {
+        return -1;
+    }
+    _avs_coap_msg_cache_get_stats(ctx->msg_cache, &out_stats->cache);
+    return 0;
+}
+
+void avs_coap_stats_cleanup(avs_coap_stats_t *stats) {
+    AVS_LIST_CLEAR(&stats->endpoints);
+}
+
 void avs_coap_ctx_cleanup(avs_coap_ctx_t **ctx) {
     if (!ctx || !*ctx) {
         return;
     }
 
     _avs_coap_msg_cache_release(&(*ctx)->msg_cache);
+    _avs_coap_stats_release(&(*ctx)->stats);
+    release_net_stats(*ctx);
     avs_free(*ctx);
     *ctx = NULL;
 }
 
+static int map_io_errno(int error, const char *operation) {
+    LOG(ERROR, "%s failed: errno = %d", operation, error);
+
+    if (error == ETIMEDOUT) {
+        return AVS_COAP_CTX_ERR_TIMEOUT;
+    } else if (error == EMSGSIZE) {
+        return AVS_COAP_CTX_ERR_MSG_TOO_LONG;
+    } else {
+        return AVS_COAP_CTX_ERR_NETWORK;
+    }
+}
+
 static int map_io_error(avs_net_abstract_socket_t *socket,
                         int result,
                         const char *operation) {
     if (result) {
-        int error = avs_net_socket_errno(socket);
-        LOG(ERROR, "%s failed: errno = %d", operation, error);
-
-        if (error == ETIMEDOUT) {
-            result = AVS_COAP_CTX_ERR_TIMEOUT;
-        } else if (error == EMSGSIZE) {
-            result = AVS_COAP_CTX_ERR_MSG_TOO_LONG;
-        } else {
-            result = AVS_COAP_CTX_ERR_NETWORK;
-        }
+        result = map_io_errno(avs_net_socket_errno(socket), operation);
     }
     return result;
 }
 
+#if defined(WITH_AVS_COAP_MESSAGE_CACHE) || defined(WITH_AVS_COAP_STATS)
+/**
+ * Packs the textual @p host and @p port, separated with a nullbyte, into
+ * @p out_ep, so that it can be used as a message cache key for sockets that
+ * cannot report their raw remote address.
+ */
+static int endpoint_from_host_port(avs_net_resolved_endpoint_t *out_ep,
+                                   const char *host,
+                                   const char *port) {
+    size_t host_size = strlen(host) + 1;
+    size_t port_size = strlen(port);
+    if (host_size + port_size > sizeof(out_ep->data.buf)) {
+        return -1;
+    }
+    memcpy(out_ep->data.buf, host, host_size);
+    memcpy(out_ep->data.buf + host_size, port, port_size);
+    out_ep->size = (uint8_t) (host_size + port_size);
+    return 0;
+}
+
+/**
+ * Retrieves a binary key identifying the remote peer of @p socket. Uses the
+ * raw socket address if the socket supports it, otherwise falls back to
+ * @ref endpoint_from_host_port.
+ */
+static int get_remote_endpoint(avs_net_abstract_socket_t *socket,
+                               avs_net_resolved_endpoint_t *out_ep) {
+    if (!avs_net_socket_get_remote_endpoint(socket, out_ep)) {
+        return 0;
+    }
+
+    char host[AVS_ADDRSTRLEN];
+    char port[sizeof("65535")];
+    if (avs_net_socket_get_remote_host(socket, host, sizeof(host))
+            || avs_net_socket_get_remote_port(socket, port, sizeof(port))) {
+        return -1;
+    }
+    return endpoint_from_host_port(out_ep, host, port);
+}
+#endif // WITH_AVS_COAP_MESSAGE_CACHE || WITH_AVS_COAP_STATS
+
 #ifndef WITH_AVS_COAP_MESSAGE_CACHE
 #define try_cache_response(...) 0
+#define try_cache_response_to(...) 0
 #else // WITH_AVS_COAP_MESSAGE_CACHE
 
 static int try_cache_response(avs_coap_ctx_t *ctx,
@@ -146,22 +425,38 @@ static int try_cache_response(avs_coap_ctx_t *ctx,
         return 0;
     }
 
-    char addr[AVS_ADDRSTRLEN];
-    char port[sizeof("65535")];
-    if (avs_net_socket_get_remote_host(socket, addr, sizeof(addr))
-            || avs_net_socket_get_remote_port(socket, port, sizeof(port))) {
-        LOG(DEBUG, "could not get remote host/port");
+    avs_net_resolved_endpoint_t remote_ep;
+    if (get_remote_endpoint(socket, &remote_ep)) {
+        LOG(DEBUG, "could not get remote endpoint");
         return -1;
     }
 
-    return _avs_coap_msg_cache_add(ctx->msg_cache, addr, port, res,
+    return _avs_coap_msg_cache_add(ctx->msg_cache, &remote_ep, res,
+                                   &ctx->tx_params);
+}
+
+/**
+ * Caches a response sent with avs_net_socket_send_to_batch(). @p remote_ep is
+ * the address reported by the socket for that datagram, i.e. the same key
+ * that @ref get_remote_endpoint yields for a retransmitted request. Sockets
+ * that cannot report it leave it empty, in which case nothing is cached.
+ */
+static int try_cache_response_to(avs_coap_ctx_t *ctx,
+                                 const avs_net_resolved_endpoint_t *remote_ep,
+                                 const avs_coap_msg_t *res) {
+    if (!avs_coap_msg_is_response(res) || !ctx->msg_cache
+            || !remote_ep->size) {
+        return 0;
+    }
+
+    return _avs_coap_msg_cache_add(ctx->msg_cache, remote_ep, res,
                                    &ctx->tx_params);
 }
 
 #endif // WITH_AVS_COAP_MESSAGE_CACHE
 
 #ifdef WITH_AVS_COAP_NET_STATS
-static size_t packet_overhead(avs_net_abstract_socket_t *socket) {
+static size_t calculate_packet_overhead(avs_net_abstract_socket_t *socket) {
     avs_net_socket_opt_value_t mtu;
     avs_net_socket_opt_value_t mtu_inner;
     if (avs_net_socket_get_opt(socket, AVS_NET_SOCKET_OPT_MTU, &mtu)
@@ -177,8 +472,122 @@ static size_t packet_overhead(avs_net_abstract_socket_t *socket) {
 error:
     return 0;
 }
+
+static size_t packet_overhead(net_stats_shard_t *shard,
+                              avs_net_abstract_socket_t *socket) {
+    packet_overhead_cache_t *cache = &shard->packet_overhead;
+    avs_net_socket_opt_value_t state;
+    if (avs_net_socket_get_opt(socket, AVS_NET_SOCKET_OPT_STATE, &state)) {
+        // cannot tell whether the cached value is still valid
+        return calculate_packet_overhead(socket);
+    }
+
+    const avs_time_monotonic_t now = avs_time_monotonic_now();
+    if (cache->socket != socket
+            || cache->socket_state != state.state
+            || !avs_time_monotonic_before(now, cache->valid_until)) {
+        cache->socket = socket;
+        cache->socket_state = state.state;
+        cache->valid_until =
+                avs_time_monotonic_add(now, PACKET_OVERHEAD_CACHE_LIFETIME);
+        cache->overhead = calculate_packet_overhead(socket);
+    }
+    return cache->overhead;
+}
+
+static void update_tx_stats(avs_coap_ctx_t *ctx,
+                            avs_net_abstract_socket_t *socket,
+                            const avs_coap_msg_t *msg,
+                            int cache_result) {
+    net_stats_shard_t *shard = net_stats_acquire(ctx, socket);
+    if (!shard) {
+        return;
+    }
+    bool request_retransmission = false;
+    if (avs_coap_msg_is_request(msg)) {
+        const avs_coap_msg_identity_t msg_identity =
+                avs_coap_msg_get_identity(msg);
+
+        request_retransmission =
+                avs_coap_identity_equal(&msg_identity,
+                                        &shard->last_request_identity);
+        shard->last_request_identity = msg_identity;
+    }
+    if (cache_result == AVS_COAP_MSG_CACHE_DUPLICATE
+            || request_retransmission) {
+        ++shard->num_outgoing_retransmissions;
+    }
+    shard->tx_bytes += msg->length + packet_overhead(shard, socket);
+    net_stats_unlock(shard);
+}
+
+static void update_rx_stats(avs_coap_ctx_t *ctx,
+                            avs_net_abstract_socket_t *socket,
+                            const avs_coap_msg_t *msg,
+                            bool cache_hit) {
+    net_stats_shard_t *shard = net_stats_acquire(ctx, socket);
+    if (!shard) {
+        return;
+    }
+    if (cache_hit) {
+        ++shard->num_incoming_retransmissions;
+    }
+    shard->rx_bytes += msg->length + packet_overhead(shard, socket);
+    net_stats_unlock(shard);
+}
+#else // WITH_AVS_COAP_NET_STATS
+#define update_tx_stats(...) ((void) 0)
+#define update_rx_stats(...) ((void) 0)
 #endif // WITH_AVS_COAP_NET_STATS
 
+#ifdef WITH_AVS_COAP_STATS
+static void update_stats_on_recv(avs_coap_ctx_t *ctx,
+                                 avs_net_abstract_socket_t *socket,
+                                 const avs_coap_msg_t *msg,
+                                 bool duplicate) {
+    if (!ctx->stats) {
+        return;
+    }
+    avs_net_resolved_endpoint_t remote_ep;
+    bool has_ep = !get_remote_endpoint(socket, &remote_ep);
+    _avs_coap_stats_on_recv(ctx->stats, has_ep ? &remote_ep : NULL, msg,
+                            duplicate);
+}
+
+static void update_stats_on_send(avs_coap_ctx_t *ctx,
+                                 avs_net_abstract_socket_t *socket,
+                                 const avs_coap_msg_t *msg,
+                                 int cache_result) {
+    if (!ctx->stats) {
+        return;
+    }
+    avs_net_resolved_endpoint_t remote_ep;
+    bool has_ep = !get_remote_endpoint(socket, &remote_ep);
+    _avs_coap_stats_on_send(ctx->stats, has_ep ? &remote_ep : NULL, msg,
+                            cache_result == AVS_COAP_MSG_CACHE_DUPLICATE);
+}
+
+/**
+ * Like @ref update_stats_on_send, but keys the endpoint by the address
+ * reported by avs_net_socket_send_to_batch(), the same way as
+ * @ref try_cache_response_to does.
+ */
+static void update_stats_on_send_to(avs_coap_ctx_t *ctx,
+                                    const avs_net_resolved_endpoint_t *remote_ep,
+                                    const avs_coap_msg_t *msg,
+                                    int cache_result) {
+    if (!ctx->stats) {
+        return;
+    }
+    _avs_coap_stats_on_send(ctx->stats, remote_ep->size ? remote_ep : NULL,
+                            msg, cache_result == AVS_COAP_MSG_CACHE_DUPLICATE);
+}
+#else // WITH_AVS_COAP_STATS
+#define update_stats_on_recv(...) ((void) 0)
+#define update_stats_on_send(...) ((void) 0)
+#define update_stats_on_send_to(...) ((void) 0)
+#endif // WITH_AVS_COAP_STATS
+
 int avs_coap_ctx_send(avs_coap_ctx_t *ctx,
                       avs_net_abstract_socket_t *socket,
                       const avs_coap_msg_t *msg) {
@@ -192,59 +601,121 @@ int avs_coap_ctx_send(avs_coap_ctx_t *ctx,
     int result = avs_net_socket_send(socket, msg->content, msg->length);
     if (!result) {
         int cache_result = try_cache_response(ctx, socket, msg);
-#ifdef WITH_AVS_COAP_NET_STATS
-        bool request_retransmission = false;
-        if (avs_coap_msg_is_request(msg)) {
-            const avs_coap_msg_identity_t msg_identity =
-                    avs_coap_msg_get_identity(msg);
-
-            request_retransmission =
-                    avs_coap_identity_equal(&msg_identity,
-                                            &ctx->last_request_identity);
-            ctx->last_request_identity = msg_identity;
+        update_tx_stats(ctx, socket, msg, cache_result);
+        update_stats_on_send(ctx, socket, msg, cache_result);
+        (void) cache_result;
+    }
+    return map_io_error(socket, result, "send");
+}
+
+/* Upper bound on the number of messages passed to a single
+ * avs_net_socket_send_to_batch() call, to keep the socket-level entries on
+ * stack. */
+#define SEND_BATCH_MAX 16
+
+int avs_coap_ctx_send_batch(avs_coap_ctx_t *ctx,
+                            avs_net_abstract_socket_t *socket,
+                            avs_coap_ctx_send_slot_t *slots,
+                            size_t count) {
+    assert(ctx && socket);
+    int result = 0;
+
+    for (size_t start = 0; start < count; start += SEND_BATCH_MAX) {
+        avs_net_socket_send_to_msg_t batch[SEND_BATCH_MAX];
+        avs_coap_ctx_send_slot_t *batch_slots[SEND_BATCH_MAX];
+        size_t batch_size = 0;
+
+        const size_t end = AVS_MIN(count, start + SEND_BATCH_MAX);
+        for (size_t i = start; i < end; ++i) {
+            if (!avs_coap_msg_is_valid(slots[i].msg)) {
+                LOG(ERROR, "cannot send an invalid CoAP message");
+                slots[i].result = -1;
+                result = -1;
+                continue;
+            }
+            LOG(TRACE, "send to [%s]:%s: %s", slots[i].host, slots[i].port,
+                AVS_COAP_MSG_SUMMARY(slots[i].msg));
+            batch[batch_size].buffer = slots[i].msg->content;
+            batch[batch_size].buffer_length = slots[i].msg->length;
+            batch[batch_size].host = slots[i].host;
+            batch[batch_size].port = slots[i].port;
+            batch_slots[batch_size++] = &slots[i];
+        }
+        if (!batch_size) {
+            continue;
         }
 
-        if (cache_result == AVS_COAP_MSG_CACHE_DUPLICATE
-                || request_retransmission) {
-            ++ctx->num_outgoing_retransmissions;
+        // per-message errors are reported through error_code fields
+        (void) avs_net_socket_send_to_batch(socket, batch, batch_size);
+
+        for (size_t i = 0; i < batch_size; ++i) {
+            avs_coap_ctx_send_slot_t *slot = batch_slots[i];
+            if (batch[i].error_code) {
+                slot->result = map_io_errno(batch[i].error_code, "send_to");
+                result = -1;
+            } else {
+                int cache_result =
+                        try_cache_response_to(ctx, &batch[i].resolved_endpoint,
+                                              slot->msg);
+                update_tx_stats(ctx, socket, slot->msg, cache_result);
+                update_stats_on_send_to(ctx, &batch[i].resolved_endpoint,
+                                        slot->msg, cache_result);
+                (void) cache_result;
+                slot->result = 0;
+            }
         }
-        ctx->tx_bytes += msg->length + packet_overhead(socket);
-#endif // WITH_AVS_COAP_NET_STATS
-        (void) cache_result;
     }
-    return map_io_error(socket, result, "send");
+    return result;
 }
 
 #ifndef WITH_AVS_COAP_MESSAGE_CACHE
 #define try_send_cached_response(...) (-1)
 #else // WITH_AVS_COAP_MESSAGE_CACHE
 
+/**
+ * Sends the cached response to @p req , if there is one. @p out_cache_hit is
+ * set if the response has been found, even if sending it failed.
+ */
 static int try_send_cached_response(avs_coap_ctx_t *ctx,
                                     avs_net_abstract_socket_t *socket,
-                                    const avs_coap_msg_t *req) {
+                                    const avs_coap_msg_t *req,
+                                    bool *out_cache_hit) {
     if (!avs_coap_msg_is_request(req) || !ctx->msg_cache) {
         return -1;
     }
 
-    char addr[AVS_ADDRSTRLEN];
-    char port[sizeof("65535")];
-    if (avs_net_socket_get_remote_host(socket, addr, sizeof(addr))
-            || avs_net_socket_get_remote_port(socket, port, sizeof(port))) {
-        LOG(DEBUG, "could not get remote remote host/port");
+    avs_net_resolved_endpoint_t remote_ep;
+    if (get_remote_endpoint(socket, &remote_ep)) {
+        LOG(DEBUG, "could not get remote endpoint");
         return -1;
     }
 
+    // most requests are not retransmissions; reject them without a full
+    // lookup, which would also need to lock and possibly copy the cached
+    // response
     uint16_t msg_id = avs_coap_msg_get_id(req);
-    const avs_coap_msg_t *res =
-            _avs_coap_msg_cache_get(ctx->msg_cache, addr, port, msg_id);
-    if (res) {
-#ifdef WITH_AVS_COAP_NET_STATS
-        ++ctx->num_incoming_retransmissions;
-#endif // WITH_AVS_COAP_NET_STATS
-        return avs_coap_ctx_send(ctx, socket, res);
+    if (!_avs_coap_msg_cache_may_contain(ctx->msg_cache, &remote_ep,
+                                         msg_id)) {
+        return -1;
+    }
+
+    // a sharded cache is shared with other threads, so the response needs
+    // to be copied before its shard is unlocked
+    avs_coap_msg_t *res_copy = NULL;
+    const avs_coap_msg_t *res;
+    if (ctx->thread_safe) {
+        res = res_copy = _avs_coap_msg_cache_get_copy(ctx->msg_cache,
+                                                      &remote_ep, msg_id);
     } else {
+        res = _avs_coap_msg_cache_get(ctx->msg_cache, &remote_ep, msg_id);
+    }
+    if (!res) {
         return -1;
     }
+    *out_cache_hit = true;
+    int result = avs_coap_ctx_send(ctx, socket, res);
+    avs_free(res_copy);
+    return result;
 }
 
 #endif // WITH_AVS_COAP_MESSAGE_CACHE
@@ -254,6 +725,38 @@ static inline bool is_coap_ping(const avs_coap_msg_t *msg) {
            && avs_coap_msg_get_code(msg) == AVS_COAP_CODE_EMPTY;
 }
 
+/**
+ * Performs all post-receive processing of a single datagram: validation,
+ * automatic responses to pings and duplicates.
+ */
+static int handle_received_msg(avs_coap_ctx_t *ctx,
+                               avs_net_abstract_socket_t *socket,
+                               avs_coap_msg_t *msg) {
+    if (!avs_coap_msg_is_valid(msg)) {
+        LOG(DEBUG, "recv: malformed message");
+        update_rx_stats(ctx, socket, msg, false);
+        return AVS_COAP_CTX_ERR_MSG_MALFORMED;
+    }
+
+    LOG(TRACE, "recv: %s", AVS_COAP_MSG_SUMMARY(msg));
+
+    if (is_coap_ping(msg)) {
+        update_rx_stats(ctx, socket, msg, false);
+        update_stats_on_recv(ctx, socket, msg, false);
+        avs_coap_ctx_send_empty(ctx, socket, AVS_COAP_MSG_RESET,
+                                avs_coap_msg_get_id(msg));
+        return AVS_COAP_CTX_ERR_MSG_WAS_PING;
+    }
+
+    bool cache_hit = false;
+    const bool duplicate =
+            !try_send_cached_response(ctx, socket, msg, &cache_hit);
+    update_rx_stats(ctx, socket, msg, cache_hit);
+    update_stats_on_recv(ctx, socket, msg, duplicate);
+    (void) cache_hit;
+    return duplicate ? AVS_COAP_CTX_ERR_DUPLICATE : 0;
+}
+
 int avs_coap_ctx_recv(avs_coap_ctx_t *ctx,
                       avs_net_abstract_socket_t *socket,
                       avs_coap_msg_t *out_msg,
@@ -269,27 +772,46 @@ int avs_coap_ctx_recv(avs_coap_ctx_t *ctx,
     if (result) {
         return map_io_error(socket, result, "receive");
     }
-#ifdef WITH_AVS_COAP_NET_STATS
-    ctx->rx_bytes += msg_length + packet_overhead(socket);
-#endif // WITH_AVS_COAP_NET_STATS
-
-    if (!avs_coap_msg_is_valid(out_msg)) {
-        LOG(DEBUG, "recv: malformed message");
-        return AVS_COAP_CTX_ERR_MSG_MALFORMED;
-    }
+    return handle_received_msg(ctx, socket, out_msg);
+}
 
-    LOG(TRACE, "recv: %s", AVS_COAP_MSG_SUMMARY(out_msg));
+/* Upper bound on the number of messages received in a single call to
+ * avs_coap_ctx_recv_batch(), to keep the socket-level slots on stack. */
+#define RECV_BATCH_MAX 16
 
-    if (is_coap_ping(out_msg)) {
-        avs_coap_ctx_send_empty(ctx, socket, AVS_COAP_MSG_RESET,
-                                avs_coap_msg_get_id(out_msg));
-        return AVS_COAP_CTX_ERR_MSG_WAS_PING;
+int avs_coap_ctx_recv_batch(avs_coap_ctx_t *ctx,
+                            avs_net_abstract_socket_t *socket,
+                            avs_coap_ctx_recv_slot_t *slots,
+                            size_t count,
+                            size_t *out_received) {
+    assert(ctx && socket);
+    assert(count > 0);
+
+    avs_net_socket_batch_msg_t batch[RECV_BATCH_MAX];
+    count = AVS_MIN(count, (size_t) RECV_BATCH_MAX);
+    for (size_t i = 0; i < count; ++i) {
+        assert(slots[i].capacity < UINT32_MAX);
+        batch[i].buffer = slots[i].msg->content;
+        batch[i].buffer_length =
+                slots[i].capacity - sizeof(slots[i].msg->length);
     }
 
-    if (!try_send_cached_response(ctx, socket, out_msg)) {
-        return AVS_COAP_CTX_ERR_DUPLICATE;
+    *out_received = 0;
+    int result = avs_net_socket_receive_batch(socket, out_received,
+                                              batch, count);
+    if (result) {
+        return map_io_error(socket, result, "receive");
     }
 
+    for (size_t i = 0; i < *out_received; ++i) {
+        slots[i].msg->length = (uint32_t) batch[i].bytes_received;
+        if (batch[i].error_code == EMSGSIZE) {
+            LOG(ERROR, "receive failed: message too long");
+            slots[i].result = AVS_COAP_CTX_ERR_MSG_TOO_LONG;
+        } else {
+            slots[i].result = handle_received_msg(ctx, socket, slots[i].msg);
+        }
+    }
     return 0;
 }
 
@@ -330,7 +852,10 @@ static void send_response(avs_coap_ctx_t *ctx,
                           const avs_coap_msg_t *request,
                           uint8_t code,
                           const uint32_t *max_age) {
-    avs_coap_msg_info_t info = avs_coap_msg_info_init();
+    uint16_t opt_arena[AVS_COAP_MSG_INFO_ARENA_OPT_SIZE(sizeof(*max_age))
+                       / sizeof(uint16_t)];
+    avs_coap_msg_info_t info =
+            avs_coap_msg_info_init_with_arena(opt_arena, sizeof(opt_arena));
 
     info.type = AVS_COAP_MSG_ACKNOWLEDGEMENT;
     info.code = code;
@@ -190,51 +190,118 @@ static bool is_header_valid(const avs_coap_msg_t *msg) {
     return true;
 }
 
-static bool are_options_valid(const avs_coap_msg_t *msg) {
-    size_t length_so_far = _avs_coap_header_size(msg)
-                           + _avs_coap_header_get_token_length(msg);
-
-    if (length_so_far == msg->length) {
-        return true;
+/**
+ * Decodes a delta or length field of an option, including its extended
+ * bytes, if any.
+ *
+ * @returns Pointer to the first byte after the extended field, or NULL if the
+ *          field is reserved, truncated or its value does not fit in 16 bits.
+ */
+static inline const uint8_t *decode_opt_field(uint8_t short_value,
+                                              const uint8_t *ptr,
+                                              const uint8_t *end,
+                                              uint32_t *out_value) {
+    if (short_value < AVS_COAP_EXT_U8) {
+        *out_value = short_value;
+        return ptr;
+    } else if (short_value == AVS_COAP_EXT_U8) {
+        if (ptr >= end) {
+            return NULL;
+        }
+        *out_value = *ptr + AVS_COAP_EXT_U8_BASE;
+        return ptr + 1;
+    } else if (short_value == AVS_COAP_EXT_U16) {
+        if (end - ptr < 2) {
+            return NULL;
+        }
+        uint32_t value = extract_u16(ptr);
+        if (value > UINT16_MAX - AVS_COAP_EXT_U16_BASE) {
+            return NULL;
+        }
+        *out_value = value + AVS_COAP_EXT_U16_BASE;
+        return ptr + 2;
     }
+    return NULL;
+}
 
-    avs_coap_opt_iterator_t optit = avs_coap_opt_begin(msg);
-    for (; length_so_far != msg->length && !avs_coap_opt_end(&optit);
-            avs_coap_opt_next(&optit)) {
-        if (!avs_coap_opt_is_valid(optit.curr_opt,
-                                      msg->length - length_so_far)) {
+/**
+ * Validates all options in a single pass over the message bytes, filling
+ * @p out_index (if not NULL) on the way. Equivalent to validating each option
+ * with @ref avs_coap_opt_is_valid while iterating over them.
+ */
+static bool are_options_valid(const avs_coap_msg_t *msg,
+                              avs_coap_msg_index_t *out_index) {
+    const uint8_t *const end = msg->content + msg->length;
+    const uint8_t *ptr = _avs_coap_header_end_const(msg)
+                         + _avs_coap_header_get_token_length(msg);
+    uint32_t opt_number = 0;
+
+    while (ptr < end && *ptr != AVS_COAP_PAYLOAD_MARKER) {
+        const uint8_t *const opt = ptr;
+        uint32_t delta;
+        uint32_t length;
+        ptr = decode_opt_field(_avs_coap_opt_get_short_delta(
+                                       (const avs_coap_opt_t *) opt),
+                               ptr + 1, end, &delta);
+        if (ptr) {
+            ptr = decode_opt_field(_avs_coap_opt_get_short_length(
+                                           (const avs_coap_opt_t *) opt),
+                                   ptr, end, &length);
+        }
+        if (!ptr) {
             LOG(DEBUG, "option validation failed");
             return false;
         }
-
-        length_so_far += avs_coap_opt_sizeof(optit.curr_opt);
-
-        if (length_so_far > msg->length) {
+        if ((size_t) (end - ptr) < length) {
             LOG(DEBUG,
                 "invalid option length (ends %lu bytes after end of message)",
-                (unsigned long) (length_so_far - msg->length));
+                (unsigned long) (length - (size_t) (end - ptr)));
             return false;
         }
+        ptr += length;
 
-        uint32_t opt_number = avs_coap_opt_number(&optit);
+        opt_number += delta;
         if (opt_number > UINT16_MAX) {
             LOG(DEBUG, "invalid option number (%" PRIu32 ")", opt_number);
             return false;
         }
+
+        if (out_index) {
+            if (out_index->num_options < AVS_COAP_MSG_INDEX_MAX_OPTIONS) {
+                avs_coap_msg_index_entry_t *entry =
+                        &out_index->options[out_index->num_options++];
+                entry->offset = (uint32_t) (opt - msg->content);
+                entry->length = length;
+                entry->number = (uint16_t) opt_number;
+            } else {
+                out_index->truncated = true;
+            }
+        }
     }
 
-    if (length_so_far + 1 == msg->length
-            && is_payload_marker(optit.curr_opt)) {
+    if (ptr + 1 == end) {
         // RFC 7252 3.1: The presence of a Payload Marker followed by a
         // zero-length payload MUST be processed as a message format error.
         LOG(DEBUG, "validation failed: payload marker at end of message");
         return false;
     }
 
+    if (out_index) {
+        out_index->payload_offset = (uint32_t) (
+                ptr < end ? ptr + 1 - msg->content : ptr - msg->content);
+    }
     return true;
 }
 
-bool avs_coap_msg_is_valid(const avs_coap_msg_t *msg) {
+bool avs_coap_msg_validate_and_index(const avs_coap_msg_t *msg,
+                                     avs_coap_msg_index_t *out_index) {
+    if (out_index) {
+        out_index->msg = msg;
+        out_index->num_options = 0;
+        out_index->truncated = false;
+        out_index->payload_offset = 0;
+    }
+
     if (msg->length < AVS_COAP_MSG_MIN_SIZE) {
         LOG(DEBUG, "message too short (%" PRIu32 "B, expected >= %" PRIu32 ")",
             msg->length, (uint32_t)AVS_COAP_MSG_MIN_SIZE);
@@ -242,7 +309,7 @@ bool avs_coap_msg_is_valid(const avs_coap_msg_t *msg) {
     }
 
     return is_header_valid(msg)
-        && are_options_valid(msg)
+        && are_options_valid(msg, out_index)
         // [RFC 7272, 1.2]
         // Empty Message: A message with a Code of 0.00; neither a request nor
         // a response. An Empty message only contains the 4-byte header.
@@ -250,6 +317,10 @@ bool avs_coap_msg_is_valid(const avs_coap_msg_t *msg) {
                 || msg->length == _avs_coap_header_size(msg));
 }
 
+bool avs_coap_msg_is_valid(const avs_coap_msg_t *msg) {
+    return avs_coap_msg_validate_and_index(msg, NULL);
+}
+
 static const char *msg_type_string(avs_coap_msg_type_t type) {
      static const char *TYPES[] = {
          "CONFIRMABLE",
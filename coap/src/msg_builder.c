@@ -192,9 +192,11 @@ int avs_coap_msg_builder_reset(avs_coap_msg_builder_t *builder,
         return -1;
     }
 
-    avs_coap_msg_info_opt_t *opt;
     uint16_t prev_opt_num = 0;
-    AVS_LIST_FOREACH(opt, info->options_) {
+    for (const avs_coap_msg_info_opt_t *opt =
+                 _avs_coap_msg_info_opt_first(info);
+            opt;
+            opt = _avs_coap_msg_info_opt_next(info, opt)) {
         assert(prev_opt_num <= opt->number);
 
         uint16_t delta = (uint16_t)(opt->number - prev_opt_num);
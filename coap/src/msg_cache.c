@@ -23,6 +23,10 @@
 #include <avsystem/commons/time.h>
 #include <avsystem/commons/utils.h>
 
+#ifdef WITH_AVS_COMPAT_THREADING
+#include <avsystem/commons/mutex.h>
+#endif // WITH_AVS_COMPAT_THREADING
+
 #include <avsystem/commons/coap/msg.h>
 
 #include "coap_log.h"
@@ -30,22 +34,105 @@
 
 #include <assert.h>
 #include <inttypes.h>
+#include <string.h>
 
 VISIBILITY_SOURCE_BEGIN
 
 typedef struct endpoint {
     uint16_t refcount;
-    char addr[AVS_ADDRSTRLEN];
-    char port[sizeof("65535")];
+    uint32_t hash;
+    avs_net_resolved_endpoint_t addr;
 } endpoint_t;
 
+/**
+ * Slot of the (endpoint, message ID) hash index.
+ *
+ * Entries are referred to by their position in the stream of all bytes ever
+ * written into the cache buffer, i.e. the offset relative to
+ * avs_buffer_data() plus coap_msg_cache_t#consumed_bytes. Unlike raw pointers
+ * or plain offsets, positions remain valid after entries are consumed from
+ * the front of the buffer and after the buffer gets defragmented.
+ */
+typedef struct {
+    uint32_t hash; // 0 indicates an empty slot
+    size_t position;
+} index_slot_t;
+
+/**
+ * Size class of the slab storage engine: a ring of equally sized slots,
+ * holding entries in insertion (and thus expiration) order.
+ */
+typedef struct {
+    size_t slot_size;
+    size_t num_slots;
+    // offset of the first slot within coap_msg_cache_t#slab_arena
+    size_t offset;
+    // slot holding the oldest entry
+    size_t head;
+    size_t count;
+} slab_class_t;
+
+/* Lower bound on the slot size of the smallest slab class. A cache entry
+ * holding an empty message needs 32 bytes on 64-bit platforms. */
+#define SLAB_MIN_SLOT_SIZE 32
+#define SLAB_MAX_CLASSES 16
+/* Largest message the slab engine is sized for: anything larger would not
+ * fit in a single Ethernet frame. This leaves plenty of room for a block of
+ * AVS_COAP_MSG_BLOCK_MAX_SIZE bytes along with its header and options. */
+#define SLAB_MAX_MSG_SIZE 1500
+
 struct coap_msg_cache {
-    AVS_LIST(endpoint_t) endpoints; // sorted by id
+    avs_coap_msg_cache_engine_t engine;
+
+    // chained hash table of endpoints referenced by entries, indexed with
+    // endpoint_hash(); endpoint_buckets_size is either 0 or a power of two
+    AVS_LIST(endpoint_t) *endpoint_buckets;
+    size_t endpoint_buckets_size;
+    size_t num_endpoints;
 
+    // AVS_COAP_MSG_CACHE_ENGINE_FIFO:
     // priority queue of cache_entry_t, sorted by expiration_time
     avs_buffer_t *buffer;
+    // total number of bytes consumed from the front of buffer
+    size_t consumed_bytes;
+
+    // AVS_COAP_MSG_CACHE_ENGINE_SLAB:
+    // slots of all classes, in order of increasing slot size
+    char *slab_arena;
+    slab_class_t slab_classes[SLAB_MAX_CLASSES];
+    size_t num_slab_classes;
+
+    // open addressing (linear probing) index of entries stored in buffer;
+    // index_size is always either 0 or a power of two
+    index_slot_t *index;
+    size_t index_size;
+    size_t index_used;
+
+    // counting Bloom filter of (endpoint, message ID) keys of all entries in
+    // the index, used to reject most lookups without probing the index or
+    // dropping expired entries; filter_size is always a power of two
+    uint8_t *filter;
+    size_t filter_size;
+
+    avs_coap_cache_stats_t stats;
+
+    // sharded caches only: independent caches, each guarded by its own lock;
+    // none of the fields above are used in such case
+    coap_msg_cache_t **shards;
+#ifdef WITH_AVS_COMPAT_THREADING
+    avs_mutex_t **shard_locks;
+#endif // WITH_AVS_COMPAT_THREADING
+    size_t num_shards;
 };
 
+/* Number of filter counters per byte of cache capacity, as a shift; entries
+ * take no less than ~32 bytes each, which gives at least 4 counters per
+ * entry. */
+#define FILTER_BYTES_PER_COUNTER_SHIFT 3
+#define FILTER_MIN_SIZE 64
+#define FILTER_MAX_SIZE 65536
+#define FILTER_NUM_HASHES 2
+
 typedef struct cache_entry {
     endpoint_t *endpoint;
     avs_time_monotonic_t expiration_time;
@@ -60,8 +147,90 @@ AVS_STATIC_ASSERT(AVS_ALIGNOF(cache_entry_t)
 AVS_STATIC_ASSERT(offsetof(cache_entry_t, data)
                       % AVS_ALIGNOF(avs_coap_msg_t) == 0,
                   invalid_msg_alignment_in_cache_entry_t);
+AVS_STATIC_ASSERT(SLAB_MIN_SLOT_SIZE % AVS_ALIGNOF(cache_entry_t) == 0,
+                  slab_slots_not_aligned_for_cache_entry_t);
+
+static size_t slab_align(size_t size) {
+    static const size_t alignment = AVS_ALIGNOF(cache_entry_t);
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+/**
+ * Sets up slab classes for @p capacity bytes.
+ *
+ * The largest slot fits an entry holding a SLAB_MAX_MSG_SIZE message, but
+ * takes no more than half of @p capacity. Each smaller class has slots half
+ * as large as the next one, down to SLAB_MIN_SLOT_SIZE. Every class gets one
+ * slot, and the rest of @p capacity is split between them with weights
+ * growing linearly with the slot size, so that large classes hold more than
+ * a token number of entries.
+ */
+static int slab_init(coap_msg_cache_t *cache, size_t capacity) {
+    size_t max_slot_size =
+            slab_align(offsetof(cache_entry_t, data)
+                       + offsetof(avs_coap_msg_t, content) + SLAB_MAX_MSG_SIZE);
+    if (max_slot_size > capacity / 2) {
+        max_slot_size = capacity / 2 / AVS_ALIGNOF(cache_entry_t)
+                        * AVS_ALIGNOF(cache_entry_t);
+    }
+    if (max_slot_size < SLAB_MIN_SLOT_SIZE) {
+        LOG(ERROR, "msg_cache: capacity too small for slab storage");
+        return -1;
+    }
+
+    size_t slot_sizes[SLAB_MAX_CLASSES];
+    size_t num_classes = 0;
+    size_t total_slot_size = 0;
+    for (size_t size = max_slot_size;
+            size >= SLAB_MIN_SLOT_SIZE && num_classes < SLAB_MAX_CLASSES;
+            size = slab_align(size / 2)) {
+        slot_sizes[num_classes++] = size;
+        total_slot_size += size;
+    }
+    // the slots add up to less than 2 * max_slot_size <= capacity
+    assert(total_slot_size <= capacity);
+
+    const size_t spare = capacity - total_slot_size;
+    const size_t total_weight = num_classes * (num_classes + 1) / 2;
+    size_t arena_size = 0;
+    for (size_t i = 0; i < num_classes; ++i) {
+        slab_class_t *cls = &cache->slab_classes[i];
+        cls->slot_size = slot_sizes[num_classes - 1 - i];
+        cls->num_slots = 1 + spare * (i + 1) / total_weight / cls->slot_size;
+        arena_size += cls->num_slots * cls->slot_size;
+    }
+    assert(arena_size <= capacity);
+    // hand out whatever is left after rounding, largest slots first
+    size_t left = capacity - arena_size;
+    for (size_t i = num_classes; i-- > 0;) {
+        slab_class_t *cls = &cache->slab_classes[i];
+        cls->num_slots += left / cls->slot_size;
+        left %= cls->slot_size;
+    }
+
+    arena_size = 0;
+    for (size_t i = 0; i < num_classes; ++i) {
+        slab_class_t *cls = &cache->slab_classes[i];
+        cls->offset = arena_size;
+        arena_size += cls->num_slots * cls->slot_size;
+    }
+
+    cache->slab_arena = (char *) avs_malloc(arena_size);
+    if (!cache->slab_arena) {
+        return -1;
+    }
+    cache->num_slab_classes = num_classes;
+    return 0;
+}
 
 coap_msg_cache_t *_avs_coap_msg_cache_create(size_t capacity) {
+    return _avs_coap_msg_cache_create_with_engine(
+            capacity, AVS_COAP_MSG_CACHE_ENGINE_FIFO);
+}
+
+coap_msg_cache_t *
+_avs_coap_msg_cache_create_with_engine(size_t capacity,
+                                       avs_coap_msg_cache_engine_t engine) {
     if (capacity == 0) {
         return NULL;
     }
@@ -71,62 +240,233 @@ coap_msg_cache_t *_avs_coap_msg_cache_create(size_t capacity) {
     if (!cache) {
         return NULL;
     }
+    cache->engine = engine;
 
-    if (avs_buffer_create(&cache->buffer, capacity)) {
+    cache->filter_size = FILTER_MIN_SIZE;
+    while (cache->filter_size < FILTER_MAX_SIZE
+            && cache->filter_size
+                           < (capacity >> FILTER_BYTES_PER_COUNTER_SHIFT)) {
+        cache->filter_size *= 2;
+    }
+    cache->filter = (uint8_t *) avs_calloc(cache->filter_size, 1);
+    if (!cache->filter) {
         avs_free(cache);
         return NULL;
     }
 
-    assert((size_t)(uintptr_t)avs_buffer_raw_insert_ptr(cache->buffer)
-           % AVS_ALIGNOF(cache_entry_t) == 0);
+    switch (engine) {
+    case AVS_COAP_MSG_CACHE_ENGINE_FIFO:
+        if (avs_buffer_create(&cache->buffer, capacity)) {
+            break;
+        }
+        assert((size_t)(uintptr_t)avs_buffer_raw_insert_ptr(cache->buffer)
+               % AVS_ALIGNOF(cache_entry_t) == 0);
+        return cache;
+
+    case AVS_COAP_MSG_CACHE_ENGINE_SLAB:
+        if (slab_init(cache, capacity)) {
+            break;
+        }
+        return cache;
+
+    default:
+        LOG(ERROR, "msg_cache: unknown storage engine: %d", (int) engine);
+        break;
+    }
+
+    avs_free(cache->filter);
+    avs_free(cache);
+    return NULL;
+}
+
+coap_msg_cache_t *
+_avs_coap_msg_cache_create_sharded(size_t capacity,
+                                   avs_coap_msg_cache_engine_t engine,
+                                   size_t num_shards) {
+#ifdef WITH_AVS_COMPAT_THREADING
+    assert(num_shards > 0);
+    coap_msg_cache_t *cache = (coap_msg_cache_t *)
+            avs_calloc(1, sizeof(coap_msg_cache_t));
+    if (!cache) {
+        return NULL;
+    }
+    cache->engine = engine;
+    cache->shards = (coap_msg_cache_t **)
+            avs_calloc(num_shards, sizeof(*cache->shards));
+    cache->shard_locks = (avs_mutex_t **)
+            avs_calloc(num_shards, sizeof(*cache->shard_locks));
+    if (!cache->shards || !cache->shard_locks) {
+        goto error;
+    }
+
+    for (; cache->num_shards < num_shards; ++cache->num_shards) {
+        const size_t i = cache->num_shards;
+        cache->shards[i] = _avs_coap_msg_cache_create_with_engine(
+                capacity / num_shards, engine);
+        if (!cache->shards[i]) {
+            goto error;
+        }
+        if (avs_mutex_create(&cache->shard_locks[i])) {
+            _avs_coap_msg_cache_release(&cache->shards[i]);
+            goto error;
+        }
+    }
     return cache;
+
+error:
+    LOG(ERROR, "msg_cache: could not create %lu shards of %lu bytes",
+        (unsigned long) num_shards, (unsigned long) (capacity / num_shards));
+    _avs_coap_msg_cache_release(&cache);
+    return NULL;
+#else // WITH_AVS_COMPAT_THREADING
+    (void) capacity;
+    (void) engine;
+    (void) num_shards;
+    LOG(ERROR, "msg_cache: sharded caches require threading support");
+    return NULL;
+#endif // WITH_AVS_COMPAT_THREADING
 }
 
 void _avs_coap_msg_cache_release(coap_msg_cache_t **cache_ptr) {
     if (cache_ptr && *cache_ptr) {
+#ifdef WITH_AVS_COMPAT_THREADING
+        for (size_t i = 0; i < (*cache_ptr)->num_shards; ++i) {
+            _avs_coap_msg_cache_release(&(*cache_ptr)->shards[i]);
+            avs_mutex_cleanup(&(*cache_ptr)->shard_locks[i]);
+        }
+        avs_free((*cache_ptr)->shard_locks);
+#endif // WITH_AVS_COMPAT_THREADING
+        avs_free((*cache_ptr)->shards);
+        avs_free((*cache_ptr)->index);
+        avs_free((*cache_ptr)->filter);
         avs_buffer_free(&(*cache_ptr)->buffer);
-        AVS_LIST_CLEAR(&(*cache_ptr)->endpoints);
+        avs_free((*cache_ptr)->slab_arena);
+        for (size_t i = 0; i < (*cache_ptr)->endpoint_buckets_size; ++i) {
+            AVS_LIST_CLEAR(&(*cache_ptr)->endpoint_buckets[i]);
+        }
+        avs_free((*cache_ptr)->endpoint_buckets);
         avs_free(*cache_ptr);
         *cache_ptr = NULL;
     }
 }
 
-static endpoint_t *cache_endpoint_add_ref(coap_msg_cache_t *cache,
-                                          const char *remote_addr,
-                                          const char *remote_port) {
-    assert(remote_addr);
-    assert(remote_port);
+static uint32_t endpoint_hash(const avs_net_resolved_endpoint_t *ep) {
+    return avs_hash_fnv1a32(AVS_HASH_FNV1A32_INIT, ep->data.buf, ep->size);
+}
+
+static bool endpoint_equal(const avs_net_resolved_endpoint_t *a,
+                           const avs_net_resolved_endpoint_t *b) {
+    return a->size == b->size && !memcmp(a->data.buf, b->data.buf, a->size);
+}
+
+#ifdef WITH_AVS_COMPAT_THREADING
+/**
+ * Locks the shard of @p cache responsible for @p remote_ep and returns it,
+ * or returns NULL if locking failed.
+ */
+static coap_msg_cache_t *
+lock_shard(coap_msg_cache_t *cache,
+           const avs_net_resolved_endpoint_t *remote_ep,
+           size_t *out_shard) {
+    *out_shard = endpoint_hash(remote_ep) % cache->num_shards;
+    if (avs_mutex_lock(cache->shard_locks[*out_shard])) {
+        LOG(ERROR, "msg_cache: could not lock shard %lu",
+            (unsigned long) *out_shard);
+        return NULL;
+    }
+    return cache->shards[*out_shard];
+}
+
+static void unlock_shard(coap_msg_cache_t *cache, size_t shard) {
+    avs_mutex_unlock(cache->shard_locks[shard]);
+}
+#else // WITH_AVS_COMPAT_THREADING
+// sharded caches cannot be created without threading support
+#define lock_shard(...) \
+    (AVS_UNREACHABLE("sharded msg_cache"), (coap_msg_cache_t *) NULL)
+#define unlock_shard(...) ((void) 0)
+#endif // WITH_AVS_COMPAT_THREADING
+
+static uint32_t entry_key_hash(uint32_t ep_hash, uint16_t msg_id) {
+    uint32_t hash = avs_hash_fnv1a32(ep_hash, &msg_id, sizeof(msg_id));
+    // final avalanche, so that low bits used for slot selection depend on
+    // the whole key
+    hash ^= hash >> 16;
+    hash *= UINT32_C(0x85EBCA6B);
+    hash ^= hash >> 13;
+    // 0 is reserved for empty index slots
+    return hash ? hash : 1;
+}
+
+#define ENDPOINT_BUCKETS_MIN_SIZE 8
+
+static AVS_LIST(endpoint_t) *endpoint_bucket(coap_msg_cache_t *cache,
+                                             uint32_t hash) {
+    return &cache->endpoint_buckets[hash & (cache->endpoint_buckets_size - 1)];
+}
+
+/* Doubles the number of endpoint buckets, keeping chains short. */
+static int endpoint_buckets_grow(coap_msg_cache_t *cache) {
+    const size_t new_size = cache->endpoint_buckets_size
+                                    ? 2 * cache->endpoint_buckets_size
+                                    : ENDPOINT_BUCKETS_MIN_SIZE;
+    AVS_LIST(endpoint_t) *new_buckets = (AVS_LIST(endpoint_t) *)
+            avs_calloc(new_size, sizeof(*new_buckets));
+    if (!new_buckets) {
+        return -1;
+    }
+    for (size_t i = 0; i < cache->endpoint_buckets_size; ++i) {
+        while (cache->endpoint_buckets[i]) {
+            AVS_LIST(endpoint_t) ep =
+                    AVS_LIST_DETACH(&cache->endpoint_buckets[i]);
+            AVS_LIST_INSERT(&new_buckets[ep->hash & (new_size - 1)], ep);
+        }
+    }
+    avs_free(cache->endpoint_buckets);
+    cache->endpoint_buckets = new_buckets;
+    cache->endpoint_buckets_size = new_size;
+    return 0;
+}
+
+static endpoint_t *
+cache_endpoint_add_ref(coap_msg_cache_t *cache,
+                       const avs_net_resolved_endpoint_t *remote_ep) {
+    assert(remote_ep);
+
+    const uint32_t hash = endpoint_hash(remote_ep);
 
-    AVS_LIST(endpoint_t) *ep_ptr;
-    AVS_LIST_FOREACH_PTR(ep_ptr, &cache->endpoints) {
-        if (!strcmp(remote_addr, (*ep_ptr)->addr)
-                && !strcmp(remote_port, (*ep_ptr)->port)) {
-            ++(*ep_ptr)->refcount;
-            return *ep_ptr;
+    if (cache->endpoint_buckets_size) {
+        AVS_LIST(endpoint_t) ep;
+        AVS_LIST_FOREACH(ep, *endpoint_bucket(cache, hash)) {
+            if (hash == ep->hash && endpoint_equal(remote_ep, &ep->addr)) {
+                ++ep->refcount;
+                return ep;
+            }
         }
     }
 
-    AVS_LIST(endpoint_t) new_ep = AVS_LIST_NEW_ELEMENT(endpoint_t);
-    if (!new_ep) {
+    // a failure to grow only makes the chains longer, unless there are no
+    // buckets at all
+    if (cache->num_endpoints >= cache->endpoint_buckets_size
+            && endpoint_buckets_grow(cache)
+            && !cache->endpoint_buckets_size) {
         LOG(DEBUG, "out of memory");
         return NULL;
     }
 
-    if (avs_simple_snprintf(new_ep->addr, sizeof(new_ep->addr), "%s",
-                            remote_addr) < 0
-            || avs_simple_snprintf(new_ep->port, sizeof(new_ep->port), "%s",
-                                   remote_port) < 0) {
-        LOG(WARNING, "endpoint address or port too long: addr = %s, "
-                     "port = %s",
-            remote_addr, remote_port);
-        AVS_LIST_DELETE(&new_ep);
+    AVS_LIST(endpoint_t) new_ep = AVS_LIST_NEW_ELEMENT(endpoint_t);
+    if (!new_ep) {
+        LOG(DEBUG, "out of memory");
         return NULL;
     }
 
     new_ep->refcount = 1;
-    AVS_LIST_INSERT(&cache->endpoints, new_ep);
+    new_ep->hash = hash;
+    new_ep->addr = *remote_ep;
+    AVS_LIST_INSERT(endpoint_bucket(cache, hash), new_ep);
+    ++cache->num_endpoints;
 
-    LOG(TRACE, "added cache endpoint: %s:%s", new_ep->addr, new_ep->port);
+    LOG(TRACE, "added cache endpoint: hash %08" PRIx32, new_ep->hash);
     return new_ep;
 }
 
@@ -134,10 +474,12 @@ static void cache_endpoint_del_ref(coap_msg_cache_t *cache,
                                    endpoint_t *endpoint) {
     if (--endpoint->refcount == 0) {
         AVS_LIST(endpoint_t) *ep_ptr = (AVS_LIST(endpoint_t) *)
-                AVS_LIST_FIND_PTR(&cache->endpoints, endpoint);
-        LOG(TRACE, "removed cache endpoint: %s:%s", (*ep_ptr)->addr,
-            (*ep_ptr)->port);
+                AVS_LIST_FIND_PTR(endpoint_bucket(cache, endpoint->hash),
+                                  endpoint);
+        LOG(TRACE, "removed cache endpoint: hash %08" PRIx32,
+            (*ep_ptr)->hash);
         AVS_LIST_DELETE(ep_ptr);
+        --cache->num_endpoints;
     }
 }
 
@@ -152,10 +494,10 @@ static size_t padding_bytes_after_msg(const avs_coap_msg_t *msg) {
     }
 }
 
-static void cache_put_entry(coap_msg_cache_t *cache,
-                            const avs_time_monotonic_t *expiration_time,
-                            endpoint_t *endpoint,
-                            const avs_coap_msg_t *msg) {
+static size_t cache_put_entry(coap_msg_cache_t *cache,
+                              const avs_time_monotonic_t *expiration_time,
+                              endpoint_t *endpoint,
+                              const avs_coap_msg_t *msg) {
     size_t msg_size = offsetof(avs_coap_msg_t, content) + msg->length;
 
     cache_entry_t entry = {
@@ -165,6 +507,7 @@ static void cache_put_entry(coap_msg_cache_t *cache,
 
     assert(avs_buffer_data_size(cache->buffer) % AVS_ALIGNOF(cache_entry_t)
             == 0);
+    const size_t entry_offset = avs_buffer_data_size(cache->buffer);
     int res;
     res = avs_buffer_append_bytes(cache->buffer, &entry,
                                   offsetof(cache_entry_t, data));
@@ -177,6 +520,7 @@ static void cache_put_entry(coap_msg_cache_t *cache,
     assert(avs_buffer_data_size(cache->buffer) % AVS_ALIGNOF(cache_entry_t)
             == 0);
     (void) res;
+    return entry_offset;
 }
 
 static const cache_entry_t *entry_first(const coap_msg_cache_t *cache) {
@@ -234,6 +578,150 @@ static const cache_entry_t *entry_next(const cache_entry_t *entry) {
     return result;
 }
 
+static size_t entry_position(const coap_msg_cache_t *cache,
+                             const cache_entry_t *entry) {
+    if (cache->engine == AVS_COAP_MSG_CACHE_ENGINE_SLAB) {
+        // slab entries never move, so plain offsets are enough
+        return (size_t) ((const char *) entry - cache->slab_arena);
+    }
+    assert((const char *) entry >= avs_buffer_data(cache->buffer));
+    return cache->consumed_bytes
+            + (size_t) ((const char *) entry - avs_buffer_data(cache->buffer));
+}
+
+static const cache_entry_t *entry_at(const coap_msg_cache_t *cache,
+                                     size_t position) {
+    if (cache->engine == AVS_COAP_MSG_CACHE_ENGINE_SLAB) {
+        return (const cache_entry_t *) (cache->slab_arena + position);
+    }
+    // unsigned arithmetic makes this correct even if positions wrap around
+    return (const cache_entry_t *) (avs_buffer_data(cache->buffer)
+                                    + (position - cache->consumed_bytes));
+}
+
+static uint32_t entry_hash(const cache_entry_t *entry) {
+    return entry_key_hash(entry->endpoint->hash, entry_id(entry));
+}
+
+/**
+ * Fills @p out_counters with indices of filter counters assigned to the entry
+ * key of given @p key_hash (see entry_key_hash()), using double hashing.
+ */
+static void filter_counters(const coap_msg_cache_t *cache,
+                            uint32_t key_hash,
+                            size_t out_counters[FILTER_NUM_HASHES]) {
+    const uint32_t h1 = key_hash;
+    const uint32_t h2 = ((key_hash >> 16) | (key_hash << 16)) | 1;
+    for (uint32_t i = 0; i < FILTER_NUM_HASHES; ++i) {
+        out_counters[i] = (h1 + i * h2) & (cache->filter_size - 1);
+    }
+}
+
+static void filter_insert(coap_msg_cache_t *cache, uint32_t key_hash) {
+    size_t counters[FILTER_NUM_HASHES];
+    filter_counters(cache, key_hash, counters);
+    for (size_t i = 0; i < FILTER_NUM_HASHES; ++i) {
+        // saturated counters are never decremented again, they only cause
+        // false positives
+        if (cache->filter[counters[i]] < UINT8_MAX) {
+            ++cache->filter[counters[i]];
+        }
+    }
+}
+
+static void filter_remove(coap_msg_cache_t *cache, uint32_t key_hash) {
+    size_t counters[FILTER_NUM_HASHES];
+    filter_counters(cache, key_hash, counters);
+    for (size_t i = 0; i < FILTER_NUM_HASHES; ++i) {
+        assert(cache->filter[counters[i]] > 0);
+        if (cache->filter[counters[i]] < UINT8_MAX) {
+            --cache->filter[counters[i]];
+        }
+    }
+}
+
+static void index_put_slot(index_slot_t *index,
+                           size_t index_size,
+                           const index_slot_t *slot) {
+    const size_t mask = index_size - 1;
+    size_t i = slot->hash & mask;
+    while (index[i].hash) {
+        i = (i + 1) & mask;
+    }
+    index[i] = *slot;
+}
+
+/**
+ * Makes sure the index is able to hold at least one more element without
+ * exceeding the maximum load factor of 1/2.
+ */
+static int index_reserve(coap_msg_cache_t *cache) {
+    if (2 * (cache->index_used + 1) <= cache->index_size) {
+        return 0;
+    }
+
+    size_t new_size = cache->index_size ? 2 * cache->index_size : 16;
+    index_slot_t *new_index = (index_slot_t *)
+            avs_calloc(new_size, sizeof(index_slot_t));
+    if (!new_index) {
+        LOG(DEBUG, "msg_cache: out of memory");
+        return -1;
+    }
+
+    for (size_t i = 0; i < cache->index_size; ++i) {
+        if (cache->index[i].hash) {
+            index_put_slot(new_index, new_size, &cache->index[i]);
+        }
+    }
+
+    avs_free(cache->index);
+    cache->index = new_index;
+    cache->index_size = new_size;
+    return 0;
+}
+
+static void index_insert(coap_msg_cache_t *cache,
+                         const cache_entry_t *entry) {
+    assert(2 * (cache->index_used + 1) <= cache->index_size);
+
+    const index_slot_t slot = {
+        .hash = entry_hash(entry),
+        .position = entry_position(cache, entry)
+    };
+    index_put_slot(cache->index, cache->index_size, &slot);
+    ++cache->index_used;
+    filter_insert(cache, slot.hash);
+}
+
+static void index_remove(coap_msg_cache_t *cache,
+                         const cache_entry_t *entry) {
+    const size_t mask = cache->index_size - 1;
+    const size_t position = entry_position(cache, entry);
+    const uint32_t hash = entry_hash(entry);
+
+    size_t i = hash & mask;
+    while (cache->index[i].position != position) {
+        assert(cache->index[i].hash);
+        i = (i + 1) & mask;
+    }
+
+    // backward shift deletion: move any following elements of the probe
+    // sequence that would become unreachable into the freed slot
+    for (size_t j = (i + 1) & mask; cache->index[j].hash; j = (j + 1) & mask) {
+        size_t home = cache->index[j].hash & mask;
+        bool reachable = (i <= j) ? (i < home && home <= j)
+                                  : (i < home || home <= j);
+        if (!reachable) {
+            cache->index[i] = cache->index[j];
+            i = j;
+        }
+    }
+
+    cache->index[i].hash = 0;
+    --cache->index_used;
+    filter_remove(cache, hash);
+}
+
 static void cache_free_bytes(coap_msg_cache_t *cache,
                              size_t bytes_required) {
     assert(bytes_required <= avs_buffer_capacity(cache->buffer));
@@ -249,18 +737,21 @@ static void cache_free_bytes(coap_msg_cache_t *cache,
         LOG(TRACE, "msg_cache: dropping msg (id = %u) to make room for"
                    " a new one (size = %lu)",
             entry_id(entry), (unsigned long) bytes_required);
+        index_remove(cache, entry);
         cache_endpoint_del_ref(cache, entry->endpoint);
         bytes_free += entry_size(entry);
+        ++cache->stats.evictions;
     }
 
     size_t expired_bytes = (uintptr_t)entry - (uintptr_t)entry_first(cache);
     int res = avs_buffer_consume_bytes(cache->buffer, expired_bytes);
     assert(!res);
     (void) res;
+    cache->consumed_bytes += expired_bytes;
 }
 
-static void cache_drop_expired(coap_msg_cache_t *cache,
-                               const avs_time_monotonic_t *now) {
+static void buffer_drop_expired(coap_msg_cache_t *cache,
+                                const avs_time_monotonic_t *now) {
     const cache_entry_t *entry;
     for (entry = entry_first(cache);
             entry_valid(cache, entry);
@@ -268,7 +759,9 @@ static void cache_drop_expired(coap_msg_cache_t *cache,
         if (entry_expired(entry, now)) {
             LOG(TRACE, "msg_cache: dropping expired msg (id = %u)",
                 entry_id(entry));
+            index_remove(cache, entry);
             cache_endpoint_del_ref(cache, entry->endpoint);
+            ++cache->stats.expirations;
         } else {
             break;
         }
@@ -278,18 +771,133 @@ static void cache_drop_expired(coap_msg_cache_t *cache,
     int res = avs_buffer_consume_bytes(cache->buffer, expired_bytes);
     assert(!res);
     (void) res;
+    cache->consumed_bytes += expired_bytes;
 }
 
-static const cache_entry_t *find_entry(const coap_msg_cache_t *cache,
-                                       const char *remote_addr,
-                                       const char *remote_port,
-                                       uint16_t msg_id) {
-    for (const cache_entry_t *entry = entry_first(cache);
-            entry_valid(cache, entry);
-            entry = entry_next(entry)) {
+static cache_entry_t *slab_entry(const coap_msg_cache_t *cache,
+                                 const slab_class_t *cls,
+                                 size_t slot) {
+    assert(slot < cls->num_slots);
+    return (cache_entry_t *) (cache->slab_arena + cls->offset
+                              + slot * cls->slot_size);
+}
+
+static bool slab_fits(const coap_msg_cache_t *cache, size_t entry_size) {
+    return entry_size
+           <= cache->slab_classes[cache->num_slab_classes - 1].slot_size;
+}
+
+/**
+ * Returns the class to store an entry of @p entry_size bytes in: the smallest
+ * one with a free slot large enough, or, if all of them are full, the one
+ * whose oldest entry expires first, so that evictions follow the global
+ * expiration order as closely as possible.
+ */
+static slab_class_t *slab_class_for(coap_msg_cache_t *cache,
+                                    size_t entry_size) {
+    assert(slab_fits(cache, entry_size));
+    slab_class_t *oldest = NULL;
+    for (size_t i = 0; i < cache->num_slab_classes; ++i) {
+        slab_class_t *cls = &cache->slab_classes[i];
+        if (cls->slot_size < entry_size) {
+            continue;
+        }
+        if (cls->count < cls->num_slots) {
+            return cls;
+        }
+        if (!oldest
+                || avs_time_monotonic_before(
+                           slab_entry(cache, cls, cls->head)->expiration_time,
+                           slab_entry(cache, oldest, oldest->head)
+                                   ->expiration_time)) {
+            oldest = cls;
+        }
+    }
+    assert(oldest);
+    return oldest;
+}
+
+static void slab_drop_oldest(coap_msg_cache_t *cache, slab_class_t *cls) {
+    assert(cls->count > 0);
+    const cache_entry_t *entry = slab_entry(cache, cls, cls->head);
+    index_remove(cache, entry);
+    cache_endpoint_del_ref(cache, entry->endpoint);
+    cls->head = (cls->head + 1) % cls->num_slots;
+    --cls->count;
+}
+
+static void slab_drop_expired(coap_msg_cache_t *cache,
+                              const avs_time_monotonic_t *now) {
+    for (size_t i = 0; i < cache->num_slab_classes; ++i) {
+        slab_class_t *cls = &cache->slab_classes[i];
+        while (cls->count > 0
+                && entry_expired(slab_entry(cache, cls, cls->head), now)) {
+            LOG(TRACE, "msg_cache: dropping expired msg (id = %u)",
+                entry_id(slab_entry(cache, cls, cls->head)));
+            slab_drop_oldest(cache, cls);
+            ++cache->stats.expirations;
+        }
+    }
+}
+
+static const cache_entry_t *
+slab_put_entry(coap_msg_cache_t *cache,
+               slab_class_t *cls,
+               const avs_time_monotonic_t *expiration_time,
+               endpoint_t *endpoint,
+               const avs_coap_msg_t *msg) {
+    if (cls->count == cls->num_slots) {
+        LOG(TRACE, "msg_cache: dropping msg (id = %u) to make room for"
+                   " a new one (slot size = %lu)",
+            entry_id(slab_entry(cache, cls, cls->head)),
+            (unsigned long) cls->slot_size);
+        slab_drop_oldest(cache, cls);
+        ++cache->stats.evictions;
+    }
+
+    const cache_entry_t header = {
+        .endpoint = endpoint,
+        .expiration_time = *expiration_time
+    };
+    cache_entry_t *entry =
+            slab_entry(cache, cls, (cls->head + cls->count) % cls->num_slots);
+    memcpy(entry, &header, offsetof(cache_entry_t, data));
+    memcpy((char *) entry + offsetof(cache_entry_t, data), msg,
+           offsetof(avs_coap_msg_t, content) + msg->length);
+    ++cls->count;
+    return entry;
+}
+
+static void cache_drop_expired(coap_msg_cache_t *cache,
+                               const avs_time_monotonic_t *now) {
+    if (cache->engine == AVS_COAP_MSG_CACHE_ENGINE_SLAB) {
+        slab_drop_expired(cache, now);
+    } else {
+        buffer_drop_expired(cache, now);
+    }
+}
+
+static const cache_entry_t *
+find_entry(const coap_msg_cache_t *cache,
+           const avs_net_resolved_endpoint_t *remote_ep,
+           uint16_t msg_id) {
+    if (!cache->index_used) {
+        return NULL;
+    }
+
+    const uint32_t hash = entry_key_hash(endpoint_hash(remote_ep), msg_id);
+    const size_t mask = cache->index_size - 1;
+
+    for (size_t i = hash & mask; cache->index[i].hash; i = (i + 1) & mask) {
+        if (cache->index[i].hash != hash) {
+            continue;
+        }
+
+        const cache_entry_t *entry = entry_at(cache, cache->index[i].position);
+        assert(cache->engine == AVS_COAP_MSG_CACHE_ENGINE_SLAB
+               || entry_valid(cache, entry));
         if (entry_id(entry) == msg_id
-                && !strcmp(entry->endpoint->addr, remote_addr)
-                && !strcmp(entry->endpoint->port, remote_port)) {
+                && endpoint_equal(&entry->endpoint->addr, remote_ep)) {
             return entry;
         }
     }
@@ -298,18 +906,34 @@ static const cache_entry_t *find_entry(const coap_msg_cache_t *cache,
 }
 
 int _avs_coap_msg_cache_add(coap_msg_cache_t *cache,
-                            const char *remote_addr,
-                            const char *remote_port,
+                            const avs_net_resolved_endpoint_t *remote_ep,
                             const avs_coap_msg_t *msg,
                             const avs_coap_tx_params_t *tx_params) {
     if (!cache) {
         return -1;
     }
 
+    if (cache->shards) {
+        size_t shard_idx;
+        coap_msg_cache_t *shard = lock_shard(cache, remote_ep, &shard_idx);
+        if (!shard) {
+            return -1;
+        }
+        int result = _avs_coap_msg_cache_add(shard, remote_ep, msg, tx_params);
+        unlock_shard(cache, shard_idx);
+        return result;
+    }
+
     size_t cap_req = _avs_coap_msg_cache_overhead(msg)
                    + offsetof(avs_coap_msg_t, content)
                    + msg->length;
-    if (avs_buffer_capacity(cache->buffer) < cap_req) {
+    bool fits;
+    if (cache->engine == AVS_COAP_MSG_CACHE_ENGINE_SLAB) {
+        fits = slab_fits(cache, cap_req);
+    } else {
+        fits = (avs_buffer_capacity(cache->buffer) >= cap_req);
+    }
+    if (!fits) {
         LOG(DEBUG, "msg_cache: not enough space for %" PRIu32 " B message",
             msg->length);
         return -1;
@@ -319,77 +943,217 @@ int _avs_coap_msg_cache_add(coap_msg_cache_t *cache,
     cache_drop_expired(cache, &now);
 
     uint16_t msg_id = avs_coap_msg_get_id(msg);
-    if (find_entry(cache, remote_addr, remote_port, msg_id)) {
+    if (find_entry(cache, remote_ep, msg_id)) {
         LOG(DEBUG, "msg_cache: message ID %u already in cache", msg_id);
         return AVS_COAP_MSG_CACHE_DUPLICATE;
     }
 
-    endpoint_t *ep = cache_endpoint_add_ref(cache, remote_addr, remote_port);
-    if (!ep) {
+    if (index_reserve(cache)) {
         return -1;
     }
 
-    cache_free_bytes(cache, cap_req);
+    endpoint_t *ep = cache_endpoint_add_ref(cache, remote_ep);
+    if (!ep) {
+        return -1;
+    }
 
     const avs_time_duration_t exchange_lifetime =
             avs_coap_exchange_lifetime(tx_params);
     avs_time_monotonic_t expiration_time =
             avs_time_monotonic_add(now, exchange_lifetime);
 
-    cache_put_entry(cache, &expiration_time, ep, msg);
+    if (cache->engine == AVS_COAP_MSG_CACHE_ENGINE_SLAB) {
+        index_insert(cache, slab_put_entry(cache, slab_class_for(cache, cap_req),
+                                           &expiration_time, ep, msg));
+    } else {
+        cache_free_bytes(cache, cap_req);
+        size_t offset = cache_put_entry(cache, &expiration_time, ep, msg);
+        index_insert(cache, (const cache_entry_t *)
+                                    (avs_buffer_data(cache->buffer) + offset));
+    }
     return 0;
 }
 
-const avs_coap_msg_t *_avs_coap_msg_cache_get(coap_msg_cache_t *cache,
-                                              const char *remote_addr,
-                                              const char *remote_port,
-                                              uint16_t msg_id) {
+const avs_coap_msg_t *
+_avs_coap_msg_cache_get(coap_msg_cache_t *cache,
+                        const avs_net_resolved_endpoint_t *remote_ep,
+                        uint16_t msg_id) {
     if (!cache) {
         return NULL;
     }
+    AVS_ASSERT(!cache->shards,
+               "_avs_coap_msg_cache_get() called on a sharded cache");
 
     avs_time_monotonic_t now = avs_time_monotonic_now();
     cache_drop_expired(cache, &now);
 
-    const cache_entry_t *entry = find_entry(cache, remote_addr, remote_port,
-                                            msg_id);
+    const cache_entry_t *entry = find_entry(cache, remote_ep, msg_id);
     if (!entry) {
+        ++cache->stats.misses;
         return NULL;
     }
 
     assert(!entry_expired(entry, &now));
 
     LOG(TRACE, "msg_cache hit (id = %u)", msg_id);
+    ++cache->stats.hits;
     return entry_msg(entry);
 }
 
+avs_coap_msg_t *
+_avs_coap_msg_cache_get_copy(coap_msg_cache_t *cache,
+                             const avs_net_resolved_endpoint_t *remote_ep,
+                             uint16_t msg_id) {
+    if (!cache) {
+        return NULL;
+    }
+
+    size_t shard_idx = 0;
+    coap_msg_cache_t *shard = cache;
+    if (cache->shards && !(shard = lock_shard(cache, remote_ep, &shard_idx))) {
+        return NULL;
+    }
+
+    avs_coap_msg_t *copy = NULL;
+    const avs_coap_msg_t *msg =
+            _avs_coap_msg_cache_get(shard, remote_ep, msg_id);
+    if (msg) {
+        const size_t size = offsetof(avs_coap_msg_t, content) + msg->length;
+        if ((copy = (avs_coap_msg_t *) avs_malloc(size))) {
+            memcpy(copy, msg, size);
+        } else {
+            LOG(ERROR, "msg_cache: out of memory");
+        }
+    }
+
+    if (cache->shards) {
+        unlock_shard(cache, shard_idx);
+    }
+    return copy;
+}
+
+bool _avs_coap_msg_cache_may_contain(
+        coap_msg_cache_t *cache,
+        const avs_net_resolved_endpoint_t *remote_ep,
+        uint16_t msg_id) {
+    if (!cache) {
+        return false;
+    }
+
+    if (cache->shards) {
+        size_t shard_idx;
+        coap_msg_cache_t *shard = lock_shard(cache, remote_ep, &shard_idx);
+        if (!shard) {
+            // let the caller find out with a proper lookup
+            return true;
+        }
+        bool result = _avs_coap_msg_cache_may_contain(shard, remote_ep, msg_id);
+        unlock_shard(cache, shard_idx);
+        return result;
+    }
+
+    size_t counters[FILTER_NUM_HASHES];
+    filter_counters(cache, entry_key_hash(endpoint_hash(remote_ep), msg_id),
+                    counters);
+    for (size_t i = 0; i < FILTER_NUM_HASHES; ++i) {
+        if (!cache->filter[counters[i]]) {
+            ++cache->stats.misses;
+            return false;
+        }
+    }
+    return true;
+}
+
+void _avs_coap_msg_cache_get_stats(const coap_msg_cache_t *cache,
+                                   avs_coap_cache_stats_t *out_stats) {
+    if (!cache) {
+        memset(out_stats, 0, sizeof(*out_stats));
+        return;
+    }
+    *out_stats = cache->stats;
+
+#ifdef WITH_AVS_COMPAT_THREADING
+    for (size_t i = 0; i < cache->num_shards; ++i) {
+        avs_coap_cache_stats_t shard_stats = { 0 };
+        if (!avs_mutex_lock(cache->shard_locks[i])) {
+            _avs_coap_msg_cache_get_stats(cache->shards[i], &shard_stats);
+            avs_mutex_unlock(cache->shard_locks[i]);
+        }
+        out_stats->hits += shard_stats.hits;
+        out_stats->misses += shard_stats.misses;
+        out_stats->evictions += shard_stats.evictions;
+        out_stats->expirations += shard_stats.expirations;
+    }
+#endif // WITH_AVS_COMPAT_THREADING
+}
+
+static void debug_print_entry(const cache_entry_t *entry) {
+    LOG(DEBUG, "entry: %p, msg padding: %lu", (const void *) entry,
+        (unsigned long) padding_bytes_after_msg(entry_msg(entry)));
+    LOG(DEBUG, "endpoint: hash %08" PRIx32, entry->endpoint->hash);
+    LOG(DEBUG, "expiration time: %" PRId64 ":%09" PRId32,
+        entry->expiration_time.since_monotonic_epoch.seconds,
+        entry->expiration_time.since_monotonic_epoch.nanoseconds);
+    avs_coap_msg_debug_print(entry_msg(entry));
+}
+
 void _avs_coap_msg_cache_debug_print(const coap_msg_cache_t *cache) {
     if (!cache) {
         LOG(DEBUG, "msg_cache: NULL");
         return;
     }
 
-    LOG(DEBUG, "msg_cache: %lu/%lu bytes used",
-        (unsigned long) avs_buffer_data_size(cache->buffer),
-        (unsigned long) avs_buffer_capacity(cache->buffer));
+#ifdef WITH_AVS_COMPAT_THREADING
+    if (cache->shards) {
+        for (size_t i = 0; i < cache->num_shards; ++i) {
+            LOG(DEBUG, "msg_cache: shard %lu", (unsigned long) i);
+            if (!avs_mutex_lock(cache->shard_locks[i])) {
+                _avs_coap_msg_cache_debug_print(cache->shards[i]);
+                avs_mutex_unlock(cache->shard_locks[i]);
+            }
+        }
+        return;
+    }
+#endif // WITH_AVS_COMPAT_THREADING
 
-    AVS_LIST(endpoint_t) ep;
-    AVS_LIST_FOREACH(ep, cache->endpoints) {
-        LOG(DEBUG, "endpoint: refcount %u, addr %s, port %s", ep->refcount,
-            ep->addr, ep->port);
+    if (cache->engine == AVS_COAP_MSG_CACHE_ENGINE_SLAB) {
+        for (size_t i = 0; i < cache->num_slab_classes; ++i) {
+            LOG(DEBUG, "msg_cache: %lu/%lu slots of %lu bytes used",
+                (unsigned long) cache->slab_classes[i].count,
+                (unsigned long) cache->slab_classes[i].num_slots,
+                (unsigned long) cache->slab_classes[i].slot_size);
+        }
+    } else {
+        LOG(DEBUG, "msg_cache: %lu/%lu bytes used",
+            (unsigned long) avs_buffer_data_size(cache->buffer),
+            (unsigned long) avs_buffer_capacity(cache->buffer));
     }
+    LOG(DEBUG, "msg_cache: %lu/%lu index slots used",
+        (unsigned long) cache->index_used,
+        (unsigned long) cache->index_size);
 
-    for (const cache_entry_t *entry = entry_first(cache);
-            entry_valid(cache, entry);
-            entry = entry_next(entry)) {
-        LOG(DEBUG, "entry: %p, msg padding: %lu", (const void *) entry,
-            (unsigned long) padding_bytes_after_msg(entry_msg(entry)));
-        LOG(DEBUG, "endpoint: %s:%s", entry->endpoint->addr,
-            entry->endpoint->port);
-        LOG(DEBUG, "expiration time: %" PRId64 ":%09" PRId32,
-            entry->expiration_time.since_monotonic_epoch.seconds,
-            entry->expiration_time.since_monotonic_epoch.nanoseconds);
-        avs_coap_msg_debug_print(entry_msg(entry));
+    for (size_t i = 0; i < cache->endpoint_buckets_size; ++i) {
+        AVS_LIST(endpoint_t) ep;
+        AVS_LIST_FOREACH(ep, cache->endpoint_buckets[i]) {
+            LOG(DEBUG, "endpoint: refcount %u, hash %08" PRIx32 ", %u bytes",
+                ep->refcount, ep->hash, (unsigned) ep->addr.size);
+        }
+    }
+
+    if (cache->engine == AVS_COAP_MSG_CACHE_ENGINE_SLAB) {
+        for (size_t i = 0; i < cache->num_slab_classes; ++i) {
+            const slab_class_t *cls = &cache->slab_classes[i];
+            for (size_t j = 0; j < cls->count; ++j) {
+                size_t slot = (cls->head + j) % cls->num_slots;
+                debug_print_entry(slab_entry(cache, cls, slot));
+            }
+        }
+    } else {
+        for (const cache_entry_t *entry = entry_first(cache);
+                entry_valid(cache, entry);
+                entry = entry_next(entry)) {
+            debug_print_entry(entry);
+        }
     }
 }
 
@@ -19,8 +19,13 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
+#include <avsystem/commons/net.h>
+
+#include <avsystem/commons/coap/ctx.h>
 #include <avsystem/commons/coap/msg.h>
+#include <avsystem/commons/coap/stats.h>
 #include <avsystem/commons/coap/tx_params.h>
 
 VISIBILITY_PRIVATE_HEADER_BEGIN
@@ -44,6 +49,46 @@ typedef struct coap_msg_cache coap_msg_cache_t;
  */
 coap_msg_cache_t *_avs_coap_msg_cache_create(size_t capacity);
 
+/**
+ * Creates a message cache object that uses given storage @p engine .
+ *
+ * @param capacity Number of bytes the cache should be able to hold.
+ * @param engine   Storage engine to use.
+ *
+ * @return Created msg_cache object, or NULL if there is not enough memory
+ *         or @p capacity is too small for the selected engine.
+ */
+coap_msg_cache_t *
+_avs_coap_msg_cache_create_with_engine(size_t capacity,
+                                       avs_coap_msg_cache_engine_t engine);
+
+/**
+ * Creates a message cache object that may be safely used from multiple
+ * threads at once.
+ *
+ * The cache is split into @p num_shards independent caches of
+ * <c>capacity / num_shards</c> bytes each, guarded by separate locks. Each
+ * remote endpoint is assigned to a single shard based on its hash, so
+ * concurrent operations on different endpoints rarely contend.
+ *
+ * Only @ref _avs_coap_msg_cache_get_copy and
+ * @ref _avs_coap_msg_cache_may_contain may be used to look up messages in
+ * a sharded cache.
+ *
+ * @param capacity   Total number of bytes the cache should be able to hold.
+ * @param engine     Storage engine to use in each shard.
+ * @param num_shards Number of shards, greater than zero.
+ *
+ * @return Created msg_cache object, or NULL if there is not enough memory,
+ *         @p capacity is too small for the requested number of shards, or
+ *         the library was compiled without threading support
+ *         (<c>WITH_AVS_COMPAT_THREADING</c>).
+ */
+coap_msg_cache_t *
+_avs_coap_msg_cache_create_sharded(size_t capacity,
+                                   avs_coap_msg_cache_engine_t engine,
+                                   size_t num_shards);
+
 /**
  * Frees any resources used by given @p cache_ptr and sets <c>*cache_ptr</c>
  * to NULL.
@@ -55,16 +100,18 @@ void _avs_coap_msg_cache_release(coap_msg_cache_t **cache_ptr);
 
 /**
  * Adds a message to cache. Drops oldest cache entries if needed to fit
- * @p msg, even if they did not expire yet.
+ * @p msg, even if they did not expire yet. With the slab engine, only entries
+ * of the same size class as @p msg are considered.
  *
  * Cached message expires after EXCHANGE_LIFETIME from being added to the cache.
  *
- * @param cache       Cache object to put message in.
- * @param remote_addr Message recipient address. Messages sent to one recipient
- *                    will not be considered valid for another one.
- * @param remote_port Message recipient port.
- * @param msg         Message to cache.
- * @param tx_params   Transmission params. Determine cached message lifetime.
+ * @param cache     Cache object to put message in.
+ * @param remote_ep Message recipient endpoint. Messages sent to one recipient
+ *                  will not be considered valid for another one. Endpoints are
+ *                  compared byte-wise, the contents do not need to be
+ *                  a valid socket address.
+ * @param msg       Message to cache.
+ * @param tx_params Transmission params. Determine cached message lifetime.
  *
  * @return 0 on success, a negative value if:
  *         @li @p cache is NULL,
@@ -79,27 +126,78 @@ void _avs_coap_msg_cache_release(coap_msg_cache_t **cache_ptr);
  * indicates a bug hiding somewhere.
  */
 int _avs_coap_msg_cache_add(coap_msg_cache_t *cache,
-                            const char *remote_addr,
-                            const char *remote_port,
+                            const avs_net_resolved_endpoint_t *remote_ep,
                             const avs_coap_msg_t *msg,
                             const avs_coap_tx_params_t *tx_params);
 
 /**
  * Looks up @p cache for a message with given @p msg_id and returns it if found.
  *
- * @param cache       Cache object to look into, or NULL.
- * @param remote_addr Message recipient address. Messages sent to one recipient
- *                    will not be considered valid for another one.
- * @param remote_port Message recipient port.
- * @param msg_id      CoAP message ID to look for.
+ * @param cache     Cache object to look into, or NULL.
+ * @param remote_ep Message recipient endpoint. Messages sent to one recipient
+ *                  will not be considered valid for another one.
+ * @param msg_id    CoAP message ID to look for.
  *
  * @return Found cached message, or NULL if it was not found
- *         or @p cache is NULL.
+ *         or @p cache is NULL. The message is only valid until the next call
+ *         to any other function on @p cache .
+ *
+ * NOTE: this function must not be called on sharded caches, use
+ * @ref _avs_coap_msg_cache_get_copy instead.
  */
-const avs_coap_msg_t *_avs_coap_msg_cache_get(coap_msg_cache_t *cache,
-                                              const char *remote_addr,
-                                              const char *remote_port,
-                                              uint16_t msg_id);
+const avs_coap_msg_t *
+_avs_coap_msg_cache_get(coap_msg_cache_t *cache,
+                        const avs_net_resolved_endpoint_t *remote_ep,
+                        uint16_t msg_id);
+
+/**
+ * Looks up @p cache for a message with given @p msg_id and returns its copy
+ * if found. Unlike @ref _avs_coap_msg_cache_get , this function may be used
+ * with sharded caches, as the result remains valid after the shard is
+ * unlocked.
+ *
+ * @param cache     Cache object to look into, or NULL.
+ * @param remote_ep Message recipient endpoint.
+ * @param msg_id    CoAP message ID to look for.
+ *
+ * @return Copy of the cached message, which needs to be freed by the caller
+ *         using avs_free(), or NULL if it was not found, @p cache is NULL,
+ *         or there is not enough memory to copy it.
+ */
+avs_coap_msg_t *
+_avs_coap_msg_cache_get_copy(coap_msg_cache_t *cache,
+                             const avs_net_resolved_endpoint_t *remote_ep,
+                             uint16_t msg_id);
+
+/**
+ * Quickly checks whether @p cache may contain a message with given
+ * @p msg_id sent to @p remote_ep , without looking the entry up.
+ *
+ * False positives are possible, false negatives are not: if this function
+ * returns false, @ref _avs_coap_msg_cache_get would return NULL. A rejected
+ * lookup is counted as a cache miss, just like a failed full lookup.
+ *
+ * @param cache     Cache object to look into, or NULL.
+ * @param remote_ep Remote endpoint the message was sent to.
+ * @param msg_id    CoAP message ID to look for.
+ *
+ * @return false if the message is definitely not in the cache, true if it may
+ *         be.
+ */
+bool _avs_coap_msg_cache_may_contain(
+        coap_msg_cache_t *cache,
+        const avs_net_resolved_endpoint_t *remote_ep,
+        uint16_t msg_id);
+
+/**
+ * Retrieves hit, miss, eviction and expiration counters of @p cache.
+ *
+ * @param cache     Cache object to query, or NULL, in which case all counters
+ *                  are reported as zero.
+ * @param out_stats Structure to fill.
+ */
+void _avs_coap_msg_cache_get_stats(const coap_msg_cache_t *cache,
+                                   avs_coap_cache_stats_t *out_stats);
 
 /**
  * Prints @p cache contents to log output.
@@ -120,9 +218,17 @@ size_t _avs_coap_msg_cache_overhead(const avs_coap_msg_t *msg);
 
 #define _avs_coap_msg_cache_create(...) \
     (LOG(ERROR, "message cache support disabled"), (coap_msg_cache_t *) NULL)
+#define _avs_coap_msg_cache_create_with_engine(...) \
+    (LOG(ERROR, "message cache support disabled"), (coap_msg_cache_t *) NULL)
+#define _avs_coap_msg_cache_create_sharded(...) \
+    (LOG(ERROR, "message cache support disabled"), (coap_msg_cache_t *) NULL)
 #define _avs_coap_msg_cache_release(...) (void)0
 #define _avs_coap_msg_cache_add(...) (void)(-1)
 #define _avs_coap_msg_cache_get(...) ((avs_coap_msg_t *) NULL)
+#define _avs_coap_msg_cache_get_copy(...) ((avs_coap_msg_t *) NULL)
+#define _avs_coap_msg_cache_may_contain(...) false
+#define _avs_coap_msg_cache_get_stats(Cache, OutStats) \
+    ((void) (Cache), (void) memset((OutStats), 0, sizeof(*(OutStats))))
 #define _avs_coap_msg_cache_debug_print(...) (void)0
 #define _avs_coap_msg_cache_overhead(...) 0
 
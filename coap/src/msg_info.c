@@ -29,16 +29,22 @@ void
 avs_coap_msg_info_reset(avs_coap_msg_info_t *info) {
     AVS_LIST_CLEAR(&info->options_);
 
-    *info = avs_coap_msg_info_init();
+    if (info->arena_) {
+        *info = avs_coap_msg_info_init_with_arena(info->arena_,
+                                                  info->arena_capacity_);
+    } else {
+        *info = avs_coap_msg_info_init();
+    }
 }
 
-static size_t
-get_options_size_bytes(const AVS_LIST(avs_coap_msg_info_opt_t) opts) {
+static size_t get_options_size_bytes(const avs_coap_msg_info_t *info) {
     size_t size = 0;
     uint16_t prev_opt_num = 0;
 
-    const avs_coap_msg_info_opt_t *opt;
-    AVS_LIST_FOREACH(opt, opts) {
+    for (const avs_coap_msg_info_opt_t *opt =
+                 _avs_coap_msg_info_opt_first(info);
+            opt;
+            opt = _avs_coap_msg_info_opt_next(info, opt)) {
         assert(opt->number >= prev_opt_num);
 
         uint16_t delta = (uint16_t)(opt->number - prev_opt_num);
@@ -54,7 +60,7 @@ size_t
 avs_coap_msg_info_get_headers_size(const avs_coap_msg_info_t *info) {
     return AVS_COAP_MAX_HEADER_SIZE
            + info->identity.token.size
-           + get_options_size_bytes(info->options_);
+           + get_options_size_bytes(info);
 }
 
 size_t
@@ -62,7 +68,7 @@ avs_coap_msg_info_get_storage_size(const avs_coap_msg_info_t *info) {
     return offsetof(avs_coap_msg_t, content)
            + AVS_COAP_MAX_HEADER_SIZE
            + AVS_COAP_MAX_TOKEN_LENGTH
-           + get_options_size_bytes(info->options_);
+           + get_options_size_bytes(info);
 }
 
 size_t
@@ -73,8 +79,33 @@ avs_coap_msg_info_get_packet_storage_size(const avs_coap_msg_info_t *info,
                            : 0);
 }
 
+static void arena_remove_by_number(avs_coap_msg_info_t *info,
+                                   uint16_t option_number) {
+    uint8_t *arena = (uint8_t *) info->arena_;
+    size_t offset = 0;
+    while (offset < info->arena_used_) {
+        const avs_coap_msg_info_opt_t *opt =
+                (const avs_coap_msg_info_opt_t *) (void *) (arena + offset);
+        const size_t opt_size = _avs_coap_msg_info_opt_arena_size(opt);
+        if (opt->number == option_number) {
+            memmove(arena + offset, arena + offset + opt_size,
+                    info->arena_used_ - offset - opt_size);
+            info->arena_used_ -= opt_size;
+        } else if (opt->number > option_number) {
+            return;
+        } else {
+            offset += opt_size;
+        }
+    }
+}
+
 void avs_coap_msg_info_opt_remove_by_number(avs_coap_msg_info_t *info,
                                             uint16_t option_number) {
+    if (info->arena_) {
+        arena_remove_by_number(info, option_number);
+        return;
+    }
+
     avs_coap_msg_info_opt_t **opt;
     avs_coap_msg_info_opt_t *helper;
     AVS_LIST_DELETABLE_FOREACH_PTR(opt, helper, &info->options_) {
@@ -147,10 +178,55 @@ int avs_coap_msg_info_opt_block(avs_coap_msg_info_t *info,
                          block->seq_num, block->has_more, block->size);
 }
 
+/**
+ * Inserts an option into the arena of @p info , after all options with number
+ * not greater than @p opt_number , shifting the following ones if necessary.
+ */
+static int arena_insert(avs_coap_msg_info_t *info,
+                        uint16_t opt_number,
+                        const void *opt_data,
+                        uint16_t opt_data_size) {
+    const size_t opt_size = AVS_COAP_MSG_INFO_ARENA_OPT_SIZE(opt_data_size);
+    if (info->arena_capacity_ - info->arena_used_ < opt_size) {
+        LOG(ERROR, "option arena full: %u/%u B used, %u B required",
+            (unsigned) info->arena_used_, (unsigned) info->arena_capacity_,
+            (unsigned) opt_size);
+        return -1;
+    }
+
+    // avs_coap_msg_info_opt_t is aligned as its uint16_t header fields
+    assert((uintptr_t) info->arena_ % AVS_ALIGNOF(uint16_t) == 0);
+    uint8_t *arena = (uint8_t *) info->arena_;
+    size_t offset = 0;
+    while (offset < info->arena_used_) {
+        const avs_coap_msg_info_opt_t *opt =
+                (const avs_coap_msg_info_opt_t *) (void *) (arena + offset);
+        if (opt->number > opt_number) {
+            break;
+        }
+        offset += _avs_coap_msg_info_opt_arena_size(opt);
+    }
+
+    memmove(arena + offset + opt_size, arena + offset,
+            info->arena_used_ - offset);
+    info->arena_used_ += opt_size;
+
+    avs_coap_msg_info_opt_t *opt =
+            (avs_coap_msg_info_opt_t *) (void *) (arena + offset);
+    opt->number = opt_number;
+    opt->data_size = opt_data_size;
+    memcpy(opt->data, opt_data, opt_data_size);
+    return 0;
+}
+
 int avs_coap_msg_info_opt_opaque(avs_coap_msg_info_t *info,
                                  uint16_t opt_number,
                                  const void *opt_data,
                                  uint16_t opt_data_size) {
+    if (info->arena_) {
+        return arena_insert(info, opt_number, opt_data, opt_data_size);
+    }
+
     avs_coap_msg_info_opt_t *opt = (avs_coap_msg_info_opt_t*)
             AVS_LIST_NEW_BUFFER(sizeof(*opt) + opt_data_size);
     if (!opt) {
@@ -18,6 +18,7 @@
 #define AVS_COAP_MSG_INTERNAL_H
 
 #include <avsystem/commons/coap/msg.h>
+#include <avsystem/commons/coap/msg_info.h>
 
 #include "parse_utils.h"
 
@@ -210,6 +211,45 @@ struct avs_coap_msg_info_opt {
     uint8_t data[];
 };
 
+AVS_STATIC_ASSERT(sizeof(avs_coap_msg_info_opt_t)
+                          == AVS_COAP_MSG_INFO_ARENA_OPT_SIZE(0),
+                  arena_opt_size_matches_avs_coap_msg_info_opt_t);
+
+static inline size_t
+_avs_coap_msg_info_opt_arena_size(const avs_coap_msg_info_opt_t *opt) {
+    return AVS_COAP_MSG_INFO_ARENA_OPT_SIZE(opt->data_size);
+}
+
+/**
+ * @returns First option stored in @p info , or NULL if there are none.
+ */
+static inline const avs_coap_msg_info_opt_t *
+_avs_coap_msg_info_opt_first(const avs_coap_msg_info_t *info) {
+    if (info->arena_) {
+        return info->arena_used_
+                ? (const avs_coap_msg_info_opt_t *) info->arena_
+                : NULL;
+    }
+    return info->options_;
+}
+
+/**
+ * @returns Option stored in @p info after @p opt , or NULL if @p opt is the
+ *          last one.
+ */
+static inline const avs_coap_msg_info_opt_t *
+_avs_coap_msg_info_opt_next(const avs_coap_msg_info_t *info,
+                            const avs_coap_msg_info_opt_t *opt) {
+    if (info->arena_) {
+        const uint8_t *next = (const uint8_t *) opt
+                              + _avs_coap_msg_info_opt_arena_size(opt);
+        return next < (const uint8_t *) info->arena_ + info->arena_used_
+                ? (const avs_coap_msg_info_opt_t *) (const void *) next
+                : NULL;
+    }
+    return AVS_LIST_NEXT(opt);
+}
+
 VISIBILITY_PRIVATE_HEADER_END
 
 #endif // AVS_COAP_MSG_INTERNAL_H
@@ -51,12 +51,93 @@ int avs_coap_msg_find_unique_opt(const avs_coap_msg_t *msg,
     return *out_opt ? 0 : -1;
 }
 
-int avs_coap_msg_get_option_uint(const avs_coap_msg_t *msg,
-                                 uint16_t option_number,
-                                 void *out_fmt,
-                                 size_t out_fmt_size) {
-    const avs_coap_opt_t *opt;
-    if (avs_coap_msg_find_unique_opt(msg, option_number, &opt)) {
+void avs_coap_msg_index_build(const avs_coap_msg_t *msg,
+                              avs_coap_msg_index_t *out_index) {
+    out_index->msg = msg;
+    out_index->num_options = 0;
+    out_index->truncated = false;
+
+    avs_coap_opt_iterator_t it = avs_coap_opt_begin(msg);
+    for (; !avs_coap_opt_end(&it); avs_coap_opt_next(&it)) {
+        if (out_index->num_options >= AVS_COAP_MSG_INDEX_MAX_OPTIONS) {
+            out_index->truncated = true;
+            break;
+        }
+
+        uint32_t opt_number = avs_coap_opt_number(&it);
+        assert(opt_number <= UINT16_MAX);
+
+        avs_coap_msg_index_entry_t *entry =
+                &out_index->options[out_index->num_options++];
+        entry->number = (uint16_t) opt_number;
+        entry->offset =
+                (uint32_t) ((const uint8_t *) it.curr_opt - msg->content);
+        entry->length = avs_coap_opt_content_length(it.curr_opt);
+    }
+
+    if (out_index->truncated) {
+        out_index->payload_offset = (uint32_t) (
+                (const uint8_t *) avs_coap_msg_payload(msg) - msg->content);
+    } else {
+        out_index->payload_offset =
+                (uint32_t) ((const uint8_t *) it.curr_opt - msg->content);
+        if (out_index->payload_offset < msg->length) {
+            // skip payload marker
+            ++out_index->payload_offset;
+        }
+    }
+}
+
+/**
+ * @returns Index of the first entry with option number not less than
+ *          @p opt_number , or <c>index->num_options</c> if there is none.
+ */
+static size_t index_lower_bound(const avs_coap_msg_index_t *index,
+                                uint16_t opt_number) {
+    size_t begin = 0;
+    size_t end = index->num_options;
+    while (begin < end) {
+        size_t mid = begin + (end - begin) / 2;
+        if (index->options[mid].number < opt_number) {
+            begin = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    return begin;
+}
+
+int avs_coap_msg_index_find_unique_opt(const avs_coap_msg_index_t *index,
+                                       uint16_t opt_number,
+                                       const avs_coap_opt_t **out_opt) {
+    if (index->truncated
+            && opt_number >= index->options[index->num_options - 1].number) {
+        return avs_coap_msg_find_unique_opt(index->msg, opt_number, out_opt);
+    }
+
+    *out_opt = NULL;
+
+    size_t i = index_lower_bound(index, opt_number);
+    if (i >= index->num_options || index->options[i].number != opt_number) {
+        return -1;
+    }
+
+    *out_opt = (const avs_coap_opt_t *) (index->msg->content
+                                         + index->options[i].offset);
+    if (i + 1 < index->num_options
+            && index->options[i + 1].number == opt_number) {
+        // multiple options with such opt_number
+        return -1;
+    }
+    return 0;
+}
+
+static int get_option_uint(int find_result,
+                           const avs_coap_opt_t *opt,
+                           uint16_t option_number,
+                           void *out_fmt,
+                           size_t out_fmt_size) {
+    if (find_result) {
         if (opt) {
             LOG(DEBUG, "multiple instances of option %d found",
                      option_number);
@@ -70,6 +151,25 @@ int avs_coap_msg_get_option_uint(const avs_coap_msg_t *msg,
     return avs_coap_opt_uint_value(opt, out_fmt, out_fmt_size);
 }
 
+int avs_coap_msg_get_option_uint(const avs_coap_msg_t *msg,
+                                 uint16_t option_number,
+                                 void *out_fmt,
+                                 size_t out_fmt_size) {
+    const avs_coap_opt_t *opt;
+    int result = avs_coap_msg_find_unique_opt(msg, option_number, &opt);
+    return get_option_uint(result, opt, option_number, out_fmt, out_fmt_size);
+}
+
+int avs_coap_msg_index_get_option_uint(const avs_coap_msg_index_t *index,
+                                       uint16_t option_number,
+                                       void *out_fmt,
+                                       size_t out_fmt_size) {
+    const avs_coap_opt_t *opt;
+    int result = avs_coap_msg_index_find_unique_opt(index, option_number,
+                                                    &opt);
+    return get_option_uint(result, opt, option_number, out_fmt, out_fmt_size);
+}
+
 int avs_coap_msg_get_option_string_it(const avs_coap_msg_t *msg,
                                       uint16_t option_number,
                                       avs_coap_opt_iterator_t *it,
@@ -94,11 +194,7 @@ int avs_coap_msg_get_option_string_it(const avs_coap_msg_t *msg,
     return AVS_COAP_OPTION_MISSING;
 }
 
-int avs_coap_msg_get_content_format(const avs_coap_msg_t *msg,
-                                    uint16_t *out_value) {
-    int result = avs_coap_msg_get_option_u16(
-            msg, AVS_COAP_OPT_CONTENT_FORMAT, out_value);
-
+static int content_format_from_result(int result, uint16_t *out_value) {
     if (result == AVS_COAP_OPTION_MISSING) {
         *out_value = AVS_COAP_FORMAT_NONE;
         return 0;
@@ -107,6 +203,22 @@ int avs_coap_msg_get_content_format(const avs_coap_msg_t *msg,
     return result;
 }
 
+int avs_coap_msg_get_content_format(const avs_coap_msg_t *msg,
+                                    uint16_t *out_value) {
+    return content_format_from_result(
+            avs_coap_msg_get_option_u16(msg, AVS_COAP_OPT_CONTENT_FORMAT,
+                                        out_value),
+            out_value);
+}
+
+int avs_coap_msg_index_get_content_format(const avs_coap_msg_index_t *index,
+                                          uint16_t *out_value) {
+    return content_format_from_result(
+            avs_coap_msg_index_get_option_u16(
+                    index, AVS_COAP_OPT_CONTENT_FORMAT, out_value),
+            out_value);
+}
+
 static bool is_opt_critical(uint32_t opt_number) {
     return opt_number % 2;
 }
@@ -149,3 +261,7 @@ int avs_coap_msg_validate_critical_options(
 
     return result;
 }
+
+#ifdef AVS_UNIT_TESTING
+#include "test/msg_opt.c"
+#endif // AVS_UNIT_TESTING
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <avs_commons_config.h>
+
+#include <avsystem/commons/memory.h>
+
+#include <avsystem/commons/coap/msg_opt.h>
+#include <avsystem/commons/coap/msg_template.h>
+#include <avsystem/commons/coap/opt.h>
+
+#include "coap_log.h"
+#include "msg_internal.h"
+
+#include <assert.h>
+#include <string.h>
+
+VISIBILITY_SOURCE_BEGIN
+
+#define MAX_OBSERVE_LENGTH 3
+#define NO_OBSERVE SIZE_MAX
+
+struct avs_coap_msg_template {
+    /* serialized header, with token length and message ID set to 0 */
+    coap_header_t header;
+    /* offset of the Observe option within body, or NO_OBSERVE */
+    size_t observe_offset;
+    /* first byte of the Observe option, with option length set to 0 */
+    uint8_t observe_opt_header;
+    size_t body_size;
+    /* options and payload, excluding the Observe option */
+    uint8_t body[1]; // actually a FAM
+};
+
+int avs_coap_msg_template_create(avs_coap_msg_template_t **out_template,
+                                 const avs_coap_msg_info_t *info,
+                                 const void *payload,
+                                 size_t payload_size) {
+    if (info->code == AVS_COAP_CODE_EMPTY) {
+        LOG(ERROR, "0.00 Empty message cannot be used as a template");
+        return -1;
+    }
+
+    avs_coap_msg_info_t shared = *info;
+    shared.identity = (avs_coap_msg_identity_t) { 0 };
+
+    const size_t storage_size =
+            avs_coap_msg_info_get_packet_storage_size(&shared, payload_size);
+    avs_coap_msg_t *msg = (avs_coap_msg_t *) avs_malloc(storage_size);
+    if (!msg) {
+        LOG(ERROR, "out of memory");
+        return -1;
+    }
+
+    int result = -1;
+    avs_coap_msg_builder_t builder;
+    if (avs_coap_msg_builder_init(&builder,
+                                  avs_coap_ensure_aligned_buffer(msg),
+                                  storage_size, &shared)
+            || avs_coap_msg_builder_payload(&builder, payload, payload_size)
+                           != payload_size) {
+        LOG(ERROR, "could not serialize message template");
+        goto finish;
+    }
+
+    const uint8_t *body = _avs_coap_header_end_const(msg);
+    size_t body_size = msg->length - _avs_coap_header_size(msg);
+
+    const avs_coap_opt_t *observe;
+    const uint8_t *observe_ptr = NULL;
+    size_t observe_size = 0;
+    if (!avs_coap_msg_find_unique_opt(msg, AVS_COAP_OPT_OBSERVE, &observe)) {
+        observe_ptr = (const uint8_t *) observe;
+        observe_size = avs_coap_opt_sizeof(observe);
+        // options preceding Observe all have numbers lower than 6
+        assert(_avs_coap_opt_get_short_delta(observe) < AVS_COAP_EXT_U8);
+    } else if (observe) {
+        LOG(ERROR, "multiple Observe options in message template");
+        goto finish;
+    }
+
+    avs_coap_msg_template_t *tpl = (avs_coap_msg_template_t *) avs_malloc(
+            offsetof(avs_coap_msg_template_t, body) + body_size);
+    if (!tpl) {
+        LOG(ERROR, "out of memory");
+        goto finish;
+    }
+
+    memcpy(&tpl->header, msg->content, sizeof(tpl->header));
+    tpl->body_size = body_size - observe_size;
+    if (observe_ptr) {
+        tpl->observe_offset = (size_t) (observe_ptr - body);
+        tpl->observe_opt_header =
+                (uint8_t) (*observe_ptr & ~AVS_COAP_OPT_LENGTH_MASK);
+        memcpy(tpl->body, body, tpl->observe_offset);
+        memcpy(tpl->body + tpl->observe_offset,
+               observe_ptr + observe_size,
+               tpl->body_size - tpl->observe_offset);
+    } else {
+        tpl->observe_offset = NO_OBSERVE;
+        tpl->observe_opt_header = 0;
+        memcpy(tpl->body, body, body_size);
+    }
+
+    *out_template = tpl;
+    result = 0;
+finish:
+    avs_free(msg);
+    return result;
+}
+
+void avs_coap_msg_template_cleanup(avs_coap_msg_template_t **template_ptr) {
+    if (template_ptr) {
+        avs_free(*template_ptr);
+        *template_ptr = NULL;
+    }
+}
+
+size_t avs_coap_msg_template_storage_size(const avs_coap_msg_template_t *tpl) {
+    return offsetof(avs_coap_msg_t, content) + sizeof(tpl->header)
+           + AVS_COAP_MAX_TOKEN_LENGTH + tpl->body_size
+           + (tpl->observe_offset == NO_OBSERVE ? 0 : 1 + MAX_OBSERVE_LENGTH);
+}
+
+static size_t encode_observe(uint8_t *out, uint32_t observe) {
+    // minimal big-endian representation, as recommended by RFC 7252, 3.2
+    size_t length = 0;
+    for (uint32_t value = observe; value && length < MAX_OBSERVE_LENGTH;
+            value >>= 8) {
+        ++length;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        out[i] = (uint8_t) (observe >> (8 * (length - 1 - i)));
+    }
+    return length;
+}
+
+const avs_coap_msg_t *
+avs_coap_msg_template_fill(const avs_coap_msg_template_t *tpl,
+                           const avs_coap_msg_identity_t *identity,
+                           uint32_t observe,
+                           avs_coap_aligned_msg_buffer_t *buffer,
+                           size_t buffer_size) {
+    assert(identity->token.size <= AVS_COAP_MAX_TOKEN_LENGTH);
+
+    avs_coap_msg_t *msg = (avs_coap_msg_t *) buffer;
+    uint8_t observe_value[MAX_OBSERVE_LENGTH];
+    size_t observe_length = 0;
+    size_t msg_length = sizeof(tpl->header) + identity->token.size
+                        + tpl->body_size;
+    if (tpl->observe_offset != NO_OBSERVE) {
+        observe_length = encode_observe(observe_value, observe & 0xFFFFFF);
+        msg_length += 1 + observe_length;
+    }
+    if (offsetof(avs_coap_msg_t, content) + msg_length > buffer_size) {
+        LOG(ERROR, "message buffer too small: %u/%u B available",
+            (unsigned) buffer_size,
+            (unsigned) (offsetof(avs_coap_msg_t, content) + msg_length));
+        return NULL;
+    }
+
+    msg->length = (uint32_t) msg_length;
+    memcpy(msg->content, &tpl->header, sizeof(tpl->header));
+    _avs_coap_header_set_token_length(msg, identity->token.size);
+    _avs_coap_header_set_id(msg, identity->msg_id);
+
+    uint8_t *ptr = _avs_coap_header_end(msg);
+    memcpy(ptr, identity->token.bytes, identity->token.size);
+    ptr += identity->token.size;
+
+    if (tpl->observe_offset == NO_OBSERVE) {
+        memcpy(ptr, tpl->body, tpl->body_size);
+        return msg;
+    }
+
+    memcpy(ptr, tpl->body, tpl->observe_offset);
+    ptr += tpl->observe_offset;
+    *ptr++ = (uint8_t) (tpl->observe_opt_header | observe_length);
+    memcpy(ptr, observe_value, observe_length);
+    ptr += observe_length;
+    memcpy(ptr, tpl->body + tpl->observe_offset,
+           tpl->body_size - tpl->observe_offset);
+    return msg;
+}
+
+#ifdef AVS_UNIT_TESTING
+#include "test/msg_template.c"
+#endif // AVS_UNIT_TESTING
@@ -0,0 +1,470 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <avs_commons_config.h>
+
+#include <avsystem/commons/memory.h>
+#include <avsystem/commons/utils.h>
+
+#include <avsystem/commons/coap/retx_scheduler.h>
+#include <avsystem/commons/coap/tx_params.h>
+
+#include "coap_log.h"
+
+#include <assert.h>
+#include <string.h>
+
+VISIBILITY_SOURCE_BEGIN
+
+/*
+ * Hierarchical timer wheel: level 0 has one slot per tick, each slot at level
+ * N covers all slots of level N-1. Entries are placed at the lowest level whose
+ * range covers their deadline, and are moved ("cascaded") one level down
+ * whenever the lower level wraps around.
+ */
+#define WHEEL_LEVELS 4
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_MAX_DELTA (((uint64_t) 1 << (WHEEL_LEVELS * WHEEL_BITS)) - 1)
+
+#define INITIAL_NUM_BUCKETS 16
+
+typedef struct retx_entry {
+    /* wheel slot list */
+    struct retx_entry *next;
+    struct retx_entry **prev_next;
+    size_t level;
+
+    /* (socket, msg_id) hash chain */
+    struct retx_entry *next_in_bucket;
+
+    uint64_t expires_tick;
+    avs_time_monotonic_t deadline;
+    avs_coap_retry_state_t retry_state;
+    avs_coap_tx_params_t tx_params;
+
+    avs_coap_ctx_t *ctx;
+    avs_net_abstract_socket_t *socket;
+    uint16_t msg_id;
+
+    /* must be the last member, message content is allocated past it */
+    avs_coap_msg_t msg;
+} retx_entry_t;
+
+struct avs_coap_retx_scheduler {
+    avs_coap_retx_timeout_handler_t *on_timeout;
+    void *on_timeout_arg;
+    unsigned rand_seed;
+
+    avs_time_monotonic_t epoch;
+    int64_t tick_ns;
+    /* next tick to be processed */
+    uint64_t current_tick;
+    retx_entry_t *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+    size_t level_size[WHEEL_LEVELS];
+
+    retx_entry_t **buckets;
+    size_t num_buckets;
+    size_t size;
+};
+
+static size_t bucket_index(const avs_coap_retx_scheduler_t *scheduler,
+                           const avs_net_abstract_socket_t *socket,
+                           uint16_t msg_id) {
+    uint32_t hash = (uint32_t) ((uintptr_t) socket >> 4) * 2654435761u;
+    hash ^= msg_id * 40503u;
+    return (size_t) hash & (scheduler->num_buckets - 1);
+}
+
+static retx_entry_t **find_entry_ptr(avs_coap_retx_scheduler_t *scheduler,
+                                     const avs_net_abstract_socket_t *socket,
+                                     uint16_t msg_id) {
+    retx_entry_t **entry_ptr =
+            &scheduler->buckets[bucket_index(scheduler, socket, msg_id)];
+    while (*entry_ptr && ((*entry_ptr)->socket != socket
+                          || (*entry_ptr)->msg_id != msg_id)) {
+        entry_ptr = &(*entry_ptr)->next_in_bucket;
+    }
+    return entry_ptr;
+}
+
+static int grow_buckets(avs_coap_retx_scheduler_t *scheduler) {
+    retx_entry_t **old_buckets = scheduler->buckets;
+    size_t old_num_buckets = scheduler->num_buckets;
+
+    scheduler->buckets = (retx_entry_t **) avs_calloc(old_num_buckets * 2,
+                                                      sizeof(retx_entry_t *));
+    if (!scheduler->buckets) {
+        scheduler->buckets = old_buckets;
+        return -1;
+    }
+    scheduler->num_buckets = old_num_buckets * 2;
+
+    for (size_t i = 0; i < old_num_buckets; ++i) {
+        while (old_buckets[i]) {
+            retx_entry_t *entry = old_buckets[i];
+            old_buckets[i] = entry->next_in_bucket;
+
+            retx_entry_t **bucket = &scheduler->buckets[bucket_index(
+                    scheduler, entry->socket, entry->msg_id)];
+            entry->next_in_bucket = *bucket;
+            *bucket = entry;
+        }
+    }
+    avs_free(old_buckets);
+    return 0;
+}
+
+static uint64_t tick_at(const avs_coap_retx_scheduler_t *scheduler,
+                        avs_time_monotonic_t time,
+                        bool round_up) {
+    int64_t ns;
+    if (avs_time_duration_to_scalar(
+                &ns, AVS_TIME_NS,
+                avs_time_monotonic_diff(time, scheduler->epoch))
+            || ns <= 0) {
+        return 0;
+    }
+    if (round_up) {
+        ns += scheduler->tick_ns - 1;
+    }
+    return (uint64_t) (ns / scheduler->tick_ns);
+}
+
+static avs_time_monotonic_t time_of_tick(const avs_coap_retx_scheduler_t *scheduler,
+                                         uint64_t tick) {
+    return avs_time_monotonic_add(
+            scheduler->epoch,
+            avs_time_duration_from_scalar((int64_t) tick * scheduler->tick_ns,
+                                          AVS_TIME_NS));
+}
+
+static void wheel_link(retx_entry_t **slot, retx_entry_t *entry) {
+    entry->next = *slot;
+    entry->prev_next = slot;
+    if (*slot) {
+        (*slot)->prev_next = &entry->next;
+    }
+    *slot = entry;
+}
+
+static void wheel_unlink(avs_coap_retx_scheduler_t *scheduler,
+                         retx_entry_t *entry) {
+    *entry->prev_next = entry->next;
+    if (entry->next) {
+        entry->next->prev_next = entry->prev_next;
+    }
+    entry->next = NULL;
+    entry->prev_next = NULL;
+    --scheduler->level_size[entry->level];
+}
+
+static void wheel_insert(avs_coap_retx_scheduler_t *scheduler,
+                         retx_entry_t *entry) {
+    uint64_t expires = entry->expires_tick;
+    size_t level = 0;
+    size_t slot;
+
+    if (expires < scheduler->current_tick) {
+        // already overdue; fire at the next processed tick
+        slot = (size_t) (scheduler->current_tick & WHEEL_MASK);
+    } else {
+        uint64_t delta = expires - scheduler->current_tick;
+        if (delta > WHEEL_MAX_DELTA) {
+            // beyond wheel range; it will be reinserted when cascaded
+            expires = scheduler->current_tick + WHEEL_MAX_DELTA;
+            delta = WHEEL_MAX_DELTA;
+        }
+        while (delta >> ((level + 1) * WHEEL_BITS)) {
+            ++level;
+        }
+        slot = (size_t) ((expires >> (level * WHEEL_BITS)) & WHEEL_MASK);
+    }
+
+    entry->level = level;
+    ++scheduler->level_size[level];
+    wheel_link(&scheduler->wheel[level][slot], entry);
+}
+
+/**
+ * Moves all entries from given slot of @p level one level down.
+ *
+ * @returns Index of the cascaded slot.
+ */
+static size_t cascade(avs_coap_retx_scheduler_t *scheduler, size_t level) {
+    size_t slot = (size_t) ((scheduler->current_tick >> (level * WHEEL_BITS))
+                            & WHEEL_MASK);
+    retx_entry_t *entry = scheduler->wheel[level][slot];
+    scheduler->wheel[level][slot] = NULL;
+    while (entry) {
+        retx_entry_t *next = entry->next;
+        --scheduler->level_size[level];
+        wheel_insert(scheduler, entry);
+        entry = next;
+    }
+    return slot;
+}
+
+static void schedule(avs_coap_retx_scheduler_t *scheduler,
+                     retx_entry_t *entry) {
+    avs_coap_update_retry_state(&entry->retry_state, &entry->tx_params,
+                                &scheduler->rand_seed);
+    entry->deadline = avs_time_monotonic_add(entry->deadline,
+                                             entry->retry_state.recv_timeout);
+    entry->expires_tick = tick_at(scheduler, entry->deadline, true);
+    wheel_insert(scheduler, entry);
+}
+
+static void remove_entry(avs_coap_retx_scheduler_t *scheduler,
+                         retx_entry_t **entry_ptr) {
+    retx_entry_t *entry = *entry_ptr;
+    *entry_ptr = entry->next_in_bucket;
+    if (entry->prev_next) {
+        wheel_unlink(scheduler, entry);
+    }
+    --scheduler->size;
+}
+
+int avs_coap_retx_scheduler_create(avs_coap_retx_scheduler_t **out_scheduler,
+                                   avs_time_duration_t tick,
+                                   avs_coap_retx_timeout_handler_t *on_timeout,
+                                   void *on_timeout_arg) {
+    int64_t tick_ns;
+    if (avs_time_duration_to_scalar(&tick_ns, AVS_TIME_NS, tick)
+            || tick_ns <= 0) {
+        LOG(ERROR, "invalid scheduler tick");
+        return -1;
+    }
+
+    avs_coap_retx_scheduler_t *scheduler = (avs_coap_retx_scheduler_t *)
+            avs_calloc(1, sizeof(avs_coap_retx_scheduler_t));
+    if (!scheduler) {
+        LOG(ERROR, "out of memory");
+        return -1;
+    }
+    scheduler->buckets = (retx_entry_t **) avs_calloc(INITIAL_NUM_BUCKETS,
+                                                      sizeof(retx_entry_t *));
+    if (!scheduler->buckets) {
+        LOG(ERROR, "out of memory");
+        avs_free(scheduler);
+        return -1;
+    }
+
+    scheduler->num_buckets = INITIAL_NUM_BUCKETS;
+    scheduler->on_timeout = on_timeout;
+    scheduler->on_timeout_arg = on_timeout_arg;
+    scheduler->rand_seed =
+            (unsigned) avs_time_real_now().since_real_epoch.nanoseconds;
+    scheduler->epoch = avs_time_monotonic_now();
+    scheduler->tick_ns = tick_ns;
+
+    *out_scheduler = scheduler;
+    return 0;
+}
+
+void avs_coap_retx_scheduler_cleanup(avs_coap_retx_scheduler_t **scheduler) {
+    if (!scheduler || !*scheduler) {
+        return;
+    }
+
+    for (size_t i = 0; i < (*scheduler)->num_buckets; ++i) {
+        while ((*scheduler)->buckets[i]) {
+            retx_entry_t *entry = (*scheduler)->buckets[i];
+            (*scheduler)->buckets[i] = entry->next_in_bucket;
+            avs_free(entry);
+        }
+    }
+    avs_free((*scheduler)->buckets);
+    avs_free(*scheduler);
+    *scheduler = NULL;
+}
+
+static int send_at(avs_coap_retx_scheduler_t *scheduler,
+                   avs_coap_ctx_t *ctx,
+                   avs_net_abstract_socket_t *socket,
+                   const avs_coap_msg_t *msg,
+                   avs_time_monotonic_t now) {
+    if (!avs_coap_msg_is_valid(msg)
+            || avs_coap_msg_get_type(msg) != AVS_COAP_MSG_CONFIRMABLE) {
+        return avs_coap_ctx_send(ctx, socket, msg);
+    }
+
+    const uint16_t msg_id = avs_coap_msg_get_id(msg);
+    if (*find_entry_ptr(scheduler, socket, msg_id)) {
+        LOG(ERROR, "message ID %u is already outstanding", msg_id);
+        return -1;
+    }
+    if (scheduler->size >= scheduler->num_buckets && grow_buckets(scheduler)) {
+        LOG(ERROR, "out of memory");
+        return -1;
+    }
+
+    retx_entry_t *entry = (retx_entry_t *) avs_calloc(
+            1, offsetof(retx_entry_t, msg) + offsetof(avs_coap_msg_t, content)
+                       + msg->length);
+    if (!entry) {
+        LOG(ERROR, "out of memory");
+        return -1;
+    }
+
+    int result = avs_coap_ctx_send(ctx, socket, msg);
+    if (result) {
+        avs_free(entry);
+        return result;
+    }
+
+    entry->ctx = ctx;
+    entry->socket = socket;
+    entry->msg_id = msg_id;
+    entry->tx_params = avs_coap_ctx_get_tx_params(ctx);
+    entry->deadline = now;
+    memcpy(&entry->msg, msg, offsetof(avs_coap_msg_t, content) + msg->length);
+
+    retx_entry_t **bucket =
+            &scheduler->buckets[bucket_index(scheduler, socket, msg_id)];
+    entry->next_in_bucket = *bucket;
+    *bucket = entry;
+    ++scheduler->size;
+
+    schedule(scheduler, entry);
+    return 0;
+}
+
+int avs_coap_retx_scheduler_send(avs_coap_retx_scheduler_t *scheduler,
+                                 avs_coap_ctx_t *ctx,
+                                 avs_net_abstract_socket_t *socket,
+                                 const avs_coap_msg_t *msg) {
+    return send_at(scheduler, ctx, socket, msg, avs_time_monotonic_now());
+}
+
+int avs_coap_retx_scheduler_cancel(avs_coap_retx_scheduler_t *scheduler,
+                                   avs_net_abstract_socket_t *socket,
+                                   uint16_t msg_id) {
+    retx_entry_t **entry_ptr = find_entry_ptr(scheduler, socket, msg_id);
+    if (!*entry_ptr) {
+        return -1;
+    }
+
+    retx_entry_t *entry = *entry_ptr;
+    remove_entry(scheduler, entry_ptr);
+    avs_free(entry);
+    return 0;
+}
+
+size_t
+avs_coap_retx_scheduler_size(const avs_coap_retx_scheduler_t *scheduler) {
+    return scheduler->size;
+}
+
+avs_time_monotonic_t avs_coap_retx_scheduler_next_deadline(
+        const avs_coap_retx_scheduler_t *scheduler) {
+    if (!scheduler->size) {
+        return AVS_TIME_MONOTONIC_INVALID;
+    }
+
+    // level 0 only holds entries expiring within WHEEL_SLOTS ticks
+    uint64_t next_tick = UINT64_MAX;
+    if (scheduler->level_size[0]) {
+        for (uint64_t tick = scheduler->current_tick;
+                tick < scheduler->current_tick + WHEEL_SLOTS;
+                ++tick) {
+            const retx_entry_t *entry =
+                    scheduler->wheel[0][tick & WHEEL_MASK];
+            if (entry) {
+                next_tick = tick;
+                break;
+            }
+        }
+    }
+
+    // entries on higher levels cannot expire before the next cascade
+    if (scheduler->size > scheduler->level_size[0]) {
+        uint64_t next_cascade =
+                (scheduler->current_tick + WHEEL_MASK) & ~(uint64_t) WHEEL_MASK;
+        next_tick = AVS_MIN(next_tick, next_cascade);
+    }
+
+    assert(next_tick != UINT64_MAX);
+    return time_of_tick(scheduler, next_tick);
+}
+
+static void handle_expired(avs_coap_retx_scheduler_t *scheduler,
+                           retx_entry_t *entry) {
+    if (entry->retry_state.retry_count > entry->tx_params.max_retransmit) {
+        LOG(DEBUG, "message ID %u timed out", entry->msg_id);
+        remove_entry(scheduler, find_entry_ptr(scheduler, entry->socket,
+                                               entry->msg_id));
+        if (scheduler->on_timeout) {
+            scheduler->on_timeout(scheduler->on_timeout_arg, entry->ctx,
+                                  entry->socket, &entry->msg);
+        }
+        avs_free(entry);
+        return;
+    }
+
+    LOG(TRACE, "retransmitting message ID %u (attempt %u)", entry->msg_id,
+        entry->retry_state.retry_count);
+    if (avs_coap_ctx_send(entry->ctx, entry->socket, &entry->msg)) {
+        LOG(WARNING, "could not retransmit message ID %u", entry->msg_id);
+    }
+    schedule(scheduler, entry);
+}
+
+static void fire_expired_at(avs_coap_retx_scheduler_t *scheduler,
+                            avs_time_monotonic_t now) {
+    const uint64_t now_tick = tick_at(scheduler, now, false);
+
+    while (scheduler->size && scheduler->current_tick <= now_tick) {
+        size_t slot = (size_t) (scheduler->current_tick & WHEEL_MASK);
+        if (!slot) {
+            for (size_t level = 1;
+                    level < WHEEL_LEVELS && !cascade(scheduler, level);
+                    ++level) {
+            }
+        }
+
+        // detach the slot, so that rescheduled entries do not end up in it;
+        // the list is kept valid for cancellations from the timeout handler
+        retx_entry_t *expired = NULL;
+        retx_entry_t *entry = scheduler->wheel[0][slot];
+        scheduler->wheel[0][slot] = NULL;
+        if (entry) {
+            expired = entry;
+            entry->prev_next = &expired;
+        }
+        ++scheduler->current_tick;
+
+        while (expired) {
+            entry = expired;
+            wheel_unlink(scheduler, entry);
+            handle_expired(scheduler, entry);
+        }
+    }
+
+    if (!scheduler->size) {
+        // nothing to process; jump straight to the present
+        scheduler->current_tick = AVS_MAX(scheduler->current_tick, now_tick + 1);
+    }
+}
+
+void avs_coap_retx_scheduler_fire_expired(avs_coap_retx_scheduler_t *scheduler) {
+    fire_expired_at(scheduler, avs_time_monotonic_now());
+}
+
+#ifdef AVS_UNIT_TESTING
+#include "test/retx_scheduler.c"
+#endif // AVS_UNIT_TESTING
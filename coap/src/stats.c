@@ -0,0 +1,533 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <avs_commons_config.h>
+
+#include <avsystem/commons/list.h>
+#include <avsystem/commons/memory.h>
+#include <avsystem/commons/time.h>
+#include <avsystem/commons/utils.h>
+
+#include <avsystem/commons/coap/msg_identity.h>
+
+#ifdef WITH_AVS_COMPAT_THREADING
+#include <avsystem/commons/mutex.h>
+#endif // WITH_AVS_COMPAT_THREADING
+
+#include "coap_log.h"
+#include "stats.h"
+
+#include <assert.h>
+#include <string.h>
+
+VISIBILITY_SOURCE_BEGIN
+
+typedef struct {
+    avs_coap_endpoint_stats_t stats;
+    // for detecting retransmissions of outgoing requests
+    avs_coap_msg_identity_t last_tx_request;
+    bool has_tx_request;
+} endpoint_entry_t;
+
+typedef enum {
+    PENDING_NONE = 0,
+    // sent by us, waiting for a response from the peer
+    PENDING_OUTGOING,
+    // received from the peer, waiting for our response
+    PENDING_INCOMING
+} pending_direction_t;
+
+typedef struct {
+    pending_direction_t direction;
+    avs_coap_msg_identity_t identity;
+    avs_net_resolved_endpoint_t endpoint;
+    avs_time_monotonic_t timestamp;
+} pending_request_t;
+
+/* Slot of the endpoint hash index. */
+typedef struct {
+    uint32_t hash; // 0 indicates an empty slot
+    endpoint_entry_t *entry;
+} index_slot_t;
+
+struct coap_stats {
+    // sharded collectors only: independent collectors, each guarded by its
+    // own lock; all other fields are unused if shards is not NULL
+    coap_stats_t **shards;
+#ifdef WITH_AVS_COMPAT_THREADING
+    avs_mutex_t **shard_locks;
+#endif // WITH_AVS_COMPAT_THREADING
+    size_t num_shards;
+
+    size_t max_endpoints;
+    size_t num_endpoints;
+    AVS_LIST(endpoint_entry_t) endpoints;
+    // open addressing (linear probing) index of endpoints; entries are never
+    // removed, and index_size is a power of two at least twice as large as
+    // max_endpoints, or 0 if max_endpoints is 0
+    index_slot_t *index;
+    size_t index_size;
+
+    avs_coap_traffic_stats_t total;
+    uint64_t rx_by_code[256];
+    uint64_t tx_by_code[256];
+    avs_coap_latency_histogram_t outgoing_request_latency;
+    avs_coap_latency_histogram_t incoming_request_latency;
+
+    // ring buffer; next_pending is the slot to be overwritten next
+    pending_request_t *pending;
+    size_t max_pending;
+    size_t next_pending;
+    // requests forgotten before being responded to, because of the ring
+    // buffer being full
+    uint64_t dropped_latency_samples;
+};
+
+static const avs_net_resolved_endpoint_t UNKNOWN_ENDPOINT = { 0 };
+
+static bool endpoint_equal(const avs_net_resolved_endpoint_t *a,
+                           const avs_net_resolved_endpoint_t *b) {
+    return a->size == b->size && !memcmp(a->data.buf, b->data.buf, a->size);
+}
+
+static uint32_t endpoint_hash(const avs_net_resolved_endpoint_t *ep) {
+    uint32_t hash =
+            avs_hash_fnv1a32(AVS_HASH_FNV1A32_INIT, ep->data.buf, ep->size);
+    // 0 is reserved for empty index slots
+    return hash ? hash : 1;
+}
+
+#ifdef WITH_AVS_COMPAT_THREADING
+/**
+ * Locks shard @p shard of @p stats and returns it, or returns NULL if locking
+ * failed.
+ */
+static coap_stats_t *lock_shard(const coap_stats_t *stats, size_t shard) {
+    if (avs_mutex_lock(stats->shard_locks[shard])) {
+        LOG(ERROR, "could not lock statistics shard %lu",
+            (unsigned long) shard);
+        return NULL;
+    }
+    return stats->shards[shard];
+}
+
+static void unlock_shard(const coap_stats_t *stats, size_t shard) {
+    avs_mutex_unlock(stats->shard_locks[shard]);
+}
+#else // WITH_AVS_COMPAT_THREADING
+// sharded collectors cannot be created without threading support
+#define lock_shard(...) \
+    (AVS_UNREACHABLE("sharded stats"), (coap_stats_t *) NULL)
+#define unlock_shard(...) ((void) 0)
+#endif // WITH_AVS_COMPAT_THREADING
+
+/**
+ * @return Index of the shard of @p stats responsible for @p remote_ep , or the
+ *         first one if @p remote_ep is NULL.
+ */
+static size_t shard_for(const coap_stats_t *stats,
+                        const avs_net_resolved_endpoint_t *remote_ep) {
+    return remote_ep ? endpoint_hash(remote_ep) % stats->num_shards : 0;
+}
+
+coap_stats_t *_avs_coap_stats_create(size_t max_endpoints,
+                                     size_t max_pending_requests) {
+    assert(max_pending_requests > 0);
+    coap_stats_t *stats = (coap_stats_t *) avs_calloc(1, sizeof(coap_stats_t));
+    if (!stats) {
+        LOG(ERROR, "out of memory");
+        return NULL;
+    }
+    stats->max_endpoints = max_endpoints;
+    stats->max_pending = max_pending_requests;
+    if (max_endpoints) {
+        stats->index_size = 1;
+        while (stats->index_size < 2 * max_endpoints) {
+            stats->index_size *= 2;
+        }
+        stats->index = (index_slot_t *) avs_calloc(stats->index_size,
+                                                   sizeof(index_slot_t));
+    }
+    stats->pending = (pending_request_t *) avs_calloc(max_pending_requests,
+                                                      sizeof(pending_request_t));
+    if ((max_endpoints && !stats->index) || !stats->pending) {
+        LOG(ERROR, "out of memory");
+        _avs_coap_stats_release(&stats);
+    }
+    return stats;
+}
+
+coap_stats_t *_avs_coap_stats_create_sharded(size_t max_endpoints,
+                                             size_t max_pending_requests,
+                                             size_t num_shards) {
+#ifdef WITH_AVS_COMPAT_THREADING
+    assert(max_pending_requests > 0);
+    assert(num_shards > 0);
+    coap_stats_t *stats = (coap_stats_t *) avs_calloc(1, sizeof(coap_stats_t));
+    if (!stats) {
+        LOG(ERROR, "out of memory");
+        return NULL;
+    }
+    stats->shards = (coap_stats_t **)
+            avs_calloc(num_shards, sizeof(*stats->shards));
+    stats->shard_locks = (avs_mutex_t **)
+            avs_calloc(num_shards, sizeof(*stats->shard_locks));
+    if (!stats->shards || !stats->shard_locks) {
+        goto error;
+    }
+
+    // limits are split evenly, rounding up, so that no shard is left without
+    // room for pending requests
+    for (; stats->num_shards < num_shards; ++stats->num_shards) {
+        const size_t i = stats->num_shards;
+        stats->shards[i] = _avs_coap_stats_create(
+                (max_endpoints + num_shards - 1) / num_shards,
+                (max_pending_requests + num_shards - 1) / num_shards);
+        if (!stats->shards[i]) {
+            goto error;
+        }
+        if (avs_mutex_create(&stats->shard_locks[i])) {
+            _avs_coap_stats_release(&stats->shards[i]);
+            goto error;
+        }
+    }
+    return stats;
+
+error:
+    LOG(ERROR, "could not create %lu statistics shards",
+        (unsigned long) num_shards);
+    _avs_coap_stats_release(&stats);
+    return NULL;
+#else // WITH_AVS_COMPAT_THREADING
+    (void) max_endpoints;
+    (void) max_pending_requests;
+    (void) num_shards;
+    LOG(ERROR, "sharded statistics require threading support");
+    return NULL;
+#endif // WITH_AVS_COMPAT_THREADING
+}
+
+void _avs_coap_stats_release(coap_stats_t **stats_ptr) {
+    if (!stats_ptr || !*stats_ptr) {
+        return;
+    }
+
+#ifdef WITH_AVS_COMPAT_THREADING
+    for (size_t i = 0; i < (*stats_ptr)->num_shards; ++i) {
+        _avs_coap_stats_release(&(*stats_ptr)->shards[i]);
+        avs_mutex_cleanup(&(*stats_ptr)->shard_locks[i]);
+    }
+    avs_free((*stats_ptr)->shard_locks);
+#endif // WITH_AVS_COMPAT_THREADING
+    avs_free((*stats_ptr)->shards);
+    AVS_LIST_CLEAR(&(*stats_ptr)->endpoints);
+    avs_free((*stats_ptr)->index);
+    avs_free((*stats_ptr)->pending);
+    avs_free(*stats_ptr);
+    *stats_ptr = NULL;
+}
+
+/**
+ * Finds the entry for @p remote_ep , creating it if the limit of tracked
+ * endpoints allows it.
+ *
+ * @return Found or created entry, or NULL if @p remote_ep is not tracked.
+ */
+static endpoint_entry_t *
+find_or_add_endpoint(coap_stats_t *stats,
+                     const avs_net_resolved_endpoint_t *remote_ep) {
+    if (!remote_ep || !stats->index_size) {
+        return NULL;
+    }
+
+    const uint32_t hash = endpoint_hash(remote_ep);
+    const size_t mask = stats->index_size - 1;
+    size_t i;
+    for (i = hash & mask; stats->index[i].hash; i = (i + 1) & mask) {
+        if (stats->index[i].hash == hash
+                && endpoint_equal(&stats->index[i].entry->stats.endpoint,
+                                  remote_ep)) {
+            return stats->index[i].entry;
+        }
+    }
+
+    if (stats->num_endpoints >= stats->max_endpoints) {
+        return NULL;
+    }
+
+    AVS_LIST(endpoint_entry_t) entry = AVS_LIST_NEW_ELEMENT(endpoint_entry_t);
+    if (!entry) {
+        LOG(DEBUG, "out of memory");
+        return NULL;
+    }
+    entry->stats.endpoint = *remote_ep;
+    AVS_LIST_INSERT(&stats->endpoints, entry);
+    ++stats->num_endpoints;
+    // the load factor never exceeds 1/2, so i is still a free slot
+    stats->index[i].hash = hash;
+    stats->index[i].entry = entry;
+    return entry;
+}
+
+static void add_pending(coap_stats_t *stats,
+                        pending_direction_t direction,
+                        const avs_net_resolved_endpoint_t *remote_ep,
+                        const avs_coap_msg_t *msg) {
+    pending_request_t *pending = &stats->pending[stats->next_pending];
+    stats->next_pending = (stats->next_pending + 1) % stats->max_pending;
+    if (pending->direction != PENDING_NONE) {
+        LOG(TRACE, "too many pending requests, dropping latency sample");
+        ++stats->dropped_latency_samples;
+    }
+
+    pending->direction = direction;
+    pending->identity = avs_coap_msg_get_identity(msg);
+    pending->endpoint = remote_ep ? *remote_ep : UNKNOWN_ENDPOINT;
+    pending->timestamp = avs_time_monotonic_now();
+}
+
+static void record_latency(avs_coap_latency_histogram_t *histogram,
+                           avs_time_duration_t latency) {
+    int64_t ms;
+    size_t bucket = AVS_COAP_STATS_LATENCY_BUCKETS - 1;
+    if (!avs_time_duration_to_scalar(&ms, AVS_TIME_MS, latency)) {
+        if (ms < 1) {
+            bucket = 0;
+        } else {
+            bucket = 1;
+            while (bucket < AVS_COAP_STATS_LATENCY_BUCKETS - 1
+                    && ms >= ((int64_t) 1 << bucket)) {
+                ++bucket;
+            }
+        }
+    }
+    ++histogram->buckets[bucket];
+}
+
+/**
+ * Matches a response against requests awaiting it. Piggybacked responses
+ * (ACK) carry the message ID of the request, separate ones only share the
+ * token.
+ */
+static void match_pending(coap_stats_t *stats,
+                          pending_direction_t direction,
+                          const avs_net_resolved_endpoint_t *remote_ep,
+                          const avs_coap_msg_t *msg,
+                          avs_coap_latency_histogram_t *histogram) {
+    if (!remote_ep) {
+        remote_ep = &UNKNOWN_ENDPOINT;
+    }
+    const avs_coap_msg_identity_t identity = avs_coap_msg_get_identity(msg);
+    const bool piggybacked =
+            avs_coap_msg_get_type(msg) == AVS_COAP_MSG_ACKNOWLEDGEMENT;
+
+    for (size_t i = 0; i < stats->max_pending; ++i) {
+        pending_request_t *pending = &stats->pending[i];
+        if (pending->direction == direction
+                && (piggybacked
+                        ? avs_coap_identity_equal(&pending->identity,
+                                                  &identity)
+                        : avs_coap_token_equal(&pending->identity.token,
+                                               &identity.token))
+                && endpoint_equal(&pending->endpoint, remote_ep)) {
+            record_latency(histogram,
+                           avs_time_monotonic_diff(avs_time_monotonic_now(),
+                                                   pending->timestamp));
+            pending->direction = PENDING_NONE;
+            return;
+        }
+    }
+}
+
+void _avs_coap_stats_on_recv(coap_stats_t *stats,
+                             const avs_net_resolved_endpoint_t *remote_ep,
+                             const avs_coap_msg_t *msg,
+                             bool duplicate) {
+    if (!stats) {
+        return;
+    }
+    if (stats->shards) {
+        const size_t shard_idx = shard_for(stats, remote_ep);
+        coap_stats_t *shard = lock_shard(stats, shard_idx);
+        if (shard) {
+            _avs_coap_stats_on_recv(shard, remote_ep, msg, duplicate);
+            unlock_shard(stats, shard_idx);
+        }
+        return;
+    }
+
+    endpoint_entry_t *entry = find_or_add_endpoint(stats, remote_ep);
+    ++stats->total.rx_msgs;
+    stats->total.rx_bytes += msg->length;
+    if (duplicate) {
+        ++stats->total.incoming_retransmissions;
+    }
+    if (entry) {
+        ++entry->stats.traffic.rx_msgs;
+        entry->stats.traffic.rx_bytes += msg->length;
+        if (duplicate) {
+            ++entry->stats.traffic.incoming_retransmissions;
+        }
+    }
+    ++stats->rx_by_code[avs_coap_msg_get_code(msg)];
+
+    if (duplicate) {
+        // response is replayed from the cache, there is nothing to measure
+        return;
+    } else if (avs_coap_msg_is_request(msg)) {
+        add_pending(stats, PENDING_INCOMING, remote_ep, msg);
+    } else if (avs_coap_msg_is_response(msg)) {
+        match_pending(stats, PENDING_OUTGOING, remote_ep, msg,
+                      &stats->outgoing_request_latency);
+    }
+}
+
+void _avs_coap_stats_on_send(coap_stats_t *stats,
+                             const avs_net_resolved_endpoint_t *remote_ep,
+                             const avs_coap_msg_t *msg,
+                             bool cached_duplicate) {
+    if (!stats) {
+        return;
+    }
+    if (stats->shards) {
+        const size_t shard_idx = shard_for(stats, remote_ep);
+        coap_stats_t *shard = lock_shard(stats, shard_idx);
+        if (shard) {
+            _avs_coap_stats_on_send(shard, remote_ep, msg, cached_duplicate);
+            unlock_shard(stats, shard_idx);
+        }
+        return;
+    }
+
+    endpoint_entry_t *entry = find_or_add_endpoint(stats, remote_ep);
+    bool retransmission = cached_duplicate;
+    if (avs_coap_msg_is_request(msg)) {
+        const avs_coap_msg_identity_t identity = avs_coap_msg_get_identity(msg);
+        if (entry) {
+            retransmission = retransmission
+                    || (entry->has_tx_request
+                            && avs_coap_identity_equal(&entry->last_tx_request,
+                                                       &identity));
+            entry->last_tx_request = identity;
+            entry->has_tx_request = true;
+        }
+        // latency is measured since the original transmission
+        if (!retransmission) {
+            add_pending(stats, PENDING_OUTGOING, remote_ep, msg);
+        }
+    } else if (avs_coap_msg_is_response(msg) && !cached_duplicate) {
+        match_pending(stats, PENDING_INCOMING, remote_ep, msg,
+                      &stats->incoming_request_latency);
+    }
+
+    ++stats->total.tx_msgs;
+    stats->total.tx_bytes += msg->length;
+    if (retransmission) {
+        ++stats->total.outgoing_retransmissions;
+    }
+    if (entry) {
+        ++entry->stats.traffic.tx_msgs;
+        entry->stats.traffic.tx_bytes += msg->length;
+        if (retransmission) {
+            ++entry->stats.traffic.outgoing_retransmissions;
+        }
+    }
+    ++stats->tx_by_code[avs_coap_msg_get_code(msg)];
+}
+
+static void add_histogram(avs_coap_latency_histogram_t *acc,
+                          const avs_coap_latency_histogram_t *histogram) {
+    for (size_t i = 0; i < AVS_COAP_STATS_LATENCY_BUCKETS; ++i) {
+        acc->buckets[i] += histogram->buckets[i];
+    }
+}
+
+/**
+ * Adds counters of a non-sharded @p stats to @p acc and appends its
+ * per-endpoint counters to the list at @p *endpoints_tail_ptr .
+ */
+static int accumulate_snapshot(
+        const coap_stats_t *stats,
+        avs_coap_stats_t *acc,
+        AVS_LIST(avs_coap_endpoint_stats_t) **endpoints_tail_ptr) {
+    acc->total.rx_msgs += stats->total.rx_msgs;
+    acc->total.tx_msgs += stats->total.tx_msgs;
+    acc->total.rx_bytes += stats->total.rx_bytes;
+    acc->total.tx_bytes += stats->total.tx_bytes;
+    acc->total.incoming_retransmissions +=
+            stats->total.incoming_retransmissions;
+    acc->total.outgoing_retransmissions +=
+            stats->total.outgoing_retransmissions;
+    for (size_t i = 0; i < AVS_ARRAY_SIZE(acc->rx_by_code); ++i) {
+        acc->rx_by_code[i] += stats->rx_by_code[i];
+        acc->tx_by_code[i] += stats->tx_by_code[i];
+    }
+    add_histogram(&acc->outgoing_request_latency,
+                  &stats->outgoing_request_latency);
+    add_histogram(&acc->incoming_request_latency,
+                  &stats->incoming_request_latency);
+    acc->dropped_latency_samples += stats->dropped_latency_samples;
+
+    const endpoint_entry_t *entry;
+    AVS_LIST_FOREACH(entry, stats->endpoints) {
+        if (!(**endpoints_tail_ptr =
+                      AVS_LIST_NEW_ELEMENT(avs_coap_endpoint_stats_t))) {
+            LOG(ERROR, "out of memory");
+            return -1;
+        }
+        ***endpoints_tail_ptr = entry->stats;
+        *endpoints_tail_ptr = AVS_LIST_NEXT_PTR(*endpoints_tail_ptr);
+    }
+    return 0;
+}
+
+int _avs_coap_stats_snapshot(const coap_stats_t *stats,
+                             avs_coap_stats_t *out_stats) {
+    assert(stats);
+
+    memset(&out_stats->total, 0, sizeof(out_stats->total));
+    memset(out_stats->rx_by_code, 0, sizeof(out_stats->rx_by_code));
+    memset(out_stats->tx_by_code, 0, sizeof(out_stats->tx_by_code));
+    memset(&out_stats->outgoing_request_latency, 0,
+           sizeof(out_stats->outgoing_request_latency));
+    memset(&out_stats->incoming_request_latency, 0,
+           sizeof(out_stats->incoming_request_latency));
+    out_stats->dropped_latency_samples = 0;
+    out_stats->endpoints = NULL;
+
+    AVS_LIST(avs_coap_endpoint_stats_t) *tail = &out_stats->endpoints;
+    int result = 0;
+    if (!stats->shards) {
+        result = accumulate_snapshot(stats, out_stats, &tail);
+    }
+    for (size_t i = 0; !result && i < stats->num_shards; ++i) {
+        const coap_stats_t *shard = lock_shard(stats, i);
+        if (!shard) {
+            result = -1;
+            break;
+        }
+        result = accumulate_snapshot(shard, out_stats, &tail);
+        unlock_shard(stats, i);
+    }
+    if (result) {
+        AVS_LIST_CLEAR(&out_stats->endpoints);
+    }
+    return result;
+}
+
+#ifdef AVS_UNIT_TESTING
+#include "test/stats.c"
+#endif // AVS_UNIT_TESTING
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AVS_COAP_STATS_H
+#define AVS_COAP_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <avsystem/commons/net.h>
+
+#include <avsystem/commons/coap/msg.h>
+#include <avsystem/commons/coap/stats.h>
+
+VISIBILITY_PRIVATE_HEADER_BEGIN
+
+typedef struct coap_stats coap_stats_t;
+
+#ifdef WITH_AVS_COAP_STATS
+
+/**
+ * Creates a statistics collector object.
+ *
+ * @param max_endpoints        Maximum number of remote endpoints to keep
+ *                             separate counters for.
+ * @param max_pending_requests Number of requests awaiting a response that
+ *                             are tracked for latency measurements, greater
+ *                             than zero.
+ *
+ * @return Created object, or NULL if there is not enough memory.
+ *
+ * NOTE: all other functions accept a NULL @ref coap_stats_t object, in which
+ * case they do nothing.
+ */
+coap_stats_t *_avs_coap_stats_create(size_t max_endpoints,
+                                     size_t max_pending_requests);
+
+/**
+ * Creates a statistics collector object that may be safely updated from
+ * multiple threads at once.
+ *
+ * The collector is split into @p num_shards independent ones, guarded by
+ * separate locks. Each remote endpoint is assigned to a single shard based on
+ * its hash, so concurrent updates for different endpoints rarely contend.
+ * @p max_endpoints and @p max_pending_requests are split evenly between the
+ * shards, rounding up.
+ *
+ * @param max_endpoints        Maximum number of remote endpoints to keep
+ *                             separate counters for.
+ * @param max_pending_requests Number of requests awaiting a response that
+ *                             are tracked for latency measurements, greater
+ *                             than zero.
+ * @param num_shards           Number of shards, greater than zero.
+ *
+ * @return Created object, or NULL if there is not enough memory or the
+ *         library was compiled without threading support
+ *         (<c>WITH_AVS_COMPAT_THREADING</c>).
+ */
+coap_stats_t *_avs_coap_stats_create_sharded(size_t max_endpoints,
+                                             size_t max_pending_requests,
+                                             size_t num_shards);
+
+/**
+ * Frees any resources used by given @p stats_ptr and sets <c>*stats_ptr</c>
+ * to NULL.
+ */
+void _avs_coap_stats_release(coap_stats_t **stats_ptr);
+
+/**
+ * Records a valid message received from @p remote_ep .
+ *
+ * @param stats     Statistics object to update.
+ * @param remote_ep Sender of the message, or NULL if unknown, in which case
+ *                  only aggregated counters are updated.
+ * @param msg       Received message.
+ * @param duplicate True if @p msg has been identified as a retransmission of
+ *                  a request that was already responded to.
+ */
+void _avs_coap_stats_on_recv(coap_stats_t *stats,
+                             const avs_net_resolved_endpoint_t *remote_ep,
+                             const avs_coap_msg_t *msg,
+                             bool duplicate);
+
+/**
+ * Records a message sent to @p remote_ep .
+ *
+ * @param stats            Statistics object to update.
+ * @param remote_ep        Recipient of the message, or NULL if unknown.
+ * @param msg              Sent message.
+ * @param cached_duplicate True if the message cache reported @p msg as
+ *                         a retransmission of an already cached response.
+ */
+void _avs_coap_stats_on_send(coap_stats_t *stats,
+                             const avs_net_resolved_endpoint_t *remote_ep,
+                             const avs_coap_msg_t *msg,
+                             bool cached_duplicate);
+
+/**
+ * Fills @p out_stats with a copy of the current counters, summed over all
+ * shards of a sharded collector. Message cache counters are left untouched.
+ *
+ * @return 0 on success, a negative value if there is not enough memory to copy
+ *         per-endpoint counters.
+ */
+int _avs_coap_stats_snapshot(const coap_stats_t *stats,
+                             avs_coap_stats_t *out_stats);
+
+#else // WITH_AVS_COAP_STATS
+
+#define _avs_coap_stats_create(...) ((coap_stats_t *) NULL)
+#define _avs_coap_stats_create_sharded(...) ((coap_stats_t *) NULL)
+#define _avs_coap_stats_release(...) (void) 0
+#define _avs_coap_stats_on_recv(...) (void) 0
+#define _avs_coap_stats_on_send(...) (void) 0
+#define _avs_coap_stats_snapshot(...) (-1)
+
+#endif // WITH_AVS_COAP_STATS
+
+VISIBILITY_PRIVATE_HEADER_END
+
+#endif // AVS_COAP_STATS_H
@@ -0,0 +1,440 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Microbenchmarks of the CoAP codec: message building, validation, option
+ * parsing, message cache and block-wise building.
+ *
+ * Usage: avs_coap_benchmark [ITERATIONS [FILTER]]
+ *
+ * Only benchmarks whose names contain FILTER are run. For each one, average
+ * time and number of avs_malloc/avs_calloc/avs_realloc calls per operation are
+ * reported.
+ */
+
+// this file provides its own, counting implementation of avs_malloc() & co.
+#define AVS_UTILS_COMPAT_STDLIB_MEMORY_C
+// standalone program, allowed to use stdio and exit() like the test framework
+#define AVS_UNIT_SOURCE
+#include <avs_commons_config.h>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avsystem/commons/memory.h>
+#include <avsystem/commons/time.h>
+
+#include <avsystem/commons/coap/block_builder.h>
+#include <avsystem/commons/coap/msg_builder.h>
+#include <avsystem/commons/coap/msg_opt.h>
+#include <avsystem/commons/coap/msg_template.h>
+
+#ifdef WITH_AVS_LOG
+#include <avsystem/commons/log.h>
+#endif // WITH_AVS_LOG
+
+#include "../coap_log.h"
+#include "../msg_cache.h"
+#include "../msg_internal.h"
+
+#define DEFAULT_ITERATIONS 200000
+
+#define BLOCK_SIZE 64
+#define BLOCK_TRANSFER_SIZE 1024
+
+#define CACHE_SIZE (64 * 1024)
+#define CACHE_ENDPOINTS 256
+
+static uint64_t ALLOCATIONS;
+
+void *avs_malloc(size_t size) {
+    ++ALLOCATIONS;
+    return malloc(size);
+}
+
+void avs_free(void *ptr) {
+    free(ptr);
+}
+
+void *avs_calloc(size_t nmemb, size_t size) {
+    ++ALLOCATIONS;
+    return calloc(nmemb, size);
+}
+
+void *avs_realloc(void *ptr, size_t size) {
+    ++ALLOCATIONS;
+    return realloc(ptr, size);
+}
+
+/* Accumulates results of benchmarked calls so that they are not optimized
+ * away. */
+static volatile size_t SINK;
+
+typedef union {
+    avs_coap_msg_t msg;
+    uint8_t bytes[offsetof(avs_coap_msg_t, content) + 256];
+} small_msg_t;
+
+typedef union {
+    avs_coap_msg_t msg;
+    uint8_t bytes[offsetof(avs_coap_msg_t, content) + AVS_COAP_MAX_HEADER_SIZE
+                  + AVS_COAP_MAX_TOKEN_LENGTH + 64
+                  + sizeof(AVS_COAP_PAYLOAD_MARKER) + BLOCK_TRANSFER_SIZE];
+} large_msg_t;
+
+static const char SMALL_TOKEN[] = "\x12\x34\x56\x78";
+static const char LARGE_TOKEN[] = "\x01\x23\x45\x67\x89\xab\xcd\xef";
+static const char *const URI_PATH[] = { "rd", "5a3f", "3303", "0" };
+static const char *const URI_QUERY[] = {
+    "ep=urn:imei:490154203237518", "lt=86400", "lwm2m=1.0", "b=U"
+};
+
+static struct {
+    uint16_t arena[256];
+    avs_coap_msg_info_t small_get;
+    avs_coap_msg_info_t many_options;
+    avs_coap_msg_info_t block_response;
+    uint8_t payload[BLOCK_TRANSFER_SIZE];
+
+    small_msg_t small_get_msg;
+    large_msg_t many_options_msg;
+    large_msg_t scratch;
+
+    avs_coap_msg_template_t *many_options_template;
+    coap_msg_cache_t *cache;
+    avs_net_resolved_endpoint_t endpoints[CACHE_ENDPOINTS];
+} CORPUS;
+
+static const avs_coap_tx_params_t TX_PARAMS = {
+    .ack_timeout = { 2, 0 },
+    .ack_random_factor = 1.5,
+    .max_retransmit = 4
+};
+
+static void set_token(avs_coap_msg_info_t *info, const char *token,
+                      size_t size) {
+    memcpy(info->identity.token.bytes, token, size);
+    info->identity.token.size = (uint8_t) size;
+}
+
+static void build(const avs_coap_msg_info_t *info,
+                  void *buffer,
+                  size_t buffer_size,
+                  const void *payload,
+                  size_t payload_size) {
+    avs_coap_msg_builder_t builder;
+    if (avs_coap_msg_builder_init(&builder,
+                                  avs_coap_ensure_aligned_buffer(buffer),
+                                  buffer_size, info)
+            || avs_coap_msg_builder_payload(&builder, payload, payload_size)
+                           != payload_size) {
+        fprintf(stderr, "could not build a message\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void corpus_init(void) {
+    for (size_t i = 0; i < sizeof(CORPUS.payload); ++i) {
+        CORPUS.payload[i] = (uint8_t) i;
+    }
+
+    CORPUS.small_get = avs_coap_msg_info_init();
+    CORPUS.small_get.type = AVS_COAP_MSG_CONFIRMABLE;
+    CORPUS.small_get.code = AVS_COAP_CODE_GET;
+    CORPUS.small_get.identity.msg_id = 0x1234;
+    set_token(&CORPUS.small_get, SMALL_TOKEN, sizeof(SMALL_TOKEN) - 1);
+    avs_coap_msg_info_opt_string(&CORPUS.small_get, AVS_COAP_OPT_URI_PATH,
+                                 URI_PATH[0]);
+    build(&CORPUS.small_get, &CORPUS.small_get_msg,
+          sizeof(CORPUS.small_get_msg), NULL, 0);
+
+    CORPUS.many_options = avs_coap_msg_info_init();
+    CORPUS.many_options.type = AVS_COAP_MSG_CONFIRMABLE;
+    CORPUS.many_options.code = AVS_COAP_CODE_POST;
+    CORPUS.many_options.identity.msg_id = 0x4321;
+    set_token(&CORPUS.many_options, LARGE_TOKEN, sizeof(LARGE_TOKEN) - 1);
+    for (size_t i = 0; i < AVS_ARRAY_SIZE(URI_PATH); ++i) {
+        avs_coap_msg_info_opt_string(&CORPUS.many_options,
+                                     AVS_COAP_OPT_URI_PATH, URI_PATH[i]);
+    }
+    for (size_t i = 0; i < AVS_ARRAY_SIZE(URI_QUERY); ++i) {
+        avs_coap_msg_info_opt_string(&CORPUS.many_options,
+                                     AVS_COAP_OPT_URI_QUERY, URI_QUERY[i]);
+    }
+    avs_coap_msg_info_opt_content_format(&CORPUS.many_options, 11543);
+    avs_coap_msg_info_opt_u16(&CORPUS.many_options, AVS_COAP_OPT_ACCEPT, 11543);
+    avs_coap_msg_info_opt_u32(&CORPUS.many_options, AVS_COAP_OPT_OBSERVE, 0);
+    const avs_coap_block_info_t block1 = {
+        .type = AVS_COAP_BLOCK1,
+        .valid = true,
+        .seq_num = 0,
+        .has_more = true,
+        .size = BLOCK_SIZE
+    };
+    avs_coap_msg_info_opt_block(&CORPUS.many_options, &block1);
+    build(&CORPUS.many_options, &CORPUS.many_options_msg,
+          sizeof(CORPUS.many_options_msg), CORPUS.payload, BLOCK_SIZE);
+
+    CORPUS.block_response = avs_coap_msg_info_init_with_arena(
+            CORPUS.arena, sizeof(CORPUS.arena));
+    CORPUS.block_response.type = AVS_COAP_MSG_ACKNOWLEDGEMENT;
+    CORPUS.block_response.code = AVS_COAP_CODE_CONTENT;
+    set_token(&CORPUS.block_response, LARGE_TOKEN, sizeof(LARGE_TOKEN) - 1);
+    avs_coap_msg_info_opt_content_format(&CORPUS.block_response, 11543);
+
+    for (size_t i = 0; i < CACHE_ENDPOINTS; ++i) {
+        avs_net_resolved_endpoint_t *ep = &CORPUS.endpoints[i];
+        // IPv4 address and port, as they would be stored by the socket
+        const uint8_t addr[] = {
+            192, 168, (uint8_t) (i >> 8), (uint8_t) i, 0x16, 0x33
+        };
+        ep->size = sizeof(addr);
+        memcpy(ep->data.buf, addr, sizeof(addr));
+    }
+}
+
+static void corpus_cleanup(void) {
+    avs_coap_msg_info_reset(&CORPUS.small_get);
+    avs_coap_msg_info_reset(&CORPUS.many_options);
+    avs_coap_msg_info_reset(&CORPUS.block_response);
+}
+
+static void run_build_small_get(size_t i) {
+    (void) i;
+    avs_coap_msg_builder_t builder;
+    avs_coap_msg_builder_init(
+            &builder, avs_coap_ensure_aligned_buffer(&CORPUS.scratch),
+            sizeof(CORPUS.scratch), &CORPUS.small_get);
+    SINK += avs_coap_msg_builder_get_msg(&builder)->length;
+}
+
+static void run_build_many_options(size_t i) {
+    (void) i;
+    avs_coap_msg_builder_t builder;
+    avs_coap_msg_builder_init(
+            &builder, avs_coap_ensure_aligned_buffer(&CORPUS.scratch),
+            sizeof(CORPUS.scratch), &CORPUS.many_options);
+    SINK += avs_coap_msg_builder_payload(&builder, CORPUS.payload, BLOCK_SIZE);
+}
+
+static void setup_template(void) {
+    avs_coap_msg_template_create(&CORPUS.many_options_template,
+                                 &CORPUS.many_options, CORPUS.payload,
+                                 BLOCK_SIZE);
+}
+
+static void teardown_template(void) {
+    avs_coap_msg_template_cleanup(&CORPUS.many_options_template);
+}
+
+static void run_build_many_options_template(size_t i) {
+    SINK += avs_coap_msg_template_fill(
+                    CORPUS.many_options_template,
+                    &CORPUS.many_options.identity, (uint32_t) i,
+                    avs_coap_ensure_aligned_buffer(&CORPUS.scratch),
+                    sizeof(CORPUS.scratch))->length;
+}
+
+static void run_validate_small_get(size_t i) {
+    (void) i;
+    SINK += avs_coap_msg_is_valid(&CORPUS.small_get_msg.msg);
+}
+
+static void run_validate_many_options(size_t i) {
+    (void) i;
+    SINK += avs_coap_msg_is_valid(&CORPUS.many_options_msg.msg);
+}
+
+static void run_validate_and_index(size_t i) {
+    (void) i;
+    avs_coap_msg_index_t index;
+    SINK += avs_coap_msg_validate_and_index(&CORPUS.many_options_msg.msg,
+                                            &index);
+    SINK += index.num_options;
+}
+
+static void run_parse_iterate(size_t i) {
+    (void) i;
+    for (avs_coap_opt_iterator_t it =
+                 avs_coap_opt_begin(&CORPUS.many_options_msg.msg);
+            !avs_coap_opt_end(&it);
+            avs_coap_opt_next(&it)) {
+        SINK += avs_coap_opt_number(&it);
+    }
+    SINK += avs_coap_msg_payload_length(&CORPUS.many_options_msg.msg);
+}
+
+static void run_parse_lookup(size_t i) {
+    (void) i;
+    uint16_t format;
+    uint32_t observe;
+    avs_coap_msg_get_content_format(&CORPUS.many_options_msg.msg, &format);
+    avs_coap_msg_get_option_u32(&CORPUS.many_options_msg.msg,
+                                AVS_COAP_OPT_OBSERVE, &observe);
+    SINK += format + observe;
+}
+
+static void run_parse_index_lookup(size_t i) {
+    (void) i;
+    avs_coap_msg_index_t index;
+    uint16_t format;
+    uint32_t observe;
+    avs_coap_msg_index_build(&CORPUS.many_options_msg.msg, &index);
+    avs_coap_msg_index_get_content_format(&index, &format);
+    avs_coap_msg_index_get_option_u32(&index, AVS_COAP_OPT_OBSERVE, &observe);
+    SINK += format + observe;
+}
+
+static void setup_cache(void) {
+    CORPUS.cache = _avs_coap_msg_cache_create(CACHE_SIZE);
+}
+
+static void setup_slab_cache(void) {
+    CORPUS.cache = _avs_coap_msg_cache_create_with_engine(
+            CACHE_SIZE, AVS_COAP_MSG_CACHE_ENGINE_SLAB);
+}
+
+static void teardown_cache(void) {
+    _avs_coap_msg_cache_release(&CORPUS.cache);
+}
+
+static void run_cache_add_get(size_t i) {
+    // every endpoint gets a fresh message ID, old entries are evicted
+    const avs_net_resolved_endpoint_t *ep =
+            &CORPUS.endpoints[i % CACHE_ENDPOINTS];
+    avs_coap_msg_t *msg = &CORPUS.many_options_msg.msg;
+    _avs_coap_header_set_id(msg, (uint16_t) (i / CACHE_ENDPOINTS));
+    _avs_coap_msg_cache_add(CORPUS.cache, ep, msg, &TX_PARAMS);
+    SINK += (size_t) _avs_coap_msg_cache_get(CORPUS.cache, ep,
+                                             avs_coap_msg_get_id(msg));
+}
+
+static void run_cache_get_miss(size_t i) {
+    SINK += (size_t) _avs_coap_msg_cache_get(
+            CORPUS.cache, &CORPUS.endpoints[i % CACHE_ENDPOINTS],
+            (uint16_t) i);
+}
+
+static void run_block_transfer(size_t i) {
+    (void) i;
+    avs_coap_msg_builder_t msg_builder;
+    avs_coap_msg_builder_init(
+            &msg_builder, avs_coap_ensure_aligned_buffer(&CORPUS.scratch),
+            sizeof(CORPUS.scratch), &CORPUS.block_response);
+    avs_coap_msg_builder_payload(&msg_builder, CORPUS.payload,
+                                 sizeof(CORPUS.payload));
+    avs_coap_block_builder_t builder =
+            avs_coap_block_builder_init(&msg_builder);
+
+    small_msg_t block;
+    avs_coap_block_info_t block_info = {
+        .type = AVS_COAP_BLOCK2,
+        .valid = true,
+        .size = BLOCK_SIZE
+    };
+    for (uint16_t id = 0; avs_coap_block_builder_payload_remaining(&builder);
+            ++id) {
+        block_info.has_more = avs_coap_block_builder_payload_remaining(&builder)
+                              > BLOCK_SIZE;
+        avs_coap_msg_info_opt_remove_by_number(&CORPUS.block_response,
+                                               AVS_COAP_OPT_BLOCK2);
+        avs_coap_msg_info_opt_block(&CORPUS.block_response, &block_info);
+        CORPUS.block_response.identity.msg_id = id;
+        SINK += avs_coap_block_builder_build(
+                        &builder, &CORPUS.block_response, BLOCK_SIZE,
+                        avs_coap_ensure_aligned_buffer(&block), sizeof(block))
+                        ->length;
+        avs_coap_block_builder_next(&builder, BLOCK_SIZE);
+        ++block_info.seq_num;
+    }
+}
+
+typedef struct {
+    const char *name;
+    void (*setup)(void);
+    void (*run)(size_t iteration);
+    void (*teardown)(void);
+} benchmark_t;
+
+static const benchmark_t BENCHMARKS[] = {
+    { "build/small_get", NULL, run_build_small_get, NULL },
+    { "build/many_options", NULL, run_build_many_options, NULL },
+    { "build/many_options_template", setup_template,
+      run_build_many_options_template, teardown_template },
+    { "validate/small_get", NULL, run_validate_small_get, NULL },
+    { "validate/many_options", NULL, run_validate_many_options, NULL },
+    { "validate/and_index", NULL, run_validate_and_index, NULL },
+    { "parse/iterate_options", NULL, run_parse_iterate, NULL },
+    { "parse/lookup", NULL, run_parse_lookup, NULL },
+    { "parse/index_lookup", NULL, run_parse_index_lookup, NULL },
+    { "cache/add_get", setup_cache, run_cache_add_get, teardown_cache },
+    { "cache/get_miss", setup_cache, run_cache_get_miss, teardown_cache },
+    { "cache/slab_add_get", setup_slab_cache, run_cache_add_get,
+      teardown_cache },
+    { "block/transfer_1k", NULL, run_block_transfer, NULL }
+};
+
+static void run_benchmark(const benchmark_t *bench, size_t iterations) {
+    if (bench->setup) {
+        bench->setup();
+    }
+
+    const uint64_t allocations_before = ALLOCATIONS;
+    const avs_time_monotonic_t start = avs_time_monotonic_now();
+    for (size_t i = 0; i < iterations; ++i) {
+        bench->run(i);
+    }
+    const avs_time_monotonic_t end = avs_time_monotonic_now();
+    const uint64_t allocations = ALLOCATIONS - allocations_before;
+
+    if (bench->teardown) {
+        bench->teardown();
+    }
+
+    int64_t ns;
+    avs_time_duration_to_scalar(&ns, AVS_TIME_NS,
+                                avs_time_monotonic_diff(end, start));
+    printf("%-28s %10zu %12.1f %12.3f\n", bench->name, iterations,
+           (double) ns / (double) iterations,
+           (double) allocations / (double) iterations);
+}
+
+int main(int argc, char **argv) {
+    size_t iterations = DEFAULT_ITERATIONS;
+    if (argc > 1 && (iterations = strtoul(argv[1], NULL, 10)) == 0) {
+        fprintf(stderr, "usage: %s [ITERATIONS [FILTER]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *filter = argc > 2 ? argv[2] : "";
+
+#ifdef WITH_AVS_LOG
+    // benchmarked paths should not be dominated by log formatting
+    avs_log_set_default_level(AVS_LOG_ERROR);
+#endif // WITH_AVS_LOG
+
+    corpus_init();
+    printf("%-28s %10s %12s %12s\n", "benchmark", "iterations", "ns/op",
+           "allocs/op");
+    for (size_t i = 0; i < AVS_ARRAY_SIZE(BENCHMARKS); ++i) {
+        if (strstr(BENCHMARKS[i].name, filter)) {
+            run_benchmark(&BENCHMARKS[i], iterations);
+        }
+    }
+    corpus_cleanup();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <avs_commons_config.h>
+
+#include <avsystem/commons/unit/test.h>
+
+#define BLOCK_SIZE 16
+
+typedef union {
+    avs_coap_msg_t msg;
+    uint8_t bytes[offsetof(avs_coap_msg_t, content) + AVS_COAP_MAX_HEADER_SIZE
+                  + AVS_COAP_MAX_TOKEN_LENGTH
+                  + sizeof(AVS_COAP_PAYLOAD_MARKER) + BLOCK_SIZE];
+} block_msg_t;
+
+static void assert_block_equal(avs_coap_block_builder_t *builder,
+                               const avs_coap_msg_info_t *info,
+                               const char *expected) {
+    block_msg_t storage;
+    const avs_coap_msg_t *msg = avs_coap_block_builder_build(
+            builder, info, BLOCK_SIZE, avs_coap_ensure_aligned_buffer(&storage),
+            sizeof(storage));
+    AVS_UNIT_ASSERT_NOT_NULL(msg);
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_msg_payload_length(msg), strlen(expected));
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(avs_coap_msg_payload(msg), expected,
+                                      strlen(expected));
+}
+
+AVS_UNIT_TEST(coap_block_builder, ring_wraparound) {
+    avs_coap_msg_info_t info = avs_coap_msg_info_init();
+    info.type = AVS_COAP_MSG_CONFIRMABLE;
+    info.code = AVS_COAP_CODE_CONTENT;
+
+    union {
+        avs_coap_msg_t msg;
+        uint8_t bytes[offsetof(avs_coap_msg_t, content)
+                      + AVS_COAP_MAX_HEADER_SIZE + 40];
+    } payload_storage;
+
+    avs_coap_msg_builder_t msg_builder;
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_builder_init(
+            &msg_builder, avs_coap_ensure_aligned_buffer(&payload_storage),
+            sizeof(payload_storage), &info));
+    static const char INITIAL[] = "0123456789abcdefghij";
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_msg_builder_payload(&msg_builder, INITIAL,
+                                                       sizeof(INITIAL) - 1),
+                          sizeof(INITIAL) - 1);
+
+    avs_coap_block_builder_t builder =
+            avs_coap_block_builder_init(&msg_builder);
+    const size_t capacity = builder.payload_capacity;
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_block_builder_payload_remaining(&builder),
+                          sizeof(INITIAL) - 1);
+    const uint8_t *stored = (const uint8_t *) builder.payload_buffer
+                            + builder.read_offset;
+
+    assert_block_equal(&builder, &info, "0123456789abcdef");
+    avs_coap_block_builder_next(&builder, BLOCK_SIZE);
+
+    // fill the whole buffer; new data wraps around its end
+    char more[64];
+    for (size_t i = 0; i < sizeof(more); ++i) {
+        more[i] = (char) ('A' + i % 26);
+    }
+    size_t appended =
+            avs_coap_block_builder_append_payload(&builder, more, sizeof(more));
+    AVS_UNIT_ASSERT_EQUAL(appended, capacity - 4);
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_block_builder_payload_remaining(&builder),
+                          capacity);
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_block_builder_append_payload(&builder, more,
+                                                                sizeof(more)),
+                          0);
+    // data that was already buffered did not move
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(stored + BLOCK_SIZE, "ghij", 4);
+    // write_offset keeps its meaning relative to read_offset
+    AVS_UNIT_ASSERT_EQUAL(builder.write_offset - builder.read_offset,
+                          capacity);
+
+    assert_block_equal(&builder, &info, "ghijABCDEFGHIJKL");
+    avs_coap_block_builder_next(&builder, BLOCK_SIZE);
+
+    size_t remaining = capacity - BLOCK_SIZE;
+    size_t offset = BLOCK_SIZE - 4;
+    while (remaining) {
+        char expected[BLOCK_SIZE + 1] = "";
+        size_t block = AVS_MIN(remaining, (size_t) BLOCK_SIZE);
+        memcpy(expected, more + offset, block);
+        assert_block_equal(&builder, &info, expected);
+        avs_coap_block_builder_next(&builder, BLOCK_SIZE);
+        remaining -= block;
+        offset += block;
+    }
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_block_builder_payload_remaining(&builder),
+                          0);
+}
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <avs_commons_config.h>
 #include <avs_commons_posix_config.h>
 
 #include <avsystem/commons/coap/ctx.h>
@@ -33,6 +34,7 @@
 
 #include <avsystem/commons/errno.h>
 #include <avsystem/commons/memory.h>
+#include <avsystem/commons/socket_v_table.h>
 #include <avsystem/commons/stream.h>
 #include <avsystem/commons/stream_v_table.h>
 #include <avsystem/commons/unit/test.h>
@@ -47,6 +49,10 @@
 
 #define TEST_PORT_DTLS 4321
 #define TEST_PORT_UDP 4322
+#define TEST_PORT_UDP_BATCH 4323
+#define TEST_PORT_UDP_SEND_BATCH 4324
+#define TEST_PORT_UDP_SEND_BATCH_CACHED 4325
+#define TEST_PORT_UDP_THREAD_SAFE 4326
 
 #define COAP_MSG_MAX_SIZE 1152
 
@@ -313,6 +319,112 @@ static avs_net_abstract_socket_t *setup_socket(socket_type_t type,
     return backend;
 }
 
+#ifdef WITH_AVS_COAP_NET_STATS
+/**
+ * Decorator that forwards everything used by avs_coap_ctx_t to a backend
+ * socket, counting the get_opt() queries made along the way.
+ */
+typedef struct {
+    const avs_net_socket_v_table_t *const operations;
+    avs_net_abstract_socket_t *backend;
+    unsigned state_queries;
+    unsigned mtu_queries;
+    unsigned inner_mtu_queries;
+} counting_socket_t;
+
+static int counting_send(avs_net_abstract_socket_t *socket,
+                         const void *buffer,
+                         size_t buffer_length) {
+    return avs_net_socket_send(((counting_socket_t *) socket)->backend,
+                               buffer, buffer_length);
+}
+
+static int counting_receive(avs_net_abstract_socket_t *socket,
+                            size_t *out_bytes_received,
+                            void *buffer,
+                            size_t buffer_length) {
+    return avs_net_socket_receive(((counting_socket_t *) socket)->backend,
+                                  out_bytes_received, buffer, buffer_length);
+}
+
+static int counting_cleanup(avs_net_abstract_socket_t **socket) {
+    counting_socket_t *counting = (counting_socket_t *) *socket;
+    int result = avs_net_socket_cleanup(&counting->backend);
+    avs_free(counting);
+    *socket = NULL;
+    return result;
+}
+
+static int counting_remote_host(avs_net_abstract_socket_t *socket,
+                                char *out_buffer, size_t out_buffer_size) {
+    return avs_net_socket_get_remote_host(
+            ((counting_socket_t *) socket)->backend,
+            out_buffer, out_buffer_size);
+}
+
+static int counting_remote_port(avs_net_abstract_socket_t *socket,
+                                char *out_buffer, size_t out_buffer_size) {
+    return avs_net_socket_get_remote_port(
+            ((counting_socket_t *) socket)->backend,
+            out_buffer, out_buffer_size);
+}
+
+static int counting_get_opt(avs_net_abstract_socket_t *socket_,
+                            avs_net_socket_opt_key_t option_key,
+                            avs_net_socket_opt_value_t *out_option_value) {
+    counting_socket_t *socket = (counting_socket_t *) socket_;
+    switch (option_key) {
+    case AVS_NET_SOCKET_OPT_STATE:
+        ++socket->state_queries;
+        break;
+    case AVS_NET_SOCKET_OPT_MTU:
+        ++socket->mtu_queries;
+        break;
+    case AVS_NET_SOCKET_OPT_INNER_MTU:
+        ++socket->inner_mtu_queries;
+        break;
+    default:
+        break;
+    }
+    return avs_net_socket_get_opt(socket->backend, option_key,
+                                  out_option_value);
+}
+
+static int counting_errno(avs_net_abstract_socket_t *socket) {
+    return avs_net_socket_errno(((counting_socket_t *) socket)->backend);
+}
+
+static int counting_remote_endpoint(avs_net_abstract_socket_t *socket,
+                                    avs_net_resolved_endpoint_t *out_endpoint) {
+    return avs_net_socket_get_remote_endpoint(
+            ((counting_socket_t *) socket)->backend, out_endpoint);
+}
+
+static const avs_net_socket_v_table_t counting_vtable = {
+    .send = counting_send,
+    .receive = counting_receive,
+    .cleanup = counting_cleanup,
+    .get_remote_host = counting_remote_host,
+    .get_remote_port = counting_remote_port,
+    .get_opt = counting_get_opt,
+    .get_errno = counting_errno,
+    .get_remote_endpoint = counting_remote_endpoint
+};
+
+static counting_socket_t *wrap_counting_socket(
+        avs_net_abstract_socket_t **socket) {
+    const avs_net_socket_v_table_t *const vtable_ptr = &counting_vtable;
+    counting_socket_t *counting = (counting_socket_t *)
+            avs_calloc(1, sizeof(counting_socket_t));
+    AVS_UNIT_ASSERT_NOT_NULL(counting);
+    memcpy((void *) (intptr_t) &counting->operations,
+           &vtable_ptr, sizeof(vtable_ptr));
+    counting->backend = *socket;
+    *socket = (avs_net_abstract_socket_t *) counting;
+    return counting;
+}
+#endif // WITH_AVS_COAP_NET_STATS
+
 AVS_UNIT_TEST(coap_ctx, coap_udp) {
     avs_net_socket_opt_value_t mtu;
     // udp_client_send_recv
@@ -342,7 +454,25 @@ AVS_UNIT_TEST(coap_ctx, coap_udp) {
             backend, AVS_NET_SOCKET_OPT_INNER_MTU, &mtu));
     AVS_UNIT_ASSERT_EQUAL(mtu.mtu, 1472); // 20 bytes IPv4 + 8 bytes UDP
 
+#ifdef WITH_AVS_COAP_NET_STATS
+    counting_socket_t *counting = wrap_counting_socket(&backend);
+#endif // WITH_AVS_COAP_NET_STATS
+
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_ctx_send(ctx, backend, msg));
+#ifdef WITH_AVS_COAP_NET_STATS
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_ctx_get_tx_bytes(ctx), msg->length + 28);
+    AVS_UNIT_ASSERT_EQUAL(counting->state_queries, 1);
+    AVS_UNIT_ASSERT_EQUAL(counting->mtu_queries, 1);
+    AVS_UNIT_ASSERT_EQUAL(counting->inner_mtu_queries, 1);
+    // overhead is cached, but must stay the same
     AVS_UNIT_ASSERT_SUCCESS(avs_coap_ctx_send(ctx, backend, msg));
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_ctx_get_tx_bytes(ctx),
+                          2 * (msg->length + 28));
+    // only the socket state is checked, MTUs are not queried again
+    AVS_UNIT_ASSERT_EQUAL(counting->state_queries, 2);
+    AVS_UNIT_ASSERT_EQUAL(counting->mtu_queries, 1);
+    AVS_UNIT_ASSERT_EQUAL(counting->inner_mtu_queries, 1);
+#endif // WITH_AVS_COAP_NET_STATS
 
     avs_coap_msg_t *recv_msg __attribute__((cleanup(free_msg))) =
             (avs_coap_msg_t *) avs_malloc(COAP_MSG_MAX_SIZE);
@@ -351,11 +481,200 @@ AVS_UNIT_TEST(coap_ctx, coap_udp) {
             avs_coap_ctx_recv(ctx, backend, recv_msg, COAP_MSG_MAX_SIZE));
 
     AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(recv_msg, msg, msg->length);
+#ifdef WITH_AVS_COAP_NET_STATS
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_ctx_get_rx_bytes(ctx), msg->length + 28);
+    // drain the echo of the second message
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_coap_ctx_recv(ctx, backend, recv_msg, COAP_MSG_MAX_SIZE));
+    AVS_UNIT_ASSERT_EQUAL(counting->state_queries, 4);
+    AVS_UNIT_ASSERT_EQUAL(counting->mtu_queries, 1);
+    AVS_UNIT_ASSERT_EQUAL(counting->inner_mtu_queries, 1);
+#endif // WITH_AVS_COAP_NET_STATS
     avs_net_socket_cleanup(&backend);
     avs_free(storage);
     avs_coap_ctx_cleanup(&ctx);
 }
 
+AVS_UNIT_TEST(coap_ctx, coap_udp_batch) {
+    avs_coap_ctx_t *ctx = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_ctx_create(&ctx, 0));
+
+    avs_net_abstract_socket_t *backend =
+            setup_socket(TYPE_UDP, TEST_PORT_UDP_BATCH);
+
+    avs_coap_msg_info_t info = avs_coap_msg_info_init();
+    info.type = AVS_COAP_MSG_NON_CONFIRMABLE;
+    info.code = AVS_COAP_CODE_CONTENT;
+
+    size_t storage_size = COAP_MSG_MAX_SIZE;
+    void *storage = avs_malloc(storage_size);
+
+    enum { NUM_MSGS = 4 };
+    for (uint16_t id = 0; id < NUM_MSGS; ++id) {
+        info.identity.msg_id = id;
+        const avs_coap_msg_t *msg = avs_coap_msg_build_without_payload(
+                avs_coap_ensure_aligned_buffer(storage),
+                storage_size, &info);
+        AVS_UNIT_ASSERT_NOT_NULL(msg);
+        AVS_UNIT_ASSERT_SUCCESS(avs_coap_ctx_send(ctx, backend, msg));
+    }
+
+    avs_coap_ctx_recv_slot_t slots[NUM_MSGS];
+    for (size_t i = 0; i < NUM_MSGS; ++i) {
+        slots[i].msg = (avs_coap_msg_t *) avs_malloc(COAP_MSG_MAX_SIZE);
+        AVS_UNIT_ASSERT_NOT_NULL(slots[i].msg);
+        slots[i].capacity = COAP_MSG_MAX_SIZE;
+    }
+
+    // echoed datagrams may not all be available at once
+    uint16_t expected_id = 0;
+    while (expected_id < NUM_MSGS) {
+        size_t received = 0;
+        AVS_UNIT_ASSERT_SUCCESS(
+                avs_coap_ctx_recv_batch(ctx, backend, slots,
+                                        (size_t) (NUM_MSGS - expected_id),
+                                        &received));
+        AVS_UNIT_ASSERT_TRUE(received > 0);
+        AVS_UNIT_ASSERT_TRUE(received <= (size_t) (NUM_MSGS - expected_id));
+        for (size_t i = 0; i < received; ++i, ++expected_id) {
+            AVS_UNIT_ASSERT_SUCCESS(slots[i].result);
+            AVS_UNIT_ASSERT_EQUAL(avs_coap_msg_get_id(slots[i].msg),
+                                  expected_id);
+        }
+    }
+
+    for (size_t i = 0; i < NUM_MSGS; ++i) {
+        avs_free(slots[i].msg);
+    }
+    avs_net_socket_cleanup(&backend);
+    avs_free(storage);
+    avs_coap_ctx_cleanup(&ctx);
+}
+
+AVS_UNIT_TEST(coap_ctx, coap_udp_send_batch) {
+    avs_coap_ctx_t *ctx = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_ctx_create(&ctx, 0));
+
+    avs_net_abstract_socket_t *backend =
+            setup_socket(TYPE_UDP, TEST_PORT_UDP_SEND_BATCH);
+
+    char port_str[8];
+    AVS_UNIT_ASSERT_TRUE(avs_simple_snprintf(port_str, sizeof(port_str), "%u",
+                                             TEST_PORT_UDP_SEND_BATCH) >= 0);
+
+    avs_coap_msg_info_t info = avs_coap_msg_info_init();
+    info.type = AVS_COAP_MSG_NON_CONFIRMABLE;
+    info.code = AVS_COAP_CODE_CONTENT;
+
+    enum { NUM_MSGS = 3 };
+    avs_coap_ctx_send_slot_t slots[NUM_MSGS + 1];
+    for (uint16_t id = 0; id < NUM_MSGS; ++id) {
+        info.identity.msg_id = id;
+        void *storage = avs_malloc(COAP_MSG_MAX_SIZE);
+        slots[id].msg = avs_coap_msg_build_without_payload(
+                avs_coap_ensure_aligned_buffer(storage),
+                COAP_MSG_MAX_SIZE, &info);
+        AVS_UNIT_ASSERT_NOT_NULL(slots[id].msg);
+        slots[id].host = "127.0.0.1";
+        slots[id].port = port_str;
+    }
+    // invalid message must not prevent others from being sent
+    avs_coap_msg_t *invalid_msg = (avs_coap_msg_t *) avs_calloc(
+            1, COAP_MSG_MAX_SIZE);
+    slots[NUM_MSGS].msg = invalid_msg;
+    slots[NUM_MSGS].host = "127.0.0.1";
+    slots[NUM_MSGS].port = port_str;
+
+    AVS_UNIT_ASSERT_FAILED(
+            avs_coap_ctx_send_batch(ctx, backend, slots, NUM_MSGS + 1));
+    for (size_t i = 0; i < NUM_MSGS; ++i) {
+        AVS_UNIT_ASSERT_SUCCESS(slots[i].result);
+    }
+    AVS_UNIT_ASSERT_FAILED(slots[NUM_MSGS].result);
+
+    avs_coap_msg_t *recv_msg __attribute__((cleanup(free_msg))) =
+            (avs_coap_msg_t *) avs_malloc(COAP_MSG_MAX_SIZE);
+    for (size_t i = 0; i < NUM_MSGS; ++i) {
+        AVS_UNIT_ASSERT_SUCCESS(
+                avs_coap_ctx_recv(ctx, backend, recv_msg, COAP_MSG_MAX_SIZE));
+        AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(recv_msg, slots[i].msg,
+                                          slots[i].msg->length);
+    }
+
+    for (size_t i = 0; i < NUM_MSGS; ++i) {
+        avs_free((void *) (intptr_t) slots[i].msg);
+    }
+    avs_free(invalid_msg);
+    avs_net_socket_cleanup(&backend);
+    avs_coap_ctx_cleanup(&ctx);
+}
+
+#ifdef WITH_AVS_COAP_MESSAGE_CACHE
+AVS_UNIT_TEST(coap_ctx, coap_udp_send_batch_cached) {
+    avs_coap_ctx_t *ctx = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_ctx_create(&ctx, 4096));
+
+    avs_net_abstract_socket_t *backend =
+            setup_socket(TYPE_UDP, TEST_PORT_UDP_SEND_BATCH_CACHED);
+
+    char port_str[8];
+    AVS_UNIT_ASSERT_TRUE(avs_simple_snprintf(port_str, sizeof(port_str), "%u",
+                                             TEST_PORT_UDP_SEND_BATCH_CACHED)
+                         >= 0);
+
+    avs_coap_msg_info_t info = avs_coap_msg_info_init();
+    info.type = AVS_COAP_MSG_NON_CONFIRMABLE;
+    info.code = AVS_COAP_CODE_CONTENT;
+    info.identity.msg_id = 42;
+
+    void *res_storage = avs_malloc(COAP_MSG_MAX_SIZE);
+    const avs_coap_msg_t *res = avs_coap_msg_build_without_payload(
+            avs_coap_ensure_aligned_buffer(res_storage),
+            COAP_MSG_MAX_SIZE, &info);
+    AVS_UNIT_ASSERT_NOT_NULL(res);
+
+    avs_coap_ctx_send_slot_t slot = {
+        .msg = res,
+        .host = "127.0.0.1",
+        .port = port_str
+    };
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_ctx_send_batch(ctx, backend, &slot, 1));
+    AVS_UNIT_ASSERT_SUCCESS(slot.result);
+
+    avs_coap_msg_t *recv_msg __attribute__((cleanup(free_msg))) =
+            (avs_coap_msg_t *) avs_malloc(COAP_MSG_MAX_SIZE);
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_coap_ctx_recv(ctx, backend, recv_msg, COAP_MSG_MAX_SIZE));
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(recv_msg, res, res->length);
+
+    // a request with the same message ID, sent around the context so that
+    // its echo looks like a retransmission from the connected peer
+    info.type = AVS_COAP_MSG_CONFIRMABLE;
+    info.code = AVS_COAP_CODE_GET;
+    void *req_storage = avs_malloc(COAP_MSG_MAX_SIZE);
+    const avs_coap_msg_t *req = avs_coap_msg_build_without_payload(
+            avs_coap_ensure_aligned_buffer(req_storage),
+            COAP_MSG_MAX_SIZE, &info);
+    AVS_UNIT_ASSERT_NOT_NULL(req);
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_send(backend, req->content, req->length));
+
+    AVS_UNIT_ASSERT_EQUAL(
+            avs_coap_ctx_recv(ctx, backend, recv_msg, COAP_MSG_MAX_SIZE),
+            AVS_COAP_CTX_ERR_DUPLICATE);
+
+    // the cached response has been re-sent and echoed back
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_coap_ctx_recv(ctx, backend, recv_msg, COAP_MSG_MAX_SIZE));
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(recv_msg, res, res->length);
+
+    avs_free(req_storage);
+    avs_free(res_storage);
+    avs_net_socket_cleanup(&backend);
+    avs_coap_ctx_cleanup(&ctx);
+}
+#endif // WITH_AVS_COAP_MESSAGE_CACHE
+
 AVS_UNIT_TEST(coap_ctx, coap_dtls) {
     avs_net_socket_opt_value_t mtu;
     avs_coap_ctx_t *ctx = NULL;
@@ -424,3 +743,91 @@ AVS_UNIT_TEST(coap_ctx, coap_dtls) {
     avs_coap_ctx_cleanup(&ctx);
     avs_free(storage);
 }
+
+AVS_UNIT_TEST(coap_ctx, thread_safe_config) {
+    avs_coap_ctx_t *ctx = NULL;
+    const avs_coap_ctx_config_t config = {
+        .msg_cache_size = 4096,
+        .msg_cache_engine = AVS_COAP_MSG_CACHE_ENGINE_SLAB,
+        .thread_safe = true
+    };
+#ifdef WITH_AVS_COMPAT_THREADING
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_ctx_create_with_config(&ctx, &config));
+    AVS_UNIT_ASSERT_NOT_NULL(ctx);
+    avs_coap_ctx_cleanup(&ctx);
+#else
+    AVS_UNIT_ASSERT_FAILED(avs_coap_ctx_create_with_config(&ctx, &config));
+#endif
+    AVS_UNIT_ASSERT_NULL(ctx);
+}
+
+#if defined(WITH_AVS_COMPAT_THREADING) && defined(WITH_AVS_COAP_MESSAGE_CACHE)
+AVS_UNIT_TEST(coap_ctx, thread_safe_duplicate) {
+    avs_coap_ctx_t *ctx = NULL;
+    const avs_coap_ctx_config_t config = {
+        .msg_cache_size = 4096,
+        .msg_cache_engine = AVS_COAP_MSG_CACHE_ENGINE_FIFO,
+        .thread_safe = true,
+        .msg_cache_shards = 4
+    };
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_ctx_create_with_config(&ctx, &config));
+
+    avs_net_abstract_socket_t *backend =
+            setup_socket(TYPE_UDP, TEST_PORT_UDP_THREAD_SAFE);
+
+    avs_coap_msg_info_t info = avs_coap_msg_info_init();
+    info.type = AVS_COAP_MSG_NON_CONFIRMABLE;
+    info.code = AVS_COAP_CODE_CONTENT;
+    info.identity.msg_id = 42;
+
+    void *res_storage = avs_malloc(COAP_MSG_MAX_SIZE);
+    const avs_coap_msg_t *res = avs_coap_msg_build_without_payload(
+            avs_coap_ensure_aligned_buffer(res_storage),
+            COAP_MSG_MAX_SIZE, &info);
+    AVS_UNIT_ASSERT_NOT_NULL(res);
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_ctx_send(ctx, backend, res));
+
+    avs_coap_msg_t *recv_msg __attribute__((cleanup(free_msg))) =
+            (avs_coap_msg_t *) avs_malloc(COAP_MSG_MAX_SIZE);
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_coap_ctx_recv(ctx, backend, recv_msg, COAP_MSG_MAX_SIZE));
+
+    info.type = AVS_COAP_MSG_CONFIRMABLE;
+    info.code = AVS_COAP_CODE_GET;
+    void *req_storage = avs_malloc(COAP_MSG_MAX_SIZE);
+    const avs_coap_msg_t *req = avs_coap_msg_build_without_payload(
+            avs_coap_ensure_aligned_buffer(req_storage),
+            COAP_MSG_MAX_SIZE, &info);
+    AVS_UNIT_ASSERT_NOT_NULL(req);
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_send(backend, req->content, req->length));
+
+    AVS_UNIT_ASSERT_EQUAL(
+            avs_coap_ctx_recv(ctx, backend, recv_msg, COAP_MSG_MAX_SIZE),
+            AVS_COAP_CTX_ERR_DUPLICATE);
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_coap_ctx_recv(ctx, backend, recv_msg, COAP_MSG_MAX_SIZE));
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(recv_msg, res, res->length);
+
+    // a request sent twice through the same socket is a retransmission
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_ctx_send(ctx, backend, req));
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_ctx_send(ctx, backend, req));
+
+#ifdef WITH_AVS_COAP_NET_STATS
+    // counters are summed over all shards
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_ctx_get_num_incoming_retransmissions(ctx),
+                          1);
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_ctx_get_num_outgoing_retransmissions(ctx),
+                          2);
+    AVS_UNIT_ASSERT_TRUE(avs_coap_ctx_get_tx_bytes(ctx)
+                         >= 2 * (uint64_t) res->length);
+    AVS_UNIT_ASSERT_TRUE(avs_coap_ctx_get_rx_bytes(ctx)
+                         >= 2 * (uint64_t) res->length + req->length);
+#endif // WITH_AVS_COAP_NET_STATS
+
+    avs_free(req_storage);
+    avs_free(res_storage);
+    avs_net_socket_cleanup(&backend);
+    avs_coap_ctx_cleanup(&ctx);
+}
+#endif // WITH_AVS_COMPAT_THREADING && WITH_AVS_COAP_MESSAGE_CACHE
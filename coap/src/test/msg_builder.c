@@ -451,3 +451,73 @@ AVS_UNIT_TEST(coap_builder, payload_call_with_zero_size_then_nonzero) {
 }
 
 #undef PAYLOAD
+
+static const avs_coap_msg_t *build_msg_with_opts(void *storage,
+                                                 size_t storage_size,
+                                                 avs_coap_msg_info_t *info) {
+    info->type = AVS_COAP_MSG_CONFIRMABLE;
+    info->code = AVS_COAP_CODE_CONTENT;
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_string(
+            info, AVS_COAP_OPT_URI_PATH, "a"));
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_u32(
+            info, AVS_COAP_OPT_MAX_AGE, 0x1234));
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_content_format(info, 42));
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_u16(
+            info, AVS_COAP_OPT_OBSERVE, 7));
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_string(
+            info, AVS_COAP_OPT_URI_PATH, "bc"));
+
+    AVS_UNIT_ASSERT_TRUE(avs_coap_msg_info_get_storage_size(info)
+                         <= storage_size);
+    return avs_coap_msg_build_without_payload(
+            avs_coap_ensure_aligned_buffer(storage), storage_size, info);
+}
+
+AVS_UNIT_TEST(coap_info, arena_same_as_list) {
+    union {
+        avs_coap_msg_t msg;
+        uint8_t bytes[128];
+    } list_storage, arena_storage;
+
+    avs_coap_msg_info_t list_info = avs_coap_msg_info_init();
+    const avs_coap_msg_t *list_msg =
+            build_msg_with_opts(&list_storage, sizeof(list_storage),
+                                &list_info);
+
+    uint16_t arena[32];
+    avs_coap_msg_info_t arena_info =
+            avs_coap_msg_info_init_with_arena(arena, sizeof(arena));
+    const avs_coap_msg_t *arena_msg =
+            build_msg_with_opts(&arena_storage, sizeof(arena_storage),
+                                &arena_info);
+    AVS_UNIT_ASSERT_NULL(arena_info.options_);
+
+    AVS_UNIT_ASSERT_EQUAL(list_msg->length, arena_msg->length);
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(list_msg->content, arena_msg->content,
+                                      list_msg->length);
+
+    avs_coap_msg_info_opt_remove_by_number(&list_info, AVS_COAP_OPT_URI_PATH);
+    avs_coap_msg_info_opt_remove_by_number(&arena_info, AVS_COAP_OPT_URI_PATH);
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_msg_info_get_headers_size(&list_info),
+                          avs_coap_msg_info_get_headers_size(&arena_info));
+
+    avs_coap_msg_info_reset(&list_info);
+    avs_coap_msg_info_reset(&arena_info);
+    AVS_UNIT_ASSERT_TRUE(arena_info.arena_ == arena);
+    AVS_UNIT_ASSERT_EQUAL(arena_info.arena_used_, 0);
+}
+
+AVS_UNIT_TEST(coap_info, arena_full) {
+    uint16_t arena[AVS_COAP_MSG_INFO_ARENA_OPT_SIZE(2) / sizeof(uint16_t)];
+    avs_coap_msg_info_t info =
+            avs_coap_msg_info_init_with_arena(arena, sizeof(arena));
+
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_string(
+            &info, AVS_COAP_OPT_URI_PATH, "ab"));
+    AVS_UNIT_ASSERT_FAILED(avs_coap_msg_info_opt_empty(
+            &info, AVS_COAP_OPT_IF_NONE_MATCH));
+
+    avs_coap_msg_info_opt_remove_by_number(&info, AVS_COAP_OPT_URI_PATH);
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_empty(
+            &info, AVS_COAP_OPT_IF_NONE_MATCH));
+}
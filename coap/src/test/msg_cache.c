@@ -16,6 +16,7 @@
 
 #include <avs_commons_posix_config.h>
 
+#include <stdio.h>
 #include <time.h>
 
 #include <avsystem/commons/defs.h>
@@ -45,6 +46,26 @@ static avs_coap_msg_t *setup_msg_with_id(void *buffer,
     return msg;
 }
 
+/**
+ * The cache treats endpoints as opaque byte strings, so for testing purposes
+ * it is enough to pack a textual host and port into one.
+ */
+static const avs_net_resolved_endpoint_t *
+make_endpoint(avs_net_resolved_endpoint_t *ep,
+              const char *host,
+              const char *port) {
+    size_t host_size = strlen(host) + 1;
+    size_t port_size = strlen(port);
+    AVS_UNIT_ASSERT_TRUE(host_size + port_size <= sizeof(ep->data.buf));
+    memcpy(ep->data.buf, host, host_size);
+    memcpy(ep->data.buf + host_size, port, port_size);
+    ep->size = (uint8_t) (host_size + port_size);
+    return ep;
+}
+
+#define ENDPOINT(Host, Port) \
+    make_endpoint(&(avs_net_resolved_endpoint_t) { 0 }, (Host), (Port))
+
 static avs_time_real_t MOCK_CLOCK = { { 0, 0 } };
 
 static void clock_advance(avs_time_duration_t t) {
@@ -73,8 +94,8 @@ AVS_UNIT_TEST(coap_msg_cache, null) {
 
     AVS_UNIT_ASSERT_NULL(_avs_coap_msg_cache_create(0));
     AVS_UNIT_ASSERT_FAILED(
-            _avs_coap_msg_cache_add(NULL, "host", "port", msg, &tx_params));
-    AVS_UNIT_ASSERT_NULL(_avs_coap_msg_cache_get(NULL, "host", "port", id));
+            _avs_coap_msg_cache_add(NULL, ENDPOINT("host", "port"), msg, &tx_params));
+    AVS_UNIT_ASSERT_NULL(_avs_coap_msg_cache_get(NULL, ENDPOINT("host", "port"), id));
 
     // these should not crash
     _avs_coap_msg_cache_release(&(coap_msg_cache_t*){NULL});
@@ -88,11 +109,11 @@ AVS_UNIT_TEST(coap_msg_cache, hit_single) {
     avs_coap_msg_t *msg __attribute__((cleanup(free_msg))) = setup_msg_with_id(avs_malloc(MIN_MSG_OBJECT_SIZE), id, "");
 
     AVS_UNIT_ASSERT_SUCCESS(
-            _avs_coap_msg_cache_add(cache, "host", "port", msg, &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), msg, &tx_params));
 
     // request message existing in cache
     const avs_coap_msg_t *cached_msg =
-            _avs_coap_msg_cache_get(cache, "host", "port", id);
+            _avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"), id);
     AVS_UNIT_ASSERT_NOT_NULL(cached_msg);
     AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(msg, cached_msg, MIN_MSG_OBJECT_SIZE);
 
@@ -111,15 +132,16 @@ AVS_UNIT_TEST(coap_msg_cache, hit_multiple) {
     };
 
     for (size_t i = 0; i < AVS_ARRAY_SIZE(msg) - 1; ++i) {
-        AVS_UNIT_ASSERT_SUCCESS(_avs_coap_msg_cache_add(cache, "host", "port",
-                                                        msg[i], &tx_params));
+        AVS_UNIT_ASSERT_SUCCESS(
+                _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"),
+                                        msg[i], &tx_params));
     }
 
     // request message existing in cache
     for (uint16_t i = 0; i < AVS_ARRAY_SIZE(msg) - 1; ++i) {
         const avs_coap_msg_t *cached_msg =
-                _avs_coap_msg_cache_get(cache, "host", "port",
-                                          (uint16_t)(id + i));
+                _avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"),
+                                        (uint16_t)(id + i));
         AVS_UNIT_ASSERT_NOT_NULL(cached_msg);
         AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(msg[i], cached_msg,
                                           MIN_MSG_OBJECT_SIZE);
@@ -135,11 +157,11 @@ AVS_UNIT_TEST(coap_msg_cache, hit_expired) {
     avs_coap_msg_t *msg __attribute__((cleanup(free_msg))) = setup_msg_with_id(avs_malloc(MIN_MSG_OBJECT_SIZE), id, "");
 
     AVS_UNIT_ASSERT_SUCCESS(
-            _avs_coap_msg_cache_add(cache, "host", "port", msg, &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), msg, &tx_params));
     clock_advance(avs_time_duration_from_scalar(247, AVS_TIME_S));
 
     // request expired message existing in cache
-    AVS_UNIT_ASSERT_NULL(_avs_coap_msg_cache_get(cache, "host", "port", id));
+    AVS_UNIT_ASSERT_NULL(_avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"), id));
 
     _avs_coap_msg_cache_release(&cache);
 }
@@ -156,15 +178,15 @@ AVS_UNIT_TEST(coap_msg_cache, hit_after_expiration) {
             setup_msg_with_id(avs_malloc(MIN_MSG_OBJECT_SIZE), id2, "");
 
     AVS_UNIT_ASSERT_SUCCESS(
-            _avs_coap_msg_cache_add(cache, "host", "port", msg1, &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), msg1, &tx_params));
     clock_advance(avs_time_duration_from_scalar(60, AVS_TIME_S));
     AVS_UNIT_ASSERT_SUCCESS(
-            _avs_coap_msg_cache_add(cache, "host", "port", msg2, &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), msg2, &tx_params));
     clock_advance(avs_time_duration_from_scalar(60, AVS_TIME_S));
 
     // request expired message existing in cache
     const avs_coap_msg_t *cached_msg =
-            _avs_coap_msg_cache_get(cache, "host", "port", id2);
+            _avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"), id2);
     AVS_UNIT_ASSERT_NOT_NULL(cached_msg);
     AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(msg2, cached_msg, MIN_MSG_OBJECT_SIZE);
 
@@ -176,7 +198,7 @@ AVS_UNIT_TEST(coap_msg_cache, miss_empty) {
     static const uint16_t id = 123;
 
     // request message from empty cache
-    AVS_UNIT_ASSERT_NULL(_avs_coap_msg_cache_get(cache, "host", "port", id));
+    AVS_UNIT_ASSERT_NULL(_avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"), id));
 
     _avs_coap_msg_cache_release(&cache);
 }
@@ -188,11 +210,11 @@ AVS_UNIT_TEST(coap_msg_cache, miss_non_empty) {
     avs_coap_msg_t *msg __attribute__((cleanup(free_msg))) = setup_msg_with_id(avs_malloc(MIN_MSG_OBJECT_SIZE), id, "");
 
     AVS_UNIT_ASSERT_SUCCESS(
-            _avs_coap_msg_cache_add(cache, "host", "port", msg, &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), msg, &tx_params));
 
     // request message not in cache
     AVS_UNIT_ASSERT_NULL(
-            _avs_coap_msg_cache_get(cache, "host", "port", (uint16_t)(id + 1)));
+            _avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"), (uint16_t)(id + 1)));
 
     _avs_coap_msg_cache_release(&cache);
 }
@@ -206,9 +228,9 @@ AVS_UNIT_TEST(coap_msg_cache, add_existing) {
     // replacing existing non-expired cached messages with updated ones
     // is not allowed
     AVS_UNIT_ASSERT_SUCCESS(
-            _avs_coap_msg_cache_add(cache, "host", "port", msg, &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), msg, &tx_params));
     AVS_UNIT_ASSERT_FAILED(
-            _avs_coap_msg_cache_add(cache, "host", "port", msg, &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), msg, &tx_params));
 
     _avs_coap_msg_cache_release(&cache);
 }
@@ -221,10 +243,10 @@ AVS_UNIT_TEST(coap_msg_cache, add_existing_expired) {
 
     // replacing existing expired cached messages is not allowed
     AVS_UNIT_ASSERT_SUCCESS(
-            _avs_coap_msg_cache_add(cache, "host", "port", msg, &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), msg, &tx_params));
     clock_advance(avs_time_duration_from_scalar(247, AVS_TIME_S));
     AVS_UNIT_ASSERT_SUCCESS(
-            _avs_coap_msg_cache_add(cache, "host", "port", msg, &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), msg, &tx_params));
 
     _avs_coap_msg_cache_release(&cache);
 }
@@ -245,23 +267,23 @@ AVS_UNIT_TEST(coap_msg_cache, add_evict) {
     // message with another ID removes oldest existing entry if extra space
     // is required
     AVS_UNIT_ASSERT_SUCCESS(
-            _avs_coap_msg_cache_add(cache, "host", "port", msg[0], &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), msg[0], &tx_params));
     AVS_UNIT_ASSERT_SUCCESS(
-            _avs_coap_msg_cache_add(cache, "host", "port", msg[1], &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), msg[1], &tx_params));
     AVS_UNIT_ASSERT_SUCCESS(
-            _avs_coap_msg_cache_add(cache, "host", "port", msg[2], &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), msg[2], &tx_params));
 
     // oldest entry was removed
-    AVS_UNIT_ASSERT_NULL(_avs_coap_msg_cache_get(cache, "host", "port", id));
+    AVS_UNIT_ASSERT_NULL(_avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"), id));
 
     // newer entry still exists
     cached_msg =
-            _avs_coap_msg_cache_get(cache, "host", "port", (uint16_t)(id + 1));
+            _avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"), (uint16_t)(id + 1));
     AVS_UNIT_ASSERT_NOT_NULL(cached_msg);
     AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(msg[1], cached_msg, MIN_MSG_OBJECT_SIZE);
 
     // newest entry was inserted
-    cached_msg = _avs_coap_msg_cache_get(cache, "host", "port",
+    cached_msg = _avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"),
                                            (uint16_t)(id + 2));
     AVS_UNIT_ASSERT_NOT_NULL(cached_msg);
     AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(msg[2], cached_msg, MIN_MSG_OBJECT_SIZE);
@@ -285,20 +307,20 @@ AVS_UNIT_TEST(coap_msg_cache, add_evict_multiple) {
     // message with another ID removes oldest existing entries if extra space
     // is required
     AVS_UNIT_ASSERT_SUCCESS(
-            _avs_coap_msg_cache_add(cache, "host", "port", msg[0], &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), msg[0], &tx_params));
     AVS_UNIT_ASSERT_SUCCESS(
-            _avs_coap_msg_cache_add(cache, "host", "port", msg[1], &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), msg[1], &tx_params));
     AVS_UNIT_ASSERT_SUCCESS(
-            _avs_coap_msg_cache_add(cache, "host", "port", msg[2], &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), msg[2], &tx_params));
 
     // oldest entries were removed
-    AVS_UNIT_ASSERT_NULL(_avs_coap_msg_cache_get(cache, "host", "port", id));
+    AVS_UNIT_ASSERT_NULL(_avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"), id));
     AVS_UNIT_ASSERT_NULL(
-            _avs_coap_msg_cache_get(cache, "host", "port", (uint16_t)(id + 1)));
+            _avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"), (uint16_t)(id + 1)));
 
     // newest entry was inserted
     const avs_coap_msg_t *cached_msg =
-            _avs_coap_msg_cache_get(cache, "host", "port", (uint16_t)(id + 2));
+            _avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"), (uint16_t)(id + 2));
     AVS_UNIT_ASSERT_NOT_NULL(cached_msg);
     AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(msg[2], cached_msg,
                                       MIN_MSG_OBJECT_SIZE
@@ -323,19 +345,19 @@ AVS_UNIT_TEST(coap_msg_cache, add_too_big) {
 
     // message too long to put into cache should be ignored
     AVS_UNIT_ASSERT_SUCCESS(
-            _avs_coap_msg_cache_add(cache, "host", "port", m1, &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), m1, &tx_params));
     AVS_UNIT_ASSERT_FAILED(
-            _avs_coap_msg_cache_add(cache, "host", "port", m2, &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), m2, &tx_params));
 
     // previously-added entry is still there
     const avs_coap_msg_t *cached_msg =
-            _avs_coap_msg_cache_get(cache, "host", "port", id);
+            _avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"), id);
     AVS_UNIT_ASSERT_NOT_NULL(cached_msg);
     AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(m1, cached_msg, MIN_MSG_OBJECT_SIZE);
 
     // "too big" entry was not inserted
     AVS_UNIT_ASSERT_NULL(
-            _avs_coap_msg_cache_get(cache, "host", "port", (uint16_t)(id + 1)));
+            _avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"), (uint16_t)(id + 1)));
 
     _avs_coap_msg_cache_release(&cache);
 }
@@ -352,17 +374,17 @@ AVS_UNIT_TEST(coap_msg_cache, multiple_hosts_same_ids) {
     coap_msg_cache_t *cache = _avs_coap_msg_cache_create(4096);
 
     AVS_UNIT_ASSERT_SUCCESS(
-            _avs_coap_msg_cache_add(cache, "h1", "port", m1, &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("h1", "port"), m1, &tx_params));
     AVS_UNIT_ASSERT_SUCCESS(
-            _avs_coap_msg_cache_add(cache, "h2", "port", m2, &tx_params));
+            _avs_coap_msg_cache_add(cache, ENDPOINT("h2", "port"), m2, &tx_params));
 
     // both entries should be present despite having identical IDs
     const avs_coap_msg_t *cached_msg =
-            _avs_coap_msg_cache_get(cache, "h1", "port", id);
+            _avs_coap_msg_cache_get(cache, ENDPOINT("h1", "port"), id);
     AVS_UNIT_ASSERT_NOT_NULL(cached_msg);
     AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(m1, cached_msg, MIN_MSG_OBJECT_SIZE);
 
-    cached_msg = _avs_coap_msg_cache_get(cache, "h2", "port", id);
+    cached_msg = _avs_coap_msg_cache_get(cache, ENDPOINT("h2", "port"), id);
     AVS_UNIT_ASSERT_NOT_NULL(cached_msg);
     AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(m2, cached_msg,
                                       MIN_MSG_OBJECT_SIZE
@@ -370,3 +392,500 @@ AVS_UNIT_TEST(coap_msg_cache, multiple_hosts_same_ids) {
 
     _avs_coap_msg_cache_release(&cache);
 }
+
+AVS_UNIT_TEST(coap_msg_cache, many_entries) {
+    static const char *const hosts[] = { "h1", "h2", "h3" };
+    static const uint16_t num_ids = 500;
+    avs_coap_msg_t *msg __attribute__((cleanup(free_msg))) =
+            setup_msg_with_id(avs_malloc(MIN_MSG_OBJECT_SIZE), 0, "");
+
+    coap_msg_cache_t *cache = _avs_coap_msg_cache_create(
+            (_avs_coap_msg_cache_overhead(msg) + MIN_MSG_OBJECT_SIZE)
+            * num_ids * AVS_ARRAY_SIZE(hosts));
+
+    for (uint16_t id = 0; id < num_ids; ++id) {
+        for (size_t i = 0; i < AVS_ARRAY_SIZE(hosts); ++i) {
+            _avs_coap_header_set_id(msg, id);
+            AVS_UNIT_ASSERT_SUCCESS(_avs_coap_msg_cache_add(
+                    cache, ENDPOINT(hosts[i], "port"), msg, &tx_params));
+        }
+    }
+
+    // all entries fit, so all of them should be found
+    for (uint16_t id = 0; id < num_ids; ++id) {
+        for (size_t i = 0; i < AVS_ARRAY_SIZE(hosts); ++i) {
+            const avs_coap_msg_t *cached_msg =
+                    _avs_coap_msg_cache_get(cache, ENDPOINT(hosts[i], "port"), id);
+            AVS_UNIT_ASSERT_NOT_NULL(cached_msg);
+            AVS_UNIT_ASSERT_EQUAL(avs_coap_msg_get_id(cached_msg), id);
+        }
+        AVS_UNIT_ASSERT_NULL(_avs_coap_msg_cache_get(cache, ENDPOINT("h1", "other"), id));
+        AVS_UNIT_ASSERT_NULL(_avs_coap_msg_cache_get(cache, ENDPOINT("h4", "port"), id));
+    }
+
+    _avs_coap_msg_cache_release(&cache);
+}
+
+AVS_UNIT_TEST(coap_msg_cache, many_endpoints) {
+    static const size_t num_hosts = 200;
+    static const uint16_t id = 123;
+    avs_coap_msg_t *msg __attribute__((cleanup(free_msg))) =
+            setup_msg_with_id(avs_malloc(MIN_MSG_OBJECT_SIZE), id, "");
+
+    coap_msg_cache_t *cache = _avs_coap_msg_cache_create(
+            (_avs_coap_msg_cache_overhead(msg) + MIN_MSG_OBJECT_SIZE)
+            * num_hosts);
+
+    // endpoints are dropped along with their last entry and added again, so
+    // check that the endpoint index survives both
+    for (int round = 0; round < 2; ++round) {
+        for (size_t i = 0; i < num_hosts; ++i) {
+            char host[16];
+            snprintf(host, sizeof(host), "h%u", (unsigned) i);
+            AVS_UNIT_ASSERT_SUCCESS(_avs_coap_msg_cache_add(
+                    cache, ENDPOINT(host, "port"), msg, &tx_params));
+        }
+        for (size_t i = 0; i < num_hosts; ++i) {
+            char host[16];
+            snprintf(host, sizeof(host), "h%u", (unsigned) i);
+            AVS_UNIT_ASSERT_NOT_NULL(
+                    _avs_coap_msg_cache_get(cache, ENDPOINT(host, "port"), id));
+        }
+        clock_advance(avs_time_duration_from_scalar(247, AVS_TIME_S));
+        AVS_UNIT_ASSERT_NULL(
+                _avs_coap_msg_cache_get(cache, ENDPOINT("h0", "port"), id));
+    }
+
+    _avs_coap_msg_cache_release(&cache);
+}
+
+// adds 1000 messages to a cache of given engine that fits exactly
+// capacity_msgs of them and checks that only the most recent ones are found
+static void assert_evicts_oldest(avs_coap_msg_cache_engine_t engine,
+                                 size_t capacity, size_t capacity_msgs) {
+    avs_coap_msg_t *msg __attribute__((cleanup(free_msg))) =
+            setup_msg_with_id(avs_malloc(MIN_MSG_OBJECT_SIZE), 0, "");
+
+    coap_msg_cache_t *cache =
+            _avs_coap_msg_cache_create_with_engine(capacity, engine);
+    AVS_UNIT_ASSERT_NOT_NULL(cache);
+
+    for (uint16_t id = 0; id < 1000; ++id) {
+        const char *host = (id % 2) ? "odd" : "even";
+        _avs_coap_header_set_id(msg, id);
+        // make expiration times, and thus the eviction order, unambiguous
+        clock_advance(avs_time_duration_from_scalar(1, AVS_TIME_MS));
+        AVS_UNIT_ASSERT_SUCCESS(
+                _avs_coap_msg_cache_add(cache, ENDPOINT(host, "port"), msg, &tx_params));
+
+        for (uint16_t prev = 0; prev <= id; ++prev) {
+            const char *prev_host = (prev % 2) ? "odd" : "even";
+            const avs_coap_msg_t *cached_msg =
+                    _avs_coap_msg_cache_get(cache, ENDPOINT(prev_host, "port"), prev);
+            if ((size_t) (id - prev) < capacity_msgs) {
+                AVS_UNIT_ASSERT_NOT_NULL(cached_msg);
+                AVS_UNIT_ASSERT_EQUAL(avs_coap_msg_get_id(cached_msg), prev);
+            } else {
+                AVS_UNIT_ASSERT_NULL(cached_msg);
+            }
+        }
+    }
+
+    _avs_coap_msg_cache_debug_print(cache);
+    _avs_coap_msg_cache_release(&cache);
+}
+
+AVS_UNIT_TEST(coap_msg_cache, evict_many) {
+    static const size_t capacity_msgs = 7;
+    avs_coap_msg_t *msg __attribute__((cleanup(free_msg))) =
+            setup_msg_with_id(avs_malloc(MIN_MSG_OBJECT_SIZE), 0, "");
+
+    // entries get evicted continuously, which also forces the underlying
+    // buffer to be defragmented; only the most recent ones may be found
+    assert_evicts_oldest(AVS_COAP_MSG_CACHE_ENGINE_FIFO,
+                         (_avs_coap_msg_cache_overhead(msg)
+                          + MIN_MSG_OBJECT_SIZE) * capacity_msgs,
+                         capacity_msgs);
+}
+
+AVS_UNIT_TEST(coap_msg_cache, prefilter) {
+    coap_msg_cache_t *cache = _avs_coap_msg_cache_create(1024);
+
+    static const uint16_t id = 123;
+    avs_coap_msg_t *msg __attribute__((cleanup(free_msg))) =
+            setup_msg_with_id(avs_malloc(MIN_MSG_OBJECT_SIZE), id, "");
+
+    AVS_UNIT_ASSERT_FALSE(_avs_coap_msg_cache_may_contain(
+            NULL, ENDPOINT("host", "port"), id));
+    AVS_UNIT_ASSERT_FALSE(_avs_coap_msg_cache_may_contain(
+            cache, ENDPOINT("host", "port"), id));
+
+    AVS_UNIT_ASSERT_SUCCESS(_avs_coap_msg_cache_add(
+            cache, ENDPOINT("host", "port"), msg, &tx_params));
+    AVS_UNIT_ASSERT_TRUE(_avs_coap_msg_cache_may_contain(
+            cache, ENDPOINT("host", "port"), id));
+    // the same ID sent to another endpoint is a different key
+    AVS_UNIT_ASSERT_FALSE(_avs_coap_msg_cache_may_contain(
+            cache, ENDPOINT("host", "other"), id));
+
+    // the filter is updated when entries expire
+    clock_advance(avs_time_duration_from_scalar(247, AVS_TIME_S));
+    AVS_UNIT_ASSERT_NULL(
+            _avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"), id));
+    AVS_UNIT_ASSERT_FALSE(_avs_coap_msg_cache_may_contain(
+            cache, ENDPOINT("host", "port"), id));
+
+    // rejections are counted as misses, except for the NULL cache
+    avs_coap_cache_stats_t stats;
+    _avs_coap_msg_cache_get_stats(cache, &stats);
+    AVS_UNIT_ASSERT_EQUAL(stats.misses, 4);
+    AVS_UNIT_ASSERT_EQUAL(stats.expirations, 1);
+
+    _avs_coap_msg_cache_release(&cache);
+}
+
+AVS_UNIT_TEST(coap_msg_cache, prefilter_no_false_negatives) {
+    coap_msg_cache_t *cache = _avs_coap_msg_cache_create(4096);
+
+    // adding many messages causes evictions, but whatever is still in the
+    // cache has to pass the filter
+    for (uint16_t id = 0; id < 1000; ++id) {
+        avs_coap_msg_t *msg __attribute__((cleanup(free_msg))) =
+                setup_msg_with_id(avs_malloc(MIN_MSG_OBJECT_SIZE),
+                                  (uint16_t) (id * 7), "");
+        AVS_UNIT_ASSERT_SUCCESS(_avs_coap_msg_cache_add(
+                cache, ENDPOINT("host", "port"), msg, &tx_params));
+    }
+
+    size_t rejected = 0;
+    for (uint32_t id = 0; id <= UINT16_MAX; ++id) {
+        if (_avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"),
+                                    (uint16_t) id)) {
+            AVS_UNIT_ASSERT_TRUE(_avs_coap_msg_cache_may_contain(
+                    cache, ENDPOINT("host", "port"), (uint16_t) id));
+        } else if (!_avs_coap_msg_cache_may_contain(
+                           cache, ENDPOINT("host", "port"), (uint16_t) id)) {
+            ++rejected;
+        }
+    }
+    // most IDs not in the cache are rejected by the filter itself
+    AVS_UNIT_ASSERT_TRUE(rejected > UINT16_MAX / 2);
+
+    _avs_coap_msg_cache_release(&cache);
+}
+
+static coap_msg_cache_t *create_slab_cache(size_t capacity) {
+    coap_msg_cache_t *cache = _avs_coap_msg_cache_create_with_engine(
+            capacity, AVS_COAP_MSG_CACHE_ENGINE_SLAB);
+    AVS_UNIT_ASSERT_NOT_NULL(cache);
+    return cache;
+}
+
+AVS_UNIT_TEST(coap_msg_cache, slab_null) {
+    AVS_UNIT_ASSERT_NULL(_avs_coap_msg_cache_create_with_engine(
+            0, AVS_COAP_MSG_CACHE_ENGINE_SLAB));
+    // not enough room for a single slot
+    AVS_UNIT_ASSERT_NULL(_avs_coap_msg_cache_create_with_engine(
+            16, AVS_COAP_MSG_CACHE_ENGINE_SLAB));
+}
+
+AVS_UNIT_TEST(coap_msg_cache, slab_hit_and_expire) {
+    coap_msg_cache_t *cache = create_slab_cache(1024);
+
+    static const uint16_t id = 123;
+    avs_coap_msg_t *msg __attribute__((cleanup(free_msg))) =
+            setup_msg_with_id(avs_malloc(MIN_MSG_OBJECT_SIZE), id, "");
+
+    AVS_UNIT_ASSERT_SUCCESS(_avs_coap_msg_cache_add(
+            cache, ENDPOINT("host", "port"), msg, &tx_params));
+    AVS_UNIT_ASSERT_EQUAL(
+            _avs_coap_msg_cache_add(cache, ENDPOINT("host", "port"), msg,
+                                    &tx_params),
+            AVS_COAP_MSG_CACHE_DUPLICATE);
+
+    const avs_coap_msg_t *cached_msg =
+            _avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"), id);
+    AVS_UNIT_ASSERT_NOT_NULL(cached_msg);
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(msg, cached_msg, MIN_MSG_OBJECT_SIZE);
+
+    clock_advance(avs_time_duration_from_scalar(247, AVS_TIME_S));
+    AVS_UNIT_ASSERT_NULL(
+            _avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"), id));
+    AVS_UNIT_ASSERT_FALSE(_avs_coap_msg_cache_may_contain(
+            cache, ENDPOINT("host", "port"), id));
+
+    avs_coap_cache_stats_t stats;
+    _avs_coap_msg_cache_get_stats(cache, &stats);
+    AVS_UNIT_ASSERT_EQUAL(stats.hits, 1);
+    AVS_UNIT_ASSERT_EQUAL(stats.expirations, 1);
+
+    _avs_coap_msg_cache_release(&cache);
+}
+
+static avs_coap_msg_t *make_msg_with_payload(uint16_t msg_id,
+                                             size_t payload_size) {
+    char *payload = (char *) avs_malloc(payload_size + 1);
+    AVS_UNIT_ASSERT_NOT_NULL(payload);
+    memset(payload, 'x', payload_size);
+    if (payload_size) {
+        payload[0] = '\xFF';
+    }
+    payload[payload_size] = '\0';
+    avs_coap_msg_t *msg = setup_msg_with_id(
+            avs_malloc(MIN_MSG_OBJECT_SIZE + payload_size), msg_id, payload);
+    avs_free(payload);
+    return msg;
+}
+
+static void add_in_order(coap_msg_cache_t *cache,
+                         avs_coap_msg_t *msg,
+                         uint16_t msg_id) {
+    clock_advance(avs_time_duration_from_scalar(1, AVS_TIME_MS));
+    _avs_coap_header_set_id(msg, msg_id);
+    AVS_UNIT_ASSERT_SUCCESS(_avs_coap_msg_cache_add(
+            cache, ENDPOINT("host", "port"), msg, &tx_params));
+}
+
+static bool is_cached(coap_msg_cache_t *cache, uint16_t msg_id) {
+    return _avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"), msg_id)
+           != NULL;
+}
+
+AVS_UNIT_TEST(coap_msg_cache, slab_evicts_oldest_that_fits) {
+    // 1024 bytes are split into 2 slots of 32 bytes, and one of 64, 128,
+    // 256 and 512 bytes each
+    coap_msg_cache_t *cache = create_slab_cache(1024);
+
+    avs_coap_msg_t *small __attribute__((cleanup(free_msg))) =
+            make_msg_with_payload(0, 0);
+    avs_coap_msg_t *large __attribute__((cleanup(free_msg))) =
+            make_msg_with_payload(0, 120);
+
+    add_in_order(cache, small, 0);
+    add_in_order(cache, small, 1);
+    for (uint16_t id = 1000; id < 1003; ++id) {
+        add_in_order(cache, large, id);
+    }
+
+    // large messages only fit in the two largest slots and evict each other
+    AVS_UNIT_ASSERT_TRUE(is_cached(cache, 0));
+    AVS_UNIT_ASSERT_TRUE(is_cached(cache, 1));
+    AVS_UNIT_ASSERT_FALSE(is_cached(cache, 1000));
+    AVS_UNIT_ASSERT_TRUE(is_cached(cache, 1001));
+    const avs_coap_msg_t *cached_msg =
+            _avs_coap_msg_cache_get(cache, ENDPOINT("host", "port"), 1002);
+    AVS_UNIT_ASSERT_NOT_NULL(cached_msg);
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(large, cached_msg,
+                                      offsetof(avs_coap_msg_t, content)
+                                      + large->length);
+
+    // small messages use free larger slots instead of evicting anything
+    add_in_order(cache, small, 2);
+    add_in_order(cache, small, 3);
+    for (uint16_t id = 0; id < 4; ++id) {
+        AVS_UNIT_ASSERT_TRUE(is_cached(cache, id));
+    }
+
+    // once everything is full, the oldest entry goes, whichever class it is in
+    add_in_order(cache, small, 4);
+    AVS_UNIT_ASSERT_FALSE(is_cached(cache, 0));
+    for (uint16_t id = 1; id < 5; ++id) {
+        AVS_UNIT_ASSERT_TRUE(is_cached(cache, id));
+    }
+    AVS_UNIT_ASSERT_TRUE(is_cached(cache, 1001));
+    AVS_UNIT_ASSERT_TRUE(is_cached(cache, 1002));
+
+    avs_coap_cache_stats_t stats;
+    _avs_coap_msg_cache_get_stats(cache, &stats);
+    AVS_UNIT_ASSERT_EQUAL(stats.evictions, 2);
+
+    _avs_coap_msg_cache_release(&cache);
+}
+
+AVS_UNIT_TEST(coap_msg_cache, slab_add_full_block) {
+    avs_coap_msg_t *msg __attribute__((cleanup(free_msg))) =
+            make_msg_with_payload(0, 1 + AVS_COAP_MSG_BLOCK_MAX_SIZE);
+
+    coap_msg_cache_t *cache = create_slab_cache(4096);
+    AVS_UNIT_ASSERT_SUCCESS(_avs_coap_msg_cache_add(
+            cache, ENDPOINT("host", "port"), msg, &tx_params));
+    AVS_UNIT_ASSERT_TRUE(is_cached(cache, 0));
+
+    _avs_coap_msg_cache_release(&cache);
+}
+
+AVS_UNIT_TEST(coap_msg_cache, slab_add_too_big) {
+    avs_coap_msg_t *msg __attribute__((cleanup(free_msg))) =
+            make_msg_with_payload(0, 500);
+
+    // the largest slot takes at most half of the capacity, even though the
+    // message would fit in the whole of it
+    coap_msg_cache_t *cache = create_slab_cache(1024);
+    AVS_UNIT_ASSERT_FAILED(_avs_coap_msg_cache_add(
+            cache, ENDPOINT("host", "port"), msg, &tx_params));
+    AVS_UNIT_ASSERT_FALSE(is_cached(cache, 0));
+
+    _avs_coap_msg_cache_release(&cache);
+}
+
+AVS_UNIT_TEST(coap_msg_cache, slab_evict_many) {
+    // 256 bytes are split into 2 slots of 32 bytes, one of 64 and one of 128
+    assert_evicts_oldest(AVS_COAP_MSG_CACHE_ENGINE_SLAB, 256, 4);
+}
+
+/**
+ * Adds a stream of messages, every fourth of them large, to a cache of given
+ * engine and after each one looks up ones sent a few exchanges earlier, as
+ * retransmitted requests would. Returns the number of hits.
+ */
+static size_t mixed_size_hits(avs_coap_msg_cache_engine_t engine) {
+    static const size_t distances[] = { 1, 2, 4, 8, 16, 32, 48, 64 };
+    avs_coap_msg_t *small __attribute__((cleanup(free_msg))) =
+            make_msg_with_payload(0, 16);
+    avs_coap_msg_t *large __attribute__((cleanup(free_msg))) =
+            make_msg_with_payload(0, 600);
+
+    coap_msg_cache_t *cache =
+            _avs_coap_msg_cache_create_with_engine(16 * 1024, engine);
+    AVS_UNIT_ASSERT_NOT_NULL(cache);
+
+    size_t hits = 0;
+    for (uint16_t id = 0; id < 2000; ++id) {
+        add_in_order(cache, id % 4 == 3 ? large : small, id);
+        for (size_t i = 0; i < AVS_ARRAY_SIZE(distances); ++i) {
+            if (id >= distances[i]
+                    && is_cached(cache, (uint16_t) (id - distances[i]))) {
+                ++hits;
+            }
+        }
+    }
+
+    _avs_coap_msg_cache_release(&cache);
+    return hits;
+}
+
+AVS_UNIT_TEST(coap_msg_cache, slab_mixed_size_hit_rate) {
+    const size_t fifo_hits = mixed_size_hits(AVS_COAP_MSG_CACHE_ENGINE_FIFO);
+    const size_t slab_hits = mixed_size_hits(AVS_COAP_MSG_CACHE_ENGINE_SLAB);
+    LOG(INFO, "mixed size hits: FIFO %lu, slab %lu",
+        (unsigned long) fifo_hits, (unsigned long) slab_hits);
+    AVS_UNIT_ASSERT_TRUE(fifo_hits > 0);
+    // fixed slot sizes waste some memory, but not most of it
+    AVS_UNIT_ASSERT_TRUE(4 * slab_hits >= 3 * fifo_hits);
+}
+
+#ifdef WITH_AVS_COMPAT_THREADING
+#include <pthread.h>
+
+AVS_UNIT_TEST(coap_msg_cache, sharded) {
+    static const char *const hosts[] = { "h1", "h2", "h3", "h4", "h5" };
+    static const uint16_t id = 123;
+    avs_coap_msg_t *msg __attribute__((cleanup(free_msg))) =
+            setup_msg_with_id(avs_malloc(MIN_MSG_OBJECT_SIZE), id, "");
+
+    AVS_UNIT_ASSERT_NULL(_avs_coap_msg_cache_create_sharded(
+            16, AVS_COAP_MSG_CACHE_ENGINE_FIFO, 32));
+
+    coap_msg_cache_t *cache = _avs_coap_msg_cache_create_sharded(
+            4096, AVS_COAP_MSG_CACHE_ENGINE_FIFO, 4);
+    AVS_UNIT_ASSERT_NOT_NULL(cache);
+
+    for (size_t i = 0; i < AVS_ARRAY_SIZE(hosts); ++i) {
+        AVS_UNIT_ASSERT_SUCCESS(_avs_coap_msg_cache_add(
+                cache, ENDPOINT(hosts[i], "port"), msg, &tx_params));
+        AVS_UNIT_ASSERT_EQUAL(
+                _avs_coap_msg_cache_add(cache, ENDPOINT(hosts[i], "port"),
+                                        msg, &tx_params),
+                AVS_COAP_MSG_CACHE_DUPLICATE);
+    }
+    for (size_t i = 0; i < AVS_ARRAY_SIZE(hosts); ++i) {
+        avs_coap_msg_t *copy = _avs_coap_msg_cache_get_copy(
+                cache, ENDPOINT(hosts[i], "port"), id);
+        AVS_UNIT_ASSERT_NOT_NULL(copy);
+        AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(msg, copy, MIN_MSG_OBJECT_SIZE);
+        avs_free(copy);
+    }
+    AVS_UNIT_ASSERT_NULL(_avs_coap_msg_cache_get_copy(
+            cache, ENDPOINT("h6", "port"), id));
+    // each shard keeps its own filter
+    for (size_t i = 0; i < AVS_ARRAY_SIZE(hosts); ++i) {
+        AVS_UNIT_ASSERT_TRUE(_avs_coap_msg_cache_may_contain(
+                cache, ENDPOINT(hosts[i], "port"), id));
+        AVS_UNIT_ASSERT_FALSE(_avs_coap_msg_cache_may_contain(
+                cache, ENDPOINT(hosts[i], "port"), (uint16_t) (id + 1)));
+    }
+    AVS_UNIT_ASSERT_FALSE(_avs_coap_msg_cache_may_contain(
+            cache, ENDPOINT("h6", "port"), id));
+
+    avs_coap_cache_stats_t stats;
+    _avs_coap_msg_cache_get_stats(cache, &stats);
+    AVS_UNIT_ASSERT_EQUAL(stats.hits, AVS_ARRAY_SIZE(hosts));
+    // the failed copy and every filter rejection
+    AVS_UNIT_ASSERT_EQUAL(stats.misses, AVS_ARRAY_SIZE(hosts) + 2);
+
+    _avs_coap_msg_cache_debug_print(cache);
+    _avs_coap_msg_cache_release(&cache);
+    AVS_UNIT_ASSERT_NULL(cache);
+}
+
+#define SHARDED_THREADS 4
+#define SHARDED_MSGS_PER_THREAD 200
+
+typedef struct {
+    coap_msg_cache_t *cache;
+    char host[sizeof("hostN")];
+    bool ok;
+} sharded_worker_t;
+
+static void *sharded_worker(void *arg_) {
+    sharded_worker_t *arg = (sharded_worker_t *) arg_;
+    union {
+        avs_coap_msg_t msg;
+        char bytes[MIN_MSG_OBJECT_SIZE];
+    } storage;
+    arg->ok = true;
+    for (uint16_t id = 0; id < SHARDED_MSGS_PER_THREAD; ++id) {
+        avs_net_resolved_endpoint_t ep;
+        setup_msg_with_id(&storage.msg, id, "");
+        make_endpoint(&ep, arg->host, "port");
+        if (_avs_coap_msg_cache_add(arg->cache, &ep, &storage.msg,
+                                    &tx_params)) {
+            arg->ok = false;
+        }
+        avs_coap_msg_t *copy =
+                _avs_coap_msg_cache_get_copy(arg->cache, &ep, id);
+        if (!copy || avs_coap_msg_get_id(copy) != id) {
+            arg->ok = false;
+        }
+        avs_free(copy);
+    }
+    return NULL;
+}
+
+AVS_UNIT_TEST(coap_msg_cache, sharded_concurrent) {
+    coap_msg_cache_t *cache = _avs_coap_msg_cache_create_sharded(
+            64 * 1024, AVS_COAP_MSG_CACHE_ENGINE_SLAB, 4);
+    AVS_UNIT_ASSERT_NOT_NULL(cache);
+
+    pthread_t threads[SHARDED_THREADS];
+    sharded_worker_t workers[SHARDED_THREADS];
+    for (size_t i = 0; i < SHARDED_THREADS; ++i) {
+        workers[i].cache = cache;
+        memcpy(workers[i].host, "hostN", sizeof("hostN"));
+        workers[i].host[sizeof("host") - 1] = (char) ('0' + i);
+        AVS_UNIT_ASSERT_SUCCESS(pthread_create(&threads[i], NULL,
+                                               sharded_worker, &workers[i]));
+    }
+    for (size_t i = 0; i < SHARDED_THREADS; ++i) {
+        AVS_UNIT_ASSERT_SUCCESS(pthread_join(threads[i], NULL));
+        AVS_UNIT_ASSERT_TRUE(workers[i].ok);
+    }
+
+    avs_coap_cache_stats_t stats;
+    _avs_coap_msg_cache_get_stats(cache, &stats);
+    AVS_UNIT_ASSERT_EQUAL(stats.hits,
+                          SHARDED_THREADS * SHARDED_MSGS_PER_THREAD);
+
+    _avs_coap_msg_cache_release(&cache);
+}
+#endif // WITH_AVS_COMPAT_THREADING
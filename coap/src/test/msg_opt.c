@@ -0,0 +1,284 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <avs_commons_config.h>
+
+#include <avsystem/commons/unit/test.h>
+
+#include <avsystem/commons/coap/block_utils.h>
+#include <avsystem/commons/coap/msg_builder.h>
+
+typedef union {
+    avs_coap_msg_t msg;
+    char buffer[offsetof(avs_coap_msg_t, content) + 256];
+} test_msg_t;
+
+static const avs_coap_msg_t *build_msg(test_msg_t *storage,
+                                       avs_coap_msg_info_t *info,
+                                       const char *payload) {
+    info->type = AVS_COAP_MSG_CONFIRMABLE;
+    info->code = AVS_COAP_CODE_CONTENT;
+
+    avs_coap_msg_builder_t builder;
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_builder_init(
+            &builder, avs_coap_ensure_aligned_buffer(storage),
+            sizeof(*storage), info));
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_msg_builder_payload(&builder, payload,
+                                                       strlen(payload)),
+                          strlen(payload));
+    avs_coap_msg_info_reset(info);
+    return avs_coap_msg_builder_get_msg(&builder);
+}
+
+AVS_UNIT_TEST(coap_msg_opt, index_lookup) {
+    avs_coap_msg_info_t info = avs_coap_msg_info_init();
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_string(
+            &info, AVS_COAP_OPT_URI_PATH, "foo"));
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_string(
+            &info, AVS_COAP_OPT_URI_PATH, "bar"));
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_content_format(&info, 42));
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_u32(
+            &info, AVS_COAP_OPT_OBSERVE, 0x123456));
+    const avs_coap_block_info_t block = {
+        .type = AVS_COAP_BLOCK2,
+        .valid = true,
+        .seq_num = 3,
+        .has_more = true,
+        .size = 64
+    };
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_block(&info, &block));
+
+    test_msg_t storage;
+    const avs_coap_msg_t *msg = build_msg(&storage, &info, "payload");
+
+    avs_coap_msg_index_t index;
+    avs_coap_msg_index_build(msg, &index);
+    AVS_UNIT_ASSERT_TRUE(index.msg == msg);
+    AVS_UNIT_ASSERT_EQUAL(index.num_options, 5);
+    AVS_UNIT_ASSERT_FALSE(index.truncated);
+    AVS_UNIT_ASSERT_TRUE(msg->content + index.payload_offset
+                         == avs_coap_msg_payload(msg));
+
+    uint16_t opt_numbers[] = {
+        AVS_COAP_OPT_URI_PATH, AVS_COAP_OPT_CONTENT_FORMAT,
+        AVS_COAP_OPT_OBSERVE, AVS_COAP_OPT_BLOCK2, AVS_COAP_OPT_BLOCK1
+    };
+    for (size_t i = 0; i < AVS_ARRAY_SIZE(opt_numbers); ++i) {
+        const avs_coap_opt_t *expected;
+        const avs_coap_opt_t *actual;
+        int expected_result =
+                avs_coap_msg_find_unique_opt(msg, opt_numbers[i], &expected);
+        AVS_UNIT_ASSERT_EQUAL(avs_coap_msg_index_find_unique_opt(
+                                      &index, opt_numbers[i], &actual),
+                              expected_result);
+        AVS_UNIT_ASSERT_TRUE(actual == expected);
+    }
+
+    uint16_t format;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_coap_msg_index_get_content_format(&index, &format));
+    AVS_UNIT_ASSERT_EQUAL(format, 42);
+
+    uint32_t observe;
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_index_get_option_u32(
+            &index, AVS_COAP_OPT_OBSERVE, &observe));
+    AVS_UNIT_ASSERT_EQUAL(observe, 0x123456);
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_msg_index_get_option_u32(
+                                  &index, AVS_COAP_OPT_MAX_AGE, &observe),
+                          AVS_COAP_OPTION_MISSING);
+    AVS_UNIT_ASSERT_FAILED(avs_coap_msg_index_get_option_u32(
+            &index, AVS_COAP_OPT_URI_PATH, &observe));
+
+    avs_coap_block_info_t block_info;
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_index_get_block_info(
+            &index, AVS_COAP_BLOCK2, &block_info));
+    AVS_UNIT_ASSERT_TRUE(block_info.valid);
+    AVS_UNIT_ASSERT_EQUAL(block_info.seq_num, 3);
+    AVS_UNIT_ASSERT_TRUE(block_info.has_more);
+    AVS_UNIT_ASSERT_EQUAL(block_info.size, 64);
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_index_get_block_info(
+            &index, AVS_COAP_BLOCK1, &block_info));
+    AVS_UNIT_ASSERT_FALSE(block_info.valid);
+}
+
+AVS_UNIT_TEST(coap_msg_opt, index_no_options) {
+    avs_coap_msg_info_t info = avs_coap_msg_info_init();
+    test_msg_t storage;
+    const avs_coap_msg_t *msg = build_msg(&storage, &info, "");
+
+    avs_coap_msg_index_t index;
+    avs_coap_msg_index_build(msg, &index);
+    AVS_UNIT_ASSERT_EQUAL(index.num_options, 0);
+    AVS_UNIT_ASSERT_EQUAL(index.payload_offset, msg->length);
+
+    uint16_t format;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_coap_msg_index_get_content_format(&index, &format));
+    AVS_UNIT_ASSERT_EQUAL(format, AVS_COAP_FORMAT_NONE);
+}
+
+AVS_UNIT_TEST(coap_msg_opt, index_truncated) {
+    avs_coap_msg_info_t info = avs_coap_msg_info_init();
+    for (size_t i = 0; i < AVS_COAP_MSG_INDEX_MAX_OPTIONS + 4; ++i) {
+        AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_string(
+                &info, AVS_COAP_OPT_URI_PATH, "x"));
+    }
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_content_format(&info, 42));
+
+    test_msg_t storage;
+    const avs_coap_msg_t *msg = build_msg(&storage, &info, "payload");
+
+    avs_coap_msg_index_t index;
+    avs_coap_msg_index_build(msg, &index);
+    AVS_UNIT_ASSERT_TRUE(index.truncated);
+    AVS_UNIT_ASSERT_EQUAL(index.num_options, AVS_COAP_MSG_INDEX_MAX_OPTIONS);
+    AVS_UNIT_ASSERT_TRUE(msg->content + index.payload_offset
+                         == avs_coap_msg_payload(msg));
+
+    // options past the indexed ones are still found
+    uint16_t format;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_coap_msg_index_get_content_format(&index, &format));
+    AVS_UNIT_ASSERT_EQUAL(format, 42);
+
+    const avs_coap_opt_t *opt;
+    AVS_UNIT_ASSERT_FAILED(avs_coap_msg_index_find_unique_opt(
+            &index, AVS_COAP_OPT_IF_MATCH, &opt));
+    AVS_UNIT_ASSERT_NULL(opt);
+}
+
+static void assert_index_equal(const avs_coap_msg_index_t *actual,
+                               const avs_coap_msg_index_t *expected) {
+    AVS_UNIT_ASSERT_TRUE(actual->msg == expected->msg);
+    AVS_UNIT_ASSERT_EQUAL(actual->num_options, expected->num_options);
+    AVS_UNIT_ASSERT_EQUAL(actual->truncated, expected->truncated);
+    AVS_UNIT_ASSERT_EQUAL(actual->payload_offset, expected->payload_offset);
+    for (size_t i = 0; i < expected->num_options; ++i) {
+        AVS_UNIT_ASSERT_EQUAL(actual->options[i].offset,
+                              expected->options[i].offset);
+        AVS_UNIT_ASSERT_EQUAL(actual->options[i].length,
+                              expected->options[i].length);
+        AVS_UNIT_ASSERT_EQUAL(actual->options[i].number,
+                              expected->options[i].number);
+    }
+}
+
+AVS_UNIT_TEST(coap_msg_opt, validate_and_index) {
+    avs_coap_msg_info_t info = avs_coap_msg_info_init();
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_string(
+            &info, AVS_COAP_OPT_URI_PATH, "foo"));
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_string(
+            &info, AVS_COAP_OPT_URI_QUERY,
+            "a query long enough to need an extended length field"));
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_content_format(&info, 42));
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_u16(&info, 2048, 1));
+
+    test_msg_t storage;
+    const avs_coap_msg_t *msg = build_msg(&storage, &info, "payload");
+
+    avs_coap_msg_index_t expected;
+    avs_coap_msg_index_build(msg, &expected);
+    avs_coap_msg_index_t actual;
+    AVS_UNIT_ASSERT_TRUE(avs_coap_msg_validate_and_index(msg, &actual));
+    assert_index_equal(&actual, &expected);
+    AVS_UNIT_ASSERT_TRUE(avs_coap_msg_validate_and_index(msg, NULL));
+}
+
+AVS_UNIT_TEST(coap_msg_opt, validate_and_index_truncated) {
+    avs_coap_msg_info_t info = avs_coap_msg_info_init();
+    for (size_t i = 0; i < AVS_COAP_MSG_INDEX_MAX_OPTIONS + 4; ++i) {
+        AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_string(
+                &info, AVS_COAP_OPT_URI_PATH, "x"));
+    }
+
+    test_msg_t storage;
+    const avs_coap_msg_t *msg = build_msg(&storage, &info, "");
+
+    avs_coap_msg_index_t expected;
+    avs_coap_msg_index_build(msg, &expected);
+    avs_coap_msg_index_t actual;
+    AVS_UNIT_ASSERT_TRUE(avs_coap_msg_validate_and_index(msg, &actual));
+    AVS_UNIT_ASSERT_TRUE(actual.truncated);
+    assert_index_equal(&actual, &expected);
+}
+
+/**
+ * Straightforward validation through the generic option iterator, used as
+ * a reference for the single-pass validator.
+ */
+static bool reference_is_valid(const avs_coap_msg_t *msg) {
+    if (msg->length < AVS_COAP_MSG_MIN_SIZE
+            || _avs_coap_header_get_version(msg) != 1
+            || _avs_coap_header_get_token_length(msg)
+                           > AVS_COAP_MAX_TOKEN_LENGTH
+            || _avs_coap_header_size(msg)
+                           + _avs_coap_header_get_token_length(msg)
+                       > msg->length) {
+        return false;
+    }
+
+    size_t length_so_far = _avs_coap_header_size(msg)
+                           + _avs_coap_header_get_token_length(msg);
+    avs_coap_opt_iterator_t it = avs_coap_opt_begin(msg);
+    for (; length_so_far != msg->length && !avs_coap_opt_end(&it);
+            avs_coap_opt_next(&it)) {
+        if (!avs_coap_opt_is_valid(it.curr_opt, msg->length - length_so_far)
+                || avs_coap_opt_number(&it) > UINT16_MAX) {
+            return false;
+        }
+        length_so_far += avs_coap_opt_sizeof(it.curr_opt);
+    }
+
+    return length_so_far + 1 != msg->length
+           && (avs_coap_msg_get_code(msg) != AVS_COAP_CODE_EMPTY
+                   || msg->length == _avs_coap_header_size(msg));
+}
+
+AVS_UNIT_TEST(coap_msg_opt, validate_and_index_corrupted) {
+    avs_coap_msg_info_t info = avs_coap_msg_info_init();
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_string(
+            &info, AVS_COAP_OPT_URI_PATH, "a path segment of 20"));
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_u32(
+            &info, AVS_COAP_OPT_OBSERVE, 0x123456));
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_u16(&info, 1000, 7));
+
+    test_msg_t original;
+    const avs_coap_msg_t *msg = build_msg(&original, &info, "xyz");
+
+    // whatever the message turns into, the result is consistent with
+    // iterator-based validation and avs_coap_msg_index_build()
+    unsigned seed = 1;
+    for (size_t i = 0; i < 10000; ++i) {
+        test_msg_t corrupted;
+        memcpy(&corrupted, &original, sizeof(corrupted));
+        size_t pos = (size_t) avs_rand_r(&seed) % msg->length;
+        // write through the union buffer: content is declared as uint8_t[1]
+        uint8_t *content = (uint8_t *) corrupted.buffer
+                           + offsetof(avs_coap_msg_t, content);
+        content[pos] = (uint8_t) avs_rand_r(&seed);
+        corrupted.msg.length = (uint32_t) (
+                pos + 1 + (size_t) avs_rand_r(&seed) % (msg->length - pos));
+
+        avs_coap_msg_index_t actual;
+        bool valid = avs_coap_msg_validate_and_index(&corrupted.msg, &actual);
+        AVS_UNIT_ASSERT_EQUAL(valid, reference_is_valid(&corrupted.msg));
+        if (valid) {
+            avs_coap_msg_index_t expected;
+            avs_coap_msg_index_build(&corrupted.msg, &expected);
+            assert_index_equal(&actual, &expected);
+        }
+    }
+}
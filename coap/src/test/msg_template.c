@@ -0,0 +1,171 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <avs_commons_config.h>
+
+#include <avsystem/commons/unit/test.h>
+
+typedef union {
+    avs_coap_msg_t msg;
+    uint8_t bytes[offsetof(avs_coap_msg_t, content) + 512];
+} test_msg_t;
+
+static const char PAYLOAD[] = "Rock and roll ain't noise pollution";
+
+static void setup_info(avs_coap_msg_info_t *info, bool with_observe) {
+    *info = avs_coap_msg_info_init();
+    info->type = AVS_COAP_MSG_NON_CONFIRMABLE;
+    info->code = AVS_COAP_CODE_CONTENT;
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_opaque(
+            info, AVS_COAP_OPT_ETAG, "\x01\x02\x03\x04", 4));
+    if (with_observe) {
+        AVS_UNIT_ASSERT_SUCCESS(
+                avs_coap_msg_info_opt_u32(info, AVS_COAP_OPT_OBSERVE, 0));
+    }
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_string(
+            info, AVS_COAP_OPT_LOCATION_PATH, "notify"));
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_content_format(info, 0));
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_u16(
+            info, AVS_COAP_OPT_MAX_AGE, 60));
+}
+
+static const avs_coap_msg_t *build_reference(test_msg_t *storage,
+                                             avs_coap_msg_info_t *info,
+                                             const avs_coap_msg_identity_t *id,
+                                             bool with_observe,
+                                             uint32_t observe) {
+    info->identity = *id;
+    if (with_observe) {
+        avs_coap_msg_info_opt_remove_by_number(info, AVS_COAP_OPT_OBSERVE);
+        AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_info_opt_u32(
+                info, AVS_COAP_OPT_OBSERVE, observe & 0xFFFFFF));
+    }
+
+    avs_coap_msg_builder_t builder;
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_builder_init(
+            &builder, avs_coap_ensure_aligned_buffer(storage),
+            sizeof(*storage), info));
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_msg_builder_payload(&builder, PAYLOAD,
+                                                       sizeof(PAYLOAD) - 1),
+                          sizeof(PAYLOAD) - 1);
+    return avs_coap_msg_builder_get_msg(&builder);
+}
+
+static void assert_fill_matches_builder(bool with_observe) {
+    static const uint32_t OBSERVE_VALUES[] = {
+        0, 1, 0xFF, 0x100, 0xFFFF, 0x10000, 0xFFFFFF, 0x1000000, 0xDEADBEEF
+    };
+    static const avs_coap_msg_identity_t IDENTITIES[] = {
+        { 0, { 0, { 0 } } },
+        { 0x1234, { 1, { 'A' } } },
+        { 0xFFFF, { 8, { '1', '2', '3', '4', '5', '6', '7', '8' } } }
+    };
+
+    avs_coap_msg_info_t info;
+    setup_info(&info, with_observe);
+
+    avs_coap_msg_template_t *tpl = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_template_create(
+            &tpl, &info, PAYLOAD, sizeof(PAYLOAD) - 1));
+    AVS_UNIT_ASSERT_NOT_NULL(tpl);
+
+    for (size_t i = 0; i < AVS_ARRAY_SIZE(IDENTITIES); ++i) {
+        for (size_t j = 0; j < AVS_ARRAY_SIZE(OBSERVE_VALUES); ++j) {
+            test_msg_t expected_storage;
+            const avs_coap_msg_t *expected =
+                    build_reference(&expected_storage, &info, &IDENTITIES[i],
+                                    with_observe, OBSERVE_VALUES[j]);
+
+            test_msg_t actual_storage;
+            memset(&actual_storage, 0xAA, sizeof(actual_storage));
+            const avs_coap_msg_t *actual = avs_coap_msg_template_fill(
+                    tpl, &IDENTITIES[i], OBSERVE_VALUES[j],
+                    avs_coap_ensure_aligned_buffer(&actual_storage),
+                    sizeof(actual_storage));
+
+            AVS_UNIT_ASSERT_NOT_NULL(actual);
+            AVS_UNIT_ASSERT_TRUE(avs_coap_msg_is_valid(actual));
+            AVS_UNIT_ASSERT_EQUAL(actual->length, expected->length);
+            AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(actual->content,
+                                              expected->content,
+                                              expected->length);
+            AVS_UNIT_ASSERT_TRUE(
+                    offsetof(avs_coap_msg_t, content) + actual->length
+                    <= avs_coap_msg_template_storage_size(tpl));
+        }
+    }
+
+    avs_coap_msg_template_cleanup(&tpl);
+    AVS_UNIT_ASSERT_NULL(tpl);
+    avs_coap_msg_info_reset(&info);
+}
+
+AVS_UNIT_TEST(coap_msg_template, fill_matches_builder) {
+    assert_fill_matches_builder(true);
+}
+
+AVS_UNIT_TEST(coap_msg_template, fill_without_observe) {
+    assert_fill_matches_builder(false);
+}
+
+AVS_UNIT_TEST(coap_msg_template, fill_buffer_too_small) {
+    avs_coap_msg_info_t info;
+    setup_info(&info, true);
+
+    avs_coap_msg_template_t *tpl = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_template_create(
+            &tpl, &info, PAYLOAD, sizeof(PAYLOAD) - 1));
+
+    const avs_coap_msg_identity_t identity = { 42, { 4, "1234" } };
+    test_msg_t storage;
+    AVS_UNIT_ASSERT_NOT_NULL(avs_coap_msg_template_fill(
+            tpl, &identity, 0x10000,
+            avs_coap_ensure_aligned_buffer(&storage), sizeof(storage)));
+    const size_t required = offsetof(avs_coap_msg_t, content)
+                            + storage.msg.length;
+    AVS_UNIT_ASSERT_NULL(avs_coap_msg_template_fill(
+            tpl, &identity, 0x10000,
+            avs_coap_ensure_aligned_buffer(&storage), required - 1));
+    AVS_UNIT_ASSERT_NOT_NULL(avs_coap_msg_template_fill(
+            tpl, &identity, 0x10000,
+            avs_coap_ensure_aligned_buffer(&storage), required));
+
+    avs_coap_msg_template_cleanup(&tpl);
+    avs_coap_msg_info_reset(&info);
+}
+
+AVS_UNIT_TEST(coap_msg_template, create_rejects_duplicate_observe) {
+    avs_coap_msg_info_t info;
+    setup_info(&info, true);
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_coap_msg_info_opt_u32(&info, AVS_COAP_OPT_OBSERVE, 1));
+
+    avs_coap_msg_template_t *tpl = NULL;
+    AVS_UNIT_ASSERT_FAILED(avs_coap_msg_template_create(&tpl, &info, NULL, 0));
+    AVS_UNIT_ASSERT_NULL(tpl);
+
+    avs_coap_msg_info_reset(&info);
+}
+
+AVS_UNIT_TEST(coap_msg_template, create_rejects_empty) {
+    avs_coap_msg_info_t info = avs_coap_msg_info_init();
+    info.type = AVS_COAP_MSG_RESET;
+    info.code = AVS_COAP_CODE_EMPTY;
+
+    avs_coap_msg_template_t *tpl = NULL;
+    AVS_UNIT_ASSERT_FAILED(avs_coap_msg_template_create(&tpl, &info, NULL, 0));
+    AVS_UNIT_ASSERT_NULL(tpl);
+}
@@ -0,0 +1,251 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <avs_commons_config.h>
+
+#include <avsystem/commons/unit/test.h>
+
+#include <avsystem/commons/coap/msg_builder.h>
+
+typedef union {
+    avs_coap_msg_t msg;
+    uint8_t bytes[offsetof(avs_coap_msg_t, content) + 64];
+} retx_msg_t;
+
+typedef struct {
+    avs_coap_ctx_t *ctx;
+    avs_net_abstract_socket_t *socket;
+    avs_coap_retx_scheduler_t *scheduler;
+    size_t timeouts;
+    uint16_t last_timed_out_id;
+} retx_env_t;
+
+static void on_timeout(void *env_,
+                       avs_coap_ctx_t *ctx,
+                       avs_net_abstract_socket_t *socket,
+                       const avs_coap_msg_t *msg) {
+    retx_env_t *env = (retx_env_t *) env_;
+    AVS_UNIT_ASSERT_TRUE(ctx == env->ctx);
+    AVS_UNIT_ASSERT_TRUE(socket == env->socket);
+    ++env->timeouts;
+    env->last_timed_out_id = avs_coap_msg_get_id(msg);
+}
+
+static void setup_env(retx_env_t *env,
+                      avs_time_duration_t ack_timeout,
+                      unsigned max_retransmit,
+                      avs_time_duration_t tick) {
+    memset(env, 0, sizeof(*env));
+
+    // datagrams are sent to the socket itself, so that they can be counted
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&env->socket, AVS_NET_UDP_SOCKET, NULL));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_bind(env->socket, "127.0.0.1", "0"));
+    char port[16];
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_get_local_port(env->socket, port, sizeof(port)));
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_connect(env->socket, "127.0.0.1", port));
+    avs_net_socket_opt_value_t timeout = {
+        .recv_timeout = avs_time_duration_from_scalar(10, AVS_TIME_MS)
+    };
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_set_opt(
+            env->socket, AVS_NET_SOCKET_OPT_RECV_TIMEOUT, timeout));
+
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_ctx_create(&env->ctx, 0));
+    const avs_coap_tx_params_t tx_params = {
+        .ack_timeout = ack_timeout,
+        .ack_random_factor = 1.0,
+        .max_retransmit = max_retransmit
+    };
+    avs_coap_ctx_set_tx_params(env->ctx, &tx_params);
+
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_retx_scheduler_create(
+            &env->scheduler, tick, on_timeout, env));
+}
+
+static void teardown_env(retx_env_t *env) {
+    avs_coap_retx_scheduler_cleanup(&env->scheduler);
+    avs_coap_ctx_cleanup(&env->ctx);
+    avs_net_socket_cleanup(&env->socket);
+}
+
+static const avs_coap_msg_t *make_msg(retx_msg_t *storage,
+                                      avs_coap_msg_type_t type,
+                                      uint16_t msg_id) {
+    avs_coap_msg_info_t info = avs_coap_msg_info_init();
+    info.type = type;
+    info.code = AVS_COAP_CODE_GET;
+    info.identity.msg_id = msg_id;
+
+    avs_coap_msg_builder_t builder;
+    AVS_UNIT_ASSERT_SUCCESS(avs_coap_msg_builder_init(
+            &builder, avs_coap_ensure_aligned_buffer(storage),
+            sizeof(*storage), &info));
+    return avs_coap_msg_builder_get_msg(&builder);
+}
+
+/** Drains the socket, returning the number of received datagrams. */
+static size_t count_sent(retx_env_t *env) {
+    size_t count = 0;
+    uint8_t buffer[64];
+    size_t received;
+    while (!avs_net_socket_receive(env->socket, &received, buffer,
+                                   sizeof(buffer))) {
+        ++count;
+    }
+    return count;
+}
+
+static avs_time_monotonic_t at_ms(const retx_env_t *env, int64_t ms) {
+    return avs_time_monotonic_add(
+            env->scheduler->epoch,
+            avs_time_duration_from_scalar(ms, AVS_TIME_MS));
+}
+
+AVS_UNIT_TEST(coap_retx_scheduler, retransmit_and_timeout) {
+    retx_env_t env;
+    setup_env(&env, avs_time_duration_from_scalar(2, AVS_TIME_S), 2,
+              avs_time_duration_from_scalar(100, AVS_TIME_MS));
+
+    retx_msg_t storage;
+    AVS_UNIT_ASSERT_SUCCESS(send_at(
+            env.scheduler, env.ctx, env.socket,
+            make_msg(&storage, AVS_COAP_MSG_CONFIRMABLE, 42), at_ms(&env, 0)));
+    AVS_UNIT_ASSERT_EQUAL(count_sent(&env), 1);
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_retx_scheduler_size(env.scheduler), 1);
+    AVS_UNIT_ASSERT_TRUE(avs_time_monotonic_equal(
+            avs_coap_retx_scheduler_next_deadline(env.scheduler),
+            at_ms(&env, 2000)));
+
+    fire_expired_at(env.scheduler, at_ms(&env, 1999));
+    AVS_UNIT_ASSERT_EQUAL(count_sent(&env), 0);
+
+    // timeouts double after each retransmission: 2s, 4s, 8s
+    fire_expired_at(env.scheduler, at_ms(&env, 2000));
+    AVS_UNIT_ASSERT_EQUAL(count_sent(&env), 1);
+    AVS_UNIT_ASSERT_TRUE(avs_time_monotonic_equal(
+            avs_coap_retx_scheduler_next_deadline(env.scheduler),
+            at_ms(&env, 6000)));
+
+    fire_expired_at(env.scheduler, at_ms(&env, 6000));
+    AVS_UNIT_ASSERT_EQUAL(count_sent(&env), 1);
+    AVS_UNIT_ASSERT_EQUAL(env.timeouts, 0);
+
+    // the deadline lies past the lowest wheel level, so an earlier wakeup is
+    // acceptable, but not a later one
+    avs_time_monotonic_t next =
+            avs_coap_retx_scheduler_next_deadline(env.scheduler);
+    AVS_UNIT_ASSERT_TRUE(avs_time_monotonic_valid(next));
+    AVS_UNIT_ASSERT_FALSE(avs_time_monotonic_before(at_ms(&env, 14000), next));
+
+    fire_expired_at(env.scheduler, at_ms(&env, 13999));
+    AVS_UNIT_ASSERT_EQUAL(env.timeouts, 0);
+    fire_expired_at(env.scheduler, at_ms(&env, 14000));
+    AVS_UNIT_ASSERT_EQUAL(count_sent(&env), 0);
+    AVS_UNIT_ASSERT_EQUAL(env.timeouts, 1);
+    AVS_UNIT_ASSERT_EQUAL(env.last_timed_out_id, 42);
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_retx_scheduler_size(env.scheduler), 0);
+    AVS_UNIT_ASSERT_FALSE(avs_time_monotonic_valid(
+            avs_coap_retx_scheduler_next_deadline(env.scheduler)));
+
+    teardown_env(&env);
+}
+
+AVS_UNIT_TEST(coap_retx_scheduler, cancel) {
+    retx_env_t env;
+    setup_env(&env, avs_time_duration_from_scalar(2, AVS_TIME_S), 4,
+              avs_time_duration_from_scalar(100, AVS_TIME_MS));
+
+    retx_msg_t storage;
+    for (uint16_t id = 1; id <= 3; ++id) {
+        AVS_UNIT_ASSERT_SUCCESS(send_at(
+                env.scheduler, env.ctx, env.socket,
+                make_msg(&storage, AVS_COAP_MSG_CONFIRMABLE, id),
+                at_ms(&env, 0)));
+    }
+    // message ID already in use
+    AVS_UNIT_ASSERT_FAILED(send_at(
+            env.scheduler, env.ctx, env.socket,
+            make_msg(&storage, AVS_COAP_MSG_CONFIRMABLE, 2), at_ms(&env, 0)));
+    // non-confirmable messages are not tracked
+    AVS_UNIT_ASSERT_SUCCESS(send_at(
+            env.scheduler, env.ctx, env.socket,
+            make_msg(&storage, AVS_COAP_MSG_NON_CONFIRMABLE, 4),
+            at_ms(&env, 0)));
+    AVS_UNIT_ASSERT_EQUAL(count_sent(&env), 4);
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_retx_scheduler_size(env.scheduler), 3);
+
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_coap_retx_scheduler_cancel(env.scheduler, env.socket, 2));
+    AVS_UNIT_ASSERT_FAILED(
+            avs_coap_retx_scheduler_cancel(env.scheduler, env.socket, 2));
+    AVS_UNIT_ASSERT_FAILED(
+            avs_coap_retx_scheduler_cancel(env.scheduler, env.socket, 4));
+    AVS_UNIT_ASSERT_FAILED(
+            avs_coap_retx_scheduler_cancel(env.scheduler, NULL, 1));
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_retx_scheduler_size(env.scheduler), 2);
+
+    fire_expired_at(env.scheduler, at_ms(&env, 2000));
+    AVS_UNIT_ASSERT_EQUAL(count_sent(&env), 2);
+
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_coap_retx_scheduler_cancel(env.scheduler, env.socket, 1));
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_coap_retx_scheduler_cancel(env.scheduler, env.socket, 3));
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_retx_scheduler_size(env.scheduler), 0);
+
+    fire_expired_at(env.scheduler, at_ms(&env, 100000));
+    AVS_UNIT_ASSERT_EQUAL(count_sent(&env), 0);
+    AVS_UNIT_ASSERT_EQUAL(env.timeouts, 0);
+
+    teardown_env(&env);
+}
+
+AVS_UNIT_TEST(coap_retx_scheduler, many_messages_cascade) {
+    retx_env_t env;
+    // 1 ms ticks, so that the timeouts span several wheel levels
+    setup_env(&env, avs_time_duration_from_scalar(5, AVS_TIME_S), 0,
+              avs_time_duration_from_scalar(1, AVS_TIME_MS));
+
+    retx_msg_t storage;
+    static const size_t NUM_MESSAGES = 100;
+    for (size_t i = 0; i < NUM_MESSAGES; ++i) {
+        AVS_UNIT_ASSERT_SUCCESS(send_at(
+                env.scheduler, env.ctx, env.socket,
+                make_msg(&storage, AVS_COAP_MSG_CONFIRMABLE, (uint16_t) i),
+                at_ms(&env, (int64_t) i * 37)));
+        count_sent(&env);
+    }
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_retx_scheduler_size(env.scheduler),
+                          NUM_MESSAGES);
+
+    // each message times out exactly at its own deadline
+    for (size_t i = 0; i < NUM_MESSAGES; ++i) {
+        const int64_t deadline_ms = 5000 + (int64_t) i * 37;
+        AVS_UNIT_ASSERT_FALSE(avs_time_monotonic_before(
+                at_ms(&env, deadline_ms),
+                avs_coap_retx_scheduler_next_deadline(env.scheduler)));
+        fire_expired_at(env.scheduler, at_ms(&env, deadline_ms - 1));
+        AVS_UNIT_ASSERT_EQUAL(env.timeouts, i);
+        fire_expired_at(env.scheduler, at_ms(&env, deadline_ms));
+        AVS_UNIT_ASSERT_EQUAL(env.timeouts, i + 1);
+        AVS_UNIT_ASSERT_EQUAL(env.last_timed_out_id, i);
+    }
+    AVS_UNIT_ASSERT_EQUAL(avs_coap_retx_scheduler_size(env.scheduler), 0);
+
+    teardown_env(&env);
+}
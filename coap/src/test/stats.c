@@ -0,0 +1,303 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <avs_commons_config.h>
+
+#include <avsystem/commons/memory.h>
+#include <avsystem/commons/unit/test.h>
+#include <avsystem/commons/utils.h>
+
+#include <avsystem/commons/coap/msg_builder.h>
+
+#include <stdlib.h>
+
+typedef union {
+    avs_coap_msg_t msg;
+    char buffer[offsetof(avs_coap_msg_t, content) + 64];
+} test_msg_t;
+
+static const avs_coap_msg_t *build_msg(test_msg_t *storage,
+                                       avs_coap_msg_type_t type,
+                                       uint8_t code,
+                                       uint16_t msg_id,
+                                       const char *token) {
+    avs_coap_msg_info_t info = avs_coap_msg_info_init();
+    info.type = type;
+    info.code = code;
+    info.identity.msg_id = msg_id;
+    info.identity.token.size = (uint8_t) strlen(token);
+    memcpy(info.identity.token.bytes, token, info.identity.token.size);
+
+    const avs_coap_msg_t *msg = avs_coap_msg_build_without_payload(
+            avs_coap_ensure_aligned_buffer(storage), sizeof(*storage), &info);
+    AVS_UNIT_ASSERT_NOT_NULL(msg);
+    return msg;
+}
+
+static avs_net_resolved_endpoint_t make_endpoint(const char *name) {
+    avs_net_resolved_endpoint_t ep = { 0 };
+    ep.size = (uint8_t) strlen(name);
+    memcpy(ep.data.buf, name, ep.size);
+    return ep;
+}
+
+static uint64_t histogram_total(const avs_coap_latency_histogram_t *h) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < AVS_COAP_STATS_LATENCY_BUCKETS; ++i) {
+        total += h->buckets[i];
+    }
+    return total;
+}
+
+AVS_UNIT_TEST(coap_stats, incoming_request) {
+    coap_stats_t *stats = _avs_coap_stats_create(
+            8, AVS_COAP_STATS_DEFAULT_MAX_PENDING_REQUESTS);
+    AVS_UNIT_ASSERT_NOT_NULL(stats);
+    avs_net_resolved_endpoint_t ep = make_endpoint("ep");
+    test_msg_t req, res;
+
+    _avs_coap_stats_on_recv(stats, &ep,
+                            build_msg(&req, AVS_COAP_MSG_CONFIRMABLE,
+                                      AVS_COAP_CODE_GET, 1, "tk"),
+                            false);
+    _avs_coap_stats_on_send(stats, &ep,
+                            build_msg(&res, AVS_COAP_MSG_ACKNOWLEDGEMENT,
+                                      AVS_COAP_CODE_CONTENT, 1, "tk"),
+                            false);
+
+    avs_coap_stats_t snapshot;
+    AVS_UNIT_ASSERT_SUCCESS(_avs_coap_stats_snapshot(stats, &snapshot));
+    AVS_UNIT_ASSERT_EQUAL(snapshot.total.rx_msgs, 1);
+    AVS_UNIT_ASSERT_EQUAL(snapshot.total.tx_msgs, 1);
+    AVS_UNIT_ASSERT_EQUAL(snapshot.total.rx_bytes, req.msg.length);
+    AVS_UNIT_ASSERT_EQUAL(snapshot.total.tx_bytes, res.msg.length);
+    AVS_UNIT_ASSERT_EQUAL(snapshot.rx_by_code[AVS_COAP_CODE_GET], 1);
+    AVS_UNIT_ASSERT_EQUAL(snapshot.tx_by_code[AVS_COAP_CODE_CONTENT], 1);
+    AVS_UNIT_ASSERT_EQUAL(
+            histogram_total(&snapshot.incoming_request_latency), 1);
+    AVS_UNIT_ASSERT_EQUAL(
+            histogram_total(&snapshot.outgoing_request_latency), 0);
+
+    AVS_UNIT_ASSERT_EQUAL(AVS_LIST_SIZE(snapshot.endpoints), 1);
+    AVS_UNIT_ASSERT_EQUAL(snapshot.endpoints->endpoint.size, ep.size);
+    AVS_UNIT_ASSERT_EQUAL(snapshot.endpoints->traffic.rx_msgs, 1);
+    AVS_UNIT_ASSERT_EQUAL(snapshot.endpoints->traffic.tx_msgs, 1);
+
+    avs_coap_stats_cleanup(&snapshot);
+    _avs_coap_stats_release(&stats);
+}
+
+AVS_UNIT_TEST(coap_stats, outgoing_request_retransmission) {
+    coap_stats_t *stats = _avs_coap_stats_create(
+            8, AVS_COAP_STATS_DEFAULT_MAX_PENDING_REQUESTS);
+    AVS_UNIT_ASSERT_NOT_NULL(stats);
+    avs_net_resolved_endpoint_t ep = make_endpoint("ep");
+    avs_net_resolved_endpoint_t other_ep = make_endpoint("other");
+    test_msg_t req, res;
+
+    build_msg(&req, AVS_COAP_MSG_CONFIRMABLE, AVS_COAP_CODE_GET, 7, "x");
+    _avs_coap_stats_on_send(stats, &ep, &req.msg, false);
+    _avs_coap_stats_on_send(stats, &ep, &req.msg, false);
+
+    // separate response from a different endpoint does not match
+    build_msg(&res, AVS_COAP_MSG_CONFIRMABLE, AVS_COAP_CODE_CONTENT, 99, "x");
+    _avs_coap_stats_on_recv(stats, &other_ep, &res.msg, false);
+    // but it does from the right one, even though message ID differs
+    _avs_coap_stats_on_recv(stats, &ep, &res.msg, false);
+
+    avs_coap_stats_t snapshot;
+    AVS_UNIT_ASSERT_SUCCESS(_avs_coap_stats_snapshot(stats, &snapshot));
+    AVS_UNIT_ASSERT_EQUAL(snapshot.total.tx_msgs, 2);
+    AVS_UNIT_ASSERT_EQUAL(snapshot.total.outgoing_retransmissions, 1);
+    AVS_UNIT_ASSERT_EQUAL(
+            histogram_total(&snapshot.outgoing_request_latency), 1);
+    AVS_UNIT_ASSERT_EQUAL(AVS_LIST_SIZE(snapshot.endpoints), 2);
+
+    avs_coap_stats_cleanup(&snapshot);
+    _avs_coap_stats_release(&stats);
+}
+
+AVS_UNIT_TEST(coap_stats, endpoint_limit) {
+    coap_stats_t *stats = _avs_coap_stats_create(
+            1, AVS_COAP_STATS_DEFAULT_MAX_PENDING_REQUESTS);
+    AVS_UNIT_ASSERT_NOT_NULL(stats);
+    avs_net_resolved_endpoint_t ep1 = make_endpoint("ep1");
+    avs_net_resolved_endpoint_t ep2 = make_endpoint("ep2");
+    test_msg_t msg;
+    build_msg(&msg, AVS_COAP_MSG_NON_CONFIRMABLE, AVS_COAP_CODE_GET, 1, "");
+
+    _avs_coap_stats_on_recv(stats, &ep1, &msg.msg, false);
+    _avs_coap_stats_on_recv(stats, &ep2, &msg.msg, false);
+    _avs_coap_stats_on_recv(stats, NULL, &msg.msg, false);
+    _avs_coap_stats_on_recv(stats, &ep2, &msg.msg, true);
+
+    avs_coap_stats_t snapshot;
+    AVS_UNIT_ASSERT_SUCCESS(_avs_coap_stats_snapshot(stats, &snapshot));
+    AVS_UNIT_ASSERT_EQUAL(snapshot.total.rx_msgs, 4);
+    AVS_UNIT_ASSERT_EQUAL(snapshot.total.incoming_retransmissions, 1);
+    AVS_UNIT_ASSERT_EQUAL(AVS_LIST_SIZE(snapshot.endpoints), 1);
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(snapshot.endpoints->endpoint.data.buf,
+                                      "ep1", 3);
+    AVS_UNIT_ASSERT_EQUAL(snapshot.endpoints->traffic.rx_msgs, 1);
+    AVS_UNIT_ASSERT_EQUAL(
+            snapshot.endpoints->traffic.incoming_retransmissions, 0);
+
+    avs_coap_stats_cleanup(&snapshot);
+    _avs_coap_stats_release(&stats);
+}
+
+AVS_UNIT_TEST(coap_stats, many_endpoints) {
+    coap_stats_t *stats = _avs_coap_stats_create(
+            64, AVS_COAP_STATS_DEFAULT_MAX_PENDING_REQUESTS);
+    AVS_UNIT_ASSERT_NOT_NULL(stats);
+    test_msg_t msg;
+    build_msg(&msg, AVS_COAP_MSG_NON_CONFIRMABLE, AVS_COAP_CODE_GET, 1, "");
+
+    // every endpoint sends as many messages as its number
+    for (int round = 0; round < 100; ++round) {
+        for (int i = round; i < 100; ++i) {
+            char name[sizeof("ep99")];
+            AVS_UNIT_ASSERT_TRUE(
+                    avs_simple_snprintf(name, sizeof(name), "ep%d", i) >= 0);
+            avs_net_resolved_endpoint_t ep = make_endpoint(name);
+            _avs_coap_stats_on_recv(stats, &ep, &msg.msg, false);
+        }
+    }
+
+    avs_coap_stats_t snapshot;
+    AVS_UNIT_ASSERT_SUCCESS(_avs_coap_stats_snapshot(stats, &snapshot));
+    AVS_UNIT_ASSERT_EQUAL(snapshot.total.rx_msgs, 100 * 101 / 2);
+    AVS_UNIT_ASSERT_EQUAL(AVS_LIST_SIZE(snapshot.endpoints), 64);
+    avs_coap_endpoint_stats_t *ep_stats;
+    AVS_LIST_FOREACH(ep_stats, snapshot.endpoints) {
+        char name[sizeof("ep99")] = "";
+        memcpy(name, ep_stats->endpoint.data.buf, ep_stats->endpoint.size);
+        AVS_UNIT_ASSERT_EQUAL(ep_stats->traffic.rx_msgs,
+                              strtoul(name + 2, NULL, 10) + 1);
+    }
+
+    avs_coap_stats_cleanup(&snapshot);
+    _avs_coap_stats_release(&stats);
+}
+
+AVS_UNIT_TEST(coap_stats, dropped_latency_samples) {
+    coap_stats_t *stats = _avs_coap_stats_create(8, 2);
+    AVS_UNIT_ASSERT_NOT_NULL(stats);
+    avs_net_resolved_endpoint_t ep = make_endpoint("ep");
+    test_msg_t req, res;
+
+    for (uint16_t id = 1; id <= 3; ++id) {
+        _avs_coap_stats_on_recv(stats, &ep,
+                                build_msg(&req, AVS_COAP_MSG_CONFIRMABLE,
+                                          AVS_COAP_CODE_GET, id, ""),
+                                false);
+    }
+    // the first request has already been forgotten
+    for (uint16_t id = 1; id <= 3; ++id) {
+        _avs_coap_stats_on_send(stats, &ep,
+                                build_msg(&res, AVS_COAP_MSG_ACKNOWLEDGEMENT,
+                                          AVS_COAP_CODE_CONTENT, id, ""),
+                                false);
+    }
+
+    avs_coap_stats_t snapshot;
+    AVS_UNIT_ASSERT_SUCCESS(_avs_coap_stats_snapshot(stats, &snapshot));
+    AVS_UNIT_ASSERT_EQUAL(
+            histogram_total(&snapshot.incoming_request_latency), 2);
+    AVS_UNIT_ASSERT_EQUAL(snapshot.dropped_latency_samples, 1);
+
+    avs_coap_stats_cleanup(&snapshot);
+    _avs_coap_stats_release(&stats);
+}
+
+AVS_UNIT_TEST(coap_stats, sharded) {
+#ifdef WITH_AVS_COMPAT_THREADING
+    coap_stats_t *stats = _avs_coap_stats_create_sharded(
+            16, AVS_COAP_STATS_DEFAULT_MAX_PENDING_REQUESTS, 4);
+    AVS_UNIT_ASSERT_NOT_NULL(stats);
+
+    enum { NUM_ENDPOINTS = 10 };
+    avs_net_resolved_endpoint_t eps[NUM_ENDPOINTS];
+    test_msg_t req, res;
+    for (size_t i = 0; i < NUM_ENDPOINTS; ++i) {
+        char name[8];
+        AVS_UNIT_ASSERT_TRUE(avs_simple_snprintf(name, sizeof(name), "ep%u",
+                                                 (unsigned) i) >= 0);
+        eps[i] = make_endpoint(name);
+        _avs_coap_stats_on_recv(stats, &eps[i],
+                                build_msg(&req, AVS_COAP_MSG_CONFIRMABLE,
+                                          AVS_COAP_CODE_GET, 1, "tk"),
+                                false);
+        _avs_coap_stats_on_send(stats, &eps[i],
+                                build_msg(&res, AVS_COAP_MSG_ACKNOWLEDGEMENT,
+                                          AVS_COAP_CODE_CONTENT, 1, "tk"),
+                                false);
+    }
+    // traffic of unknown endpoints is accounted for as well
+    _avs_coap_stats_on_recv(stats, NULL, &req.msg, true);
+
+    avs_coap_stats_t snapshot;
+    AVS_UNIT_ASSERT_SUCCESS(_avs_coap_stats_snapshot(stats, &snapshot));
+    AVS_UNIT_ASSERT_EQUAL(snapshot.total.rx_msgs, NUM_ENDPOINTS + 1);
+    AVS_UNIT_ASSERT_EQUAL(snapshot.total.tx_msgs, NUM_ENDPOINTS);
+    AVS_UNIT_ASSERT_EQUAL(snapshot.total.incoming_retransmissions, 1);
+    AVS_UNIT_ASSERT_EQUAL(snapshot.rx_by_code[AVS_COAP_CODE_GET],
+                          NUM_ENDPOINTS + 1);
+    AVS_UNIT_ASSERT_EQUAL(snapshot.tx_by_code[AVS_COAP_CODE_CONTENT],
+                          NUM_ENDPOINTS);
+    // requests and responses of each endpoint end up in the same shard
+    AVS_UNIT_ASSERT_EQUAL(
+            histogram_total(&snapshot.incoming_request_latency),
+            NUM_ENDPOINTS);
+
+    AVS_UNIT_ASSERT_EQUAL(AVS_LIST_SIZE(snapshot.endpoints), NUM_ENDPOINTS);
+    for (size_t i = 0; i < NUM_ENDPOINTS; ++i) {
+        const avs_coap_endpoint_stats_t *entry;
+        AVS_LIST_FOREACH(entry, snapshot.endpoints) {
+            if (entry->endpoint.size == eps[i].size
+                    && !memcmp(entry->endpoint.data.buf, eps[i].data.buf,
+                               eps[i].size)) {
+                break;
+            }
+        }
+        AVS_UNIT_ASSERT_NOT_NULL(entry);
+        AVS_UNIT_ASSERT_EQUAL(entry->traffic.rx_msgs, 1);
+        AVS_UNIT_ASSERT_EQUAL(entry->traffic.tx_msgs, 1);
+    }
+
+    avs_coap_stats_cleanup(&snapshot);
+    _avs_coap_stats_release(&stats);
+#else // WITH_AVS_COMPAT_THREADING
+    AVS_UNIT_ASSERT_NULL(_avs_coap_stats_create_sharded(
+            16, AVS_COAP_STATS_DEFAULT_MAX_PENDING_REQUESTS, 4));
+#endif // WITH_AVS_COMPAT_THREADING
+}
+
+AVS_UNIT_TEST(coap_stats, latency_buckets) {
+    avs_coap_latency_histogram_t histogram = { { 0 } };
+    record_latency(&histogram, avs_time_duration_from_scalar(0, AVS_TIME_MS));
+    record_latency(&histogram, avs_time_duration_from_scalar(1, AVS_TIME_MS));
+    record_latency(&histogram, avs_time_duration_from_scalar(3, AVS_TIME_MS));
+    record_latency(&histogram, avs_time_duration_from_scalar(4, AVS_TIME_MS));
+    record_latency(&histogram, avs_time_duration_from_scalar(1, AVS_TIME_DAY));
+
+    AVS_UNIT_ASSERT_EQUAL(histogram.buckets[0], 1);
+    AVS_UNIT_ASSERT_EQUAL(histogram.buckets[1], 1);
+    AVS_UNIT_ASSERT_EQUAL(histogram.buckets[2], 1);
+    AVS_UNIT_ASSERT_EQUAL(histogram.buckets[3], 1);
+    AVS_UNIT_ASSERT_EQUAL(
+            histogram.buckets[AVS_COAP_STATS_LATENCY_BUCKETS - 1], 1);
+}
@@ -65,10 +65,10 @@
 #  pragma GCC poison fclose
 # endif // AVS_STREAM_STREAM_FILE_C
 
-# ifndef AVS_NET_API_C
-// fflush is used in unit test framework and network debug log
+# if !defined(AVS_NET_API_C) && !defined(AVS_STREAM_STREAM_FILE_C)
+// fflush is used in unit test framework, network debug log and file stream
 #  pragma GCC poison fflush
-# endif // AVS_NET_API_C
+# endif // !defined(AVS_NET_API_C) && !defined(AVS_STREAM_STREAM_FILE_C)
 
 # if !defined(AVS_LOG_LOG_C) && !defined(AVS_NET_API_C)
 // fprintf is used in unit test framework, network debug log and logging
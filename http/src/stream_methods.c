@@ -318,7 +318,9 @@ static const avs_stream_v_table_t http_vtable = {
             &(avs_stream_v_table_extension_net_t[]) {
                 {
                     http_getsock,
-                    http_setsock
+                    http_setsock,
+                    // file contents need to go through chunked encoding
+                    NULL // send_file
                 }
             }[0]
         },
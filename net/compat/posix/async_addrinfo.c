@@ -0,0 +1,340 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <avs_commons_posix_config.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef WITH_AVS_NET_ASYNC_RESOLVER
+#include <pthread.h>
+#endif
+
+#include <avsystem/commons/memory.h>
+#include <avsystem/commons/net.h>
+
+#include "compat.h"
+
+VISIBILITY_SOURCE_BEGIN
+
+#ifdef WITH_AVS_NET_ASYNC_RESOLVER
+
+/**
+ * Maximum number of resolver threads. They are started lazily, whenever there
+ * are more queued requests than idle threads, and live until global cleanup.
+ */
+#define RESOLVER_MAX_THREADS 4
+
+typedef enum {
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE
+} job_state_t;
+
+struct avs_net_addrinfo_async_struct {
+    struct avs_net_addrinfo_async_struct *next_queued;
+    job_state_t state;
+    /* set if the handle has been cleaned up while the job was running */
+    bool abandoned;
+    /* [0] is watched by the user, [1] is written to on completion */
+    int pipe_fds[2];
+    avs_net_addrinfo_t *result;
+
+    avs_net_socket_type_t socket_type;
+    avs_net_af_t family;
+    int flags;
+    bool has_preferred_endpoint;
+    avs_net_resolved_endpoint_t preferred_endpoint;
+    /* points into the same buffer as host, or NULL */
+    const char *port;
+    char host[1]; // actually a FAM
+};
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    avs_net_addrinfo_async_t *queue;
+    size_t num_queued;
+    pthread_t threads[RESOLVER_MAX_THREADS];
+    size_t num_threads;
+    size_t idle_threads;
+    bool shutting_down;
+} g_resolver = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER
+};
+
+static void free_job(avs_net_addrinfo_async_t *job) {
+    avs_net_addrinfo_delete(&job->result);
+    close(job->pipe_fds[0]);
+    close(job->pipe_fds[1]);
+    avs_free(job);
+}
+
+static avs_net_addrinfo_async_t *pop_job(void) {
+    avs_net_addrinfo_async_t *job = g_resolver.queue;
+    if (job) {
+        g_resolver.queue = job->next_queued;
+        job->next_queued = NULL;
+        --g_resolver.num_queued;
+    }
+    return job;
+}
+
+/* Needs to be called with g_resolver.mutex locked */
+static void complete_job(avs_net_addrinfo_async_t *job,
+                         avs_net_addrinfo_t *result) {
+    if (job->abandoned) {
+        avs_net_addrinfo_delete(&result);
+        free_job(job);
+        return;
+    }
+    job->result = result;
+    job->state = JOB_DONE;
+    if (write(job->pipe_fds[1], "", 1) != 1) {
+        LOG(ERROR, "could not signal resolution completion: %s",
+            strerror(errno));
+    }
+}
+
+static void *resolver_thread(void *unused) {
+    (void) unused;
+    pthread_mutex_lock(&g_resolver.mutex);
+    while (!g_resolver.shutting_down) {
+        avs_net_addrinfo_async_t *job = pop_job();
+        if (!job) {
+            ++g_resolver.idle_threads;
+            pthread_cond_wait(&g_resolver.cond, &g_resolver.mutex);
+            --g_resolver.idle_threads;
+            continue;
+        }
+        job->state = JOB_RUNNING;
+        pthread_mutex_unlock(&g_resolver.mutex);
+
+        avs_net_addrinfo_t *result = avs_net_addrinfo_resolve_ex(
+                job->socket_type, job->family, job->host, job->port,
+                job->flags,
+                job->has_preferred_endpoint ? &job->preferred_endpoint : NULL);
+
+        pthread_mutex_lock(&g_resolver.mutex);
+        complete_job(job, result);
+    }
+    pthread_mutex_unlock(&g_resolver.mutex);
+    return NULL;
+}
+
+static avs_net_addrinfo_async_t *
+create_job(avs_net_socket_type_t socket_type,
+           avs_net_af_t family,
+           const char *host,
+           const char *port,
+           int flags,
+           const avs_net_resolved_endpoint_t *preferred_endpoint) {
+    if (!host) {
+        host = "";
+    }
+    size_t host_size = strlen(host) + 1;
+    size_t port_size = port ? strlen(port) + 1 : 0;
+    avs_net_addrinfo_async_t *job = (avs_net_addrinfo_async_t *) avs_calloc(
+            1, offsetof(avs_net_addrinfo_async_t, host) + host_size
+                       + port_size);
+    if (!job) {
+        LOG(ERROR, "Out of memory");
+        return NULL;
+    }
+    if (pipe(job->pipe_fds)) {
+        LOG(ERROR, "pipe() failed: %s", strerror(errno));
+        avs_free(job);
+        return NULL;
+    }
+    job->socket_type = socket_type;
+    job->family = family;
+    job->flags = flags;
+    if (preferred_endpoint) {
+        job->has_preferred_endpoint = true;
+        job->preferred_endpoint = *preferred_endpoint;
+    }
+    memcpy(job->host, host, host_size);
+    if (port) {
+        memcpy(job->host + host_size, port, port_size);
+        job->port = job->host + host_size;
+    }
+    return job;
+}
+
+avs_net_addrinfo_async_t *avs_net_addrinfo_resolve_async(
+        avs_net_socket_type_t socket_type,
+        avs_net_af_t family,
+        const char *host,
+        const char *port,
+        int flags,
+        const avs_net_resolved_endpoint_t *preferred_endpoint) {
+    if (_avs_net_ensure_global_state()) {
+        LOG(ERROR, "avs_net global state initialization error");
+        return NULL;
+    }
+    avs_net_addrinfo_async_t *job = create_job(socket_type, family, host, port,
+                                               flags, preferred_endpoint);
+    if (!job) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_resolver.mutex);
+    if (g_resolver.shutting_down) {
+        LOG(ERROR, "resolver is shutting down");
+        goto fail;
+    }
+    if (g_resolver.num_queued >= g_resolver.idle_threads
+            && g_resolver.num_threads < RESOLVER_MAX_THREADS) {
+        int result = pthread_create(&g_resolver.threads[g_resolver.num_threads],
+                                    NULL, resolver_thread, NULL);
+        if (!result) {
+            ++g_resolver.num_threads;
+        } else if (!g_resolver.num_threads) {
+            LOG(ERROR, "could not start resolver thread: %s",
+                strerror(result));
+            goto fail;
+        }
+    }
+    avs_net_addrinfo_async_t **tail_ptr = &g_resolver.queue;
+    while (*tail_ptr) {
+        tail_ptr = &(*tail_ptr)->next_queued;
+    }
+    *tail_ptr = job;
+    ++g_resolver.num_queued;
+    pthread_cond_signal(&g_resolver.cond);
+    pthread_mutex_unlock(&g_resolver.mutex);
+    return job;
+fail:
+    pthread_mutex_unlock(&g_resolver.mutex);
+    free_job(job);
+    return NULL;
+}
+
+const void *avs_net_addrinfo_async_get_system(avs_net_addrinfo_async_t *handle) {
+    return &handle->pipe_fds[0];
+}
+
+int avs_net_addrinfo_async_finish(avs_net_addrinfo_async_t *handle,
+                                  avs_net_addrinfo_t **out_info) {
+    int result;
+    pthread_mutex_lock(&g_resolver.mutex);
+    if (handle->state != JOB_DONE) {
+        result = AVS_NET_ADDRINFO_ASYNC_PENDING;
+    } else if (!handle->result) {
+        result = -1;
+    } else {
+        *out_info = handle->result;
+        handle->result = NULL;
+        result = 0;
+    }
+    pthread_mutex_unlock(&g_resolver.mutex);
+    return result;
+}
+
+void avs_net_addrinfo_async_cleanup(avs_net_addrinfo_async_t **handle_ptr) {
+    avs_net_addrinfo_async_t *job = *handle_ptr;
+    if (!job) {
+        return;
+    }
+    pthread_mutex_lock(&g_resolver.mutex);
+    switch (job->state) {
+    case JOB_QUEUED: {
+        avs_net_addrinfo_async_t **job_ptr = &g_resolver.queue;
+        while (*job_ptr != job) {
+            assert(*job_ptr);
+            job_ptr = &(*job_ptr)->next_queued;
+        }
+        *job_ptr = job->next_queued;
+        --g_resolver.num_queued;
+        free_job(job);
+        break;
+    }
+    case JOB_RUNNING:
+        // the resolver thread will free it
+        job->abandoned = true;
+        break;
+    case JOB_DONE:
+        free_job(job);
+        break;
+    }
+    pthread_mutex_unlock(&g_resolver.mutex);
+    *handle_ptr = NULL;
+}
+
+void _avs_net_cleanup_global_async_resolver(void) {
+    pthread_mutex_lock(&g_resolver.mutex);
+    g_resolver.shutting_down = true;
+    avs_net_addrinfo_async_t *job;
+    while ((job = pop_job())) {
+        complete_job(job, NULL);
+    }
+    pthread_cond_broadcast(&g_resolver.cond);
+    size_t num_threads = g_resolver.num_threads;
+    pthread_mutex_unlock(&g_resolver.mutex);
+
+    for (size_t i = 0; i < num_threads; ++i) {
+        pthread_join(g_resolver.threads[i], NULL);
+    }
+
+    pthread_mutex_lock(&g_resolver.mutex);
+    g_resolver.num_threads = 0;
+    g_resolver.shutting_down = false;
+    pthread_mutex_unlock(&g_resolver.mutex);
+}
+
+#else // WITH_AVS_NET_ASYNC_RESOLVER
+
+avs_net_addrinfo_async_t *avs_net_addrinfo_resolve_async(
+        avs_net_socket_type_t socket_type,
+        avs_net_af_t family,
+        const char *host,
+        const char *port,
+        int flags,
+        const avs_net_resolved_endpoint_t *preferred_endpoint) {
+    (void) socket_type;
+    (void) family;
+    (void) host;
+    (void) port;
+    (void) flags;
+    (void) preferred_endpoint;
+    LOG(ERROR, "asynchronous address resolution not supported");
+    return NULL;
+}
+
+const void *avs_net_addrinfo_async_get_system(avs_net_addrinfo_async_t *handle) {
+    (void) handle;
+    return NULL;
+}
+
+int avs_net_addrinfo_async_finish(avs_net_addrinfo_async_t *handle,
+                                  avs_net_addrinfo_t **out_info) {
+    (void) handle;
+    (void) out_info;
+    return -1;
+}
+
+void avs_net_addrinfo_async_cleanup(avs_net_addrinfo_async_t **handle_ptr) {
+    (void) handle_ptr;
+}
+
+#endif // WITH_AVS_NET_ASYNC_RESOLVER
+
+#ifdef AVS_UNIT_TESTING
+#include "test/async_addrinfo.c"
+#endif // AVS_UNIT_TESTING
@@ -32,6 +32,8 @@ VISIBILITY_SOURCE_BEGIN
 
 struct avs_net_addrinfo_struct {
     struct addrinfo *results;
+    /* if non-NULL, results were built from cache and live in this buffer */
+    void *cached_results_buf;
     const struct addrinfo *to_send;
 #ifdef WITH_AVS_V4MAPPED
     bool v4mapped;
@@ -142,9 +144,77 @@ static void randomize_addrinfo_list(struct addrinfo **list_ptr,
     }
 }
 
+typedef struct {
+    struct addrinfo info;
+    avs_net_resolved_endpoint_t endpoint;
+} cached_addrinfo_t;
+
+static int results_from_cache(avs_net_addrinfo_t *ctx,
+                              const struct addrinfo *hint,
+                              const avs_net_resolved_endpoint_t *endpoints,
+                              size_t count) {
+    cached_addrinfo_t *nodes =
+            (cached_addrinfo_t *) avs_calloc(count, sizeof(*nodes));
+    if (!nodes) {
+        LOG(ERROR, "Out of memory");
+        return -1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        nodes[i].endpoint = endpoints[i];
+        nodes[i].info.ai_family =
+                ((const struct sockaddr *) endpoints[i].data.buf)->sa_family;
+        nodes[i].info.ai_socktype = hint->ai_socktype;
+        nodes[i].info.ai_addrlen = endpoints[i].size;
+        nodes[i].info.ai_addr = (struct sockaddr *) nodes[i].endpoint.data.buf;
+        nodes[i].info.ai_next = (i + 1 < count) ? &nodes[i + 1].info : NULL;
+    }
+    ctx->cached_results_buf = nodes;
+    ctx->results = &nodes[0].info;
+    return 0;
+}
+
+static void store_results_in_cache(const char *host,
+                                   const struct addrinfo *hint,
+                                   const struct addrinfo *results) {
+    size_t count = 0;
+    for (const struct addrinfo *ai = results; ai; ai = ai->ai_next) {
+        ++count;
+    }
+    avs_net_resolved_endpoint_t *endpoints = NULL;
+    if (count
+            && !(endpoints = (avs_net_resolved_endpoint_t *) avs_calloc(
+                         count, sizeof(*endpoints)))) {
+        return;
+    }
+    size_t stored = 0;
+    for (const struct addrinfo *ai = results; ai; ai = ai->ai_next) {
+        if (ai->ai_addrlen <= sizeof(endpoints[stored].data)) {
+            endpoints[stored].size = (uint8_t) ai->ai_addrlen;
+            memcpy(endpoints[stored].data.buf, ai->ai_addr, ai->ai_addrlen);
+            ++stored;
+        }
+    }
+    if (stored) {
+        _avs_net_addrinfo_cache_store(host, hint->ai_family,
+                                      hint->ai_socktype, hint->ai_flags,
+                                      endpoints, stored);
+    }
+    avs_free(endpoints);
+}
+
+static bool is_nonexistent_host_error(int error) {
+    return error == EAI_NONAME
+#ifdef EAI_NODATA
+            || error == EAI_NODATA
+#endif
+            ;
+}
+
 void avs_net_addrinfo_delete(avs_net_addrinfo_t **ctx) {
     if (*ctx) {
-        if ((*ctx)->results) {
+        if ((*ctx)->cached_results_buf) {
+            avs_free((*ctx)->cached_results_buf);
+        } else if ((*ctx)->results) {
             freeaddrinfo((*ctx)->results);
         }
         avs_free(*ctx);
@@ -213,7 +283,32 @@ avs_net_addrinfo_t *avs_net_addrinfo_resolve_ex(
             host = "";
         }
     }
-    int error = getaddrinfo(host, NULL, &hint, &ctx->results);
+    avs_net_resolved_endpoint_t *cached = NULL;
+    size_t cached_count = 0;
+    int error;
+    if (!_avs_net_addrinfo_cache_lookup(host, hint.ai_family,
+                                        hint.ai_socktype, hint.ai_flags,
+                                        &cached, &cached_count)) {
+        if (!cached_count) {
+            LOG(DEBUG, "cached negative result for %s", host);
+            avs_net_addrinfo_delete(&ctx);
+            return NULL;
+        }
+        error = results_from_cache(ctx, &hint, cached, cached_count);
+        avs_free(cached);
+        if (error) {
+            avs_net_addrinfo_delete(&ctx);
+            return NULL;
+        }
+    } else if (!(error = getaddrinfo(host, NULL, &hint, &ctx->results))) {
+        if (_avs_net_addrinfo_cache_enabled()) {
+            store_results_in_cache(host, &hint, ctx->results);
+        }
+    } else if (is_nonexistent_host_error(error)) {
+        // temporary failures, e.g. EAI_AGAIN, are deliberately not cached
+        _avs_net_addrinfo_cache_store(host, hint.ai_family, hint.ai_socktype,
+                                      hint.ai_flags, NULL, 0);
+    }
     if (error) {
 #ifdef HAVE_GAI_STRERROR
         LOG(DEBUG, "getaddrinfo() error: %s; family == (avs_net_af_t) %d",
@@ -16,6 +16,11 @@
 
 #define _AVS_NEED_POSIX_SOCKET
 
+// recvmmsg() and sendmmsg() are GNU extensions on glibc
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <avs_commons_posix_config.h>
 
 #include <avsystem/commons/memory.h>
@@ -33,6 +38,14 @@
 #include <ifaddrs.h>
 #endif
 
+#ifdef HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
+
+#ifdef HAVE_LINUX_FILTER_H
+#include <linux/filter.h>
+#endif
+
 #include "compat.h"
 
 VISIBILITY_SOURCE_BEGIN
@@ -155,6 +168,17 @@ static const avs_time_duration_t NET_SEND_TIMEOUT = { 30, 0 };
 static const avs_time_duration_t NET_CONNECT_TIMEOUT = { 10, 0 };
 static const avs_time_duration_t NET_ACCEPT_TIMEOUT = { 5, 0 };
 
+#ifdef HAVE_POLL
+/* "Connection Attempt Delay" recommended by RFC 8305, section 8 */
+static const avs_time_duration_t NET_CONNECTION_ATTEMPT_DELAY = {
+    0, 250000000
+};
+/* Maximum number of addresses tried when connecting a TCP socket */
+#define NET_HAPPY_EYEBALLS_MAX_CANDIDATES 16
+/* Maximum number of connection attempts that may be in flight at once */
+#define NET_HAPPY_EYEBALLS_MAX_ATTEMPTS 4
+#endif // HAVE_POLL
+
 #define NET_LISTEN_BACKLOG 1024
 
 #ifdef HAVE_INET_NTOP
@@ -283,6 +307,36 @@ static int set_opt_net(avs_net_abstract_socket_t *net_socket,
                        avs_net_socket_opt_key_t option_key,
                        avs_net_socket_opt_value_t option_value);
 static int errno_net(avs_net_abstract_socket_t *net_socket);
+static int remote_endpoint_net(avs_net_abstract_socket_t *net_socket,
+                               avs_net_resolved_endpoint_t *out_endpoint);
+static int receive_batch_net(avs_net_abstract_socket_t *net_socket,
+                             size_t *out_received,
+                             avs_net_socket_batch_msg_t *messages,
+                             size_t count);
+static int send_to_batch_net(avs_net_abstract_socket_t *net_socket,
+                             avs_net_socket_send_to_msg_t *messages,
+                             size_t count);
+static int send_vec_net(avs_net_abstract_socket_t *net_socket,
+                        const avs_net_socket_const_iovec_t *iov,
+                        size_t iov_count);
+static int receive_vec_net(avs_net_abstract_socket_t *net_socket,
+                           size_t *out,
+                           const avs_net_socket_iovec_t *iov,
+                           size_t iov_count);
+static int send_file_net(avs_net_abstract_socket_t *net_socket,
+                         const void *file_handle,
+                         avs_off_t offset,
+                         size_t length,
+                         size_t *out_bytes_sent);
+static int send_segmented_net(avs_net_abstract_socket_t *net_socket,
+                              const void *buffer,
+                              size_t buffer_length,
+                              size_t segment_size);
+static int receive_segmented_net(avs_net_abstract_socket_t *net_socket,
+                                 size_t *out_bytes_received,
+                                 size_t *out_segment_size,
+                                 void *buffer,
+                                 size_t buffer_length);
 
 static int unimplemented() {
     return -1;
@@ -309,7 +363,15 @@ static const avs_net_socket_v_table_t net_vtable = {
     local_port_net,
     get_opt_net,
     set_opt_net,
-    errno_net
+    errno_net,
+    remote_endpoint_net,
+    receive_batch_net,
+    send_to_batch_net,
+    send_vec_net,
+    receive_vec_net,
+    send_file_net,
+    send_segmented_net,
+    receive_segmented_net
 };
 
 typedef struct {
@@ -319,9 +381,19 @@ typedef struct {
     avs_net_socket_state_t state;
     char remote_hostname[NET_MAX_HOSTNAME_SIZE];
     char remote_port[NET_PORT_SIZE];
+    /* address of the connected peer; size == 0 if not connected */
+    sockaddr_endpoint_union_t remote_endpoint;
     avs_net_socket_configuration_t configuration;
+    /* UDP_GRO has been successfully enabled on the system socket */
+    bool udp_gro_enabled;
+    /* UDP_SEGMENT has been found not to work; only set if udp_offload is */
+    bool udp_gso_unavailable;
 
     avs_time_duration_t recv_timeout;
+    /* total time spent in call_when_ready() waiting for readiness; only
+     * accounted after AVS_NET_SOCKET_OPT_POLL_WAIT_TIME is first queried */
+    avs_time_duration_t poll_wait_time;
+    bool poll_wait_accounted;
     volatile int error_code;
 } avs_net_socket_t;
 
@@ -501,6 +573,19 @@ static int remote_port_net(avs_net_abstract_socket_t *socket_,
     }
 }
 
+static int remote_endpoint_net(avs_net_abstract_socket_t *net_socket_,
+                               avs_net_resolved_endpoint_t *out_endpoint) {
+    avs_net_socket_t *net_socket = (avs_net_socket_t *) net_socket_;
+    if (!net_socket->remote_endpoint.api_ep.size) {
+        net_socket->error_code =
+                (net_socket->socket == INVALID_SOCKET ? EBADF : ENOTCONN);
+        return -1;
+    }
+    *out_endpoint = net_socket->remote_endpoint.api_ep;
+    net_socket->error_code = 0;
+    return 0;
+}
+
 static int system_socket_net(avs_net_abstract_socket_t *net_socket_,
                              const void **out) {
     avs_net_socket_t *net_socket = (avs_net_socket_t *) net_socket_;
@@ -520,6 +605,7 @@ static void close_net_raw(avs_net_socket_t *net_socket) {
         net_socket->socket = INVALID_SOCKET;
         net_socket->state = AVS_NET_SOCKET_STATE_CLOSED;
     }
+    net_socket->remote_endpoint.api_ep.size = 0;
 }
 
 static int close_net(avs_net_abstract_socket_t *net_socket_) {
@@ -588,6 +674,14 @@ static sa_family_t get_connection_family(sockfd_t fd) {
 #define IPV6_TRANSPARENT 75
 #endif
 
+/* from <netinet/udp.h> / <linux/udp.h>, missing in older C libraries */
+#if !defined(UDP_SEGMENT) && defined(__linux__)
+#define UDP_SEGMENT 103
+#endif
+#if !defined(UDP_GRO) && defined(__linux__)
+#define UDP_GRO 104
+#endif
+
 static int configure_socket(avs_net_socket_t *net_socket) {
     errno = 0;
     LOG(TRACE, "configuration '%s' 0x%02x 0x%02x",
@@ -675,6 +769,19 @@ static int configure_socket(avs_net_socket_t *net_socket) {
             return -1;
         }
     }
+#if defined(UDP_GRO) && defined(HAVE_RECVMSG)
+    if (net_socket->configuration.udp_offload
+            && net_socket->type == AVS_NET_UDP_SOCKET) {
+        int value = 1;
+        net_socket->udp_gro_enabled =
+                !setsockopt(net_socket->socket, IPPROTO_UDP, UDP_GRO,
+                            &value, sizeof(value));
+        if (!net_socket->udp_gro_enabled) {
+            /* not fatal - datagrams will just not be coalesced */
+            LOG(WARNING, "could not enable UDP_GRO: %s", strerror(errno));
+        }
+    }
+#endif /* defined(UDP_GRO) && defined(HAVE_RECVMSG) */
 
     net_socket->error_code = 0;
     return 0;
@@ -808,17 +915,34 @@ static int wait_until_ready(const volatile sockfd_t *sockfd_ptr,
     return result;
 }
 
+static int wait_until_ready_accounted(avs_net_socket_t *net_socket,
+                                     avs_time_monotonic_t deadline,
+                                     char in, char out, char err) {
+    if (!net_socket->poll_wait_accounted) {
+        return wait_until_ready(&net_socket->socket, deadline, in, out, err);
+    }
+    avs_time_monotonic_t start = avs_time_monotonic_now();
+    int result = wait_until_ready(&net_socket->socket, deadline, in, out, err);
+    int error = errno;
+    net_socket->poll_wait_time = avs_time_duration_add(
+            net_socket->poll_wait_time,
+            avs_time_monotonic_diff(avs_time_monotonic_now(), start));
+    errno = error;
+    return result;
+}
+
 typedef int call_when_ready_cb_t(sockfd_t sockfd, void *arg);
 
-static int call_when_ready(const volatile sockfd_t *sockfd_ptr,
+static int call_when_ready(avs_net_socket_t *net_socket,
                            avs_time_duration_t timeout,
                            char in, char out, char err,
                            call_when_ready_cb_t *callback,
                            void *callback_arg) {
+    const volatile sockfd_t *sockfd_ptr = &net_socket->socket;
     int result = -1;
     avs_time_monotonic_t deadline = avs_time_monotonic_add(
             avs_time_monotonic_now(), timeout);
-    while (!wait_until_ready(sockfd_ptr, deadline, in, out, err)) {
+    while (!wait_until_ready_accounted(net_socket, deadline, in, out, err)) {
         do {
             sockfd_t sockfd = *sockfd_ptr;
             if (sockfd == INVALID_SOCKET) {
@@ -1071,18 +1195,17 @@ resolve_addrinfo_for_socket(avs_net_socket_t *net_socket,
                     ? net_socket->configuration.preferred_endpoint : NULL);
 }
 
-static int try_connect_open_socket(avs_net_socket_t *net_socket,
-                                   const sockaddr_endpoint_union_t *address) {
-    char socket_is_stream = (net_socket->type == AVS_NET_TCP_SOCKET);
-    if (connect_with_timeout(&net_socket->socket, address, socket_is_stream) < 0
-            || (socket_is_stream
-                    && send_net((avs_net_abstract_socket_t *) net_socket,
-                                NULL, 0) < 0)) {
+static int finish_connect(avs_net_socket_t *net_socket,
+                          const sockaddr_endpoint_union_t *address) {
+    if (net_socket->type == AVS_NET_TCP_SOCKET
+            && send_net((avs_net_abstract_socket_t *) net_socket,
+                        NULL, 0) < 0) {
         net_socket->error_code = errno;
         return -1;
     } else {
         /* SUCCESS */
         net_socket->state = AVS_NET_SOCKET_STATE_CONNECTED;
+        net_socket->remote_endpoint = *address;
         /* store address affinity */
         if (net_socket->configuration.preferred_endpoint) {
             *net_socket->configuration.preferred_endpoint = address->api_ep;
@@ -1092,6 +1215,17 @@ static int try_connect_open_socket(avs_net_socket_t *net_socket,
     }
 }
 
+static int try_connect_open_socket(avs_net_socket_t *net_socket,
+                                   const sockaddr_endpoint_union_t *address) {
+    char socket_is_stream = (net_socket->type == AVS_NET_TCP_SOCKET);
+    if (connect_with_timeout(&net_socket->socket, address,
+                             socket_is_stream) < 0) {
+        net_socket->error_code = errno;
+        return -1;
+    }
+    return finish_connect(net_socket, address);
+}
+
 static int try_connect(avs_net_socket_t *net_socket,
                        const sockaddr_endpoint_union_t *address) {
     char socket_was_already_open = (net_socket->socket != INVALID_SOCKET);
@@ -1121,6 +1255,270 @@ static int try_connect(avs_net_socket_t *net_socket,
     return retval;
 }
 
+#ifdef HAVE_POLL
+typedef struct {
+    sockfd_t fd;
+    size_t candidate;
+    avs_time_monotonic_t deadline;
+} connect_attempt_t;
+
+typedef struct {
+    sockaddr_endpoint_union_t candidates[NET_HAPPY_EYEBALLS_MAX_CANDIDATES];
+    size_t num_candidates;
+    size_t next_candidate;
+    avs_time_monotonic_t next_attempt_time;
+    connect_attempt_t attempts[NET_HAPPY_EYEBALLS_MAX_ATTEMPTS];
+    size_t num_attempts;
+} happy_eyeballs_t;
+
+/**
+ * Resolves addresses of both families and interleaves them, starting with the
+ * preferred family (RFC 8305, section 4).
+ */
+static void he_collect_candidates(happy_eyeballs_t *he,
+                                  avs_net_socket_t *net_socket,
+                                  const char *host,
+                                  const char *port) {
+    avs_net_addrinfo_t *infos[] = {
+        resolve_addrinfo_for_socket(net_socket, host, port,
+                                    true, PREFERRED_FAMILY_ONLY),
+        resolve_addrinfo_for_socket(net_socket, host, port,
+                                    true, PREFERRED_FAMILY_BLOCKED)
+    };
+    bool more = true;
+    he->num_candidates = 0;
+    while (more && he->num_candidates < NET_HAPPY_EYEBALLS_MAX_CANDIDATES) {
+        more = false;
+        for (size_t i = 0; i < AVS_ARRAY_SIZE(infos)
+                        && he->num_candidates
+                                   < NET_HAPPY_EYEBALLS_MAX_CANDIDATES;
+                ++i) {
+            if (infos[i] && !avs_net_addrinfo_next(
+                    infos[i], &he->candidates[he->num_candidates].api_ep)) {
+                ++he->num_candidates;
+                more = true;
+            }
+        }
+    }
+    for (size_t i = 0; i < AVS_ARRAY_SIZE(infos); ++i) {
+        avs_net_addrinfo_delete(&infos[i]);
+    }
+}
+
+static void he_remove_attempt(happy_eyeballs_t *he, size_t index) {
+    he->attempts[index] = he->attempts[--he->num_attempts];
+}
+
+/**
+ * Starts a nonblocking connection to the next candidate address.
+ *
+ * @returns 1 if the connection is in progress, 0 if it succeeded immediately
+ *          (in which case net_socket->socket is set), or -1 if it failed.
+ */
+static int he_start_attempt(happy_eyeballs_t *he,
+                            avs_net_socket_t *net_socket) {
+    size_t candidate = he->next_candidate++;
+    const sockaddr_endpoint_t *address =
+            &he->candidates[candidate].sockaddr_ep;
+    sockfd_t fd = socket(address->addr.sa_family,
+                         _avs_net_get_socket_type(net_socket->type), 0);
+    if (fd == INVALID_SOCKET) {
+        net_socket->error_code = errno;
+        LOG(ERROR, "cannot create socket: %s", strerror(errno));
+        return -1;
+    }
+    // configure_socket() operates on the socket object itself
+    net_socket->socket = fd;
+    int result = configure_socket(net_socket);
+    net_socket->socket = INVALID_SOCKET;
+    if (result) {
+        LOG(WARNING, "socket configuration problem");
+        // make sure the error from a previous attempt is not reported instead
+        if (!net_socket->error_code) {
+            net_socket->error_code = EINVAL;
+        }
+    } else if (!connect(fd, &address->addr, address->header.size)) {
+        net_socket->socket = fd;
+        return 0;
+    } else if (errno == EINPROGRESS) {
+        connect_attempt_t *attempt = &he->attempts[he->num_attempts++];
+        attempt->fd = fd;
+        attempt->candidate = candidate;
+        attempt->deadline = avs_time_monotonic_add(avs_time_monotonic_now(),
+                                                   NET_CONNECT_TIMEOUT);
+        return 1;
+    } else {
+        net_socket->error_code = errno;
+    }
+    close(fd);
+    return -1;
+}
+
+static int he_poll_timeout_ms(const happy_eyeballs_t *he) {
+    avs_time_monotonic_t wake_up = AVS_TIME_MONOTONIC_INVALID;
+    if (he->next_candidate < he->num_candidates
+            && he->num_attempts < NET_HAPPY_EYEBALLS_MAX_ATTEMPTS) {
+        wake_up = he->next_attempt_time;
+    }
+    for (size_t i = 0; i < he->num_attempts; ++i) {
+        if (!avs_time_monotonic_valid(wake_up)
+                || avs_time_monotonic_before(he->attempts[i].deadline,
+                                             wake_up)) {
+            wake_up = he->attempts[i].deadline;
+        }
+    }
+    int64_t timeout_ms;
+    if (avs_time_duration_to_scalar(
+                &timeout_ms, AVS_TIME_MS,
+                avs_time_monotonic_diff(wake_up, avs_time_monotonic_now()))
+            || timeout_ms < 0) {
+        return 0;
+    }
+    // round up, so that we don't wake up just before the deadline
+    return timeout_ms >= INT_MAX ? INT_MAX : (int) timeout_ms + 1;
+}
+
+/**
+ * Polls the attempts in flight, dropping the failed and timed out ones.
+ *
+ * @returns Index of a successfully connected attempt, or
+ *          NET_HAPPY_EYEBALLS_MAX_ATTEMPTS if there is none yet.
+ */
+static size_t he_poll_attempts(happy_eyeballs_t *he,
+                               avs_net_socket_t *net_socket) {
+    struct pollfd pollfds[NET_HAPPY_EYEBALLS_MAX_ATTEMPTS];
+    for (size_t i = 0; i < he->num_attempts; ++i) {
+        pollfds[i].fd = he->attempts[i].fd;
+        pollfds[i].events = POLLOUT;
+        pollfds[i].revents = 0;
+    }
+    int result = poll(pollfds, (nfds_t) he->num_attempts,
+                      he_poll_timeout_ms(he));
+    if (result < 0) {
+        // most likely EINTR; everything will be rechecked in the next pass
+        return NET_HAPPY_EYEBALLS_MAX_ATTEMPTS;
+    }
+
+    avs_time_monotonic_t now = avs_time_monotonic_now();
+    // iterate backwards, so that he_remove_attempt() does not disturb pollfds
+    for (size_t i = he->num_attempts; i-- > 0;) {
+        if (pollfds[i].revents) {
+            int error_code = 0;
+            socklen_t length = sizeof(error_code);
+            if (getsockopt(he->attempts[i].fd, SOL_SOCKET, SO_ERROR,
+                           &error_code, &length)) {
+                error_code = errno;
+            }
+            if (!error_code && (pollfds[i].revents & POLLOUT)) {
+                return i;
+            }
+            net_socket->error_code = error_code ? error_code : ECONNREFUSED;
+        } else if (avs_time_monotonic_before(he->attempts[i].deadline, now)) {
+            net_socket->error_code = ETIMEDOUT;
+        } else {
+            continue;
+        }
+        close(he->attempts[i].fd);
+        he_remove_attempt(he, i);
+        // a failed attempt lets the next one start right away
+        he->next_attempt_time = now;
+    }
+    return NET_HAPPY_EYEBALLS_MAX_ATTEMPTS;
+}
+
+static void he_init(happy_eyeballs_t *he) {
+    he->next_candidate = 0;
+    he->next_attempt_time = avs_time_monotonic_now();
+    he->num_attempts = 0;
+}
+
+static bool he_exhausted(const happy_eyeballs_t *he) {
+    return he->num_attempts == 0 && he->next_candidate >= he->num_candidates;
+}
+
+/**
+ * Starts the next connection attempt if it is due, or waits for the attempts
+ * in flight otherwise.
+ *
+ * @returns Index of the candidate address that has been connected to (in
+ *          which case net_socket->socket is set), or SIZE_MAX if there is
+ *          none yet.
+ */
+static size_t he_step(happy_eyeballs_t *he, avs_net_socket_t *net_socket) {
+    if (he->next_candidate < he->num_candidates
+            && he->num_attempts < NET_HAPPY_EYEBALLS_MAX_ATTEMPTS
+            && !avs_time_monotonic_before(avs_time_monotonic_now(),
+                                          he->next_attempt_time)) {
+        size_t candidate = he->next_candidate;
+        int result = he_start_attempt(he, net_socket);
+        if (!result) {
+            return candidate;
+        } else if (result > 0) {
+            he->next_attempt_time =
+                    avs_time_monotonic_add(avs_time_monotonic_now(),
+                                           NET_CONNECTION_ATTEMPT_DELAY);
+        }
+        return SIZE_MAX;
+    }
+    size_t index = he_poll_attempts(he, net_socket);
+    if (index < he->num_attempts) {
+        size_t candidate = he->attempts[index].candidate;
+        net_socket->socket = he->attempts[index].fd;
+        he_remove_attempt(he, index);
+        return candidate;
+    }
+    return SIZE_MAX;
+}
+
+/* Cancels the attempts that lost the race. */
+static void he_cancel_attempts(happy_eyeballs_t *he) {
+    for (size_t i = 0; i < he->num_attempts; ++i) {
+        close(he->attempts[i].fd);
+    }
+    he->num_attempts = 0;
+}
+
+/**
+ * Connects a TCP socket using the Happy Eyeballs algorithm (RFC 8305):
+ * connections to subsequent candidate addresses are started in parallel,
+ * staggered by NET_CONNECTION_ATTEMPT_DELAY, and the first one to succeed is
+ * used.
+ */
+static int connect_happy_eyeballs(avs_net_socket_t *net_socket,
+                                  const char *host,
+                                  const char *port) {
+    happy_eyeballs_t *he =
+            (happy_eyeballs_t *) avs_malloc(sizeof(happy_eyeballs_t));
+    if (!he) {
+        LOG(ERROR, "out of memory");
+        net_socket->error_code = ENOMEM;
+        return -1;
+    }
+    he_collect_candidates(he, net_socket, host, port);
+    he_init(he);
+
+    size_t winner = SIZE_MAX;
+    while (winner == SIZE_MAX && !he_exhausted(he)) {
+        winner = he_step(he, net_socket);
+    }
+    he_cancel_attempts(he);
+
+    int result = -1;
+    if (winner != SIZE_MAX) {
+        LOG(TRACE, "connected to candidate address %u of %u",
+            (unsigned) winner + 1, (unsigned) he->num_candidates);
+        if (!(result = finish_connect(net_socket, &he->candidates[winner]))) {
+            avs_free(he);
+            return 0;
+        }
+        close(net_socket->socket);
+        net_socket->socket = INVALID_SOCKET;
+    }
+    avs_free(he);
+    return result;
+}
+#endif // HAVE_POLL
+
 static int connect_net(avs_net_abstract_socket_t *net_socket_,
                        const char *host,
                        const char *port) {
@@ -1141,6 +1539,17 @@ static int connect_net(avs_net_abstract_socket_t *net_socket_,
 
     errno = 0;
     net_socket->error_code = EADDRNOTAVAIL;
+#ifdef HAVE_POLL
+    if (net_socket->type == AVS_NET_TCP_SOCKET
+            && net_socket->socket == INVALID_SOCKET) {
+        if (!connect_happy_eyeballs(net_socket, host, port)) {
+            goto success;
+        }
+        LOG(ERROR, "cannot establish connection to [%s]:%s: %s",
+            host, port, strerror(net_socket->error_code));
+        return -1;
+    }
+#endif // HAVE_POLL
     if ((info = resolve_addrinfo_for_socket(net_socket, host, port,
                                             true, PREFERRED_FAMILY_ONLY))) {
         sockaddr_endpoint_union_t address;
@@ -1210,7 +1619,7 @@ static int send_net(avs_net_abstract_socket_t *net_socket_,
 
     /* send at least one datagram, even if zero-length - hence do..while */
     do {
-        if (call_when_ready(&net_socket->socket, NET_SEND_TIMEOUT, 0, 1, 1,
+        if (call_when_ready(net_socket, NET_SEND_TIMEOUT, 0, 1, 1,
                             send_internal, &arg) < 0) {
             net_socket->error_code = errno;
             LOG(ERROR, "send failed: %s", strerror(errno));
@@ -1239,6 +1648,314 @@ static int send_net(avs_net_abstract_socket_t *net_socket_,
     }
 }
 
+#if defined(HAVE_SENDMSG) || defined(HAVE_RECVMSG)
+/* Upper bound on the number of segments passed to a single sendmsg() or
+ * recvmsg() call, to keep the iovec array on stack reasonably small. */
+#define NET_MAX_IOVECS 16
+#endif
+
+#ifdef HAVE_SENDMSG
+
+typedef struct {
+    struct iovec iov[NET_MAX_IOVECS];
+    /* index of the first segment that has not been sent in full */
+    size_t first;
+    size_t count;
+    size_t bytes_sent;
+} send_vec_internal_arg_t;
+
+static int send_vec_internal(sockfd_t sockfd, void *arg_) {
+    send_vec_internal_arg_t *arg = (send_vec_internal_arg_t *) arg_;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &arg->iov[arg->first];
+    msg.msg_iovlen = arg->count - arg->first;
+    ssize_t result = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+    if (result < 0) {
+        return (int) result;
+    }
+    arg->bytes_sent = (size_t) result;
+    return 0;
+}
+
+static void consume_iovecs(send_vec_internal_arg_t *arg, size_t bytes) {
+    while (arg->first < arg->count && bytes >= arg->iov[arg->first].iov_len) {
+        bytes -= arg->iov[arg->first].iov_len;
+        ++arg->first;
+    }
+    if (bytes) {
+        arg->iov[arg->first].iov_base =
+                (char *) arg->iov[arg->first].iov_base + bytes;
+        arg->iov[arg->first].iov_len -= bytes;
+    }
+}
+
+static int send_vec_chunk(avs_net_socket_t *net_socket,
+                          send_vec_internal_arg_t *arg,
+                          size_t length) {
+    size_t bytes_sent = 0;
+    /* send at least one datagram, even if zero-length - hence do..while */
+    do {
+        if (call_when_ready(net_socket, NET_SEND_TIMEOUT, 0, 1, 1,
+                            send_vec_internal, arg) < 0) {
+            net_socket->error_code = errno;
+            LOG(ERROR, "send failed: %s", strerror(errno));
+            return -1;
+        } else if (length != 0 && arg->bytes_sent == 0) {
+            LOG(ERROR, "send returned 0");
+            break;
+        } else {
+            bytes_sent += arg->bytes_sent;
+            consume_iovecs(arg, arg->bytes_sent);
+        }
+        /* call sendmsg() multiple times only if the socket is
+         * stream-oriented */
+    } while (net_socket->type == AVS_NET_TCP_SOCKET && bytes_sent < length);
+
+    if (bytes_sent < length) {
+        LOG(ERROR, "sending fail (%lu/%lu)",
+            (unsigned long) bytes_sent, (unsigned long) length);
+        net_socket->error_code = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+static int send_vec_net(avs_net_abstract_socket_t *net_socket_,
+                        const avs_net_socket_const_iovec_t *iov,
+                        size_t iov_count) {
+    avs_net_socket_t *net_socket = (avs_net_socket_t *) net_socket_;
+    if (iov_count > NET_MAX_IOVECS
+            && net_socket->type != AVS_NET_TCP_SOCKET) {
+        /* a datagram needs to be sent with a single call */
+        return _avs_net_socket_send_vec_coalesced(net_socket_, iov, iov_count);
+    }
+
+    size_t offset = 0;
+    do {
+        send_vec_internal_arg_t arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.count = AVS_MIN(iov_count - offset, (size_t) NET_MAX_IOVECS);
+        size_t length = 0;
+        for (size_t i = 0; i < arg.count; ++i) {
+            arg.iov[i].iov_base = (void *) (intptr_t) iov[offset + i].buffer;
+            arg.iov[i].iov_len = iov[offset + i].buffer_length;
+            length += arg.iov[i].iov_len;
+        }
+        if (send_vec_chunk(net_socket, &arg, length)) {
+            return -1;
+        }
+        offset += arg.count;
+    } while (offset < iov_count);
+
+    net_socket->error_code = 0;
+    return 0;
+}
+
+#else /* HAVE_SENDMSG */
+
+static int send_vec_net(avs_net_abstract_socket_t *net_socket,
+                        const avs_net_socket_const_iovec_t *iov,
+                        size_t iov_count) {
+    return _avs_net_socket_send_vec_coalesced(net_socket, iov, iov_count);
+}
+
+#endif /* HAVE_SENDMSG */
+
+#ifdef HAVE_SENDFILE
+
+typedef struct {
+    int file_fd;
+    off_t offset;
+    size_t length;
+    size_t bytes_sent;
+} send_file_internal_arg_t;
+
+static int send_file_internal(sockfd_t sockfd, void *arg_) {
+    send_file_internal_arg_t *arg = (send_file_internal_arg_t *) arg_;
+    /* sendfile() advances arg->offset by itself */
+    ssize_t result = sendfile(sockfd, arg->file_fd, &arg->offset, arg->length);
+    if (result < 0) {
+        return (int) result;
+    }
+    arg->bytes_sent = (size_t) result;
+    return 0;
+}
+
+static int send_file_net(avs_net_abstract_socket_t *net_socket_,
+                         const void *file_handle,
+                         avs_off_t offset,
+                         size_t length,
+                         size_t *out_bytes_sent) {
+    avs_net_socket_t *net_socket = (avs_net_socket_t *) net_socket_;
+    *out_bytes_sent = 0;
+    if (net_socket->type != AVS_NET_TCP_SOCKET) {
+        return AVS_NET_SOCKET_SEND_FILE_UNSUPPORTED;
+    }
+    if (offset < 0) {
+        net_socket->error_code = EINVAL;
+        return -1;
+    }
+    send_file_internal_arg_t arg = {
+        .file_fd = *(const int *) file_handle,
+        .offset = (off_t) offset
+    };
+    while (*out_bytes_sent < length) {
+        arg.length = length - *out_bytes_sent;
+        arg.bytes_sent = 0;
+        if (call_when_ready(net_socket, NET_SEND_TIMEOUT, 0, 1, 1,
+                            send_file_internal, &arg) < 0) {
+            if (*out_bytes_sent == 0 && (errno == EINVAL || errno == ENOSYS)) {
+                /* the file descriptor does not support sendfile(),
+                 * e.g. it refers to a pipe */
+                return AVS_NET_SOCKET_SEND_FILE_UNSUPPORTED;
+            }
+            net_socket->error_code = errno;
+            LOG(ERROR, "sendfile failed: %s", strerror(errno));
+            return -1;
+        } else if (arg.bytes_sent == 0) {
+            /* end of file */
+            break;
+        }
+        *out_bytes_sent += arg.bytes_sent;
+    }
+    net_socket->error_code = 0;
+    return 0;
+}
+
+#else /* HAVE_SENDFILE */
+
+static int send_file_net(avs_net_abstract_socket_t *net_socket,
+                         const void *file_handle,
+                         avs_off_t offset,
+                         size_t length,
+                         size_t *out_bytes_sent) {
+    (void) net_socket;
+    (void) file_handle;
+    (void) offset;
+    (void) length;
+    *out_bytes_sent = 0;
+    return AVS_NET_SOCKET_SEND_FILE_UNSUPPORTED;
+}
+
+#endif /* HAVE_SENDFILE */
+
+#if defined(UDP_SEGMENT) && defined(HAVE_SENDMSG)
+
+/* Limits imposed by Linux on a single UDP_SEGMENT send: the number of
+ * segments and the maximum UDP payload over IPv4. */
+#define NET_UDP_GSO_MAX_SEGMENTS 64
+#define NET_UDP_GSO_MAX_PAYLOAD 65507
+
+typedef struct {
+    const void *data;
+    size_t data_length;
+    uint16_t segment_size;
+    size_t bytes_sent;
+} send_gso_internal_arg_t;
+
+static int send_gso_internal(sockfd_t sockfd, void *arg_) {
+    send_gso_internal_arg_t *arg = (send_gso_internal_arg_t *) arg_;
+    struct iovec iov;
+    iov.iov_base = (void *) (intptr_t) arg->data;
+    iov.iov_len = arg->data_length;
+    union {
+        char buf[CMSG_SPACE(sizeof(uint16_t))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = IPPROTO_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cmsg), &arg->segment_size, sizeof(uint16_t));
+
+    ssize_t result = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+    if (result < 0) {
+        return (int) result;
+    }
+    arg->bytes_sent = (size_t) result;
+    return 0;
+}
+
+static int send_segmented_net(avs_net_abstract_socket_t *net_socket_,
+                              const void *buffer,
+                              size_t buffer_length,
+                              size_t segment_size) {
+    avs_net_socket_t *net_socket = (avs_net_socket_t *) net_socket_;
+    if (net_socket->type != AVS_NET_UDP_SOCKET) {
+        /* segment boundaries are meaningless for a byte stream */
+        return send_net(net_socket_, buffer, buffer_length);
+    }
+    if (!net_socket->configuration.udp_offload
+            || net_socket->udp_gso_unavailable
+            || segment_size > NET_UDP_GSO_MAX_PAYLOAD
+            || buffer_length <= segment_size) {
+        return _avs_net_socket_send_segmented_separately(
+                net_socket_, buffer, buffer_length, segment_size);
+    }
+
+    const size_t max_chunk =
+            AVS_MIN((size_t) NET_UDP_GSO_MAX_SEGMENTS,
+                    NET_UDP_GSO_MAX_PAYLOAD / segment_size) * segment_size;
+    send_gso_internal_arg_t arg = {
+        .segment_size = (uint16_t) segment_size
+    };
+    size_t offset = 0;
+    while (offset < buffer_length) {
+        arg.data = (const char *) buffer + offset;
+        arg.data_length = AVS_MIN(buffer_length - offset, max_chunk);
+        if (call_when_ready(net_socket, NET_SEND_TIMEOUT, 0, 1, 1,
+                            send_gso_internal, &arg) < 0) {
+            int error = errno;
+            if (error != EIO && error != EINVAL && error != ENOPROTOOPT) {
+                net_socket->error_code = error;
+                LOG(ERROR, "send failed: %s", strerror(error));
+                return -1;
+            }
+            /* EINVAL means that the segment size is too large for the
+             * path MTU; other errors mean that the offload is not supported
+             * by the kernel or the network device at all */
+            LOG(WARNING, "UDP_SEGMENT failed (%s), sending datagrams "
+                "separately", strerror(error));
+            if (error != EINVAL) {
+                net_socket->udp_gso_unavailable = true;
+            }
+            return _avs_net_socket_send_segmented_separately(
+                    net_socket_, arg.data, buffer_length - offset,
+                    segment_size);
+        } else if (arg.bytes_sent != arg.data_length) {
+            LOG(ERROR, "sending fail (%lu/%lu)",
+                (unsigned long) arg.bytes_sent,
+                (unsigned long) arg.data_length);
+            net_socket->error_code = EIO;
+            return -1;
+        }
+        offset += arg.data_length;
+    }
+    net_socket->error_code = 0;
+    return 0;
+}
+
+#else /* defined(UDP_SEGMENT) && defined(HAVE_SENDMSG) */
+
+static int send_segmented_net(avs_net_abstract_socket_t *net_socket,
+                              const void *buffer,
+                              size_t buffer_length,
+                              size_t segment_size) {
+    return _avs_net_socket_send_segmented_separately(
+            net_socket, buffer, buffer_length, segment_size);
+}
+
+#endif /* defined(UDP_SEGMENT) && defined(HAVE_SENDMSG) */
+
 typedef struct {
     const void *data;
     size_t data_length;
@@ -1262,37 +1979,197 @@ static int send_to_internal(sockfd_t sockfd, void *arg_) {
     }
 }
 
-static int send_to_net(avs_net_abstract_socket_t *net_socket_,
-                       const void *buffer,
-                       size_t buffer_length,
-                       const char *host,
-                       const char *port) {
-    avs_net_socket_t *net_socket = (avs_net_socket_t *) net_socket_;
+static int resolve_send_to_endpoint(avs_net_socket_t *net_socket,
+                                    const char *host,
+                                    const char *port,
+                                    sockaddr_endpoint_union_t *out_addr) {
     avs_net_addrinfo_t *info = NULL;
     int result = -1;
-    send_to_internal_arg_t arg = {
-        .data = buffer,
-        .data_length = buffer_length
-    };
 
     if (!(info = resolve_addrinfo_for_socket(net_socket, host, port,
                                              false, PREFERRED_FAMILY_ONLY))) {
         info = resolve_addrinfo_for_socket(net_socket, host, port,
                                            false, PREFERRED_FAMILY_BLOCKED);
     }
-    if (!info || (result = avs_net_addrinfo_next(info,
-                                                 &arg.dest_addr.api_ep))) {
+    if (!info || (result = avs_net_addrinfo_next(info, &out_addr->api_ep))) {
         LOG(ERROR, "cannot resolve address: [%s]:%s", host, port);
+        result = -1;
+    }
+    avs_net_addrinfo_delete(&info);
+    return result;
+}
+
+/**
+ * Resolves host:port and sends the datagram there. If @p out_endpoint is not
+ * NULL, the address the datagram has been sent to is stored there on success.
+ */
+static int send_to_resolved(avs_net_socket_t *net_socket,
+                            const void *buffer,
+                            size_t buffer_length,
+                            const char *host,
+                            const char *port,
+                            avs_net_resolved_endpoint_t *out_endpoint) {
+    send_to_internal_arg_t arg = {
+        .data = buffer,
+        .data_length = buffer_length
+    };
+
+    if (resolve_send_to_endpoint(net_socket, host, port, &arg.dest_addr)) {
         net_socket->error_code = EADDRNOTAVAIL;
-    } else {
-        result = call_when_ready(&net_socket->socket, NET_SEND_TIMEOUT, 0, 1, 1,
+        return -1;
+    }
+    int result = call_when_ready(net_socket, NET_SEND_TIMEOUT, 0, 1, 1,
                                  send_to_internal, &arg);
-        net_socket->error_code = errno;
+    net_socket->error_code = errno;
+    if (!result && out_endpoint) {
+        *out_endpoint = arg.dest_addr.api_ep;
     }
-    avs_net_addrinfo_delete(&info);
     return result;
 }
 
+static int send_to_net(avs_net_abstract_socket_t *net_socket_,
+                       const void *buffer,
+                       size_t buffer_length,
+                       const char *host,
+                       const char *port) {
+    return send_to_resolved((avs_net_socket_t *) net_socket_,
+                            buffer, buffer_length, host, port, NULL);
+}
+
+#ifdef HAVE_SENDMMSG
+
+/* Upper bound on the number of datagrams passed to a single sendmmsg()
+ * call, to keep the message headers on stack reasonably small. */
+#define SENDMMSG_MAX_BATCH 16
+
+typedef struct {
+    struct mmsghdr *hdrs;
+    size_t count;
+    size_t sent;
+} sendmmsg_internal_arg_t;
+
+static int sendmmsg_internal(sockfd_t sockfd, void *arg_) {
+    sendmmsg_internal_arg_t *arg = (sendmmsg_internal_arg_t *) arg_;
+    int result = sendmmsg(sockfd, arg->hdrs, (unsigned) arg->count,
+                          MSG_NOSIGNAL);
+    if (result <= 0) {
+        if (!result) {
+            errno = EAGAIN;
+        }
+        return -1;
+    }
+    arg->sent = (size_t) result;
+    return 0;
+}
+
+/**
+ * Sends up to SENDMMSG_MAX_BATCH datagrams, starting at *index, and advances
+ * *index past all the entries it has handled.
+ */
+static void send_to_batch_chunk(avs_net_socket_t *net_socket,
+                                avs_net_socket_send_to_msg_t *messages,
+                                size_t count,
+                                size_t *index) {
+    sockaddr_endpoint_union_t addrs[SENDMMSG_MAX_BATCH];
+    struct mmsghdr hdrs[SENDMMSG_MAX_BATCH];
+    struct iovec iovs[SENDMMSG_MAX_BATCH];
+    avs_net_socket_send_to_msg_t *chunk_msgs[SENDMMSG_MAX_BATCH];
+    size_t chunk_size = 0;
+
+    memset(hdrs, 0, sizeof(hdrs));
+    for (; *index < count && chunk_size < SENDMMSG_MAX_BATCH; ++*index) {
+        avs_net_socket_send_to_msg_t *msg = &messages[*index];
+        const avs_net_socket_send_to_msg_t *prev =
+                *index > 0 ? &messages[*index - 1] : NULL;
+        msg->error_code = 0;
+        msg->resolved_endpoint.size = 0;
+        if (chunk_size > 0 && prev == chunk_msgs[chunk_size - 1]
+                && !strcmp(msg->host, prev->host)
+                && !strcmp(msg->port, prev->port)) {
+            addrs[chunk_size] = addrs[chunk_size - 1];
+        } else if (resolve_send_to_endpoint(net_socket, msg->host, msg->port,
+                                            &addrs[chunk_size])) {
+            msg->error_code = EADDRNOTAVAIL;
+            continue;
+        }
+        iovs[chunk_size].iov_base = (void *) (intptr_t) msg->buffer;
+        iovs[chunk_size].iov_len = msg->buffer_length;
+        hdrs[chunk_size].msg_hdr.msg_name =
+                &addrs[chunk_size].sockaddr_ep.addr;
+        hdrs[chunk_size].msg_hdr.msg_namelen =
+                addrs[chunk_size].sockaddr_ep.header.size;
+        hdrs[chunk_size].msg_hdr.msg_iov = &iovs[chunk_size];
+        hdrs[chunk_size].msg_hdr.msg_iovlen = 1;
+        chunk_msgs[chunk_size++] = msg;
+    }
+
+    size_t done = 0;
+    while (done < chunk_size) {
+        sendmmsg_internal_arg_t arg = {
+            .hdrs = &hdrs[done],
+            .count = chunk_size - done
+        };
+        if (call_when_ready(net_socket, NET_SEND_TIMEOUT, 0, 1, 1,
+                            sendmmsg_internal, &arg)) {
+            /* sendmmsg() fails only if the first datagram could not be sent;
+             * skip it and retry with the rest */
+            LOG(ERROR, "send_to failed: %s", strerror(errno));
+            chunk_msgs[done++]->error_code = errno;
+            continue;
+        }
+        for (size_t i = done; i < done + arg.sent; ++i) {
+            if (hdrs[i].msg_len != iovs[i].iov_len) {
+                LOG(ERROR, "send_to fail (%lu/%lu)",
+                    (unsigned long) hdrs[i].msg_len,
+                    (unsigned long) iovs[i].iov_len);
+                chunk_msgs[i]->error_code = EIO;
+            }
+        }
+        done += arg.sent;
+    }
+
+    for (size_t i = 0; i < chunk_size; ++i) {
+        if (!chunk_msgs[i]->error_code) {
+            chunk_msgs[i]->resolved_endpoint = addrs[i].api_ep;
+        }
+    }
+}
+
+#endif /* HAVE_SENDMMSG */
+
+static int send_to_batch_net(avs_net_abstract_socket_t *net_socket_,
+                             avs_net_socket_send_to_msg_t *messages,
+                             size_t count) {
+    avs_net_socket_t *net_socket = (avs_net_socket_t *) net_socket_;
+    size_t i = 0;
+#ifdef HAVE_SENDMMSG
+    if (net_socket->type == AVS_NET_UDP_SOCKET) {
+        while (i < count) {
+            send_to_batch_chunk(net_socket, messages, count, &i);
+        }
+    }
+#endif /* HAVE_SENDMMSG */
+    for (; i < count; ++i) {
+        messages[i].error_code = 0;
+        messages[i].resolved_endpoint.size = 0;
+        if (send_to_resolved(net_socket, messages[i].buffer,
+                             messages[i].buffer_length,
+                             messages[i].host, messages[i].port,
+                             &messages[i].resolved_endpoint)) {
+            messages[i].error_code = net_socket->error_code;
+        }
+    }
+
+    net_socket->error_code = 0;
+    for (i = 0; i < count; ++i) {
+        if (messages[i].error_code) {
+            net_socket->error_code = messages[i].error_code;
+            return -1;
+        }
+    }
+    return 0;
+}
+
 typedef struct {
     avs_net_socket_type_t socket_type;
     size_t bytes_received;
@@ -1382,13 +2259,176 @@ static int receive_net(avs_net_abstract_socket_t *net_socket_,
         .buffer = buffer,
         .buffer_length = buffer_length
     };
-    int result = call_when_ready(&net_socket->socket, net_socket->recv_timeout,
+    int result = call_when_ready(net_socket, net_socket->recv_timeout,
                                  1, 0, 1, recvfrom_internal, &arg);
     *out = arg.bytes_received;
     net_socket->error_code = errno;
     return result;
 }
 
+#ifdef HAVE_RECVMSG
+
+typedef struct {
+    struct iovec iov[NET_MAX_IOVECS];
+    size_t count;
+    size_t total_length;
+    size_t bytes_received;
+} receive_vec_internal_arg_t;
+
+static int receive_vec_internal(sockfd_t sockfd, void *arg_) {
+    receive_vec_internal_arg_t *arg = (receive_vec_internal_arg_t *) arg_;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = arg->iov;
+    msg.msg_iovlen = arg->count;
+
+    errno = 0;
+    ssize_t recv_out = recvmsg(sockfd, &msg, 0);
+    if (msg.msg_flags & MSG_TRUNC) {
+        /* message too long to fit in the buffers */
+        errno = EMSGSIZE;
+        arg->bytes_received = AVS_MIN((size_t) recv_out, arg->total_length);
+        return -1;
+    } else if (recv_out < 0) {
+        arg->bytes_received = 0;
+        return -1;
+    } else {
+        arg->bytes_received = (size_t) recv_out;
+        return 0;
+    }
+}
+
+static int receive_vec_net(avs_net_abstract_socket_t *net_socket_,
+                           size_t *out,
+                           const avs_net_socket_iovec_t *iov,
+                           size_t iov_count) {
+    avs_net_socket_t *net_socket = (avs_net_socket_t *) net_socket_;
+    if (iov_count > NET_MAX_IOVECS) {
+        return _avs_net_socket_receive_vec_bounced(net_socket_, out,
+                                                   iov, iov_count);
+    }
+    receive_vec_internal_arg_t arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.count = iov_count;
+    for (size_t i = 0; i < iov_count; ++i) {
+        arg.iov[i].iov_base = iov[i].buffer;
+        arg.iov[i].iov_len = iov[i].buffer_length;
+        arg.total_length += iov[i].buffer_length;
+    }
+    int result = call_when_ready(net_socket, net_socket->recv_timeout,
+                                 1, 0, 1, receive_vec_internal, &arg);
+    *out = arg.bytes_received;
+    net_socket->error_code = errno;
+    return result;
+}
+
+#else /* HAVE_RECVMSG */
+
+static int receive_vec_net(avs_net_abstract_socket_t *net_socket,
+                           size_t *out,
+                           const avs_net_socket_iovec_t *iov,
+                           size_t iov_count) {
+    return _avs_net_socket_receive_vec_bounced(net_socket, out,
+                                               iov, iov_count);
+}
+
+#endif /* HAVE_RECVMSG */
+
+#if defined(UDP_GRO) && defined(HAVE_RECVMSG)
+
+typedef struct {
+    void *buffer;
+    size_t buffer_length;
+    size_t bytes_received;
+    size_t segment_size;
+} receive_gro_internal_arg_t;
+
+static int receive_gro_internal(sockfd_t sockfd, void *arg_) {
+    receive_gro_internal_arg_t *arg = (receive_gro_internal_arg_t *) arg_;
+    struct iovec iov;
+    iov.iov_base = arg->buffer;
+    iov.iov_len = arg->buffer_length;
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    errno = 0;
+    ssize_t recv_out = recvmsg(sockfd, &msg, 0);
+    if (recv_out < 0) {
+        arg->bytes_received = 0;
+        arg->segment_size = 0;
+        return -1;
+    }
+    arg->bytes_received = (size_t) recv_out;
+    /* no control message means that no coalescing took place */
+    arg->segment_size = arg->bytes_received;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+            cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int gso_size;
+            memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+            if (gso_size > 0) {
+                arg->segment_size = AVS_MIN((size_t) gso_size,
+                                            arg->bytes_received);
+            }
+        }
+    }
+    if (msg.msg_flags & MSG_TRUNC) {
+        /* message too long to fit in the buffer */
+        errno = EMSGSIZE;
+        return -1;
+    }
+    return 0;
+}
+
+static int receive_segmented_net(avs_net_abstract_socket_t *net_socket_,
+                                 size_t *out_bytes_received,
+                                 size_t *out_segment_size,
+                                 void *buffer,
+                                 size_t buffer_length) {
+    avs_net_socket_t *net_socket = (avs_net_socket_t *) net_socket_;
+    if (!net_socket->udp_gro_enabled) {
+        int result = receive_net(net_socket_, out_bytes_received,
+                                 buffer, buffer_length);
+        *out_segment_size = *out_bytes_received;
+        return result;
+    }
+    receive_gro_internal_arg_t arg = {
+        .buffer = buffer,
+        .buffer_length = buffer_length
+    };
+    int result = call_when_ready(net_socket, net_socket->recv_timeout,
+                                 1, 0, 1, receive_gro_internal, &arg);
+    *out_bytes_received = arg.bytes_received;
+    *out_segment_size = arg.segment_size;
+    net_socket->error_code = errno;
+    return result;
+}
+
+#else /* defined(UDP_GRO) && defined(HAVE_RECVMSG) */
+
+static int receive_segmented_net(avs_net_abstract_socket_t *net_socket,
+                                 size_t *out_bytes_received,
+                                 size_t *out_segment_size,
+                                 void *buffer,
+                                 size_t buffer_length) {
+    int result = receive_net(net_socket, out_bytes_received,
+                             buffer, buffer_length);
+    *out_segment_size = *out_bytes_received;
+    return result;
+}
+
+#endif /* defined(UDP_GRO) && defined(HAVE_RECVMSG) */
+
 static int receive_from_net(avs_net_abstract_socket_t *net_socket_,
                             size_t *out,
                             void *message_buffer, size_t buffer_size,
@@ -1406,7 +2446,7 @@ static int receive_from_net(avs_net_abstract_socket_t *net_socket_,
         .buffer = message_buffer,
         .buffer_length = buffer_size
     };
-    int result = call_when_ready(&net_socket->socket, net_socket->recv_timeout,
+    int result = call_when_ready(net_socket, net_socket->recv_timeout,
                                  1, 0, 1, recvfrom_internal, &arg);
     *out = arg.bytes_received;
     net_socket->error_code = errno;
@@ -1425,6 +2465,94 @@ static int receive_from_net(avs_net_abstract_socket_t *net_socket_,
     return result;
 }
 
+#ifdef HAVE_RECVMMSG
+
+/* Upper bound on the number of datagrams received in a single recvmmsg()
+ * call, to keep the message headers on stack reasonably small. */
+#define RECVMMSG_MAX_BATCH 16
+
+typedef struct {
+    avs_net_socket_batch_msg_t *messages;
+    size_t count;
+    size_t received;
+} recvmmsg_internal_arg_t;
+
+static int recvmmsg_internal(sockfd_t sockfd, void *arg_) {
+    recvmmsg_internal_arg_t *arg = (recvmmsg_internal_arg_t *) arg_;
+    struct mmsghdr hdrs[RECVMMSG_MAX_BATCH];
+    struct iovec iovs[RECVMMSG_MAX_BATCH];
+    const size_t count = AVS_MIN(arg->count, (size_t) RECVMMSG_MAX_BATCH);
+
+    memset(hdrs, 0, sizeof(hdrs));
+    for (size_t i = 0; i < count; ++i) {
+        iovs[i].iov_base = arg->messages[i].buffer;
+        iovs[i].iov_len = arg->messages[i].buffer_length;
+        hdrs[i].msg_hdr.msg_iov = &iovs[i];
+        hdrs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    errno = 0;
+    /* MSG_WAITFORONE: do not block once the first datagram is received */
+    int recv_out = recvmmsg(sockfd, hdrs, (unsigned) count, MSG_WAITFORONE,
+                            NULL);
+    if (recv_out <= 0) {
+        if (!recv_out) {
+            errno = EAGAIN;
+        }
+        arg->received = 0;
+        return -1;
+    }
+
+    arg->received = (size_t) recv_out;
+    for (size_t i = 0; i < arg->received; ++i) {
+        arg->messages[i].bytes_received =
+                AVS_MIN((size_t) hdrs[i].msg_len,
+                        arg->messages[i].buffer_length);
+        arg->messages[i].error_code =
+                (hdrs[i].msg_hdr.msg_flags & MSG_TRUNC) ? EMSGSIZE : 0;
+    }
+    return 0;
+}
+
+#endif /* HAVE_RECVMMSG */
+
+static int receive_batch_net(avs_net_abstract_socket_t *net_socket_,
+                             size_t *out_received,
+                             avs_net_socket_batch_msg_t *messages,
+                             size_t count) {
+    avs_net_socket_t *net_socket = (avs_net_socket_t *) net_socket_;
+    int result;
+#ifdef HAVE_RECVMMSG
+    if (net_socket->type == AVS_NET_UDP_SOCKET) {
+        recvmmsg_internal_arg_t arg = {
+            .messages = messages,
+            .count = count
+        };
+        result = call_when_ready(net_socket, net_socket->recv_timeout,
+                                 1, 0, 1, recvmmsg_internal, &arg);
+        *out_received = arg.received;
+        net_socket->error_code = errno;
+        return result;
+    }
+#else
+    (void) count;
+#endif /* HAVE_RECVMMSG */
+
+    /* stream socket or no recvmmsg() - receive one datagram at a time */
+    *out_received = 0;
+    messages[0].error_code = 0;
+    result = receive_net(net_socket_, &messages[0].bytes_received,
+                         messages[0].buffer, messages[0].buffer_length);
+    if (result && net_socket->error_code == EMSGSIZE) {
+        messages[0].error_code = EMSGSIZE;
+        result = 0;
+    }
+    if (!result) {
+        *out_received = 1;
+    }
+    return result;
+}
+
 static int create_listening_socket(avs_net_socket_t *net_socket,
                                    const struct sockaddr *addr,
                                    socklen_t addrlen) {
@@ -1448,6 +2576,21 @@ static int create_listening_socket(avs_net_socket_t *net_socket,
         LOG(ERROR, "can't set socket opt");
         goto create_listening_socket_error;
     }
+    if (net_socket->configuration.reuse_port) {
+#ifdef SO_REUSEPORT
+        int reuse_port = 1;
+        if (setsockopt(net_socket->socket, SOL_SOCKET, SO_REUSEPORT,
+                       &reuse_port, sizeof(reuse_port))) {
+            net_socket->error_code = errno;
+            LOG(ERROR, "can't set SO_REUSEPORT: %s", strerror(errno));
+            goto create_listening_socket_error;
+        }
+#else // SO_REUSEPORT
+        net_socket->error_code = EINVAL;
+        LOG(ERROR, "SO_REUSEPORT not supported");
+        goto create_listening_socket_error;
+#endif // SO_REUSEPORT
+    }
     if (configure_socket(net_socket)) {
         goto create_listening_socket_error;
     }
@@ -1524,6 +2667,66 @@ static int bind_net(avs_net_abstract_socket_t *net_socket_,
     return retval;
 }
 
+#if defined(HAVE_LINUX_FILTER_H) && defined(SO_ATTACH_REUSEPORT_CBPF)
+
+int _avs_net_attach_peer_address_steering(const void *system_socket,
+                                          size_t group_size) {
+    if (group_size > UINT32_MAX) {
+        return -1;
+    }
+    /* Classic BPF program run by the kernel for each incoming packet, with
+     * access to the IP header at negative SKF_NET_OFF offsets. It returns the
+     * index of the socket within the group: a multiplicative hash of the IPv4
+     * source address, or of the four words of the IPv6 one XORed together. */
+    struct sock_filter code[] = {
+        /* A = IP version */
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, (uint32_t) SKF_NET_OFF),
+        BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 4),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 4, 0, 2),
+        /* IPv4: A = source address */
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t) SKF_NET_OFF + 12),
+        BPF_JUMP(BPF_JMP | BPF_JA, 10, 0, 0),
+        /* IPv6: A = XOR of the source address words */
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t) SKF_NET_OFF + 8),
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t) SKF_NET_OFF + 12),
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t) SKF_NET_OFF + 16),
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t) SKF_NET_OFF + 20),
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+        /* return hash(A) % group_size */
+        BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 0x9E3779B1),
+        BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t) group_size),
+        BPF_STMT(BPF_RET | BPF_A, 0)
+    };
+    struct sock_fprog program = {
+        .len = (unsigned short) AVS_ARRAY_SIZE(code),
+        .filter = code
+    };
+    if (setsockopt(*(const sockfd_t *) system_socket, SOL_SOCKET,
+                   SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program))) {
+        LOG(ERROR, "can't attach steering program: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+#else // defined(HAVE_LINUX_FILTER_H) && defined(SO_ATTACH_REUSEPORT_CBPF)
+
+int _avs_net_attach_peer_address_steering(const void *system_socket,
+                                          size_t group_size) {
+    (void) system_socket;
+    (void) group_size;
+    LOG(ERROR, "socket steering not supported");
+    return -1;
+}
+
+#endif // defined(HAVE_LINUX_FILTER_H) && defined(SO_ATTACH_REUSEPORT_CBPF)
+
 typedef struct {
     sockfd_t client_sockfd;
     sockaddr_union_t remote_addr;
@@ -1562,7 +2765,7 @@ static int accept_net(avs_net_abstract_socket_t *server_net_socket_,
     accept_internal_arg_t arg = {
         .client_sockfd = INVALID_SOCKET
     };
-    if (call_when_ready(&server_net_socket->socket, NET_ACCEPT_TIMEOUT, 1, 0, 1,
+    if (call_when_ready(server_net_socket, NET_ACCEPT_TIMEOUT, 1, 0, 1,
                         accept_internal, &arg)) {
         return -1;
     }
@@ -1578,6 +2781,12 @@ static int accept_net(avs_net_abstract_socket_t *server_net_socket_,
         close_net_raw(new_net_socket);
         return -1;
     }
+    assert((size_t) arg.remote_addr_length
+           <= sizeof(new_net_socket->remote_endpoint.api_ep.data));
+    new_net_socket->remote_endpoint.api_ep.size =
+            (uint8_t) arg.remote_addr_length;
+    memcpy(new_net_socket->remote_endpoint.api_ep.data.buf,
+           &arg.remote_addr, arg.remote_addr_length);
     new_net_socket->state = AVS_NET_SOCKET_STATE_ACCEPTED;
     int result = configure_socket(new_net_socket);
     if (result) {
@@ -1845,6 +3054,13 @@ static int get_opt_net(avs_net_abstract_socket_t *net_socket_,
     case AVS_NET_SOCKET_OPT_STATE:
         out_option_value->state = net_socket->state;
         return 0;
+    case AVS_NET_SOCKET_OPT_POLL_WAIT_TIME:
+        out_option_value->poll_wait_time = net_socket->poll_wait_time;
+        net_socket->poll_wait_accounted = true;
+        return 0;
+    case AVS_NET_SOCKET_OPT_NATIVE_SEND_VEC:
+        out_option_value->flag = true;
+        return 0;
     case AVS_NET_SOCKET_OPT_ADDR_FAMILY:
         out_option_value->addr_family =
                 get_avs_af(get_socket_family(net_socket->socket));
@@ -2063,3 +3279,7 @@ void _avs_net_cleanup_global_compat_state(void) {
     cleanup_global_compat_state();
 #endif // HAVE_GLOBAL_COMPAT_STATE
 }
+
+#ifdef AVS_UNIT_TESTING
+#include "test/net_impl.c"
+#endif // AVS_UNIT_TESTING
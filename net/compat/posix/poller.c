@@ -0,0 +1,565 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _AVS_NEED_POSIX_SOCKET
+
+#include <avs_commons_posix_config.h>
+
+#include <avsystem/commons/memory.h>
+#include <avsystem/commons/net_poller.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#include "compat.h"
+
+VISIBILITY_SOURCE_BEGIN
+
+#if defined(HAVE_EPOLL) || defined(HAVE_POLL)
+
+typedef struct {
+    avs_net_abstract_socket_t *socket;
+    void *user_data;
+    sockfd_t fd;
+    int events;
+    /* position in avs_net_poller::entries (and pollfds, if used) */
+    size_t index;
+    /* true if the socket supports AVS_NET_SOCKET_OPT_HAS_BUFFERED_DATA */
+    bool may_buffer;
+    /* true if present in avs_net_poller::maybe_buffered, at
+     * maybe_buffered_index */
+    bool maybe_buffered;
+    size_t maybe_buffered_index;
+    /* value of avs_net_poller::generation if already reported in the current
+     * avs_net_poller_wait() call, at out_events[reported_at]; 64-bit, so that
+     * it never wraps back to the 0 of newly added entries */
+    uint64_t reported_generation;
+    size_t reported_at;
+} poller_entry_t;
+
+struct avs_net_poller {
+#ifdef HAVE_EPOLL
+    int epoll_fd;
+    struct epoll_event *epoll_events;
+    size_t epoll_events_capacity;
+#else // HAVE_EPOLL
+    struct pollfd *pollfds;
+#endif // HAVE_EPOLL
+    poller_entry_t **entries;
+    size_t num_entries;
+    size_t entries_capacity;
+    /* entries indexed by file descriptor, for O(1) lookups */
+    poller_entry_t **by_fd;
+    size_t by_fd_size;
+    /* entries that may have received data buffered internally: only those
+     * reported readable since they were last checked, so that idle sockets
+     * are not queried on every wait; same capacity as entries */
+    poller_entry_t **maybe_buffered;
+    size_t num_maybe_buffered;
+    uint64_t generation;
+};
+
+static sockfd_t get_fd(avs_net_abstract_socket_t *socket) {
+    const sockfd_t *fd_ptr =
+            (const sockfd_t *) avs_net_socket_get_system(socket);
+    return fd_ptr ? *fd_ptr : INVALID_SOCKET;
+}
+
+static poller_entry_t *find_entry(avs_net_poller_t *poller,
+                                  avs_net_abstract_socket_t *socket) {
+    sockfd_t fd = get_fd(socket);
+    if (fd >= 0 && (size_t) fd < poller->by_fd_size
+            && poller->by_fd[fd] && poller->by_fd[fd]->socket == socket) {
+        return poller->by_fd[fd];
+    }
+    /* the socket might have been closed without being removed first */
+    for (size_t i = 0; i < poller->num_entries; ++i) {
+        if (poller->entries[i]->socket == socket) {
+            return poller->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static int reserve_fd_slot(avs_net_poller_t *poller, sockfd_t fd) {
+    if ((size_t) fd < poller->by_fd_size) {
+        return 0;
+    }
+    size_t new_size = poller->by_fd_size ? poller->by_fd_size : 64;
+    while (new_size <= (size_t) fd) {
+        new_size *= 2;
+    }
+    poller_entry_t **by_fd = (poller_entry_t **) avs_realloc(
+            poller->by_fd, new_size * sizeof(*by_fd));
+    if (!by_fd) {
+        return -1;
+    }
+    memset(by_fd + poller->by_fd_size, 0,
+           (new_size - poller->by_fd_size) * sizeof(*by_fd));
+    poller->by_fd = by_fd;
+    poller->by_fd_size = new_size;
+    return 0;
+}
+
+static int reserve_entry_slot(avs_net_poller_t *poller) {
+    if (poller->num_entries < poller->entries_capacity) {
+        return 0;
+    }
+    size_t new_capacity =
+            poller->entries_capacity ? 2 * poller->entries_capacity : 16;
+    poller_entry_t **entries = (poller_entry_t **) avs_realloc(
+            poller->entries, new_capacity * sizeof(*entries));
+    if (!entries) {
+        return -1;
+    }
+    poller->entries = entries;
+    poller_entry_t **maybe_buffered = (poller_entry_t **) avs_realloc(
+            poller->maybe_buffered, new_capacity * sizeof(*maybe_buffered));
+    if (!maybe_buffered) {
+        return -1;
+    }
+    poller->maybe_buffered = maybe_buffered;
+#ifndef HAVE_EPOLL
+    struct pollfd *pollfds = (struct pollfd *) avs_realloc(
+            poller->pollfds, new_capacity * sizeof(*pollfds));
+    if (!pollfds) {
+        return -1;
+    }
+    poller->pollfds = pollfds;
+#endif // !HAVE_EPOLL
+    poller->entries_capacity = new_capacity;
+    return 0;
+}
+
+static void mark_maybe_buffered(avs_net_poller_t *poller,
+                                poller_entry_t *entry) {
+    if (entry->may_buffer && !entry->maybe_buffered) {
+        assert(poller->num_maybe_buffered < poller->entries_capacity);
+        entry->maybe_buffered = true;
+        entry->maybe_buffered_index = poller->num_maybe_buffered;
+        poller->maybe_buffered[poller->num_maybe_buffered++] = entry;
+    }
+}
+
+static void unmark_maybe_buffered(avs_net_poller_t *poller,
+                                  poller_entry_t *entry) {
+    if (entry->maybe_buffered) {
+        poller_entry_t *last =
+                poller->maybe_buffered[--poller->num_maybe_buffered];
+        poller->maybe_buffered[entry->maybe_buffered_index] = last;
+        last->maybe_buffered_index = entry->maybe_buffered_index;
+        entry->maybe_buffered = false;
+    }
+}
+
+static int timeout_to_ms(avs_time_duration_t timeout) {
+    int64_t timeout_ms;
+    if (avs_time_duration_to_scalar(&timeout_ms, AVS_TIME_MS, timeout)
+            || timeout_ms > INT_MAX) {
+        return -1;
+    } else if (timeout_ms < 0) {
+        return 0;
+    }
+    return (int) timeout_ms;
+}
+
+#ifdef HAVE_EPOLL
+static uint32_t to_system_events(int events) {
+    return (uint32_t) (((events & AVS_NET_POLLER_IN) ? EPOLLIN : 0)
+                       | ((events & AVS_NET_POLLER_OUT) ? EPOLLOUT : 0));
+}
+
+static int from_system_events(uint32_t events) {
+    return ((events & EPOLLIN) ? AVS_NET_POLLER_IN : 0)
+           | ((events & EPOLLOUT) ? AVS_NET_POLLER_OUT : 0)
+           | ((events & (EPOLLERR | EPOLLHUP)) ? AVS_NET_POLLER_ERR : 0);
+}
+
+static int system_register(avs_net_poller_t *poller,
+                           poller_entry_t *entry,
+                           int op) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = to_system_events(entry->events);
+    event.data.ptr = entry;
+    if (epoll_ctl(poller->epoll_fd, op, entry->fd, &event)) {
+        LOG(ERROR, "epoll_ctl() failed: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int system_add(avs_net_poller_t *poller, poller_entry_t *entry) {
+    return system_register(poller, entry, EPOLL_CTL_ADD);
+}
+
+static int system_modify(avs_net_poller_t *poller, poller_entry_t *entry) {
+    return system_register(poller, entry, EPOLL_CTL_MOD);
+}
+
+static void system_remove(avs_net_poller_t *poller, poller_entry_t *entry) {
+    /* fails harmlessly if the descriptor has already been closed */
+    struct epoll_event dummy;
+    epoll_ctl(poller->epoll_fd, EPOLL_CTL_DEL, entry->fd, &dummy);
+}
+#else // HAVE_EPOLL
+static short to_system_events(int events) {
+    return (short) (((events & AVS_NET_POLLER_IN) ? POLLIN : 0)
+                    | ((events & AVS_NET_POLLER_OUT) ? POLLOUT : 0));
+}
+
+static int from_system_events(short events) {
+    return ((events & POLLIN) ? AVS_NET_POLLER_IN : 0)
+           | ((events & POLLOUT) ? AVS_NET_POLLER_OUT : 0)
+           | ((events & (POLLERR | POLLHUP | POLLNVAL))
+                   ? AVS_NET_POLLER_ERR : 0);
+}
+
+static int system_add(avs_net_poller_t *poller, poller_entry_t *entry) {
+    struct pollfd *pollfd = &poller->pollfds[entry->index];
+    pollfd->fd = entry->fd;
+    pollfd->events = to_system_events(entry->events);
+    pollfd->revents = 0;
+    return 0;
+}
+
+static int system_modify(avs_net_poller_t *poller, poller_entry_t *entry) {
+    poller->pollfds[entry->index].events = to_system_events(entry->events);
+    return 0;
+}
+
+static void system_remove(avs_net_poller_t *poller, poller_entry_t *entry) {
+    poller->pollfds[entry->index] = poller->pollfds[poller->num_entries - 1];
+}
+#endif // HAVE_EPOLL
+
+int avs_net_poller_create(avs_net_poller_t **out_poller) {
+    avs_net_poller_t *poller =
+            (avs_net_poller_t *) avs_calloc(1, sizeof(avs_net_poller_t));
+    if (!poller) {
+        LOG(ERROR, "out of memory");
+        return -1;
+    }
+#ifdef HAVE_EPOLL
+    if ((poller->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        LOG(ERROR, "epoll_create1() failed: %s", strerror(errno));
+        avs_free(poller);
+        return -1;
+    }
+#endif // HAVE_EPOLL
+    *out_poller = poller;
+    return 0;
+}
+
+void avs_net_poller_cleanup(avs_net_poller_t **poller_ptr) {
+    if (!poller_ptr || !*poller_ptr) {
+        return;
+    }
+    avs_net_poller_t *poller = *poller_ptr;
+    for (size_t i = 0; i < poller->num_entries; ++i) {
+        avs_free(poller->entries[i]);
+    }
+#ifdef HAVE_EPOLL
+    close(poller->epoll_fd);
+    avs_free(poller->epoll_events);
+#else // HAVE_EPOLL
+    avs_free(poller->pollfds);
+#endif // HAVE_EPOLL
+    avs_free(poller->entries);
+    avs_free(poller->maybe_buffered);
+    avs_free(poller->by_fd);
+    avs_free(poller);
+    *poller_ptr = NULL;
+}
+
+int avs_net_poller_add(avs_net_poller_t *poller,
+                       avs_net_abstract_socket_t *socket,
+                       int events,
+                       void *user_data) {
+    sockfd_t fd = get_fd(socket);
+    if (fd < 0) {
+        LOG(ERROR, "cannot poll a socket without a system descriptor");
+        return -1;
+    }
+    if (find_entry(poller, socket)) {
+        LOG(ERROR, "socket already registered");
+        return -1;
+    }
+    if (reserve_fd_slot(poller, fd) || reserve_entry_slot(poller)) {
+        LOG(ERROR, "out of memory");
+        return -1;
+    }
+    poller_entry_t *entry =
+            (poller_entry_t *) avs_calloc(1, sizeof(poller_entry_t));
+    if (!entry) {
+        LOG(ERROR, "out of memory");
+        return -1;
+    }
+
+    avs_net_socket_opt_value_t buffered;
+    entry->socket = socket;
+    entry->user_data = user_data;
+    entry->fd = fd;
+    entry->events = events;
+    entry->index = poller->num_entries;
+    entry->may_buffer = !avs_net_socket_get_opt(
+            socket, AVS_NET_SOCKET_OPT_HAS_BUFFERED_DATA, &buffered);
+    if (system_add(poller, entry)) {
+        avs_free(entry);
+        return -1;
+    }
+
+    poller->entries[poller->num_entries++] = entry;
+    poller->by_fd[fd] = entry;
+    /* the socket might have been received from before being added */
+    mark_maybe_buffered(poller, entry);
+    return 0;
+}
+
+int avs_net_poller_modify(avs_net_poller_t *poller,
+                          avs_net_abstract_socket_t *socket,
+                          int events,
+                          void *user_data) {
+    poller_entry_t *entry = find_entry(poller, socket);
+    if (!entry) {
+        LOG(ERROR, "socket not registered");
+        return -1;
+    }
+    int old_events = entry->events;
+    entry->events = events;
+    if (system_modify(poller, entry)) {
+        entry->events = old_events;
+        return -1;
+    }
+    entry->user_data = user_data;
+    if (events & AVS_NET_POLLER_IN) {
+        mark_maybe_buffered(poller, entry);
+    }
+    return 0;
+}
+
+int avs_net_poller_remove(avs_net_poller_t *poller,
+                          avs_net_abstract_socket_t *socket) {
+    poller_entry_t *entry = find_entry(poller, socket);
+    if (!entry) {
+        LOG(ERROR, "socket not registered");
+        return -1;
+    }
+    system_remove(poller, entry);
+    unmark_maybe_buffered(poller, entry);
+
+    poller_entry_t *last = poller->entries[--poller->num_entries];
+    poller->entries[entry->index] = last;
+    last->index = entry->index;
+    if (poller->by_fd[entry->fd] == entry) {
+        poller->by_fd[entry->fd] = NULL;
+    }
+    avs_free(entry);
+    return 0;
+}
+
+static void report(avs_net_poller_t *poller,
+                   poller_entry_t *entry,
+                   int events,
+                   avs_net_poller_event_t *out_events,
+                   size_t *inout_count) {
+    if (entry->reported_generation == poller->generation) {
+        out_events[entry->reported_at].events |= events;
+        return;
+    }
+    if (events & AVS_NET_POLLER_IN) {
+        /* the user is about to receive from the socket, which may leave some
+         * data buffered */
+        mark_maybe_buffered(poller, entry);
+    }
+    entry->reported_generation = poller->generation;
+    entry->reported_at = *inout_count;
+    out_events[*inout_count].socket = entry->socket;
+    out_events[*inout_count].user_data = entry->user_data;
+    out_events[*inout_count].events = events;
+    ++*inout_count;
+}
+
+/**
+ * Reports entries from avs_net_poller::maybe_buffered that actually have
+ * buffered data, and forgets the ones that do not - they cannot get any until
+ * received from, i.e. until reported readable again.
+ */
+static size_t report_buffered(avs_net_poller_t *poller,
+                              avs_net_poller_event_t *out_events,
+                              size_t max_events) {
+    size_t count = 0;
+    size_t i = 0;
+    while (i < poller->num_maybe_buffered && count < max_events) {
+        poller_entry_t *entry = poller->maybe_buffered[i];
+        avs_net_socket_opt_value_t buffered;
+        if ((entry->events & AVS_NET_POLLER_IN)
+                && !avs_net_socket_get_opt(entry->socket,
+                                           AVS_NET_SOCKET_OPT_HAS_BUFFERED_DATA,
+                                           &buffered)
+                && buffered.flag) {
+            report(poller, entry, AVS_NET_POLLER_IN, out_events, &count);
+            ++i;
+        } else {
+            /* moves another entry to index i */
+            unmark_maybe_buffered(poller, entry);
+        }
+    }
+    return count;
+}
+
+#ifdef HAVE_EPOLL
+static int system_wait(avs_net_poller_t *poller,
+                       avs_net_poller_event_t *out_events,
+                       size_t max_events,
+                       size_t *inout_count,
+                       int timeout_ms) {
+    size_t capacity = max_events - *inout_count;
+    if (capacity > INT_MAX) {
+        capacity = INT_MAX;
+    }
+    if (capacity > poller->epoll_events_capacity) {
+        struct epoll_event *epoll_events = (struct epoll_event *) avs_realloc(
+                poller->epoll_events, capacity * sizeof(*epoll_events));
+        if (!epoll_events) {
+            LOG(ERROR, "out of memory");
+            return -1;
+        }
+        poller->epoll_events = epoll_events;
+        poller->epoll_events_capacity = capacity;
+    }
+
+    int result = epoll_wait(poller->epoll_fd, poller->epoll_events,
+                            (int) capacity, timeout_ms);
+    if (result < 0) {
+        return -1;
+    }
+    for (int i = 0; i < result; ++i) {
+        poller_entry_t *entry = (poller_entry_t *) poller->epoll_events[i].data.ptr;
+        report(poller, entry,
+               from_system_events(poller->epoll_events[i].events)
+                       & (entry->events | AVS_NET_POLLER_ERR),
+               out_events, inout_count);
+    }
+    return 0;
+}
+#else // HAVE_EPOLL
+static int system_wait(avs_net_poller_t *poller,
+                       avs_net_poller_event_t *out_events,
+                       size_t max_events,
+                       size_t *inout_count,
+                       int timeout_ms) {
+    int result = poll(poller->pollfds, (nfds_t) poller->num_entries,
+                      timeout_ms);
+    if (result < 0) {
+        return -1;
+    }
+    for (size_t i = 0; result > 0 && i < poller->num_entries; ++i) {
+        if (!poller->pollfds[i].revents) {
+            continue;
+        }
+        --result;
+        poller_entry_t *entry = poller->entries[i];
+        if (entry->reported_generation != poller->generation
+                && *inout_count >= max_events) {
+            continue;
+        }
+        report(poller, entry,
+               from_system_events(poller->pollfds[i].revents)
+                       & (entry->events | AVS_NET_POLLER_ERR),
+               out_events, inout_count);
+    }
+    return 0;
+}
+#endif // HAVE_EPOLL
+
+int avs_net_poller_wait(avs_net_poller_t *poller,
+                        avs_net_poller_event_t *out_events,
+                        size_t max_events,
+                        avs_time_duration_t timeout) {
+    assert(max_events > 0);
+    ++poller->generation;
+
+    size_t count = report_buffered(poller, out_events, max_events);
+    if (count < max_events) {
+        /* if there is buffered data already, only check what else is ready */
+        if (system_wait(poller, out_events, max_events, &count,
+                        count ? 0 : timeout_to_ms(timeout))) {
+            if (errno == EINTR && count) {
+                return (int) count;
+            }
+            LOG(ERROR, "waiting for sockets failed: %s", strerror(errno));
+            return -1;
+        }
+    }
+    assert(count <= INT_MAX);
+    return (int) count;
+}
+
+#else // defined(HAVE_EPOLL) || defined(HAVE_POLL)
+
+int avs_net_poller_create(avs_net_poller_t **out_poller) {
+    (void) out_poller;
+    LOG(ERROR, "avs_net_poller requires epoll() or poll() support");
+    return -1;
+}
+
+void avs_net_poller_cleanup(avs_net_poller_t **poller_ptr) {
+    (void) poller_ptr;
+}
+
+int avs_net_poller_add(avs_net_poller_t *poller,
+                       avs_net_abstract_socket_t *socket,
+                       int events,
+                       void *user_data) {
+    (void) poller; (void) socket; (void) events; (void) user_data;
+    return -1;
+}
+
+int avs_net_poller_modify(avs_net_poller_t *poller,
+                          avs_net_abstract_socket_t *socket,
+                          int events,
+                          void *user_data) {
+    (void) poller; (void) socket; (void) events; (void) user_data;
+    return -1;
+}
+
+int avs_net_poller_remove(avs_net_poller_t *poller,
+                          avs_net_abstract_socket_t *socket) {
+    (void) poller; (void) socket;
+    return -1;
+}
+
+int avs_net_poller_wait(avs_net_poller_t *poller,
+                        avs_net_poller_event_t *out_events,
+                        size_t max_events,
+                        avs_time_duration_t timeout) {
+    (void) poller; (void) out_events; (void) max_events; (void) timeout;
+    return -1;
+}
+
+#endif // defined(HAVE_EPOLL) || defined(HAVE_POLL)
+
+#ifdef AVS_UNIT_TESTING
+#include "test/poller.c"
+#endif // AVS_UNIT_TESTING
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <avs_commons_config.h>
+
+#include <avsystem/commons/unit/test.h>
+
+#if defined(WITH_AVS_NET_ASYNC_RESOLVER) && defined(HAVE_POLL)
+
+static int wait_and_finish(avs_net_addrinfo_async_t *handle,
+                           avs_net_addrinfo_t **out_info) {
+    struct pollfd pfd;
+    pfd.fd = *(const int *) avs_net_addrinfo_async_get_system(handle);
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    AVS_UNIT_ASSERT_EQUAL(poll(&pfd, 1, 5000), 1);
+    AVS_UNIT_ASSERT_TRUE(pfd.revents & POLLIN);
+    return avs_net_addrinfo_async_finish(handle, out_info);
+}
+
+AVS_UNIT_TEST(addrinfo_async, numeric_address) {
+    avs_net_addrinfo_async_t *handle =
+            avs_net_addrinfo_resolve_async(AVS_NET_UDP_SOCKET,
+                                           AVS_NET_AF_INET4, "127.0.0.1",
+                                           "5683", 0, NULL);
+    AVS_UNIT_ASSERT_NOT_NULL(handle);
+
+    avs_net_addrinfo_t *info = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(wait_and_finish(handle, &info));
+    AVS_UNIT_ASSERT_NOT_NULL(info);
+    // result is handed over only once
+    avs_net_addrinfo_t *info2 = NULL;
+    AVS_UNIT_ASSERT_FAILED(avs_net_addrinfo_async_finish(handle, &info2));
+    AVS_UNIT_ASSERT_NULL(info2);
+    avs_net_addrinfo_async_cleanup(&handle);
+    AVS_UNIT_ASSERT_NULL(handle);
+
+    avs_net_resolved_endpoint_t endpoint;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_addrinfo_next(info, &endpoint));
+    char host[64];
+    char port[16];
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_resolved_endpoint_get_host_port(
+            &endpoint, host, sizeof(host), port, sizeof(port)));
+    AVS_UNIT_ASSERT_EQUAL_STRING(host, "127.0.0.1");
+    AVS_UNIT_ASSERT_EQUAL_STRING(port, "5683");
+    avs_net_addrinfo_delete(&info);
+}
+
+AVS_UNIT_TEST(addrinfo_async, failure) {
+    avs_net_addrinfo_async_t *handle =
+            avs_net_addrinfo_resolve_async(AVS_NET_UDP_SOCKET,
+                                           AVS_NET_AF_INET4, "127.0.0.1",
+                                           "invalid port", 0, NULL);
+    AVS_UNIT_ASSERT_NOT_NULL(handle);
+    avs_net_addrinfo_t *info = NULL;
+    AVS_UNIT_ASSERT_FAILED(wait_and_finish(handle, &info));
+    AVS_UNIT_ASSERT_NULL(info);
+    avs_net_addrinfo_async_cleanup(&handle);
+}
+
+AVS_UNIT_TEST(addrinfo_async, many_requests_and_cancellation) {
+    avs_net_addrinfo_async_t *handles[3 * RESOLVER_MAX_THREADS];
+    for (size_t i = 0; i < AVS_ARRAY_SIZE(handles); ++i) {
+        handles[i] = avs_net_addrinfo_resolve_async(
+                AVS_NET_TCP_SOCKET, AVS_NET_AF_INET4, "127.0.0.1", "80", 0,
+                NULL);
+        AVS_UNIT_ASSERT_NOT_NULL(handles[i]);
+    }
+    AVS_UNIT_ASSERT_TRUE(g_resolver.num_threads <= RESOLVER_MAX_THREADS);
+
+    // cancel every other request, regardless of its state
+    for (size_t i = 0; i < AVS_ARRAY_SIZE(handles); i += 2) {
+        avs_net_addrinfo_async_cleanup(&handles[i]);
+    }
+    for (size_t i = 1; i < AVS_ARRAY_SIZE(handles); i += 2) {
+        avs_net_addrinfo_t *info = NULL;
+        AVS_UNIT_ASSERT_SUCCESS(wait_and_finish(handles[i], &info));
+        avs_net_addrinfo_delete(&info);
+        avs_net_addrinfo_async_cleanup(&handles[i]);
+    }
+}
+
+AVS_UNIT_TEST(addrinfo_async, global_cleanup_fails_queued_requests) {
+    avs_net_addrinfo_async_t *handle =
+            avs_net_addrinfo_resolve_async(AVS_NET_UDP_SOCKET,
+                                           AVS_NET_AF_INET4, "127.0.0.1",
+                                           "5683", 0, NULL);
+    AVS_UNIT_ASSERT_NOT_NULL(handle);
+    _avs_net_cleanup_global_async_resolver();
+    AVS_UNIT_ASSERT_EQUAL(g_resolver.num_threads, 0);
+
+    // the request either completed before or was failed by the cleanup
+    avs_net_addrinfo_t *info = NULL;
+    int result = wait_and_finish(handle, &info);
+    AVS_UNIT_ASSERT_TRUE(result == 0 || result < 0);
+    avs_net_addrinfo_delete(&info);
+    avs_net_addrinfo_async_cleanup(&handle);
+
+    // resolver threads are restarted on demand
+    handle = avs_net_addrinfo_resolve_async(AVS_NET_UDP_SOCKET,
+                                            AVS_NET_AF_INET4, "127.0.0.1",
+                                            "5683", 0, NULL);
+    AVS_UNIT_ASSERT_NOT_NULL(handle);
+    AVS_UNIT_ASSERT_SUCCESS(wait_and_finish(handle, &info));
+    avs_net_addrinfo_delete(&info);
+    avs_net_addrinfo_async_cleanup(&handle);
+}
+
+#endif // defined(WITH_AVS_NET_ASYNC_RESOLVER) && defined(HAVE_POLL)
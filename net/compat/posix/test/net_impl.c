@@ -0,0 +1,634 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <avs_commons_config.h>
+
+#include <avsystem/commons/unit/test.h>
+
+static void create_tcp_server(avs_net_abstract_socket_t **out_server,
+                              char *out_port, size_t port_size) {
+    avs_net_socket_configuration_t config;
+    memset(&config, 0, sizeof(config));
+    config.address_family = AVS_NET_AF_INET4;
+    *out_server = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_create(
+            out_server, AVS_NET_TCP_SOCKET, &config));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_bind(*out_server, "127.0.0.1", "0"));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_get_local_port(
+            *out_server, out_port, port_size));
+}
+
+#ifdef HAVE_POLL
+AVS_UNIT_TEST(net_connect, happy_eyeballs_success) {
+    avs_net_abstract_socket_t *server = NULL;
+    char port[NET_PORT_SIZE];
+    create_tcp_server(&server, port, sizeof(port));
+
+    avs_net_resolved_endpoint_t preferred_endpoint;
+    memset(&preferred_endpoint, 0, sizeof(preferred_endpoint));
+    avs_net_socket_configuration_t config;
+    memset(&config, 0, sizeof(config));
+    config.preferred_endpoint = &preferred_endpoint;
+
+    avs_net_abstract_socket_t *client = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&client, AVS_NET_TCP_SOCKET, &config));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_connect(client, "localhost", port));
+
+    avs_net_socket_opt_value_t state;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_get_opt(client, AVS_NET_SOCKET_OPT_STATE, &state));
+    AVS_UNIT_ASSERT_EQUAL(state.state, AVS_NET_SOCKET_STATE_CONNECTED);
+    // the winning address is stored as the preferred one
+    AVS_UNIT_ASSERT_TRUE(preferred_endpoint.size > 0);
+    const sockaddr_endpoint_union_t *remote =
+            &((avs_net_socket_t *) client)->remote_endpoint;
+    AVS_UNIT_ASSERT_EQUAL(remote->api_ep.size, preferred_endpoint.size);
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(remote->api_ep.data.buf,
+                                      preferred_endpoint.data.buf,
+                                      preferred_endpoint.size);
+
+    avs_net_abstract_socket_t *accepted = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&accepted, AVS_NET_TCP_SOCKET, NULL));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_accept(server, accepted));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_send(client, "hello", 5));
+    char buf[8];
+    size_t received;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_receive(accepted, &received, buf, sizeof(buf)));
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(buf, "hello", 5);
+
+    avs_net_socket_cleanup(&accepted);
+    avs_net_socket_cleanup(&client);
+    avs_net_socket_cleanup(&server);
+}
+
+AVS_UNIT_TEST(net_connect, happy_eyeballs_refused) {
+    avs_net_abstract_socket_t *server = NULL;
+    char port[NET_PORT_SIZE];
+    create_tcp_server(&server, port, sizeof(port));
+    // free the port, so that nothing is listening on it
+    avs_net_socket_cleanup(&server);
+
+    avs_net_abstract_socket_t *client = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&client, AVS_NET_TCP_SOCKET, NULL));
+    AVS_UNIT_ASSERT_FAILED(avs_net_socket_connect(client, "localhost", port));
+    AVS_UNIT_ASSERT_EQUAL(avs_net_socket_errno(client), ECONNREFUSED);
+    AVS_UNIT_ASSERT_EQUAL(((avs_net_socket_t *) client)->socket,
+                          INVALID_SOCKET);
+    avs_net_socket_cleanup(&client);
+}
+
+static void set_candidate(sockaddr_endpoint_union_t *out, sockfd_t listener) {
+    memset(out, 0, sizeof(*out));
+    socklen_t length = sizeof(struct sockaddr_in);
+    AVS_UNIT_ASSERT_SUCCESS(
+            getsockname(listener, &out->sockaddr_ep.addr, &length));
+    out->sockaddr_ep.header.size = (uint8_t) length;
+}
+
+typedef struct {
+    sockfd_t listener;
+    sockfd_t filler;
+} unresponsive_server_t;
+
+/**
+ * Creates a listening socket that never completes any further connections:
+ * with a backlog of 0, a single connection fills its accept queue, and any
+ * subsequent SYNs are dropped, so connection attempts hang.
+ */
+static void unresponsive_server_init(unresponsive_server_t *server,
+                                     sockaddr_endpoint_union_t *out_address) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    server->listener = socket(AF_INET, SOCK_STREAM, 0);
+    AVS_UNIT_ASSERT_TRUE(server->listener != INVALID_SOCKET);
+    AVS_UNIT_ASSERT_SUCCESS(bind(server->listener,
+                                 (const struct sockaddr *) &addr,
+                                 sizeof(addr)));
+    AVS_UNIT_ASSERT_SUCCESS(listen(server->listener, 0));
+    set_candidate(out_address, server->listener);
+
+    server->filler = socket(AF_INET, SOCK_STREAM, 0);
+    AVS_UNIT_ASSERT_TRUE(server->filler != INVALID_SOCKET);
+    AVS_UNIT_ASSERT_SUCCESS(connect(server->filler,
+                                    &out_address->sockaddr_ep.addr,
+                                    out_address->sockaddr_ep.header.size));
+}
+
+static void unresponsive_server_cleanup(unresponsive_server_t *server) {
+    close(server->filler);
+    close(server->listener);
+}
+
+AVS_UNIT_TEST(net_connect, happy_eyeballs_staggered_start) {
+    unresponsive_server_t slow;
+    avs_net_abstract_socket_t *fast = NULL;
+    char port[NET_PORT_SIZE];
+    create_tcp_server(&fast, port, sizeof(port));
+
+    happy_eyeballs_t he;
+    unresponsive_server_init(&slow, &he.candidates[0]);
+    set_candidate(&he.candidates[1], ((avs_net_socket_t *) fast)->socket);
+    he.num_candidates = 2;
+
+    avs_net_abstract_socket_t *client = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&client, AVS_NET_TCP_SOCKET, NULL));
+    avs_net_socket_t *net_socket = (avs_net_socket_t *) client;
+
+    const avs_time_monotonic_t start = avs_time_monotonic_now();
+    he_init(&he);
+    // the first attempt starts right away and hangs
+    AVS_UNIT_ASSERT_EQUAL(he_step(&he, net_socket), SIZE_MAX);
+    AVS_UNIT_ASSERT_EQUAL(he.num_attempts, 1);
+
+    // the second one only starts once the attempt delay has passed
+    while (he.next_candidate < 2) {
+        AVS_UNIT_ASSERT_EQUAL(he_step(&he, net_socket), SIZE_MAX);
+        if (he.next_candidate < 2) {
+            AVS_UNIT_ASSERT_EQUAL(he.num_attempts, 1);
+        }
+    }
+    AVS_UNIT_ASSERT_FALSE(avs_time_monotonic_before(
+            avs_time_monotonic_now(),
+            avs_time_monotonic_add(start, NET_CONNECTION_ATTEMPT_DELAY)));
+
+    he_cancel_attempts(&he);
+    if (net_socket->socket != INVALID_SOCKET) {
+        close(net_socket->socket);
+        net_socket->socket = INVALID_SOCKET;
+    }
+    avs_net_socket_cleanup(&client);
+    avs_net_socket_cleanup(&fast);
+    unresponsive_server_cleanup(&slow);
+}
+
+AVS_UNIT_TEST(net_connect, happy_eyeballs_slow_first_attempt_loses) {
+    unresponsive_server_t slow;
+    avs_net_abstract_socket_t *fast = NULL;
+    char port[NET_PORT_SIZE];
+    create_tcp_server(&fast, port, sizeof(port));
+
+    happy_eyeballs_t he;
+    unresponsive_server_init(&slow, &he.candidates[0]);
+    set_candidate(&he.candidates[1], ((avs_net_socket_t *) fast)->socket);
+    he.num_candidates = 2;
+
+    avs_net_abstract_socket_t *client = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&client, AVS_NET_TCP_SOCKET, NULL));
+    avs_net_socket_t *net_socket = (avs_net_socket_t *) client;
+
+    const avs_time_monotonic_t start = avs_time_monotonic_now();
+    he_init(&he);
+    size_t winner = SIZE_MAX;
+    while (winner == SIZE_MAX && !he_exhausted(&he)) {
+        winner = he_step(&he, net_socket);
+    }
+    AVS_UNIT_ASSERT_EQUAL(winner, 1);
+    // the first attempt was still in flight, and was not waited for
+    AVS_UNIT_ASSERT_EQUAL(he.num_attempts, 1);
+    AVS_UNIT_ASSERT_TRUE(avs_time_monotonic_before(
+            avs_time_monotonic_now(),
+            avs_time_monotonic_add(start, NET_CONNECT_TIMEOUT)));
+    he_cancel_attempts(&he);
+    AVS_UNIT_ASSERT_SUCCESS(finish_connect(net_socket, &he.candidates[1]));
+
+    avs_net_abstract_socket_t *accepted = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&accepted, AVS_NET_TCP_SOCKET, NULL));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_accept(fast, accepted));
+
+    avs_net_socket_cleanup(&accepted);
+    avs_net_socket_cleanup(&client);
+    avs_net_socket_cleanup(&fast);
+    unresponsive_server_cleanup(&slow);
+}
+
+AVS_UNIT_TEST(net_connect, happy_eyeballs_configuration_error) {
+    avs_net_abstract_socket_t *server = NULL;
+    char port[NET_PORT_SIZE];
+    create_tcp_server(&server, port, sizeof(port));
+
+    happy_eyeballs_t he;
+    set_candidate(&he.candidates[0], ((avs_net_socket_t *) server)->socket);
+    he.num_candidates = 1;
+
+    avs_net_socket_configuration_t config;
+    memset(&config, 0, sizeof(config));
+    strcpy(config.interface_name, "avsnonexist0");
+    avs_net_abstract_socket_t *client = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&client, AVS_NET_TCP_SOCKET, &config));
+    avs_net_socket_t *net_socket = (avs_net_socket_t *) client;
+
+    // binding to a nonexistent interface fails, and that must be reported
+    // instead of whatever error_code was left from before
+    net_socket->error_code = 0;
+    he_init(&he);
+    AVS_UNIT_ASSERT_EQUAL(he_start_attempt(&he, net_socket), -1);
+    AVS_UNIT_ASSERT_NOT_EQUAL(net_socket->error_code, 0);
+    AVS_UNIT_ASSERT_EQUAL(he.num_attempts, 0);
+    AVS_UNIT_ASSERT_EQUAL(net_socket->socket, INVALID_SOCKET);
+
+    avs_net_socket_cleanup(&client);
+    avs_net_socket_cleanup(&server);
+}
+#endif // HAVE_POLL
+
+static void create_udp_pair_ex(avs_net_abstract_socket_t **out_receiver,
+                               avs_net_abstract_socket_t **out_sender,
+                               uint8_t udp_offload) {
+    avs_net_socket_configuration_t config;
+    memset(&config, 0, sizeof(config));
+    config.address_family = AVS_NET_AF_INET4;
+    config.udp_offload = udp_offload;
+    *out_receiver = NULL;
+    *out_sender = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_create(
+            out_receiver, AVS_NET_UDP_SOCKET, &config));
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_bind(*out_receiver, "127.0.0.1", "0"));
+    char port[NET_PORT_SIZE];
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_get_local_port(
+            *out_receiver, port, sizeof(port)));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_create(
+            out_sender, AVS_NET_UDP_SOCKET, &config));
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_connect(*out_sender, "127.0.0.1", port));
+}
+
+static void create_udp_pair(avs_net_abstract_socket_t **out_receiver,
+                            avs_net_abstract_socket_t **out_sender) {
+    create_udp_pair_ex(out_receiver, out_sender, 0);
+}
+
+AVS_UNIT_TEST(net_vec, udp_segments_form_single_datagram) {
+    avs_net_abstract_socket_t *receiver;
+    avs_net_abstract_socket_t *sender;
+    create_udp_pair(&receiver, &sender);
+
+    const avs_net_socket_const_iovec_t out[] = {
+        { "head", 4 }, { "", 0 }, { "-body-", 6 }, { "tail", 4 }
+    };
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_send_vec(sender, out, AVS_ARRAY_SIZE(out)));
+
+    char first[3];
+    char second[16];
+    const avs_net_socket_iovec_t in[] = {
+        { first, sizeof(first) }, { second, sizeof(second) }
+    };
+    size_t received;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_receive_vec(
+            receiver, &received, in, AVS_ARRAY_SIZE(in)));
+    AVS_UNIT_ASSERT_EQUAL(received, 14);
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(first, "hea", 3);
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(second, "d-body-tail", 11);
+
+    // truncation is reported like in avs_net_socket_receive()
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_send_vec(sender, out, AVS_ARRAY_SIZE(out)));
+    const avs_net_socket_iovec_t small_in[] = {
+        { first, sizeof(first) }, { second, 2 }
+    };
+    AVS_UNIT_ASSERT_FAILED(avs_net_socket_receive_vec(
+            receiver, &received, small_in, AVS_ARRAY_SIZE(small_in)));
+    AVS_UNIT_ASSERT_EQUAL(avs_net_socket_errno(receiver), EMSGSIZE);
+    AVS_UNIT_ASSERT_EQUAL(received, 5);
+
+    avs_net_socket_cleanup(&sender);
+    avs_net_socket_cleanup(&receiver);
+}
+
+AVS_UNIT_TEST(net_vec, udp_many_segments) {
+    avs_net_abstract_socket_t *receiver;
+    avs_net_abstract_socket_t *sender;
+    create_udp_pair(&receiver, &sender);
+
+    static const char DATA[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    avs_net_socket_const_iovec_t out[sizeof(DATA) - 1];
+    char in_buffers[sizeof(DATA) - 1];
+    avs_net_socket_iovec_t in[sizeof(DATA) - 1];
+    for (size_t i = 0; i < sizeof(DATA) - 1; ++i) {
+        out[i].buffer = &DATA[i];
+        out[i].buffer_length = 1;
+        in[i].buffer = &in_buffers[i];
+        in[i].buffer_length = 1;
+    }
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_send_vec(sender, out, AVS_ARRAY_SIZE(out)));
+    size_t received;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_receive_vec(
+            receiver, &received, in, AVS_ARRAY_SIZE(in)));
+    AVS_UNIT_ASSERT_EQUAL(received, sizeof(DATA) - 1);
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(in_buffers, DATA, sizeof(DATA) - 1);
+
+    avs_net_socket_cleanup(&sender);
+    avs_net_socket_cleanup(&receiver);
+}
+
+AVS_UNIT_TEST(net_vec, tcp_stream) {
+    avs_net_abstract_socket_t *server = NULL;
+    char port[NET_PORT_SIZE];
+    create_tcp_server(&server, port, sizeof(port));
+
+    avs_net_abstract_socket_t *client = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&client, AVS_NET_TCP_SOCKET, NULL));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_connect(client, "127.0.0.1", port));
+    avs_net_abstract_socket_t *accepted = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&accepted, AVS_NET_TCP_SOCKET, NULL));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_accept(server, accepted));
+
+    avs_net_socket_opt_value_t native;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_get_opt(
+            client, AVS_NET_SOCKET_OPT_NATIVE_SEND_VEC, &native));
+    AVS_UNIT_ASSERT_TRUE(native.flag);
+
+    // more segments than a single sendmsg() call takes
+    avs_net_socket_const_iovec_t out[40];
+    for (size_t i = 0; i < AVS_ARRAY_SIZE(out); ++i) {
+        out[i].buffer = (i % 2) ? "\r\n" : "chunk";
+        out[i].buffer_length = (i % 2) ? 2 : 5;
+    }
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_send_vec(client, out, AVS_ARRAY_SIZE(out)));
+
+    char buf[20 * 7];
+    size_t total = 0;
+    while (total < sizeof(buf)) {
+        size_t received;
+        const avs_net_socket_iovec_t in[] = {
+            { buf + total, (sizeof(buf) - total) / 2 },
+            { buf + total + (sizeof(buf) - total) / 2,
+              sizeof(buf) - total - (sizeof(buf) - total) / 2 }
+        };
+        AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_receive_vec(
+                accepted, &received, in, AVS_ARRAY_SIZE(in)));
+        AVS_UNIT_ASSERT_TRUE(received > 0);
+        total += received;
+    }
+    for (size_t i = 0; i < 20; ++i) {
+        AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(&buf[7 * i], "chunk\r\n", 7);
+    }
+
+    avs_net_socket_cleanup(&accepted);
+    avs_net_socket_cleanup(&client);
+    avs_net_socket_cleanup(&server);
+}
+
+#ifdef HAVE_SENDFILE
+AVS_UNIT_TEST(net_send_file, tcp) {
+    char filename[] = "/tmp/test_net_send_file-XXXXXX";
+    int fd = mkstemp(filename);
+    AVS_UNIT_ASSERT_TRUE(fd >= 0);
+    unlink(filename);
+    static const char DATA[] = "0123456789abcdef";
+    AVS_UNIT_ASSERT_EQUAL(write(fd, DATA, sizeof(DATA) - 1),
+                          (ssize_t) (sizeof(DATA) - 1));
+
+    avs_net_abstract_socket_t *server = NULL;
+    char port[NET_PORT_SIZE];
+    create_tcp_server(&server, port, sizeof(port));
+    avs_net_abstract_socket_t *client = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&client, AVS_NET_TCP_SOCKET, NULL));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_connect(client, "127.0.0.1", port));
+    avs_net_abstract_socket_t *accepted = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&accepted, AVS_NET_TCP_SOCKET, NULL));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_accept(server, accepted));
+
+    // requesting more than available stops at end of file
+    size_t bytes_sent;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_send_file(client, &fd, 4, 100, &bytes_sent));
+    AVS_UNIT_ASSERT_EQUAL(bytes_sent, sizeof(DATA) - 1 - 4);
+    // file position is not affected
+    AVS_UNIT_ASSERT_EQUAL(lseek(fd, 0, SEEK_CUR), (off_t) (sizeof(DATA) - 1));
+
+    char buf[sizeof(DATA)];
+    size_t total = 0;
+    while (total < sizeof(DATA) - 1 - 4) {
+        size_t received;
+        AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_receive(
+                accepted, &received, buf + total, sizeof(buf) - total));
+        AVS_UNIT_ASSERT_TRUE(received > 0);
+        total += received;
+    }
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(buf, DATA + 4, sizeof(DATA) - 1 - 4);
+
+    avs_net_socket_cleanup(&accepted);
+    avs_net_socket_cleanup(&client);
+    avs_net_socket_cleanup(&server);
+    close(fd);
+}
+
+AVS_UNIT_TEST(net_send_file, udp_unsupported) {
+    int fd = open("/dev/null", O_RDONLY);
+    AVS_UNIT_ASSERT_TRUE(fd >= 0);
+    avs_net_abstract_socket_t *socket = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&socket, AVS_NET_UDP_SOCKET, NULL));
+    size_t bytes_sent;
+    AVS_UNIT_ASSERT_EQUAL(
+            avs_net_socket_send_file(socket, &fd, 0, 1, &bytes_sent),
+            AVS_NET_SOCKET_SEND_FILE_UNSUPPORTED);
+    AVS_UNIT_ASSERT_EQUAL(bytes_sent, 0);
+    avs_net_socket_cleanup(&socket);
+    close(fd);
+}
+#endif // HAVE_SENDFILE
+
+static void test_send_segmented(uint8_t udp_offload) {
+    avs_net_abstract_socket_t *receiver;
+    avs_net_abstract_socket_t *sender;
+    create_udp_pair_ex(&receiver, &sender, udp_offload);
+
+    // more segments than a single UDP_SEGMENT send takes
+    enum { SEGMENT = 1000, COUNT = 70, LAST = 500 };
+    static char data[SEGMENT * COUNT + LAST];
+    for (size_t i = 0; i < sizeof(data); ++i) {
+        data[i] = (char) (i / SEGMENT);
+    }
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_send_segmented(
+            sender, data, sizeof(data), SEGMENT));
+
+    static char buf[65535];
+    size_t datagrams = 0;
+    size_t total = 0;
+    while (total < sizeof(data)) {
+        size_t received;
+        size_t segment_size;
+        AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_receive_segmented(
+                receiver, &received, &segment_size, buf, sizeof(buf)));
+        AVS_UNIT_ASSERT_TRUE(received > 0);
+        AVS_UNIT_ASSERT_TRUE(segment_size > 0);
+        for (size_t offset = 0; offset < received; offset += segment_size) {
+            size_t length = AVS_MIN(segment_size, received - offset);
+            // each message is exactly one of the sent datagrams
+            AVS_UNIT_ASSERT_EQUAL(length, datagrams < COUNT ? SEGMENT : LAST);
+            AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(&buf[offset], &data[total],
+                                              length);
+            total += length;
+            ++datagrams;
+        }
+    }
+    AVS_UNIT_ASSERT_EQUAL(datagrams, COUNT + 1);
+
+    avs_net_socket_cleanup(&sender);
+    avs_net_socket_cleanup(&receiver);
+}
+
+AVS_UNIT_TEST(net_udp_offload, send_and_receive_segmented) {
+    test_send_segmented(1);
+}
+
+AVS_UNIT_TEST(net_udp_offload, fallback_without_offload) {
+    test_send_segmented(0);
+}
+
+AVS_UNIT_TEST(net_udp_offload, single_segment) {
+    avs_net_abstract_socket_t *receiver;
+    avs_net_abstract_socket_t *sender;
+    create_udp_pair_ex(&receiver, &sender, 1);
+
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_send_segmented(sender, "hello", 5, 1000));
+    AVS_UNIT_ASSERT_FAILED(
+            avs_net_socket_send_segmented(sender, "hello", 5, 0));
+    char buf[65535];
+    size_t received;
+    size_t segment_size;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_receive_segmented(
+            receiver, &received, &segment_size, buf, sizeof(buf)));
+    AVS_UNIT_ASSERT_EQUAL(received, 5);
+    AVS_UNIT_ASSERT_EQUAL(segment_size, 5);
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(buf, "hello", 5);
+
+    avs_net_socket_cleanup(&sender);
+    avs_net_socket_cleanup(&receiver);
+}
+
+#define GROUP_SIZE 4
+
+static void create_group(avs_net_abstract_socket_t **out_sockets,
+                         avs_net_socket_type_t type,
+                         int flags) {
+    avs_net_socket_configuration_t config;
+    memset(&config, 0, sizeof(config));
+    config.address_family = AVS_NET_AF_INET4;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_bind_reuse_port_group(
+            out_sockets, GROUP_SIZE, type, &config, "127.0.0.1", "0", flags));
+
+    char first_port[NET_PORT_SIZE];
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_get_local_port(
+            out_sockets[0], first_port, sizeof(first_port)));
+    for (size_t i = 1; i < GROUP_SIZE; ++i) {
+        char port[NET_PORT_SIZE];
+        AVS_UNIT_ASSERT_SUCCESS(
+                avs_net_socket_get_local_port(out_sockets[i], port,
+                                              sizeof(port)));
+        AVS_UNIT_ASSERT_EQUAL_STRING(port, first_port);
+    }
+}
+
+static void cleanup_group(avs_net_abstract_socket_t **sockets) {
+    for (size_t i = 0; i < GROUP_SIZE; ++i) {
+        avs_net_socket_cleanup(&sockets[i]);
+    }
+}
+
+AVS_UNIT_TEST(net_reuse_port, udp_group) {
+    avs_net_abstract_socket_t *sockets[GROUP_SIZE];
+    create_group(sockets, AVS_NET_UDP_SOCKET, 0);
+    cleanup_group(sockets);
+}
+
+AVS_UNIT_TEST(net_reuse_port, tcp_group) {
+    avs_net_abstract_socket_t *sockets[GROUP_SIZE];
+    create_group(sockets, AVS_NET_TCP_SOCKET, 0);
+    cleanup_group(sockets);
+}
+
+AVS_UNIT_TEST(net_reuse_port, invalid_arguments) {
+    avs_net_abstract_socket_t *sockets[GROUP_SIZE];
+    AVS_UNIT_ASSERT_FAILED(avs_net_socket_bind_reuse_port_group(
+            sockets, 0, AVS_NET_UDP_SOCKET, NULL, "127.0.0.1", "0", 0));
+    AVS_UNIT_ASSERT_FAILED(avs_net_socket_bind_reuse_port_group(
+            sockets, GROUP_SIZE, AVS_NET_SSL_SOCKET, NULL, "127.0.0.1", "0",
+            0));
+}
+
+#if defined(HAVE_LINUX_FILTER_H) && defined(SO_ATTACH_REUSEPORT_CBPF)
+AVS_UNIT_TEST(net_reuse_port, steering_by_peer_address) {
+    avs_net_abstract_socket_t *sockets[GROUP_SIZE];
+    create_group(sockets, AVS_NET_UDP_SOCKET,
+                 AVS_NET_SOCKET_GROUP_F_STEER_BY_PEER_ADDRESS);
+    char port[NET_PORT_SIZE];
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_get_local_port(sockets[0], port, sizeof(port)));
+
+    // every client has a different source port, but the same address
+    enum { CLIENTS = 8 };
+    avs_net_abstract_socket_t *clients[CLIENTS];
+    for (size_t i = 0; i < CLIENTS; ++i) {
+        clients[i] = NULL;
+        AVS_UNIT_ASSERT_SUCCESS(
+                avs_net_socket_create(&clients[i], AVS_NET_UDP_SOCKET, NULL));
+        AVS_UNIT_ASSERT_SUCCESS(
+                avs_net_socket_connect(clients[i], "127.0.0.1", port));
+        AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_send(clients[i], "x", 1));
+    }
+
+    const avs_net_socket_opt_value_t timeout = {
+        .recv_timeout = avs_time_duration_from_scalar(100, AVS_TIME_MS)
+    };
+    size_t sockets_used = 0;
+    size_t total_received = 0;
+    for (size_t i = 0; i < GROUP_SIZE; ++i) {
+        AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_set_opt(
+                sockets[i], AVS_NET_SOCKET_OPT_RECV_TIMEOUT, timeout));
+        size_t received_here = 0;
+        char buf[8];
+        size_t received;
+        while (!avs_net_socket_receive(sockets[i], &received, buf,
+                                       sizeof(buf))) {
+            ++received_here;
+        }
+        if (received_here) {
+            ++sockets_used;
+            total_received += received_here;
+        }
+    }
+    AVS_UNIT_ASSERT_EQUAL(total_received, CLIENTS);
+    AVS_UNIT_ASSERT_EQUAL(sockets_used, 1);
+
+    for (size_t i = 0; i < CLIENTS; ++i) {
+        avs_net_socket_cleanup(&clients[i]);
+    }
+    cleanup_group(sockets);
+}
+#endif // defined(HAVE_LINUX_FILTER_H) && defined(SO_ATTACH_REUSEPORT_CBPF)
+
+#undef GROUP_SIZE
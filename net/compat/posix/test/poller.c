@@ -0,0 +1,267 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <avs_commons_config.h>
+
+#include <avsystem/commons/socket_v_table.h>
+#include <avsystem/commons/unit/test.h>
+
+#if defined(HAVE_EPOLL) || defined(HAVE_POLL)
+
+typedef struct {
+    avs_net_abstract_socket_t *receiver;
+    avs_net_abstract_socket_t *sender;
+} udp_pair_t;
+
+static void udp_pair_init(udp_pair_t *pair) {
+    avs_net_socket_configuration_t config;
+    memset(&config, 0, sizeof(config));
+    config.address_family = AVS_NET_AF_INET4;
+
+    pair->receiver = NULL;
+    pair->sender = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_create(
+            &pair->receiver, AVS_NET_UDP_SOCKET, &config));
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_bind(pair->receiver, "127.0.0.1", "0"));
+    char port[NET_PORT_SIZE];
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_get_local_port(
+            pair->receiver, port, sizeof(port)));
+
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_create(
+            &pair->sender, AVS_NET_UDP_SOCKET, &config));
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_connect(pair->sender, "127.0.0.1", port));
+}
+
+static void udp_pair_cleanup(udp_pair_t *pair) {
+    avs_net_socket_cleanup(&pair->receiver);
+    avs_net_socket_cleanup(&pair->sender);
+}
+
+static const avs_time_duration_t WAIT_TIMEOUT = { 1, 0 };
+
+AVS_UNIT_TEST(net_poller, udp_readiness) {
+    udp_pair_t pair;
+    udp_pair_init(&pair);
+
+    avs_net_poller_t *poller = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_poller_create(&poller));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_poller_add(poller, pair.receiver,
+                                               AVS_NET_POLLER_IN, &pair));
+    AVS_UNIT_ASSERT_FAILED(avs_net_poller_add(poller, pair.receiver,
+                                              AVS_NET_POLLER_IN, NULL));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_poller_add(poller, pair.sender,
+                                               AVS_NET_POLLER_IN, NULL));
+
+    avs_net_poller_event_t events[4];
+    AVS_UNIT_ASSERT_EQUAL(avs_net_poller_wait(poller, events,
+                                              AVS_ARRAY_SIZE(events),
+                                              AVS_TIME_DURATION_ZERO), 0);
+
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_send(pair.sender, "ping", 4));
+    AVS_UNIT_ASSERT_EQUAL(avs_net_poller_wait(poller, events,
+                                              AVS_ARRAY_SIZE(events),
+                                              WAIT_TIMEOUT), 1);
+    AVS_UNIT_ASSERT_TRUE(events[0].socket == pair.receiver);
+    AVS_UNIT_ASSERT_TRUE(events[0].user_data == &pair);
+    AVS_UNIT_ASSERT_EQUAL(events[0].events, AVS_NET_POLLER_IN);
+
+    // sender is always writable
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_poller_modify(poller, pair.sender,
+                                                  AVS_NET_POLLER_OUT, &pair));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_poller_remove(poller, pair.receiver));
+    AVS_UNIT_ASSERT_FAILED(avs_net_poller_remove(poller, pair.receiver));
+    AVS_UNIT_ASSERT_EQUAL(avs_net_poller_wait(poller, events,
+                                              AVS_ARRAY_SIZE(events),
+                                              WAIT_TIMEOUT), 1);
+    AVS_UNIT_ASSERT_TRUE(events[0].socket == pair.sender);
+    AVS_UNIT_ASSERT_EQUAL(events[0].events, AVS_NET_POLLER_OUT);
+
+    avs_net_poller_cleanup(&poller);
+    AVS_UNIT_ASSERT_NULL(poller);
+    udp_pair_cleanup(&pair);
+}
+
+AVS_UNIT_TEST(net_poller, generation_past_32_bits) {
+    udp_pair_t pair;
+    udp_pair_init(&pair);
+
+    avs_net_poller_t *poller = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_poller_create(&poller));
+    // a new entry must not look like one already reported in this wait
+    poller->generation = UINT32_MAX;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_poller_add(poller, pair.receiver,
+                                               AVS_NET_POLLER_IN, NULL));
+
+    avs_net_poller_event_t events[4];
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_send(pair.sender, "ping", 4));
+    AVS_UNIT_ASSERT_EQUAL(avs_net_poller_wait(poller, events,
+                                              AVS_ARRAY_SIZE(events),
+                                              WAIT_TIMEOUT), 1);
+    AVS_UNIT_ASSERT_TRUE(events[0].socket == pair.receiver);
+    AVS_UNIT_ASSERT_EQUAL(events[0].events, AVS_NET_POLLER_IN);
+
+    avs_net_poller_cleanup(&poller);
+    udp_pair_cleanup(&pair);
+}
+
+AVS_UNIT_TEST(net_poller, max_events) {
+    enum { NUM_PAIRS = 8 };
+    udp_pair_t pairs[NUM_PAIRS];
+    avs_net_poller_t *poller = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_poller_create(&poller));
+    for (size_t i = 0; i < NUM_PAIRS; ++i) {
+        udp_pair_init(&pairs[i]);
+        AVS_UNIT_ASSERT_SUCCESS(avs_net_poller_add(poller, pairs[i].receiver,
+                                                   AVS_NET_POLLER_IN,
+                                                   &pairs[i]));
+        AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_send(pairs[i].sender, "x", 1));
+    }
+
+    avs_net_poller_event_t events[NUM_PAIRS];
+    AVS_UNIT_ASSERT_EQUAL(avs_net_poller_wait(poller, events, 3,
+                                              WAIT_TIMEOUT), 3);
+
+    // drain all sockets; each of them shall be reported exactly once
+    size_t drained = 0;
+    while (drained < NUM_PAIRS) {
+        int count = avs_net_poller_wait(poller, events, NUM_PAIRS,
+                                        WAIT_TIMEOUT);
+        AVS_UNIT_ASSERT_TRUE(count > 0);
+        for (int i = 0; i < count; ++i) {
+            udp_pair_t *pair = (udp_pair_t *) events[i].user_data;
+            char buf[4];
+            size_t received;
+            AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_receive(
+                    pair->receiver, &received, buf, sizeof(buf)));
+            AVS_UNIT_ASSERT_SUCCESS(
+                    avs_net_poller_remove(poller, pair->receiver));
+            ++drained;
+        }
+    }
+    AVS_UNIT_ASSERT_EQUAL(avs_net_poller_wait(poller, events, NUM_PAIRS,
+                                              AVS_TIME_DURATION_ZERO), 0);
+
+    avs_net_poller_cleanup(&poller);
+    for (size_t i = 0; i < NUM_PAIRS; ++i) {
+        udp_pair_cleanup(&pairs[i]);
+    }
+}
+
+typedef struct {
+    const avs_net_socket_v_table_t *const operations;
+    avs_net_abstract_socket_t *backend;
+    bool buffered;
+    unsigned buffered_queries;
+} buffering_socket_t;
+
+static int buffering_get_system(avs_net_abstract_socket_t *socket,
+                                const void **out) {
+    *out = avs_net_socket_get_system(((buffering_socket_t *) socket)->backend);
+    return *out ? 0 : -1;
+}
+
+static int buffering_get_opt(avs_net_abstract_socket_t *socket,
+                             avs_net_socket_opt_key_t option_key,
+                             avs_net_socket_opt_value_t *out_option_value) {
+    if (option_key != AVS_NET_SOCKET_OPT_HAS_BUFFERED_DATA) {
+        return -1;
+    }
+    buffering_socket_t *buffering = (buffering_socket_t *) socket;
+    ++buffering->buffered_queries;
+    out_option_value->flag = buffering->buffered;
+    return 0;
+}
+
+static const avs_net_socket_v_table_t BUFFERING_VTABLE = {
+    .get_system_socket = buffering_get_system,
+    .get_opt = buffering_get_opt
+};
+
+AVS_UNIT_TEST(net_poller, buffered_data) {
+    udp_pair_t pair;
+    udp_pair_init(&pair);
+    buffering_socket_t buffering = {
+        .operations = &BUFFERING_VTABLE,
+        .backend = pair.receiver,
+        .buffered = false
+    };
+    avs_net_abstract_socket_t *socket = (avs_net_abstract_socket_t *) &buffering;
+
+    avs_net_poller_t *poller = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_poller_create(&poller));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_poller_add(poller, socket,
+                                               AVS_NET_POLLER_IN, NULL));
+
+    avs_net_poller_event_t events[2];
+    AVS_UNIT_ASSERT_EQUAL(avs_net_poller_wait(poller, events,
+                                              AVS_ARRAY_SIZE(events),
+                                              AVS_TIME_DURATION_ZERO), 0);
+
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_send(pair.sender, "ping", 4));
+    AVS_UNIT_ASSERT_EQUAL(avs_net_poller_wait(poller, events,
+                                              AVS_ARRAY_SIZE(events),
+                                              WAIT_TIMEOUT), 1);
+    AVS_UNIT_ASSERT_TRUE(events[0].socket == socket);
+    AVS_UNIT_ASSERT_EQUAL(events[0].events, AVS_NET_POLLER_IN);
+
+    // receiving drains the system socket, but the decorator holds plaintext
+    char buf[8];
+    size_t received;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_receive(pair.receiver, &received,
+                                                   buf, sizeof(buf)));
+    buffering.buffered = true;
+    AVS_UNIT_ASSERT_EQUAL(avs_net_poller_wait(poller, events,
+                                              AVS_ARRAY_SIZE(events),
+                                              WAIT_TIMEOUT), 1);
+    AVS_UNIT_ASSERT_TRUE(events[0].socket == socket);
+    AVS_UNIT_ASSERT_EQUAL(events[0].events, AVS_NET_POLLER_IN);
+
+    // readiness of both kinds is merged into a single event
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_send(pair.sender, "ping", 4));
+    AVS_UNIT_ASSERT_EQUAL(avs_net_poller_wait(poller, events,
+                                              AVS_ARRAY_SIZE(events),
+                                              WAIT_TIMEOUT), 1);
+    AVS_UNIT_ASSERT_TRUE(events[0].socket == socket);
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_receive(pair.receiver, &received,
+                                                   buf, sizeof(buf)));
+
+    // once the buffer is found empty, an idle socket is no longer queried
+    buffering.buffered = false;
+    AVS_UNIT_ASSERT_EQUAL(avs_net_poller_wait(poller, events,
+                                              AVS_ARRAY_SIZE(events),
+                                              AVS_TIME_DURATION_ZERO), 0);
+    const unsigned queries = buffering.buffered_queries;
+    AVS_UNIT_ASSERT_EQUAL(avs_net_poller_wait(poller, events,
+                                              AVS_ARRAY_SIZE(events),
+                                              AVS_TIME_DURATION_ZERO), 0);
+    AVS_UNIT_ASSERT_EQUAL(buffering.buffered_queries, queries);
+
+    // unless explicitly requested
+    buffering.buffered = true;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_poller_modify(poller, socket,
+                                                  AVS_NET_POLLER_IN, NULL));
+    AVS_UNIT_ASSERT_EQUAL(avs_net_poller_wait(poller, events,
+                                              AVS_ARRAY_SIZE(events),
+                                              AVS_TIME_DURATION_ZERO), 1);
+    AVS_UNIT_ASSERT_TRUE(events[0].socket == socket);
+
+    avs_net_poller_cleanup(&poller);
+    udp_pair_cleanup(&pair);
+}
+
+#endif // defined(HAVE_EPOLL) || defined(HAVE_POLL)
@@ -157,6 +157,132 @@ int avs_net_addrinfo_next(avs_net_addrinfo_t *ctx,
  */
 void avs_net_addrinfo_rewind(avs_net_addrinfo_t *ctx);
 
+/**
+ * Type for a handle of address resolution performed in the background.
+ */
+typedef struct avs_net_addrinfo_async_struct avs_net_addrinfo_async_t;
+
+/**
+ * Value returned by @ref avs_net_addrinfo_async_finish if the resolution is
+ * still in progress.
+ */
+#define AVS_NET_ADDRINFO_ASYNC_PENDING 1
+
+/**
+ * Starts resolving a text-represented host and port address without blocking
+ * the calling thread. The actual resolution is performed by
+ * @ref avs_net_addrinfo_resolve_ex called on one of a small pool of internal
+ * resolver threads, so all of its semantics, including use of the address
+ * resolution cache, apply.
+ *
+ * The parameters have the same meaning as for
+ * @ref avs_net_addrinfo_resolve_ex . All of them are copied, so they do not
+ * need to remain valid after this function returns.
+ *
+ * This function is only available if avs_commons has been compiled with
+ * <c>WITH_AVS_NET_ASYNC_RESOLVER</c>; otherwise it always fails.
+ *
+ * @return A new handle that may be watched for completion using
+ *         @ref avs_net_addrinfo_async_get_system, queried using
+ *         @ref avs_net_addrinfo_async_finish and has to be freed using
+ *         @ref avs_net_addrinfo_async_cleanup. If an error occured,
+ *         <c>NULL</c> is returned.
+ */
+avs_net_addrinfo_async_t *avs_net_addrinfo_resolve_async(
+        avs_net_socket_type_t socket_type,
+        avs_net_af_t family,
+        const char *host,
+        const char *port,
+        int flags,
+        const avs_net_resolved_endpoint_t *preferred_endpoint);
+
+/**
+ * Returns a pointer to the system file descriptor (an <c>int</c> on POSIX
+ * platforms) that becomes readable when the resolution started with
+ * @ref avs_net_addrinfo_resolve_async completes. It may be passed e.g. to
+ * <c>poll()</c> along with other descriptors of an event loop. The descriptor
+ * must not be read from or closed by the user.
+ *
+ * @param handle Handle returned by @ref avs_net_addrinfo_resolve_async.
+ */
+const void *avs_net_addrinfo_async_get_system(avs_net_addrinfo_async_t *handle);
+
+/**
+ * Retrieves the result of resolution started with
+ * @ref avs_net_addrinfo_resolve_async. This function never blocks.
+ *
+ * @param handle   Handle returned by @ref avs_net_addrinfo_resolve_async.
+ * @param out_info Pointer to a variable that will be set to a new instance of
+ *                 @ref avs_net_addrinfo_t on success. The ownership of that
+ *                 object is passed to the caller, who has to free it using
+ *                 @ref avs_net_addrinfo_delete. It is retrieved only once;
+ *                 subsequent calls return an error.
+ *
+ * @return @li 0 for success
+ *         @li <c>AVS_NET_ADDRINFO_ASYNC_PENDING</c> if the resolution is still
+ *             in progress
+ *         @li negative value in case of error, including failure to resolve
+ *             the address
+ */
+int avs_net_addrinfo_async_finish(avs_net_addrinfo_async_t *handle,
+                                  avs_net_addrinfo_t **out_info);
+
+/**
+ * Frees a handle returned by @ref avs_net_addrinfo_resolve_async. If the
+ * resolution is still in progress, it is cancelled; the result, if any, is
+ * discarded in the background.
+ *
+ * @param handle_ptr Pointer to a variable holding the handle. It will be
+ *                   freed and zeroed.
+ */
+void avs_net_addrinfo_async_cleanup(avs_net_addrinfo_async_t **handle_ptr);
+
+/**
+ * Configuration of the in-process cache of address resolution results.
+ */
+typedef struct {
+    /**
+     * Maximum number of cached (host, family, socket type) queries. When the
+     * cache is full, the oldest entry is evicted. 0 disables the cache.
+     */
+    size_t max_entries;
+
+    /**
+     * Time for which successful resolution results are reused. Note that the
+     * actual DNS record TTL is not available through <c>getaddrinfo()</c>, so
+     * this is an upper bound chosen by the application.
+     */
+    avs_time_duration_t ttl;
+
+    /**
+     * Time for which failures caused by nonexistent host names are
+     * remembered. Temporary failures are never cached. Zero disables negative
+     * caching.
+     */
+    avs_time_duration_t negative_ttl;
+} avs_net_addrinfo_cache_config_t;
+
+/**
+ * Enables, reconfigures or disables the address resolution cache used by
+ * @ref avs_net_addrinfo_resolve_ex and all functions built on top of it,
+ * including @ref avs_net_socket_connect . The cache is disabled by default.
+ *
+ * Any previously cached entries are discarded.
+ *
+ * @param config New configuration, or NULL to disable the cache.
+ *
+ * @return 0 for success, or a negative value in case of error, in which case
+ *         the cache is disabled.
+ */
+int avs_net_addrinfo_cache_configure(
+        const avs_net_addrinfo_cache_config_t *config);
+
+/**
+ * Discards all entries from the address resolution cache, e.g. after network
+ * configuration has changed. The cache configuration is retained.
+ */
+void avs_net_addrinfo_cache_flush(void);
+
 /**
  * Translates a binary representation of a socket address to textual
  * representation.
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AVS_COMMONS_NET_POLLER_H
+#define AVS_COMMONS_NET_POLLER_H
+
+#include <stddef.h>
+
+#include <avsystem/commons/socket.h>
+#include <avsystem/commons/time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Object that waits for readiness of many sockets at once.
+ *
+ * On Linux, it is backed by epoll, so that the cost of a single wait depends
+ * on the number of ready sockets rather than the number of registered ones.
+ * Other POSIX platforms use poll().
+ *
+ * Sockets that buffer received data internally (e.g. SSL and DTLS sockets,
+ * see @ref AVS_NET_SOCKET_OPT_HAS_BUFFERED_DATA) are reported as readable
+ * whenever such data is available, even if the underlying system socket is
+ * not. Such data can only appear after receiving from the socket, so it is
+ * only checked for on sockets reported as readable since the last check, and
+ * on ones just added or modified to watch for @ref AVS_NET_POLLER_IN . If
+ * a socket is received from without having been reported as readable, call
+ * @ref avs_net_poller_modify on it to have it checked again.
+ */
+typedef struct avs_net_poller avs_net_poller_t;
+
+/** Readiness flags, used both for registration and in reported events. */
+typedef enum {
+    /** Socket can be received from without blocking. */
+    AVS_NET_POLLER_IN = (1 << 0),
+    /** Socket can be sent to without blocking. */
+    AVS_NET_POLLER_OUT = (1 << 1),
+    /**
+     * An error or hang-up occurred on the socket. Always reported, even if not
+     * requested during registration.
+     */
+    AVS_NET_POLLER_ERR = (1 << 2)
+} avs_net_poller_flag_t;
+
+/** Single readiness event reported by @ref avs_net_poller_wait . */
+typedef struct {
+    /** Socket that the event concerns. */
+    avs_net_abstract_socket_t *socket;
+    /** Value passed when registering @ref socket . */
+    void *user_data;
+    /** Bit mask of @ref avs_net_poller_flag_t values. */
+    int events;
+} avs_net_poller_event_t;
+
+/**
+ * Creates an empty poller.
+ *
+ * @param[out] out_poller Pointer to a variable that will be set to the newly
+ *                        created poller.
+ *
+ * @returns 0 on success, a negative value in case of error.
+ */
+int avs_net_poller_create(avs_net_poller_t **out_poller);
+
+/**
+ * Frees all resources used by the poller and sets <c>*poller_ptr</c> to NULL.
+ * Registered sockets are not affected.
+ */
+void avs_net_poller_cleanup(avs_net_poller_t **poller_ptr);
+
+/**
+ * Registers a socket in the poller.
+ *
+ * The socket needs to be bound, connected or accepted, and must be removed
+ * from the poller with @ref avs_net_poller_remove before it is closed,
+ * reconnected or freed.
+ *
+ * @param poller    Poller to register the socket in.
+ * @param socket    Socket to watch.
+ * @param events    Bit mask of @ref avs_net_poller_flag_t values to watch for.
+ * @param user_data Opaque pointer reported along with events on @p socket .
+ *
+ * @returns 0 on success, a negative value in case of error, including the case
+ *          of @p socket already being registered.
+ */
+int avs_net_poller_add(avs_net_poller_t *poller,
+                       avs_net_abstract_socket_t *socket,
+                       int events,
+                       void *user_data);
+
+/**
+ * Changes the set of events watched for on a registered socket, and its
+ * associated @p user_data .
+ *
+ * @returns 0 on success, a negative value in case of error, including the case
+ *          of @p socket not being registered.
+ */
+int avs_net_poller_modify(avs_net_poller_t *poller,
+                          avs_net_abstract_socket_t *socket,
+                          int events,
+                          void *user_data);
+
+/**
+ * Unregisters a socket from the poller.
+ *
+ * @returns 0 on success, a negative value if @p socket is not registered.
+ */
+int avs_net_poller_remove(avs_net_poller_t *poller,
+                          avs_net_abstract_socket_t *socket);
+
+/**
+ * Waits until at least one of the registered sockets becomes ready, or the
+ * @p timeout passes.
+ *
+ * @param poller     Poller to wait on.
+ * @param out_events Array that will be filled with readiness events. At most
+ *                   one event is reported for each socket.
+ * @param max_events Capacity of @p out_events . Must be positive.
+ * @param timeout    Maximum time to wait. Invalid duration means infinite
+ *                   wait, zero or negative duration means a non-blocking
+ *                   check.
+ *
+ * @returns Number of events stored in @p out_events (0 if the timeout passed),
+ *          or a negative value in case of error.
+ */
+int avs_net_poller_wait(avs_net_poller_t *poller,
+                        avs_net_poller_event_t *out_events,
+                        size_t max_events,
+                        avs_time_duration_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AVS_COMMONS_NET_POLLER_H */
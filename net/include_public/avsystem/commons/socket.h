@@ -203,6 +203,32 @@ typedef struct {
      * <c>AVS_NET_UNSPEC</c>.
      */
     avs_net_af_t preferred_family;
+
+    /**
+     * Enables UDP segmentation offload for UDP sockets, where supported by the
+     * system (currently Linux): <c>UDP_SEGMENT</c> for data sent using
+     * @ref avs_net_socket_send_segmented and <c>UDP_GRO</c> for received data.
+     * This is a boolean flag that needs to be set to either 0 or 1, left as
+     * <c>uint8_t</c> instead of <c>bool</c> for compatibility reasons.
+     *
+     * If the offload turns out not to be available, the socket silently falls
+     * back to handling each datagram separately.
+     *
+     * Note that with receive offload enabled, multiple datagrams from the same
+     * peer may be returned as a single, coalesced one, so data shall be
+     * received using @ref avs_net_socket_receive_segmented only.
+     */
+    uint8_t udp_offload;
+
+    /**
+     * Used to set <c>SO_REUSEPORT</c> on the underlying system socket before
+     * binding it. This allows multiple sockets to be bound to the same address
+     * and port, with the system distributing incoming datagrams or connections
+     * among them. See also @ref avs_net_socket_bind_reuse_port_group . This is
+     * a boolean flag that needs to be set to either 0 or 1, left as
+     * <c>uint8_t</c> instead of <c>bool</c> for compatibility reasons.
+     */
+    uint8_t reuse_port;
 } avs_net_socket_configuration_t;
 
 /**
@@ -527,7 +553,40 @@ typedef enum {
      * call will still be successful. This option makes it possible to check
      * whether the session has been resumed, or is a new unrelated one.
      */
-    AVS_NET_SOCKET_OPT_SESSION_RESUMED
+    AVS_NET_SOCKET_OPT_SESSION_RESUMED,
+    /**
+     * Used to check whether the socket holds already received and decoded
+     * data that can be read with @ref avs_net_socket_receive without waiting
+     * for the underlying system socket to become readable, e.g. plaintext
+     * buffered by a (D)TLS layer. The value is passed in the <c>flag</c> field
+     * of the @ref avs_net_socket_opt_value_t union.
+     *
+     * Only sockets that perform such buffering support this option. Plain TCP
+     * and UDP sockets report it as unsupported.
+     */
+    AVS_NET_SOCKET_OPT_HAS_BUFFERED_DATA,
+    /**
+     * Used to get the total time the socket has spent waiting for the system
+     * socket to become ready for sending, receiving or accepting. The value is
+     * passed in the <c>poll_wait_time</c> field of the
+     * @ref avs_net_socket_opt_value_t union. This option is read-only.
+     *
+     * To keep sockets that are never queried free of the timing overhead, the
+     * wait time is only accounted after this option is read for the first
+     * time; the first query always reports zero.
+     */
+    AVS_NET_SOCKET_OPT_POLL_WAIT_TIME,
+    /**
+     * Used to check whether the socket implements
+     * @ref avs_net_socket_send_vec natively, i.e. without copying all the
+     * segments into a temporary buffer on each call. The value is passed in
+     * the <c>flag</c> field of the @ref avs_net_socket_opt_value_t union. This
+     * option is read-only.
+     *
+     * Sockets that do not support this option shall be assumed to use the
+     * copying fallback.
+     */
+    AVS_NET_SOCKET_OPT_NATIVE_SEND_VEC
 } avs_net_socket_opt_key_t;
 
 typedef enum {
@@ -573,6 +632,7 @@ typedef enum {
 
 typedef union {
     avs_time_duration_t recv_timeout;
+    avs_time_duration_t poll_wait_time;
     avs_net_socket_state_t state;
     avs_net_af_t addr_family;
     int mtu;
@@ -680,6 +740,101 @@ int avs_net_socket_decorate_in_place(avs_net_abstract_socket_t **socket,
                                      avs_net_socket_type_t new_type,
                                      const void *configuration);
 
+/**
+ * Number of buckets in latency histograms of
+ * @ref avs_net_socket_op_stats_t .
+ */
+#define AVS_NET_SOCKET_STATS_LATENCY_BUCKETS 24
+
+/**
+ * Statistics of a single class of operations performed on an instrumented
+ * socket.
+ */
+typedef struct {
+    /** Number of operations performed. */
+    uint64_t calls;
+    /** Number of operations that failed, including timeouts. */
+    uint64_t errors;
+    /**
+     * Number of operations that failed with <c>ETIMEDOUT</c>,
+     * <c>EAGAIN</c> or <c>EWOULDBLOCK</c>.
+     */
+    uint64_t timeouts;
+    /** Number of bytes successfully sent or received. */
+    uint64_t bytes;
+    /** Total time spent inside the operations. */
+    avs_time_duration_t total_time;
+    /**
+     * Part of @ref total_time spent waiting for the system socket to become
+     * ready, as reported by @ref AVS_NET_SOCKET_OPT_POLL_WAIT_TIME. Remains
+     * zero if the wrapped socket does not support that option.
+     */
+    avs_time_duration_t poll_wait_time;
+    /**
+     * Histogram of operation latencies. Element 0 counts operations that took
+     * less than 1 microsecond, element <c>i</c> counts those that took between
+     * <c>2^(i-1)</c> (inclusive) and <c>2^i</c> (exclusive) microseconds. The
+     * last element also counts all operations longer than that.
+     */
+    uint64_t latency_histogram[AVS_NET_SOCKET_STATS_LATENCY_BUCKETS];
+} avs_net_socket_op_stats_t;
+
+/**
+ * Statistics collected by an instrumented socket, see
+ * @ref avs_net_socket_instrument .
+ */
+typedef struct {
+    /**
+     * @ref avs_net_socket_send and all its variants, including
+     * @ref avs_net_socket_send_file . Batched operations are counted once.
+     */
+    avs_net_socket_op_stats_t send;
+    /** @ref avs_net_socket_receive and all its variants. */
+    avs_net_socket_op_stats_t receive;
+    /**
+     * @ref avs_net_socket_connect and @ref avs_net_socket_accept . For
+     * (D)TLS sockets, this includes the handshake.
+     */
+    avs_net_socket_op_stats_t connect;
+} avs_net_socket_stats_t;
+
+/**
+ * Wraps <c>*socket</c> in an instrumentation layer that collects
+ * @ref avs_net_socket_stats_t for all operations performed on it, and
+ * replaces <c>*socket</c> with the wrapper. All operations are passed through
+ * to the original socket, which is owned and cleaned up by the wrapper.
+ *
+ * Unlike the communication log enabled by @ref avs_net_socket_debug, this does
+ * not record any data, so it is cheap enough to be used in production.
+ *
+ * @param[inout] socket Pointer to a socket object to instrument.
+ *
+ * @returns 0 on success, a negative value in case of error, including when
+ *          the instrumentation layer is not compiled in. On failure,
+ *          <c>*socket</c> value is guaranteed to be left untouched.
+ */
+int avs_net_socket_instrument(avs_net_abstract_socket_t **socket);
+
+/**
+ * Retrieves a snapshot of statistics collected by an instrumented socket.
+ *
+ * @param[in]  socket    Socket wrapped using @ref avs_net_socket_instrument .
+ * @param[out] out_stats Structure to fill with the statistics.
+ *
+ * @returns 0 on success, a negative value if @p socket is not instrumented.
+ */
+int avs_net_socket_get_stats(avs_net_abstract_socket_t *socket,
+                             avs_net_socket_stats_t *out_stats);
+
+/**
+ * Resets all statistics collected by an instrumented socket to zero.
+ *
+ * @param socket Socket wrapped using @ref avs_net_socket_instrument .
+ *
+ * @returns 0 on success, a negative value if @p socket is not instrumented.
+ */
+int avs_net_socket_reset_stats(avs_net_abstract_socket_t *socket);
+
 /**
  * Sends exactly @p buffer_length bytes from @p buffer to @p socket.
  *
@@ -728,6 +883,58 @@ int avs_net_socket_send_to(avs_net_abstract_socket_t *socket,
                            size_t buffer_length,
                            const char *host,
                            const char *port);
+/**
+ * Single datagram used by @ref avs_net_socket_send_to_batch .
+ */
+typedef struct {
+    /** Data to send. Set by the caller. */
+    const void *buffer;
+    /** Number of bytes in @ref buffer . Set by the caller. */
+    size_t buffer_length;
+    /** Host name or IP address of the recipient. Set by the caller. */
+    const char *host;
+    /** Port of the recipient. Set by the caller. */
+    const char *port;
+    /**
+     * 0 if the datagram has been sent, or an errno value describing why it
+     * could not be sent. Set by the library.
+     */
+    int error_code;
+    /**
+     * Address the datagram has been sent to, in the same format as reported
+     * by @ref avs_net_socket_get_remote_endpoint for a socket connected to
+     * it. Set by the library; its <c>size</c> is 0 if the datagram has not
+     * been sent or if the socket implementation cannot report the address.
+     */
+    avs_net_resolved_endpoint_t resolved_endpoint;
+} avs_net_socket_send_to_msg_t;
+
+/**
+ * Sends multiple datagrams, possibly to different recipients, with as few
+ * system calls as possible. This is equivalent to calling
+ * @ref avs_net_socket_send_to for each entry of @p messages , in order, but
+ * a failure to send one datagram does not prevent the remaining ones from
+ * being sent.
+ *
+ * Consecutive entries with identical <c>host</c> and <c>port</c> are resolved
+ * only once.
+ *
+ * If the socket implementation does not support batched sending, this
+ * function falls back to calling @ref avs_net_socket_send_to in a loop.
+ *
+ * @param[in]    socket   Socket object to send data through.
+ * @param[inout] messages Array of datagrams to send.
+ * @param[in]    count    Number of entries in @p messages .
+ *
+ * @returns @li 0 if all the datagrams have been sent,
+ *          @li a negative value if at least one of them failed, in which case
+ *              the <c>error_code</c> fields of @p messages indicate which
+ *              ones.
+ */
+int avs_net_socket_send_to_batch(avs_net_abstract_socket_t *socket,
+                                 avs_net_socket_send_to_msg_t *messages,
+                                 size_t count);
+
 /**
  * Receives up to @p buffer_length bytes of data from @p socket into @p buffer .
  *
@@ -800,6 +1007,222 @@ int avs_net_socket_receive_from(avs_net_abstract_socket_t *socket,
                                 char *host, size_t host_size,
                                 char *port, size_t port_size);
 
+/**
+ * Single datagram slot used by @ref avs_net_socket_receive_batch .
+ */
+typedef struct {
+    /** Buffer to store the datagram in. Set by the caller. */
+    void *buffer;
+    /** Number of bytes available in @ref buffer . Set by the caller. */
+    size_t buffer_length;
+    /** Number of bytes written into @ref buffer . Set by the library. */
+    size_t bytes_received;
+    /**
+     * 0 if the datagram has been received in full, or EMSGSIZE if it has been
+     * truncated to @ref buffer_length bytes. Set by the library.
+     */
+    int error_code;
+} avs_net_socket_batch_msg_t;
+
+/**
+ * Receives multiple datagrams from @p socket at once, with as few system calls
+ * as possible.
+ *
+ * The function waits (honoring the receive timeout) until at least one
+ * datagram is available, and then fills consecutive entries of @p messages
+ * with datagrams that can be read without blocking. It may receive fewer than
+ * @p count datagrams even if more are pending.
+ *
+ * Truncated datagrams do not cause the function to fail - instead, the
+ * <c>error_code</c> field of the corresponding entry is set to EMSGSIZE.
+ *
+ * If the socket implementation does not support batched receiving, this
+ * function falls back to a single @ref avs_net_socket_receive call.
+ *
+ * @param[in]    socket           Socket object to read data from.
+ *                                The socket must be connected.
+ * @param[out]   out_received     Number of leading entries in @p messages that
+ *                                have been filled.
+ * @param[inout] messages         Array of datagram slots.
+ * @param[in]    count            Number of entries in @p messages . Must be
+ *                                greater than zero.
+ *
+ * @returns @li 0 on success, in which case at least one datagram has been
+ *              received,
+ *          @li a negative value in case of error, in which case @p socket
+ *              errno (see @ref avs_net_socket_errno) is set to an appropriate
+ *              value and no datagrams have been received.
+ */
+int avs_net_socket_receive_batch(avs_net_abstract_socket_t *socket,
+                                 size_t *out_received,
+                                 avs_net_socket_batch_msg_t *messages,
+                                 size_t count);
+
+/**
+ * Single segment of data sent by @ref avs_net_socket_send_vec .
+ */
+typedef struct {
+    /** Data to send. */
+    const void *buffer;
+    /** Number of bytes in @ref buffer . */
+    size_t buffer_length;
+} avs_net_socket_const_iovec_t;
+
+/**
+ * Single segment of buffer space used by @ref avs_net_socket_receive_vec .
+ */
+typedef struct {
+    /** Buffer to store received data in. */
+    void *buffer;
+    /** Number of bytes available in @ref buffer . */
+    size_t buffer_length;
+} avs_net_socket_iovec_t;
+
+/**
+ * Sends data gathered from multiple segments, as if they were concatenated and
+ * passed to @ref avs_net_socket_send . In particular, for UDP sockets, all the
+ * segments form a single datagram.
+ *
+ * This allows e.g. sending protocol framing data along with payload that
+ * resides in a different buffer without copying it and with a single system
+ * call, where supported. SSL/TLS sockets coalesce the segments into as few
+ * records as possible.
+ *
+ * If the socket implementation does not support vectored sending, the segments
+ * are copied into a temporary buffer and sent using
+ * @ref avs_net_socket_send . @ref AVS_NET_SOCKET_OPT_NATIVE_SEND_VEC may be
+ * used to tell these cases apart.
+ *
+ * @param socket    Socket object to send data to.
+ * @param iov       Array of segments to send.
+ * @param iov_count Number of entries in @p iov .
+ *
+ * @returns @li 0 if all bytes of all the segments were written,
+ *          @li a negative value in case of error, in which case @p socket
+ *              errno (see @ref avs_net_socket_errno) is set to an appropriate
+ *              value.
+ */
+int avs_net_socket_send_vec(avs_net_abstract_socket_t *socket,
+                            const avs_net_socket_const_iovec_t *iov,
+                            size_t iov_count);
+
+/**
+ * Receives data and scatters it into multiple segments, filling them in order.
+ * Apart from that, it behaves exactly like @ref avs_net_socket_receive with
+ * a buffer whose size is the sum of the sizes of all segments.
+ *
+ * If the socket implementation does not support vectored receiving, the data
+ * is received into a temporary buffer and then copied into the segments.
+ *
+ * @param[in]  socket             Socket object to read data from.
+ *                                The socket must be connected.
+ * @param[out] out_bytes_received Total number of bytes written into the
+ *                                segments.
+ * @param[in]  iov                Array of segments to fill.
+ * @param[in]  iov_count          Number of entries in @p iov .
+ *
+ * @returns @li 0 on success,
+ *          @li a negative value in case of error, in which case @p socket
+ *              errno (see @ref avs_net_socket_errno) is set to an appropriate
+ *              value.
+ */
+int avs_net_socket_receive_vec(avs_net_abstract_socket_t *socket,
+                               size_t *out_bytes_received,
+                               const avs_net_socket_iovec_t *iov,
+                               size_t iov_count);
+
+/**
+ * Value returned by @ref avs_net_socket_send_file if the socket is not able to
+ * send file contents directly. Nothing has been sent in that case, and the
+ * caller is expected to read the file and use @ref avs_net_socket_send instead.
+ */
+#define AVS_NET_SOCKET_SEND_FILE_UNSUPPORTED 1
+
+/**
+ * Sends a fragment of an open file, without copying its contents through
+ * a user-space buffer, where supported (e.g. using <c>sendfile()</c> for
+ * unencrypted TCP sockets on Linux).
+ *
+ * The file position associated with @p file_handle is not modified.
+ *
+ * @param[in]  socket         Socket object to send data to.
+ * @param[in]  file_handle    Pointer to a system file handle (e.g. a pointer to
+ *                            an <c>int</c> file descriptor on POSIX systems).
+ * @param[in]  offset         Offset in the file at which to start sending.
+ * @param[in]  length         Number of bytes to send.
+ * @param[out] out_bytes_sent Number of bytes actually sent. It may be lower
+ *                            than @p length if end of file has been reached.
+ *                            It is also meaningful in case of error.
+ *
+ * @returns @li 0 on success,
+ *          @li @ref AVS_NET_SOCKET_SEND_FILE_UNSUPPORTED if the socket does
+ *              not support this operation,
+ *          @li a negative value in case of error, in which case @p socket
+ *              errno (see @ref avs_net_socket_errno) is set to an appropriate
+ *              value.
+ */
+int avs_net_socket_send_file(avs_net_abstract_socket_t *socket,
+                             const void *file_handle,
+                             avs_off_t offset,
+                             size_t length,
+                             size_t *out_bytes_sent);
+
+/**
+ * Sends data split into equally sized segments, as if each of them was passed
+ * to a separate call to @ref avs_net_socket_send . The last segment may be
+ * shorter than the others. For UDP sockets, each segment forms a separate
+ * datagram.
+ *
+ * If the socket has been created with the <c>udp_offload</c> configuration
+ * flag set, the segmentation is performed by the system (or network hardware)
+ * and up to 64 datagrams are passed to the kernel in a single system call.
+ *
+ * @param socket         Socket object to send data to.
+ * @param buffer         Data to send.
+ * @param buffer_length  Number of bytes to send.
+ * @param segment_size   Size of each segment, must be positive.
+ *
+ * @returns @li 0 if all the segments were sent,
+ *          @li a negative value in case of error, in which case @p socket
+ *              errno (see @ref avs_net_socket_errno) is set to an appropriate
+ *              value. Some of the segments may have been sent in that case.
+ */
+int avs_net_socket_send_segmented(avs_net_abstract_socket_t *socket,
+                                  const void *buffer,
+                                  size_t buffer_length,
+                                  size_t segment_size);
+
+/**
+ * Receives data like @ref avs_net_socket_receive , but allows the system to
+ * coalesce multiple consecutive datagrams of equal size from the same peer
+ * into a single buffer, if the socket has been created with the
+ * <c>udp_offload</c> configuration flag set.
+ *
+ * The received data consists of datagrams of @p out_segment_size bytes each,
+ * except for the last one, which may be shorter. If no coalescing took place,
+ * @p out_segment_size is equal to @p out_bytes_received .
+ *
+ * As the system may coalesce up to 64 KB of data, @p buffer_length should be
+ * at least 65535 bytes if <c>udp_offload</c> is enabled; otherwise the data is
+ * truncated and an error with errno set to <c>EMSGSIZE</c> is reported.
+ *
+ * @param[in]  socket             Socket object to read data from.
+ * @param[out] out_bytes_received Total number of bytes received.
+ * @param[out] out_segment_size   Size of each received datagram.
+ * @param[out] buffer             Buffer to store the received data in.
+ * @param[in]  buffer_length      Number of bytes available in @p buffer .
+ *
+ * @returns @li 0 on success,
+ *          @li a negative value in case of error, in which case @p socket
+ *              errno (see @ref avs_net_socket_errno) is set to an appropriate
+ *              value.
+ */
+int avs_net_socket_receive_segmented(avs_net_abstract_socket_t *socket,
+                                     size_t *out_bytes_received,
+                                     size_t *out_segment_size,
+                                     void *buffer,
+                                     size_t buffer_length);
+
 /**
  * Binds @p socket to specified local @p address and @p port .
  *
@@ -813,6 +1236,50 @@ int avs_net_socket_bind(avs_net_abstract_socket_t *socket,
                         const char *address,
                         const char *port);
 
+/**
+ * Flag for @ref avs_net_socket_bind_reuse_port_group : distribute incoming
+ * traffic among the sockets based only on the remote IP address, so that all
+ * datagrams or connections from a given host are handled by the same socket,
+ * even if its source port changes (e.g. because of NAT rebinding). Currently
+ * only supported on Linux.
+ *
+ * By default, the system distributes traffic based on a hash of both the
+ * remote address and port.
+ */
+#define AVS_NET_SOCKET_GROUP_F_STEER_BY_PEER_ADDRESS (1 << 0)
+
+/**
+ * Creates @p count TCP or UDP sockets, all bound to the same local @p address
+ * and @p port using the <c>reuse_port</c> configuration flag. Each of the
+ * sockets has a separate queue of incoming datagrams or connections in the
+ * system, so they may be efficiently serviced from separate threads.
+ *
+ * If @p port is NULL, empty or "0", an ephemeral port is chosen for the first
+ * socket, and all the other ones are bound to the same port.
+ *
+ * @param out_sockets   Array of @p count pointers that will be filled with the
+ *                      created sockets. On error, it is filled with NULLs.
+ * @param count         Number of sockets to create, must be positive.
+ * @param type          Type of the sockets: @ref AVS_NET_TCP_SOCKET or
+ *                      @ref AVS_NET_UDP_SOCKET .
+ * @param configuration Configuration of the sockets, may be NULL. The
+ *                      <c>reuse_port</c> field is ignored and assumed to be 1.
+ * @param address       Local IP address to bind to.
+ * @param port          Local port to bind to.
+ * @param flags         Either 0 or @ref
+ *                      AVS_NET_SOCKET_GROUP_F_STEER_BY_PEER_ADDRESS .
+ *
+ * @returns 0 on success, a negative value in case of error.
+ */
+int avs_net_socket_bind_reuse_port_group(
+        avs_net_abstract_socket_t **out_sockets,
+        size_t count,
+        avs_net_socket_type_t type,
+        const avs_net_socket_configuration_t *configuration,
+        const char *address,
+        const char *port,
+        int flags);
+
 /**
  * Accepts an incoming connection targeted at @p server_socket and prepares
  * @p client_socket for communication with connecting host.
@@ -942,6 +1409,27 @@ int avs_net_socket_get_remote_hostname(avs_net_abstract_socket_t *socket,
 int avs_net_socket_get_remote_port(avs_net_abstract_socket_t *socket,
                                    char *out_buffer, size_t out_buffer_size);
 
+/**
+ * Returns the raw address of the remote endpoint @p socket is connected to.
+ *
+ * This is intended for code that needs to identify the remote endpoint on
+ * every packet, e.g. as a lookup key: unlike
+ * @ref avs_net_socket_get_remote_host and @ref avs_net_socket_get_remote_port,
+ * it does not involve converting the address to a string. Two sockets
+ * connected to the same remote endpoint yield byte-wise identical results.
+ *
+ * @param[in]  socket       Socket object to operate on.
+ * @param[out] out_endpoint Buffer to store the remote endpoint address in.
+ *
+ * @returns @li 0 on success,
+ *          @li a negative value in case of error, or if the socket
+ *              implementation does not support this operation; in the latter
+ *              case, @p socket errno is not modified.
+ */
+int avs_net_socket_get_remote_endpoint(
+        avs_net_abstract_socket_t *socket,
+        avs_net_resolved_endpoint_t *out_endpoint);
+
 /**
  * Returns the IP address @p socket is bound to.
  *
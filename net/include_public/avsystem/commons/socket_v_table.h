@@ -93,6 +93,52 @@ typedef int (*avs_net_socket_set_opt_t)(avs_net_abstract_socket_t *socket,
 
 typedef int (*avs_net_socket_errno_t)(avs_net_abstract_socket_t *socket);
 
+typedef int (*avs_net_socket_get_remote_endpoint_t)(
+        avs_net_abstract_socket_t *socket,
+        avs_net_resolved_endpoint_t *out_endpoint);
+
+typedef int (*avs_net_socket_receive_batch_t)(
+        avs_net_abstract_socket_t *socket,
+        size_t *out_received,
+        avs_net_socket_batch_msg_t *messages,
+        size_t count);
+
+typedef int (*avs_net_socket_send_to_batch_t)(
+        avs_net_abstract_socket_t *socket,
+        avs_net_socket_send_to_msg_t *messages,
+        size_t count);
+
+typedef int (*avs_net_socket_send_vec_t)(
+        avs_net_abstract_socket_t *socket,
+        const avs_net_socket_const_iovec_t *iov,
+        size_t iov_count);
+
+typedef int (*avs_net_socket_receive_vec_t)(
+        avs_net_abstract_socket_t *socket,
+        size_t *out_bytes_received,
+        const avs_net_socket_iovec_t *iov,
+        size_t iov_count);
+
+typedef int (*avs_net_socket_send_file_t)(
+        avs_net_abstract_socket_t *socket,
+        const void *file_handle,
+        avs_off_t offset,
+        size_t length,
+        size_t *out_bytes_sent);
+
+typedef int (*avs_net_socket_send_segmented_t)(
+        avs_net_abstract_socket_t *socket,
+        const void *buffer,
+        size_t buffer_length,
+        size_t segment_size);
+
+typedef int (*avs_net_socket_receive_segmented_t)(
+        avs_net_abstract_socket_t *socket,
+        size_t *out_bytes_received,
+        size_t *out_segment_size,
+        void *buffer,
+        size_t buffer_length);
+
 typedef struct {
     avs_net_socket_connect_t connect;
     avs_net_socket_decorate_t decorate;
@@ -115,6 +161,16 @@ typedef struct {
     avs_net_socket_get_opt_t get_opt;
     avs_net_socket_set_opt_t set_opt;
     avs_net_socket_errno_t get_errno;
+    /* Entries below are optional - they may be NULL or not initialized at all
+     * in socket implementations that do not support them. */
+    avs_net_socket_get_remote_endpoint_t get_remote_endpoint;
+    avs_net_socket_receive_batch_t receive_batch;
+    avs_net_socket_send_to_batch_t send_to_batch;
+    avs_net_socket_send_vec_t send_vec;
+    avs_net_socket_receive_vec_t receive_vec;
+    avs_net_socket_send_file_t send_file;
+    avs_net_socket_send_segmented_t send_segmented;
+    avs_net_socket_receive_segmented_t receive_segmented;
 } avs_net_socket_v_table_t;
 
 #ifdef	__cplusplus
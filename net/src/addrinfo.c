@@ -17,15 +17,270 @@
 #include <avs_commons_config.h>
 
 #include <assert.h>
+#include <stddef.h>
 #include <string.h>
 
+#include <avsystem/commons/memory.h>
+#include <avsystem/commons/mutex.h>
 #include <avsystem/commons/net.h>
 #include <avsystem/commons/utils.h>
 
+#include "global.h"
 #include "net_impl.h"
 
 VISIBILITY_SOURCE_BEGIN
 
+typedef struct addrinfo_cache_entry_struct {
+    struct addrinfo_cache_entry_struct *next_in_bucket;
+    /* neighbours in the list ordered by insertion time */
+    struct addrinfo_cache_entry_struct *older;
+    struct addrinfo_cache_entry_struct *newer;
+    uint32_t hash;
+    int family;
+    int socktype;
+    int flags;
+    avs_time_monotonic_t valid_until;
+    /* 0 for negative entries */
+    size_t num_endpoints;
+    avs_net_resolved_endpoint_t *endpoints;
+    char host[1]; // actually a FAM
+} addrinfo_cache_entry_t;
+
+static struct {
+    avs_mutex_t *mutex;
+    avs_net_addrinfo_cache_config_t config;
+    /* number of buckets is a power of two, or 0 if the cache is disabled */
+    addrinfo_cache_entry_t **buckets;
+    size_t num_buckets;
+    size_t num_entries;
+    addrinfo_cache_entry_t *oldest;
+    addrinfo_cache_entry_t *newest;
+} g_addrinfo_cache;
+
+static uint32_t cache_hash(const char *host, int family, int socktype,
+                           int flags) {
+    const int params[] = { family, socktype, flags };
+    return avs_hash_fnv1a32(
+            avs_hash_fnv1a32(AVS_HASH_FNV1A32_INIT, host, strlen(host)),
+            params, sizeof(params));
+}
+
+static addrinfo_cache_entry_t **cache_find(uint32_t hash,
+                                           const char *host,
+                                           int family,
+                                           int socktype,
+                                           int flags) {
+    addrinfo_cache_entry_t **entry_ptr =
+            &g_addrinfo_cache.buckets[hash & (g_addrinfo_cache.num_buckets - 1)];
+    for (; *entry_ptr; entry_ptr = &(*entry_ptr)->next_in_bucket) {
+        if ((*entry_ptr)->hash == hash
+                && (*entry_ptr)->family == family
+                && (*entry_ptr)->socktype == socktype
+                && (*entry_ptr)->flags == flags
+                && strcmp((*entry_ptr)->host, host) == 0) {
+            break;
+        }
+    }
+    return entry_ptr;
+}
+
+static void cache_remove(addrinfo_cache_entry_t **entry_ptr) {
+    addrinfo_cache_entry_t *entry = *entry_ptr;
+    *entry_ptr = entry->next_in_bucket;
+    if (entry->older) {
+        entry->older->newer = entry->newer;
+    } else {
+        g_addrinfo_cache.oldest = entry->newer;
+    }
+    if (entry->newer) {
+        entry->newer->older = entry->older;
+    } else {
+        g_addrinfo_cache.newest = entry->older;
+    }
+    --g_addrinfo_cache.num_entries;
+    avs_free(entry->endpoints);
+    avs_free(entry);
+}
+
+static void cache_clear(void) {
+    while (g_addrinfo_cache.oldest) {
+        addrinfo_cache_entry_t *entry = g_addrinfo_cache.oldest;
+        cache_remove(cache_find(entry->hash, entry->host, entry->family,
+                                entry->socktype, entry->flags));
+    }
+}
+
+static void cache_reset(void) {
+    cache_clear();
+    avs_free(g_addrinfo_cache.buckets);
+    g_addrinfo_cache.buckets = NULL;
+    g_addrinfo_cache.num_buckets = 0;
+    memset(&g_addrinfo_cache.config, 0, sizeof(g_addrinfo_cache.config));
+}
+
+int _avs_net_initialize_global_addrinfo_cache(void) {
+    return avs_mutex_create(&g_addrinfo_cache.mutex);
+}
+
+void _avs_net_cleanup_global_addrinfo_cache(void) {
+    cache_reset();
+    avs_mutex_cleanup(&g_addrinfo_cache.mutex);
+}
+
+int avs_net_addrinfo_cache_configure(
+        const avs_net_addrinfo_cache_config_t *config) {
+    if (_avs_net_ensure_global_state()) {
+        LOG(ERROR, "avs_net global state initialization error");
+        return -1;
+    }
+    if (avs_mutex_lock(g_addrinfo_cache.mutex)) {
+        return -1;
+    }
+    int result = 0;
+    cache_reset();
+    if (config && config->max_entries > 0) {
+        size_t num_buckets = 1;
+        while (num_buckets < config->max_entries && num_buckets <= SIZE_MAX / 4) {
+            num_buckets *= 2;
+        }
+        g_addrinfo_cache.buckets = (addrinfo_cache_entry_t **) avs_calloc(
+                num_buckets, sizeof(*g_addrinfo_cache.buckets));
+        if (!g_addrinfo_cache.buckets) {
+            LOG(ERROR, "Out of memory");
+            result = -1;
+        } else {
+            g_addrinfo_cache.num_buckets = num_buckets;
+            g_addrinfo_cache.config = *config;
+        }
+    }
+    avs_mutex_unlock(g_addrinfo_cache.mutex);
+    return result;
+}
+
+void avs_net_addrinfo_cache_flush(void) {
+    if (_avs_net_ensure_global_state()
+            || avs_mutex_lock(g_addrinfo_cache.mutex)) {
+        return;
+    }
+    cache_clear();
+    avs_mutex_unlock(g_addrinfo_cache.mutex);
+}
+
+bool _avs_net_addrinfo_cache_enabled(void) {
+    if (avs_mutex_lock(g_addrinfo_cache.mutex)) {
+        return false;
+    }
+    bool enabled = (g_addrinfo_cache.num_buckets > 0);
+    avs_mutex_unlock(g_addrinfo_cache.mutex);
+    return enabled;
+}
+
+int _avs_net_addrinfo_cache_lookup(const char *host,
+                                   int family,
+                                   int socktype,
+                                   int flags,
+                                   avs_net_resolved_endpoint_t **out_endpoints,
+                                   size_t *out_count) {
+    if (avs_mutex_lock(g_addrinfo_cache.mutex)) {
+        return -1;
+    }
+    int result = AVS_NET_ADDRINFO_CACHE_MISS;
+    if (g_addrinfo_cache.num_buckets > 0) {
+        addrinfo_cache_entry_t **entry_ptr =
+                cache_find(cache_hash(host, family, socktype, flags),
+                           host, family, socktype, flags);
+        if (*entry_ptr
+                && !avs_time_monotonic_before((*entry_ptr)->valid_until,
+                                              avs_time_monotonic_now())) {
+            const addrinfo_cache_entry_t *entry = *entry_ptr;
+            *out_endpoints = NULL;
+            *out_count = entry->num_endpoints;
+            result = 0;
+            if (entry->num_endpoints) {
+                size_t size = entry->num_endpoints * sizeof(**out_endpoints);
+                if (!(*out_endpoints = (avs_net_resolved_endpoint_t *)
+                              avs_malloc(size))) {
+                    LOG(ERROR, "Out of memory");
+                    result = -1;
+                } else {
+                    memcpy(*out_endpoints, entry->endpoints, size);
+                }
+            }
+        } else if (*entry_ptr) {
+            cache_remove(entry_ptr);
+        }
+    }
+    avs_mutex_unlock(g_addrinfo_cache.mutex);
+    return result;
+}
+
+void _avs_net_addrinfo_cache_store(const char *host,
+                                   int family,
+                                   int socktype,
+                                   int flags,
+                                   const avs_net_resolved_endpoint_t *endpoints,
+                                   size_t count) {
+    if (avs_mutex_lock(g_addrinfo_cache.mutex)) {
+        return;
+    }
+    const avs_time_duration_t ttl = count ? g_addrinfo_cache.config.ttl
+                                          : g_addrinfo_cache.config.negative_ttl;
+    if (g_addrinfo_cache.num_buckets == 0
+            || !avs_time_duration_less(AVS_TIME_DURATION_ZERO, ttl)) {
+        goto finish;
+    }
+
+    uint32_t hash = cache_hash(host, family, socktype, flags);
+    addrinfo_cache_entry_t **entry_ptr =
+            cache_find(hash, host, family, socktype, flags);
+    if (*entry_ptr) {
+        cache_remove(entry_ptr);
+    }
+    while (g_addrinfo_cache.num_entries >= g_addrinfo_cache.config.max_entries) {
+        addrinfo_cache_entry_t *oldest = g_addrinfo_cache.oldest;
+        cache_remove(cache_find(oldest->hash, oldest->host, oldest->family,
+                                oldest->socktype, oldest->flags));
+    }
+
+    size_t host_size = strlen(host) + 1;
+    addrinfo_cache_entry_t *entry = (addrinfo_cache_entry_t *) avs_calloc(
+            1, offsetof(addrinfo_cache_entry_t, host) + host_size);
+    if (!entry) {
+        goto finish;
+    }
+    if (count) {
+        entry->endpoints = (avs_net_resolved_endpoint_t *) avs_malloc(
+                count * sizeof(*endpoints));
+        if (!entry->endpoints) {
+            avs_free(entry);
+            goto finish;
+        }
+        memcpy(entry->endpoints, endpoints, count * sizeof(*endpoints));
+    }
+    entry->hash = hash;
+    entry->family = family;
+    entry->socktype = socktype;
+    entry->flags = flags;
+    entry->valid_until = avs_time_monotonic_add(avs_time_monotonic_now(), ttl);
+    entry->num_endpoints = count;
+    memcpy(entry->host, host, host_size);
+
+    entry_ptr = &g_addrinfo_cache.buckets[hash
+                                          & (g_addrinfo_cache.num_buckets - 1)];
+    entry->next_in_bucket = *entry_ptr;
+    *entry_ptr = entry;
+    entry->older = g_addrinfo_cache.newest;
+    if (g_addrinfo_cache.newest) {
+        g_addrinfo_cache.newest->newer = entry;
+    } else {
+        g_addrinfo_cache.oldest = entry;
+    }
+    g_addrinfo_cache.newest = entry;
+    ++g_addrinfo_cache.num_entries;
+finish:
+    avs_mutex_unlock(g_addrinfo_cache.mutex);
+}
+
 avs_net_addrinfo_t *avs_net_addrinfo_resolve(
         avs_net_socket_type_t socket_type,
         avs_net_af_t family,
@@ -53,3 +308,7 @@ int avs_net_resolve_host_simple(avs_net_socket_type_t socket_type,
     avs_net_addrinfo_delete(&info);
     return result;
 }
+
+#ifdef AVS_UNIT_TESTING
+#include "test/addrinfo.c"
+#endif // AVS_UNIT_TESTING
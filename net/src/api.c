@@ -17,11 +17,13 @@
 #define AVS_NET_API_C
 #include <avs_commons_config.h>
 
+#include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
 
+#include <avsystem/commons/errno.h>
 #include <avsystem/commons/memory.h>
 #include <avsystem/commons/net.h>
 #include <avsystem/commons/socket.h>
@@ -181,6 +183,27 @@ int avs_net_socket_send_to(avs_net_abstract_socket_t *socket,
                                        host, port);
 }
 
+int avs_net_socket_send_to_batch(avs_net_abstract_socket_t *socket,
+                                 avs_net_socket_send_to_msg_t *messages,
+                                 size_t count) {
+    if (socket->operations->send_to_batch) {
+        return socket->operations->send_to_batch(socket, messages, count);
+    }
+
+    int result = 0;
+    for (size_t i = 0; i < count; ++i) {
+        messages[i].error_code = 0;
+        messages[i].resolved_endpoint.size = 0;
+        if (avs_net_socket_send_to(socket, messages[i].buffer,
+                                   messages[i].buffer_length,
+                                   messages[i].host, messages[i].port)) {
+            messages[i].error_code = avs_net_socket_errno(socket);
+            result = -1;
+        }
+    }
+    return result;
+}
+
 int avs_net_socket_receive(avs_net_abstract_socket_t *socket,
                            size_t *out_bytes_received,
                            void *buffer,
@@ -201,12 +224,233 @@ int avs_net_socket_receive_from(avs_net_abstract_socket_t *socket,
                                             port, port_size);
 }
 
+int avs_net_socket_receive_batch(avs_net_abstract_socket_t *socket,
+                                 size_t *out_received,
+                                 avs_net_socket_batch_msg_t *messages,
+                                 size_t count) {
+    assert(count > 0);
+    if (socket->operations->receive_batch) {
+        return socket->operations->receive_batch(socket, out_received,
+                                                 messages, count);
+    }
+
+    *out_received = 0;
+    messages[0].error_code = 0;
+    int result = avs_net_socket_receive(socket, &messages[0].bytes_received,
+                                        messages[0].buffer,
+                                        messages[0].buffer_length);
+    if (result && avs_net_socket_errno(socket) == EMSGSIZE) {
+        messages[0].error_code = EMSGSIZE;
+        result = 0;
+    }
+    if (!result) {
+        *out_received = 1;
+    }
+    return result;
+}
+
+int _avs_net_socket_send_vec_coalesced(avs_net_abstract_socket_t *socket,
+                                       const avs_net_socket_const_iovec_t *iov,
+                                       size_t iov_count) {
+    if (iov_count == 1) {
+        return avs_net_socket_send(socket, iov[0].buffer, iov[0].buffer_length);
+    }
+    size_t total_length = 0;
+    for (size_t i = 0; i < iov_count; ++i) {
+        total_length += iov[i].buffer_length;
+    }
+    char *buffer = (char *) avs_malloc(total_length ? total_length : 1);
+    if (!buffer) {
+        LOG(ERROR, "Out of memory");
+        return -1;
+    }
+    size_t offset = 0;
+    for (size_t i = 0; i < iov_count; ++i) {
+        if (iov[i].buffer_length) {
+            memcpy(buffer + offset, iov[i].buffer, iov[i].buffer_length);
+            offset += iov[i].buffer_length;
+        }
+    }
+    int result = avs_net_socket_send(socket, buffer, total_length);
+    avs_free(buffer);
+    return result;
+}
+
+int avs_net_socket_send_vec(avs_net_abstract_socket_t *socket,
+                            const avs_net_socket_const_iovec_t *iov,
+                            size_t iov_count) {
+    if (socket->operations->send_vec) {
+        return socket->operations->send_vec(socket, iov, iov_count);
+    }
+    return _avs_net_socket_send_vec_coalesced(socket, iov, iov_count);
+}
+
+int _avs_net_socket_receive_vec_bounced(avs_net_abstract_socket_t *socket,
+                                        size_t *out_bytes_received,
+                                        const avs_net_socket_iovec_t *iov,
+                                        size_t iov_count) {
+    if (iov_count == 1) {
+        return avs_net_socket_receive(socket, out_bytes_received,
+                                      iov[0].buffer, iov[0].buffer_length);
+    }
+    size_t total_length = 0;
+    for (size_t i = 0; i < iov_count; ++i) {
+        total_length += iov[i].buffer_length;
+    }
+    char *buffer = (char *) avs_malloc(total_length ? total_length : 1);
+    if (!buffer) {
+        LOG(ERROR, "Out of memory");
+        *out_bytes_received = 0;
+        return -1;
+    }
+    int result = avs_net_socket_receive(socket, out_bytes_received,
+                                        buffer, total_length);
+    size_t offset = 0;
+    for (size_t i = 0; i < iov_count && offset < *out_bytes_received; ++i) {
+        size_t chunk = AVS_MIN(iov[i].buffer_length,
+                               *out_bytes_received - offset);
+        memcpy(iov[i].buffer, buffer + offset, chunk);
+        offset += chunk;
+    }
+    avs_free(buffer);
+    return result;
+}
+
+int avs_net_socket_receive_vec(avs_net_abstract_socket_t *socket,
+                               size_t *out_bytes_received,
+                               const avs_net_socket_iovec_t *iov,
+                               size_t iov_count) {
+    if (socket->operations->receive_vec) {
+        return socket->operations->receive_vec(socket, out_bytes_received,
+                                                iov, iov_count);
+    }
+    return _avs_net_socket_receive_vec_bounced(socket, out_bytes_received,
+                                               iov, iov_count);
+}
+
+int avs_net_socket_send_file(avs_net_abstract_socket_t *socket,
+                             const void *file_handle,
+                             avs_off_t offset,
+                             size_t length,
+                             size_t *out_bytes_sent) {
+    if (socket->operations->send_file) {
+        return socket->operations->send_file(socket, file_handle, offset,
+                                             length, out_bytes_sent);
+    }
+    *out_bytes_sent = 0;
+    return AVS_NET_SOCKET_SEND_FILE_UNSUPPORTED;
+}
+
+int _avs_net_socket_send_segmented_separately(avs_net_abstract_socket_t *socket,
+                                              const void *buffer,
+                                              size_t buffer_length,
+                                              size_t segment_size) {
+    size_t offset = 0;
+    /* send at least one segment, even if zero-length - hence do..while */
+    do {
+        size_t length = AVS_MIN(segment_size, buffer_length - offset);
+        if (avs_net_socket_send(socket, (const char *) buffer + offset,
+                                length)) {
+            return -1;
+        }
+        offset += length;
+    } while (offset < buffer_length);
+    return 0;
+}
+
+int avs_net_socket_send_segmented(avs_net_abstract_socket_t *socket,
+                                  const void *buffer,
+                                  size_t buffer_length,
+                                  size_t segment_size) {
+    if (!segment_size) {
+        LOG(ERROR, "segment size must be positive");
+        return -1;
+    }
+    if (socket->operations->send_segmented) {
+        return socket->operations->send_segmented(socket, buffer, buffer_length,
+                                                  segment_size);
+    }
+    return _avs_net_socket_send_segmented_separately(socket, buffer,
+                                                     buffer_length,
+                                                     segment_size);
+}
+
+int avs_net_socket_receive_segmented(avs_net_abstract_socket_t *socket,
+                                     size_t *out_bytes_received,
+                                     size_t *out_segment_size,
+                                     void *buffer,
+                                     size_t buffer_length) {
+    if (socket->operations->receive_segmented) {
+        return socket->operations->receive_segmented(
+                socket, out_bytes_received, out_segment_size,
+                buffer, buffer_length);
+    }
+    int result = avs_net_socket_receive(socket, out_bytes_received,
+                                        buffer, buffer_length);
+    *out_segment_size = *out_bytes_received;
+    return result;
+}
+
 int avs_net_socket_bind(avs_net_abstract_socket_t *socket,
                         const char *address,
                         const char *port) {
     return socket->operations->bind(socket, address, port);
 }
 
+int avs_net_socket_bind_reuse_port_group(
+        avs_net_abstract_socket_t **out_sockets,
+        size_t count,
+        avs_net_socket_type_t type,
+        const avs_net_socket_configuration_t *configuration,
+        const char *address,
+        const char *port,
+        int flags) {
+    if (!count
+            || (type != AVS_NET_TCP_SOCKET && type != AVS_NET_UDP_SOCKET)) {
+        LOG(ERROR, "invalid socket group parameters");
+        return -1;
+    }
+    avs_net_socket_configuration_t config;
+    if (configuration) {
+        config = *configuration;
+    } else {
+        memset(&config, 0, sizeof(config));
+    }
+    config.reuse_port = 1;
+
+    for (size_t i = 0; i < count; ++i) {
+        out_sockets[i] = NULL;
+    }
+    char bound_port[NET_PORT_SIZE];
+    for (size_t i = 0; i < count; ++i) {
+        if (avs_net_socket_create(&out_sockets[i], type, &config)
+                || avs_net_socket_bind(out_sockets[i], address,
+                                       i ? bound_port : port)) {
+            LOG(ERROR, "could not bind socket %lu of the group",
+                (unsigned long) i);
+            goto error;
+        }
+        if (!i && avs_net_socket_get_local_port(out_sockets[0], bound_port,
+                                                sizeof(bound_port))) {
+            goto error;
+        }
+    }
+    if ((flags & AVS_NET_SOCKET_GROUP_F_STEER_BY_PEER_ADDRESS) && count > 1) {
+        const void *system_socket = avs_net_socket_get_system(out_sockets[0]);
+        if (!system_socket
+                || _avs_net_attach_peer_address_steering(system_socket,
+                                                         count)) {
+            goto error;
+        }
+    }
+    return 0;
+error:
+    for (size_t i = 0; i < count; ++i) {
+        avs_net_socket_cleanup(&out_sockets[i]);
+    }
+    return -1;
+}
+
 int avs_net_socket_accept(avs_net_abstract_socket_t *server_socket,
                           avs_net_abstract_socket_t *client_socket) {
     return server_socket->operations->accept(server_socket, client_socket);
@@ -261,6 +505,15 @@ int avs_net_socket_get_remote_port(avs_net_abstract_socket_t *socket,
                                                out_buffer, out_buffer_size);
 }
 
+int avs_net_socket_get_remote_endpoint(
+        avs_net_abstract_socket_t *socket,
+        avs_net_resolved_endpoint_t *out_endpoint) {
+    if (!socket->operations->get_remote_endpoint) {
+        return -1;
+    }
+    return socket->operations->get_remote_endpoint(socket, out_endpoint);
+}
+
 int avs_net_socket_get_local_host(avs_net_abstract_socket_t *socket,
                                   char *out_buffer, size_t out_buffer_size) {
     return socket->operations->get_local_host(socket,
@@ -428,6 +681,29 @@ static int send_to_debug(avs_net_abstract_socket_t *debug_socket,
     return result;
 }
 
+static int send_to_batch_debug(avs_net_abstract_socket_t *debug_socket,
+                               avs_net_socket_send_to_msg_t *messages,
+                               size_t count) {
+    int result = avs_net_socket_send_to_batch(
+            ((avs_net_socket_debug_t *) debug_socket)->socket,
+            messages, count);
+    for (size_t i = 0; i < count; ++i) {
+        if (messages[i].error_code) {
+            fprintf(communication_log, "\n----SEND-TO-FAILURE-----\n");
+        } else {
+            fprintf(communication_log, "\n--------SEND-TO---------\n");
+            fprintf(communication_log, "%s:%s\n",
+                    messages[i].host, messages[i].port);
+            fprintf(communication_log, "------------------------\n");
+            fwrite(messages[i].buffer, 1, messages[i].buffer_length,
+                   communication_log);
+            fprintf(communication_log, "\n--------SEND-END--------\n");
+        }
+    }
+    fflush(communication_log);
+    return result;
+}
+
 static int receive_debug(avs_net_abstract_socket_t *debug_socket,
                          size_t *out_bytes_received,
                          void *buffer,
@@ -570,6 +846,153 @@ static int remote_port_debug(avs_net_abstract_socket_t *debug_socket,
     return result;
 }
 
+static int remote_endpoint_debug(avs_net_abstract_socket_t *debug_socket,
+                                 avs_net_resolved_endpoint_t *out_endpoint) {
+    int result = avs_net_socket_get_remote_endpoint(
+            ((avs_net_socket_debug_t *) debug_socket)->socket, out_endpoint);
+    if (result) {
+        fprintf(communication_log, "cannot get remote endpoint\n");
+    } else {
+        fprintf(communication_log, "remote endpoint: %u bytes\n",
+                (unsigned) out_endpoint->size);
+    }
+    return result;
+}
+
+static int receive_batch_debug(avs_net_abstract_socket_t *debug_socket,
+                               size_t *out_received,
+                               avs_net_socket_batch_msg_t *messages,
+                               size_t count) {
+    int result = avs_net_socket_receive_batch(
+            ((avs_net_socket_debug_t *) debug_socket)->socket,
+            out_received, messages, count);
+    if (result < 0) {
+        fprintf(communication_log, "\n---RECV-BATCH-FAILURE---\n");
+    } else {
+        for (size_t i = 0; i < *out_received; ++i) {
+            fprintf(communication_log, "\n----------RECV----------\n");
+            fwrite(messages[i].buffer, 1, messages[i].bytes_received,
+                   communication_log);
+            fprintf(communication_log, "\n--------RECV-END--------\n");
+        }
+        fflush(communication_log);
+    }
+    return result;
+}
+
+static int send_vec_debug(avs_net_abstract_socket_t *debug_socket,
+                          const avs_net_socket_const_iovec_t *iov,
+                          size_t iov_count) {
+    int result = avs_net_socket_send_vec(
+            ((avs_net_socket_debug_t *) debug_socket)->socket, iov, iov_count);
+    if (result) {
+        fprintf(communication_log, "\n------SEND-FAILURE------\n");
+    } else {
+        fprintf(communication_log, "\n----------SEND----------\n");
+        for (size_t i = 0; i < iov_count; ++i) {
+            fwrite(iov[i].buffer, 1, iov[i].buffer_length, communication_log);
+        }
+        fprintf(communication_log, "\n--------SEND-END--------\n");
+        fflush(communication_log);
+    }
+    return result;
+}
+
+static int receive_vec_debug(avs_net_abstract_socket_t *debug_socket,
+                             size_t *out_bytes_received,
+                             const avs_net_socket_iovec_t *iov,
+                             size_t iov_count) {
+    int result = avs_net_socket_receive_vec(
+            ((avs_net_socket_debug_t *) debug_socket)->socket,
+            out_bytes_received, iov, iov_count);
+    if (result < 0) {
+        fprintf(communication_log, "\n------RECV-FAILURE------\n");
+    } else {
+        fprintf(communication_log, "\n----------RECV----------\n");
+        size_t left = *out_bytes_received;
+        for (size_t i = 0; i < iov_count && left; ++i) {
+            size_t chunk = AVS_MIN(iov[i].buffer_length, left);
+            fwrite(iov[i].buffer, 1, chunk, communication_log);
+            left -= chunk;
+        }
+        fprintf(communication_log, "\n--------RECV-END--------\n");
+        fflush(communication_log);
+    }
+    return result;
+}
+
+static int send_file_debug(avs_net_abstract_socket_t *debug_socket,
+                           const void *file_handle,
+                           avs_off_t offset,
+                           size_t length,
+                           size_t *out_bytes_sent) {
+    int result = avs_net_socket_send_file(
+            ((avs_net_socket_debug_t *) debug_socket)->socket,
+            file_handle, offset, length, out_bytes_sent);
+    if (result < 0) {
+        fprintf(communication_log, "\n------SEND-FAILURE------\n");
+    } else if (!result) {
+        fprintf(communication_log,
+                "\n-------SEND-FILE--------\n"
+                "%lu bytes at offset %ld"
+                "\n--------SEND-END--------\n",
+                (unsigned long) *out_bytes_sent, (long) offset);
+    }
+    fflush(communication_log);
+    return result;
+}
+
+static int send_segmented_debug(avs_net_abstract_socket_t *debug_socket,
+                                const void *buffer,
+                                size_t buffer_length,
+                                size_t segment_size) {
+    int result = avs_net_socket_send_segmented(
+            ((avs_net_socket_debug_t *) debug_socket)->socket,
+            buffer, buffer_length, segment_size);
+    if (result) {
+        fprintf(communication_log, "\n------SEND-FAILURE------\n");
+    } else {
+        size_t offset = 0;
+        do {
+            size_t length = AVS_MIN(segment_size, buffer_length - offset);
+            fprintf(communication_log, "\n----------SEND----------\n");
+            fwrite((const char *) buffer + offset, 1, length,
+                   communication_log);
+            fprintf(communication_log, "\n--------SEND-END--------\n");
+            offset += length;
+        } while (offset < buffer_length);
+    }
+    fflush(communication_log);
+    return result;
+}
+
+static int receive_segmented_debug(avs_net_abstract_socket_t *debug_socket,
+                                   size_t *out_bytes_received,
+                                   size_t *out_segment_size,
+                                   void *buffer,
+                                   size_t buffer_length) {
+    int result = avs_net_socket_receive_segmented(
+            ((avs_net_socket_debug_t *) debug_socket)->socket,
+            out_bytes_received, out_segment_size, buffer, buffer_length);
+    if (result < 0) {
+        fprintf(communication_log, "\n------RECV-FAILURE------\n");
+    } else {
+        size_t segment_size = *out_segment_size ? *out_segment_size
+                                                : *out_bytes_received;
+        size_t offset = 0;
+        do {
+            size_t length = AVS_MIN(segment_size, *out_bytes_received - offset);
+            fprintf(communication_log, "\n----------RECV----------\n");
+            fwrite((const char *) buffer + offset, 1, length,
+                   communication_log);
+            fprintf(communication_log, "\n--------RECV-END--------\n");
+            offset += length;
+        } while (offset < *out_bytes_received);
+    }
+    fflush(communication_log);
+    return result;
+}
+
 static int local_host_debug(avs_net_abstract_socket_t *debug_socket,
                             char *out_buffer, size_t out_buffer_size) {
     int result = avs_net_socket_get_local_host(
@@ -667,7 +1090,15 @@ static const avs_net_socket_v_table_t debug_vtable = {
     local_port_debug,
     get_opt_debug,
     set_opt_debug,
-    errno_debug
+    errno_debug,
+    remote_endpoint_debug,
+    receive_batch_debug,
+    send_to_batch_debug,
+    send_vec_debug,
+    receive_vec_debug,
+    send_file_debug,
+    send_segmented_debug,
+    receive_segmented_debug
 };
 
 static int create_socket_debug(avs_net_abstract_socket_t **debug_socket,
@@ -34,10 +34,20 @@ static int initialize_global(void *unused) {
             _avs_net_cleanup_global_compat_state();
         }
     }
+    if (!result) {
+        result = _avs_net_initialize_global_addrinfo_cache();
+        if (result) {
+            _avs_net_cleanup_global_ssl_state();
+            _avs_net_cleanup_global_compat_state();
+        }
+    }
     return result;
 }
 
 void _avs_net_cleanup_global_state(void) {
+    // resolver threads use the rest of the global state, so stop them first
+    _avs_net_cleanup_global_async_resolver();
+    _avs_net_cleanup_global_addrinfo_cache();
     _avs_net_cleanup_global_ssl_state();
     _avs_net_cleanup_global_compat_state();
     g_net_init_handle = NULL;
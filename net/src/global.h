@@ -32,6 +32,16 @@ void _avs_net_cleanup_global_ssl_state(void);
 #define _avs_net_cleanup_global_ssl_state(...) ((void) 0)
 #endif // WITH_SSL
 
+#ifdef WITH_AVS_NET_ASYNC_RESOLVER
+void _avs_net_cleanup_global_async_resolver(void);
+#else // WITH_AVS_NET_ASYNC_RESOLVER
+#define _avs_net_cleanup_global_async_resolver(...) ((void) 0)
+#endif // WITH_AVS_NET_ASYNC_RESOLVER
+
+int _avs_net_initialize_global_addrinfo_cache(void);
+
+void _avs_net_cleanup_global_addrinfo_cache(void);
+
 int _avs_net_ensure_global_state(void);
 void _avs_net_cleanup_global_state(void);
 
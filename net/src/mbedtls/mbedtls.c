@@ -93,6 +93,9 @@ typedef struct {
     avs_net_abstract_socket_t *backend_socket;
     int error_code;
     avs_net_socket_configuration_t backend_configuration;
+    /* scratch space of send_vec_ssl(), allocated on first use */
+    char *send_vec_buffer;
+    size_t send_vec_buffer_size;
 } ssl_socket_t;
 
 static bool is_ssl_started(ssl_socket_t *socket) {
@@ -108,6 +111,11 @@ static mbedtls_ssl_context *get_context(ssl_socket_t *socket) {
     return &socket->context;
 }
 
+static bool has_buffered_data(ssl_socket_t *socket) {
+    return socket->flags.context_valid
+            && mbedtls_ssl_get_bytes_avail(get_context(socket)) > 0;
+}
+
 #ifdef WITH_MBEDTLS_LOGS
 static void debug_mbedtls(void *ctx, int level, const char *file, int line, const char *str) {
     (void) ctx;
@@ -790,6 +798,7 @@ static int cleanup_ssl(avs_net_abstract_socket_t **socket_) {
 #endif // WITH_PSK
     mbedtls_ssl_config_free(&(*socket)->config);
 
+    avs_free((*socket)->send_vec_buffer);
     avs_free(*socket);
     *socket = NULL;
     return 0;
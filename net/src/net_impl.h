@@ -17,6 +17,7 @@
 #ifndef NET_H
 #define NET_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include <avsystem/commons/socket_v_table.h>
@@ -63,6 +64,84 @@ int _avs_net_create_tcp_socket(avs_net_abstract_socket_t **socket,
 int _avs_net_create_udp_socket(avs_net_abstract_socket_t **socket,
                                const void *socket_configuration);
 
+/**
+ * Value returned by @ref _avs_net_addrinfo_cache_lookup if there is no valid
+ * entry for the query.
+ */
+#define AVS_NET_ADDRINFO_CACHE_MISS 1
+
+/**
+ * Looks up a cached result of address resolution. <c>family</c>,
+ * <c>socktype</c> and <c>flags</c> are opaque values defined by the compat
+ * layer, e.g. <c>getaddrinfo()</c> hints.
+ *
+ * @returns @li 0 on a cache hit, in which case <c>*out_endpoints</c> is set to
+ *              a heap-allocated array of <c>*out_count</c> endpoints that the
+ *              caller needs to avs_free(). <c>*out_count</c> is 0 and
+ *              <c>*out_endpoints</c> is NULL if the host name is cached as
+ *              nonexistent,
+ *          @li AVS_NET_ADDRINFO_CACHE_MISS if the query is not cached or the
+ *              cache is disabled,
+ *          @li a negative value in case of error.
+ */
+int _avs_net_addrinfo_cache_lookup(const char *host,
+                                   int family,
+                                   int socktype,
+                                   int flags,
+                                   avs_net_resolved_endpoint_t **out_endpoints,
+                                   size_t *out_count);
+
+/**
+ * @returns true if @ref _avs_net_addrinfo_cache_store would actually store
+ *          anything, allowing the caller to skip preparing the data.
+ */
+bool _avs_net_addrinfo_cache_enabled(void);
+
+/**
+ * Stores a result of address resolution in the cache. @p count equal to 0
+ * marks @p host as nonexistent. Failures are silently ignored.
+ */
+void _avs_net_addrinfo_cache_store(const char *host,
+                                   int family,
+                                   int socktype,
+                                   int flags,
+                                   const avs_net_resolved_endpoint_t *endpoints,
+                                   size_t count);
+
+/**
+ * Implements @ref avs_net_socket_send_vec by copying all segments into a
+ * temporary buffer and calling @ref avs_net_socket_send once.
+ */
+int _avs_net_socket_send_vec_coalesced(avs_net_abstract_socket_t *socket,
+                                       const avs_net_socket_const_iovec_t *iov,
+                                       size_t iov_count);
+
+/**
+ * Implements @ref avs_net_socket_receive_vec by calling
+ * @ref avs_net_socket_receive with a temporary buffer and copying the data
+ * into the segments.
+ */
+int _avs_net_socket_receive_vec_bounced(avs_net_abstract_socket_t *socket,
+                                        size_t *out_bytes_received,
+                                        const avs_net_socket_iovec_t *iov,
+                                        size_t iov_count);
+
+/**
+ * Implements @ref avs_net_socket_send_segmented by calling
+ * @ref avs_net_socket_send for each segment.
+ */
+int _avs_net_socket_send_segmented_separately(avs_net_abstract_socket_t *socket,
+                                              const void *buffer,
+                                              size_t buffer_length,
+                                              size_t segment_size);
+
+/**
+ * Attaches a program to the SO_REUSEPORT group that @p system_socket belongs
+ * to, that selects one of @p group_size sockets based on the remote IP address.
+ */
+int _avs_net_attach_peer_address_steering(const void *system_socket,
+                                          size_t group_size);
+
 #ifdef WITH_SSL
 int _avs_net_create_ssl_socket(avs_net_abstract_socket_t **socket,
                                const void *socket_configuration);
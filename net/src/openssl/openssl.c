@@ -91,6 +91,9 @@ typedef struct {
     avs_net_dtls_handshake_timeouts_t dtls_handshake_timeouts;
     avs_net_socket_configuration_t backend_configuration;
     avs_net_resolved_endpoint_t endpoint_buffer;
+    /* scratch space of send_vec_ssl(), allocated on first use */
+    char *send_vec_buffer;
+    size_t send_vec_buffer_size;
 
 #ifdef WITH_PSK
     avs_net_owned_psk_t psk;
@@ -670,6 +673,10 @@ static bool is_session_resumed(ssl_socket_t *socket) {
     return false;
 }
 
+static bool has_buffered_data(ssl_socket_t *socket) {
+    return socket->ssl && SSL_pending(socket->ssl) > 0;
+}
+
 #ifdef WITH_X509
 static int configure_ssl_certs(ssl_socket_t *socket,
                                const avs_net_certificate_info_t *cert_info) {
@@ -928,6 +935,7 @@ static int cleanup_ssl(avs_net_abstract_socket_t **socket_) {
         SSL_CTX_free((*socket)->ctx);
         (*socket)->ctx = NULL;
     }
+    avs_free((*socket)->send_vec_buffer);
     avs_free(*socket);
     *socket = NULL;
     return 0;
@@ -0,0 +1,567 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <avs_commons_config.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <avsystem/commons/errno.h>
+#include <avsystem/commons/memory.h>
+#include <avsystem/commons/socket.h>
+#include <avsystem/commons/socket_v_table.h>
+
+#include "net_impl.h"
+
+VISIBILITY_SOURCE_BEGIN
+
+typedef struct {
+    const avs_net_socket_v_table_t * const operations;
+    avs_net_abstract_socket_t *socket;
+    /* errno of the last operation, captured before querying poll wait time,
+     * which resets the error code of the wrapped socket */
+    int error_code;
+    avs_net_socket_stats_t stats;
+} instrumented_socket_t;
+
+typedef struct {
+    avs_time_monotonic_t start;
+    avs_time_duration_t poll_wait_start;
+    bool poll_wait_valid;
+} measurement_t;
+
+#define WRAP_ERRNO(Socket, Retval, ...) do { \
+    Retval = (__VA_ARGS__); \
+    (Socket)->error_code = avs_net_socket_errno((Socket)->socket); \
+} while (0)
+
+static int get_poll_wait_time(avs_net_abstract_socket_t *socket,
+                              avs_time_duration_t *out_time) {
+    avs_net_socket_opt_value_t value;
+    if (avs_net_socket_get_opt(socket, AVS_NET_SOCKET_OPT_POLL_WAIT_TIME,
+                               &value)) {
+        return -1;
+    }
+    *out_time = value.poll_wait_time;
+    return 0;
+}
+
+static void measurement_begin(instrumented_socket_t *socket,
+                              measurement_t *out_measurement) {
+    out_measurement->poll_wait_valid =
+            !get_poll_wait_time(socket->socket,
+                                &out_measurement->poll_wait_start);
+    out_measurement->start = avs_time_monotonic_now();
+}
+
+static size_t latency_bucket(avs_time_duration_t latency) {
+    int64_t us;
+    if (avs_time_duration_to_scalar(&us, AVS_TIME_US, latency)) {
+        return AVS_NET_SOCKET_STATS_LATENCY_BUCKETS - 1;
+    }
+    size_t bucket = 0;
+    while (us > 0 && bucket < AVS_NET_SOCKET_STATS_LATENCY_BUCKETS - 1) {
+        us >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+static bool is_timeout(int error_code) {
+    return error_code == ETIMEDOUT || error_code == EAGAIN
+            || error_code == EWOULDBLOCK;
+}
+
+static void measurement_end(instrumented_socket_t *socket,
+                            const measurement_t *measurement,
+                            avs_net_socket_op_stats_t *stats,
+                            int result,
+                            size_t bytes) {
+    avs_time_duration_t latency =
+            avs_time_monotonic_diff(avs_time_monotonic_now(),
+                                    measurement->start);
+    socket->error_code = avs_net_socket_errno(socket->socket);
+
+    ++stats->calls;
+    if (result) {
+        ++stats->errors;
+        if (is_timeout(socket->error_code)) {
+            ++stats->timeouts;
+        }
+    }
+    stats->bytes += bytes;
+    stats->total_time = avs_time_duration_add(stats->total_time, latency);
+    ++stats->latency_histogram[latency_bucket(latency)];
+
+    avs_time_duration_t poll_wait_end;
+    if (measurement->poll_wait_valid
+            && !get_poll_wait_time(socket->socket, &poll_wait_end)) {
+        stats->poll_wait_time = avs_time_duration_add(
+                stats->poll_wait_time,
+                avs_time_duration_diff(poll_wait_end,
+                                       measurement->poll_wait_start));
+    }
+}
+
+static int connect_instrumented(avs_net_abstract_socket_t *socket_,
+                                const char *host,
+                                const char *port) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    measurement_t measurement;
+    measurement_begin(socket, &measurement);
+    int result = avs_net_socket_connect(socket->socket, host, port);
+    measurement_end(socket, &measurement, &socket->stats.connect, result, 0);
+    return result;
+}
+
+static int decorate_instrumented(avs_net_abstract_socket_t *socket_,
+                                 avs_net_abstract_socket_t *backend_socket) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    int result;
+    WRAP_ERRNO(socket, result,
+               avs_net_socket_decorate(socket->socket, backend_socket));
+    return result;
+}
+
+static int send_instrumented(avs_net_abstract_socket_t *socket_,
+                             const void *buffer,
+                             size_t buffer_length) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    measurement_t measurement;
+    measurement_begin(socket, &measurement);
+    int result = avs_net_socket_send(socket->socket, buffer, buffer_length);
+    measurement_end(socket, &measurement, &socket->stats.send, result,
+                    result ? 0 : buffer_length);
+    return result;
+}
+
+static int send_to_instrumented(avs_net_abstract_socket_t *socket_,
+                                const void *buffer,
+                                size_t buffer_length,
+                                const char *host,
+                                const char *port) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    measurement_t measurement;
+    measurement_begin(socket, &measurement);
+    int result = avs_net_socket_send_to(socket->socket, buffer, buffer_length,
+                                        host, port);
+    measurement_end(socket, &measurement, &socket->stats.send, result,
+                    result ? 0 : buffer_length);
+    return result;
+}
+
+static int send_to_batch_instrumented(avs_net_abstract_socket_t *socket_,
+                                      avs_net_socket_send_to_msg_t *messages,
+                                      size_t count) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    measurement_t measurement;
+    measurement_begin(socket, &measurement);
+    int result = avs_net_socket_send_to_batch(socket->socket, messages, count);
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!messages[i].error_code) {
+            bytes += messages[i].buffer_length;
+        }
+    }
+    measurement_end(socket, &measurement, &socket->stats.send, result, bytes);
+    return result;
+}
+
+static int receive_instrumented(avs_net_abstract_socket_t *socket_,
+                                size_t *out_bytes_received,
+                                void *buffer,
+                                size_t buffer_length) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    measurement_t measurement;
+    measurement_begin(socket, &measurement);
+    *out_bytes_received = 0;
+    int result = avs_net_socket_receive(socket->socket, out_bytes_received,
+                                        buffer, buffer_length);
+    measurement_end(socket, &measurement, &socket->stats.receive, result,
+                    *out_bytes_received);
+    return result;
+}
+
+static int receive_from_instrumented(avs_net_abstract_socket_t *socket_,
+                                     size_t *out_bytes_received,
+                                     void *buffer,
+                                     size_t buffer_length,
+                                     char *host, size_t host_size,
+                                     char *port, size_t port_size) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    measurement_t measurement;
+    measurement_begin(socket, &measurement);
+    *out_bytes_received = 0;
+    int result = avs_net_socket_receive_from(
+            socket->socket, out_bytes_received, buffer, buffer_length,
+            host, host_size, port, port_size);
+    measurement_end(socket, &measurement, &socket->stats.receive, result,
+                    *out_bytes_received);
+    return result;
+}
+
+static int receive_batch_instrumented(avs_net_abstract_socket_t *socket_,
+                                      size_t *out_received,
+                                      avs_net_socket_batch_msg_t *messages,
+                                      size_t count) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    measurement_t measurement;
+    measurement_begin(socket, &measurement);
+    *out_received = 0;
+    int result = avs_net_socket_receive_batch(socket->socket, out_received,
+                                              messages, count);
+    size_t bytes = 0;
+    for (size_t i = 0; i < *out_received; ++i) {
+        bytes += messages[i].bytes_received;
+    }
+    measurement_end(socket, &measurement, &socket->stats.receive, result,
+                    bytes);
+    return result;
+}
+
+static int send_vec_instrumented(avs_net_abstract_socket_t *socket_,
+                                 const avs_net_socket_const_iovec_t *iov,
+                                 size_t iov_count) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    measurement_t measurement;
+    measurement_begin(socket, &measurement);
+    int result = avs_net_socket_send_vec(socket->socket, iov, iov_count);
+    size_t bytes = 0;
+    if (!result) {
+        for (size_t i = 0; i < iov_count; ++i) {
+            bytes += iov[i].buffer_length;
+        }
+    }
+    measurement_end(socket, &measurement, &socket->stats.send, result, bytes);
+    return result;
+}
+
+static int receive_vec_instrumented(avs_net_abstract_socket_t *socket_,
+                                    size_t *out_bytes_received,
+                                    const avs_net_socket_iovec_t *iov,
+                                    size_t iov_count) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    measurement_t measurement;
+    measurement_begin(socket, &measurement);
+    *out_bytes_received = 0;
+    int result = avs_net_socket_receive_vec(socket->socket, out_bytes_received,
+                                            iov, iov_count);
+    measurement_end(socket, &measurement, &socket->stats.receive, result,
+                    *out_bytes_received);
+    return result;
+}
+
+static int send_file_instrumented(avs_net_abstract_socket_t *socket_,
+                                  const void *file_handle,
+                                  avs_off_t offset,
+                                  size_t length,
+                                  size_t *out_bytes_sent) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    measurement_t measurement;
+    measurement_begin(socket, &measurement);
+    *out_bytes_sent = 0;
+    int result = avs_net_socket_send_file(socket->socket, file_handle, offset,
+                                          length, out_bytes_sent);
+    if (result == AVS_NET_SOCKET_SEND_FILE_UNSUPPORTED) {
+        // nothing has been attempted, the caller will fall back to send()
+        socket->error_code = avs_net_socket_errno(socket->socket);
+    } else {
+        measurement_end(socket, &measurement, &socket->stats.send, result,
+                        *out_bytes_sent);
+    }
+    return result;
+}
+
+static int send_segmented_instrumented(avs_net_abstract_socket_t *socket_,
+                                       const void *buffer,
+                                       size_t buffer_length,
+                                       size_t segment_size) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    measurement_t measurement;
+    measurement_begin(socket, &measurement);
+    int result = avs_net_socket_send_segmented(socket->socket, buffer,
+                                               buffer_length, segment_size);
+    measurement_end(socket, &measurement, &socket->stats.send, result,
+                    result ? 0 : buffer_length);
+    return result;
+}
+
+static int receive_segmented_instrumented(avs_net_abstract_socket_t *socket_,
+                                          size_t *out_bytes_received,
+                                          size_t *out_segment_size,
+                                          void *buffer,
+                                          size_t buffer_length) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    measurement_t measurement;
+    measurement_begin(socket, &measurement);
+    *out_bytes_received = 0;
+    int result = avs_net_socket_receive_segmented(
+            socket->socket, out_bytes_received, out_segment_size, buffer,
+            buffer_length);
+    measurement_end(socket, &measurement, &socket->stats.receive, result,
+                    *out_bytes_received);
+    return result;
+}
+
+static int bind_instrumented(avs_net_abstract_socket_t *socket_,
+                             const char *localaddr,
+                             const char *port) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    int result;
+    WRAP_ERRNO(socket, result,
+               avs_net_socket_bind(socket->socket, localaddr, port));
+    return result;
+}
+
+static int cleanup_instrumented(avs_net_abstract_socket_t **socket_) {
+    instrumented_socket_t **socket = (instrumented_socket_t **) socket_;
+    avs_net_socket_cleanup(&(*socket)->socket);
+    avs_free(*socket);
+    *socket = NULL;
+    return 0;
+}
+
+static bool is_instrumented(avs_net_abstract_socket_t *socket) {
+    return ((instrumented_socket_t *) socket)->operations->cleanup
+            == cleanup_instrumented;
+}
+
+static avs_net_abstract_socket_t *
+unwrap_socket(avs_net_abstract_socket_t *socket) {
+    if (is_instrumented(socket)) {
+        return ((instrumented_socket_t *) socket)->socket;
+    }
+    return socket;
+}
+
+static int accept_instrumented(avs_net_abstract_socket_t *server_socket_,
+                               avs_net_abstract_socket_t *new_socket) {
+    instrumented_socket_t *server_socket =
+            (instrumented_socket_t *) server_socket_;
+    measurement_t measurement;
+    measurement_begin(server_socket, &measurement);
+    int result = avs_net_socket_accept(server_socket->socket,
+                                       unwrap_socket(new_socket));
+    measurement_end(server_socket, &measurement,
+                    &server_socket->stats.connect, result, 0);
+    return result;
+}
+
+static int close_instrumented(avs_net_abstract_socket_t *socket_) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    int result;
+    WRAP_ERRNO(socket, result, avs_net_socket_close(socket->socket));
+    return result;
+}
+
+static int shutdown_instrumented(avs_net_abstract_socket_t *socket_) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    int result;
+    WRAP_ERRNO(socket, result, avs_net_socket_shutdown(socket->socket));
+    return result;
+}
+
+static int system_socket_instrumented(avs_net_abstract_socket_t *socket_,
+                                      const void **out) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    *out = avs_net_socket_get_system(socket->socket);
+    return *out ? 0 : -1;
+}
+
+static int
+interface_name_instrumented(avs_net_abstract_socket_t *socket_,
+                            avs_net_socket_interface_name_t *if_name) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    int result;
+    WRAP_ERRNO(socket, result,
+               avs_net_socket_interface_name(socket->socket, if_name));
+    return result;
+}
+
+static int remote_host_instrumented(avs_net_abstract_socket_t *socket_,
+                                    char *out_buffer,
+                                    size_t out_buffer_size) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    int result;
+    WRAP_ERRNO(socket, result,
+               avs_net_socket_get_remote_host(socket->socket, out_buffer,
+                                              out_buffer_size));
+    return result;
+}
+
+static int remote_hostname_instrumented(avs_net_abstract_socket_t *socket_,
+                                        char *out_buffer,
+                                        size_t out_buffer_size) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    int result;
+    WRAP_ERRNO(socket, result,
+               avs_net_socket_get_remote_hostname(socket->socket, out_buffer,
+                                                  out_buffer_size));
+    return result;
+}
+
+static int remote_port_instrumented(avs_net_abstract_socket_t *socket_,
+                                    char *out_buffer,
+                                    size_t out_buffer_size) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    int result;
+    WRAP_ERRNO(socket, result,
+               avs_net_socket_get_remote_port(socket->socket, out_buffer,
+                                              out_buffer_size));
+    return result;
+}
+
+static int
+remote_endpoint_instrumented(avs_net_abstract_socket_t *socket_,
+                             avs_net_resolved_endpoint_t *out_endpoint) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    int result;
+    WRAP_ERRNO(socket, result,
+               avs_net_socket_get_remote_endpoint(socket->socket,
+                                                  out_endpoint));
+    return result;
+}
+
+static int local_host_instrumented(avs_net_abstract_socket_t *socket_,
+                                   char *out_buffer,
+                                   size_t out_buffer_size) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    int result;
+    WRAP_ERRNO(socket, result,
+               avs_net_socket_get_local_host(socket->socket, out_buffer,
+                                             out_buffer_size));
+    return result;
+}
+
+static int local_port_instrumented(avs_net_abstract_socket_t *socket_,
+                                   char *out_buffer,
+                                   size_t out_buffer_size) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    int result;
+    WRAP_ERRNO(socket, result,
+               avs_net_socket_get_local_port(socket->socket, out_buffer,
+                                             out_buffer_size));
+    return result;
+}
+
+static int get_opt_instrumented(avs_net_abstract_socket_t *socket_,
+                                avs_net_socket_opt_key_t option_key,
+                                avs_net_socket_opt_value_t *out_option_value) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    int result;
+    WRAP_ERRNO(socket, result,
+               avs_net_socket_get_opt(socket->socket, option_key,
+                                      out_option_value));
+    return result;
+}
+
+static int set_opt_instrumented(avs_net_abstract_socket_t *socket_,
+                                avs_net_socket_opt_key_t option_key,
+                                avs_net_socket_opt_value_t option_value) {
+    instrumented_socket_t *socket = (instrumented_socket_t *) socket_;
+    int result;
+    WRAP_ERRNO(socket, result,
+               avs_net_socket_set_opt(socket->socket, option_key,
+                                      option_value));
+    return result;
+}
+
+static int errno_instrumented(avs_net_abstract_socket_t *socket) {
+    return ((instrumented_socket_t *) socket)->error_code;
+}
+
+static const avs_net_socket_v_table_t instrumented_vtable = {
+    connect_instrumented,
+    decorate_instrumented,
+    send_instrumented,
+    send_to_instrumented,
+    receive_instrumented,
+    receive_from_instrumented,
+    bind_instrumented,
+    accept_instrumented,
+    close_instrumented,
+    shutdown_instrumented,
+    cleanup_instrumented,
+    system_socket_instrumented,
+    interface_name_instrumented,
+    remote_host_instrumented,
+    remote_hostname_instrumented,
+    remote_port_instrumented,
+    local_host_instrumented,
+    local_port_instrumented,
+    get_opt_instrumented,
+    set_opt_instrumented,
+    errno_instrumented,
+    remote_endpoint_instrumented,
+    receive_batch_instrumented,
+    send_to_batch_instrumented,
+    send_vec_instrumented,
+    receive_vec_instrumented,
+    send_file_instrumented,
+    send_segmented_instrumented,
+    receive_segmented_instrumented
+};
+
+int avs_net_socket_instrument(avs_net_abstract_socket_t **socket) {
+    if (!*socket) {
+        LOG(ERROR, "cannot instrument a NULL socket");
+        return -1;
+    }
+    const avs_net_socket_v_table_t *const VTABLE_PTR = &instrumented_vtable;
+    instrumented_socket_t *instrumented = (instrumented_socket_t *)
+            avs_calloc(1, sizeof(instrumented_socket_t));
+    if (!instrumented) {
+        LOG(ERROR, "Out of memory");
+        return -1;
+    }
+    memcpy((void *) (intptr_t) &instrumented->operations,
+           &VTABLE_PTR, sizeof(VTABLE_PTR));
+    instrumented->socket = *socket;
+    *socket = (avs_net_abstract_socket_t *) instrumented;
+    return 0;
+}
+
+static instrumented_socket_t *
+get_instrumented(avs_net_abstract_socket_t *socket) {
+    if (!socket || !is_instrumented(socket)) {
+        LOG(ERROR, "socket is not instrumented");
+        return NULL;
+    }
+    return (instrumented_socket_t *) socket;
+}
+
+int avs_net_socket_get_stats(avs_net_abstract_socket_t *socket,
+                             avs_net_socket_stats_t *out_stats) {
+    instrumented_socket_t *instrumented = get_instrumented(socket);
+    if (!instrumented) {
+        return -1;
+    }
+    *out_stats = instrumented->stats;
+    return 0;
+}
+
+int avs_net_socket_reset_stats(avs_net_abstract_socket_t *socket) {
+    instrumented_socket_t *instrumented = get_instrumented(socket);
+    if (!instrumented) {
+        return -1;
+    }
+    memset(&instrumented->stats, 0, sizeof(instrumented->stats));
+    return 0;
+}
+
+#ifdef AVS_UNIT_TESTING
+#include "test/socket_stats.c"
+#endif // AVS_UNIT_TESTING
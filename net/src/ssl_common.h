@@ -30,6 +30,7 @@ VISIBILITY_PRIVATE_HEADER_BEGIN
 /* Required non-common static method implementations */
 static bool is_ssl_started(ssl_socket_t *socket);
 static bool is_session_resumed(ssl_socket_t *socket);
+static bool has_buffered_data(ssl_socket_t *socket);
 static int start_ssl(ssl_socket_t *socket, const char *host);
 static void close_ssl_raw(ssl_socket_t *socket);
 static int get_dtls_overhead(ssl_socket_t *socket,
@@ -72,6 +73,8 @@ static int set_opt_ssl(avs_net_abstract_socket_t *net_socket,
                        avs_net_socket_opt_key_t option_key,
                        avs_net_socket_opt_value_t option_value);
 static int errno_ssl(avs_net_abstract_socket_t *net_socket);
+static int remote_endpoint_ssl(avs_net_abstract_socket_t *socket,
+                               avs_net_resolved_endpoint_t *out_endpoint);
 
 #define WRAP_ERRNO_IMPL(SslSocket, BackendSocket, Retval, ...) do { \
     if (BackendSocket) { \
@@ -291,6 +294,16 @@ static int remote_port_ssl(avs_net_abstract_socket_t *socket_,
     return retval;
 }
 
+static int remote_endpoint_ssl(avs_net_abstract_socket_t *socket_,
+                               avs_net_resolved_endpoint_t *out_endpoint) {
+    ssl_socket_t *socket = (ssl_socket_t *) socket_;
+    int retval;
+    WRAP_ERRNO(socket, retval,
+               avs_net_socket_get_remote_endpoint(socket->backend_socket,
+                                                  out_endpoint));
+    return retval;
+}
+
 static int local_host_ssl(avs_net_abstract_socket_t *socket_,
                           char *out_buffer, size_t out_buffer_size) {
     ssl_socket_t *socket = (ssl_socket_t *) socket_;
@@ -311,6 +324,105 @@ static int local_port_ssl(avs_net_abstract_socket_t *socket_,
     return retval;
 }
 
+/* Segments shorter than this are coalesced with their neighbours into
+ * a single send_ssl() call, and thus a single record; longer ones are passed
+ * to send_ssl() mostly as they are, without copying. */
+#define SSL_SEND_VEC_COALESCE_SIZE 1024
+
+/**
+ * Makes sure that socket->send_vec_buffer can hold at least @p size bytes.
+ * The buffer is kept for subsequent calls, so that it is not reallocated on
+ * every send.
+ */
+static int reserve_send_vec_buffer(ssl_socket_t *socket, size_t size) {
+    if (socket->send_vec_buffer_size >= size) {
+        return 0;
+    }
+    char *buffer = (char *) avs_realloc(socket->send_vec_buffer, size);
+    if (!buffer) {
+        LOG(ERROR, "Out of memory");
+        socket->error_code = ENOMEM;
+        return -1;
+    }
+    socket->send_vec_buffer = buffer;
+    socket->send_vec_buffer_size = size;
+    return 0;
+}
+
+/**
+ * For DTLS, all segments need to form a single record, so they are always
+ * copied together. For TLS, only short segments are coalesced; a long one is
+ * used to top up the already coalesced data, and the rest of it is sent
+ * directly.
+ */
+static int send_vec_ssl(avs_net_abstract_socket_t *socket_,
+                        const avs_net_socket_const_iovec_t *iov,
+                        size_t iov_count) {
+    ssl_socket_t *socket = (ssl_socket_t *) socket_;
+    if (iov_count == 1) {
+        return send_ssl(socket_, iov[0].buffer, iov[0].buffer_length);
+    }
+
+    if (socket->backend_type != AVS_NET_TCP_SOCKET) {
+        size_t total_length = 0;
+        for (size_t i = 0; i < iov_count; ++i) {
+            total_length += iov[i].buffer_length;
+        }
+        if (reserve_send_vec_buffer(socket, AVS_MAX(total_length, 1))) {
+            return -1;
+        }
+        size_t filled = 0;
+        for (size_t i = 0; i < iov_count; ++i) {
+            if (iov[i].buffer_length) {
+                memcpy(socket->send_vec_buffer + filled, iov[i].buffer,
+                       iov[i].buffer_length);
+                filled += iov[i].buffer_length;
+            }
+        }
+        return send_ssl(socket_, socket->send_vec_buffer, filled);
+    }
+
+    if (reserve_send_vec_buffer(socket, SSL_SEND_VEC_COALESCE_SIZE)) {
+        return -1;
+    }
+    char *const buffer = socket->send_vec_buffer;
+    int result = 0;
+    size_t filled = 0;
+    bool sent_any = false;
+    for (size_t i = 0; !result && i < iov_count; ++i) {
+        const char *data = (const char *) iov[i].buffer;
+        size_t left = iov[i].buffer_length;
+        if (left >= SSL_SEND_VEC_COALESCE_SIZE) {
+            if (filled) {
+                const size_t chunk = SSL_SEND_VEC_COALESCE_SIZE - filled;
+                memcpy(buffer + filled, data, chunk);
+                data += chunk;
+                left -= chunk;
+                result = send_ssl(socket_, buffer, SSL_SEND_VEC_COALESCE_SIZE);
+                filled = 0;
+            }
+            if (!result) {
+                result = send_ssl(socket_, data, left);
+            }
+            sent_any = true;
+        } else {
+            if (filled + left > SSL_SEND_VEC_COALESCE_SIZE) {
+                result = send_ssl(socket_, buffer, filled);
+                filled = 0;
+                sent_any = true;
+            }
+            if (left) {
+                memcpy(buffer + filled, data, left);
+                filled += left;
+            }
+        }
+    }
+    if (!result && (filled || !sent_any)) {
+        result = send_ssl(socket_, buffer, filled);
+    }
+    return result;
+}
+
 static int errno_ssl(avs_net_abstract_socket_t *net_socket) {
     return ((ssl_socket_t *) net_socket)->error_code;
 }
@@ -370,6 +482,12 @@ static int get_opt_ssl(avs_net_abstract_socket_t *ssl_socket_,
     case AVS_NET_SOCKET_OPT_SESSION_RESUMED:
         out_option_value->flag = is_session_resumed(ssl_socket);
         return 0;
+    case AVS_NET_SOCKET_OPT_HAS_BUFFERED_DATA:
+        out_option_value->flag = has_buffered_data(ssl_socket);
+        return 0;
+    case AVS_NET_SOCKET_OPT_NATIVE_SEND_VEC:
+        out_option_value->flag = true;
+        return 0;
     case AVS_NET_SOCKET_OPT_STATE:
         if (!ssl_socket->backend_socket) {
             out_option_value->state = AVS_NET_SOCKET_STATE_CLOSED;
@@ -462,7 +580,15 @@ static const avs_net_socket_v_table_t ssl_vtable = {
     local_port_ssl,
     get_opt_ssl,
     set_opt_ssl,
-    errno_ssl
+    errno_ssl,
+    remote_endpoint_ssl,
+    NULL, // receive_batch
+    NULL, // send_to_batch
+    send_vec_ssl,
+    NULL, // receive_vec
+    NULL, // send_file
+    NULL, // send_segmented
+    NULL // receive_segmented
 };
 
 static const avs_net_dtls_handshake_timeouts_t
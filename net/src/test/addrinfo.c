@@ -0,0 +1,165 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <avs_commons_config.h>
+
+#include <avsystem/commons/unit/test.h>
+
+static const avs_net_addrinfo_cache_config_t TEST_CACHE_CONFIG = {
+    .max_entries = 2,
+    .ttl = { 60, 0 },
+    .negative_ttl = { 10, 0 }
+};
+
+static avs_net_resolved_endpoint_t test_endpoint(char value) {
+    avs_net_resolved_endpoint_t endpoint;
+    memset(&endpoint, 0, sizeof(endpoint));
+    endpoint.size = 16;
+    memset(endpoint.data.buf, value, endpoint.size);
+    return endpoint;
+}
+
+static int lookup_test_host(const char *host,
+                            avs_net_resolved_endpoint_t **out_endpoints,
+                            size_t *out_count) {
+    return _avs_net_addrinfo_cache_lookup(host, 1, 2, 3,
+                                          out_endpoints, out_count);
+}
+
+AVS_UNIT_TEST(addrinfo_cache, disabled_by_default) {
+    avs_net_resolved_endpoint_t endpoint = test_endpoint('a');
+    avs_net_resolved_endpoint_t *endpoints = NULL;
+    size_t count = 0;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_addrinfo_cache_configure(NULL));
+    AVS_UNIT_ASSERT_FALSE(_avs_net_addrinfo_cache_enabled());
+    _avs_net_addrinfo_cache_store("host", 1, 2, 3, &endpoint, 1);
+    AVS_UNIT_ASSERT_EQUAL(lookup_test_host("host", &endpoints, &count),
+                          AVS_NET_ADDRINFO_CACHE_MISS);
+}
+
+AVS_UNIT_TEST(addrinfo_cache, store_lookup_evict) {
+    avs_net_resolved_endpoint_t stored[] = {
+        test_endpoint('a'), test_endpoint('b')
+    };
+    avs_net_resolved_endpoint_t *endpoints = NULL;
+    size_t count = 0;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_addrinfo_cache_configure(&TEST_CACHE_CONFIG));
+
+    _avs_net_addrinfo_cache_store("first", 1, 2, 3, stored, 2);
+    _avs_net_addrinfo_cache_store("second", 1, 2, 3, NULL, 0);
+
+    AVS_UNIT_ASSERT_SUCCESS(lookup_test_host("first", &endpoints, &count));
+    AVS_UNIT_ASSERT_EQUAL(count, 2);
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(endpoints, stored, sizeof(stored));
+    avs_free(endpoints);
+
+    // different query parameters are a different entry
+    AVS_UNIT_ASSERT_EQUAL(_avs_net_addrinfo_cache_lookup("first", 1, 2, 4,
+                                                         &endpoints, &count),
+                          AVS_NET_ADDRINFO_CACHE_MISS);
+
+    // negative entry
+    AVS_UNIT_ASSERT_SUCCESS(lookup_test_host("second", &endpoints, &count));
+    AVS_UNIT_ASSERT_EQUAL(count, 0);
+    AVS_UNIT_ASSERT_NULL(endpoints);
+
+    // third entry evicts the oldest one
+    _avs_net_addrinfo_cache_store("third", 1, 2, 3, stored, 1);
+    AVS_UNIT_ASSERT_EQUAL(lookup_test_host("first", &endpoints, &count),
+                          AVS_NET_ADDRINFO_CACHE_MISS);
+    AVS_UNIT_ASSERT_SUCCESS(lookup_test_host("second", &endpoints, &count));
+    AVS_UNIT_ASSERT_SUCCESS(lookup_test_host("third", &endpoints, &count));
+    AVS_UNIT_ASSERT_EQUAL(count, 1);
+    avs_free(endpoints);
+
+    avs_net_addrinfo_cache_flush();
+    AVS_UNIT_ASSERT_EQUAL(lookup_test_host("third", &endpoints, &count),
+                          AVS_NET_ADDRINFO_CACHE_MISS);
+    AVS_UNIT_ASSERT_TRUE(_avs_net_addrinfo_cache_enabled());
+
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_addrinfo_cache_configure(NULL));
+}
+
+AVS_UNIT_TEST(addrinfo_cache, expiry) {
+    avs_net_addrinfo_cache_config_t config = TEST_CACHE_CONFIG;
+    config.negative_ttl = AVS_TIME_DURATION_ZERO;
+    config.ttl = avs_time_duration_from_scalar(1, AVS_TIME_NS);
+    avs_net_resolved_endpoint_t endpoint = test_endpoint('a');
+    avs_net_resolved_endpoint_t *endpoints = NULL;
+    size_t count = 0;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_addrinfo_cache_configure(&config));
+
+    // negative caching disabled
+    _avs_net_addrinfo_cache_store("host", 1, 2, 3, NULL, 0);
+    AVS_UNIT_ASSERT_EQUAL(lookup_test_host("host", &endpoints, &count),
+                          AVS_NET_ADDRINFO_CACHE_MISS);
+
+    _avs_net_addrinfo_cache_store("host", 1, 2, 3, &endpoint, 1);
+    avs_time_monotonic_t deadline = avs_time_monotonic_add(
+            avs_time_monotonic_now(),
+            avs_time_duration_from_scalar(1, AVS_TIME_MS));
+    while (avs_time_monotonic_before(avs_time_monotonic_now(), deadline)) {
+    }
+    AVS_UNIT_ASSERT_EQUAL(lookup_test_host("host", &endpoints, &count),
+                          AVS_NET_ADDRINFO_CACHE_MISS);
+    AVS_UNIT_ASSERT_NULL(g_addrinfo_cache.oldest);
+
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_addrinfo_cache_configure(NULL));
+}
+
+AVS_UNIT_TEST(addrinfo_cache, resolve_uses_cache) {
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_addrinfo_cache_configure(&TEST_CACHE_CONFIG));
+
+    avs_net_addrinfo_t *info =
+            avs_net_addrinfo_resolve(AVS_NET_UDP_SOCKET, AVS_NET_AF_UNSPEC,
+                                     "localhost", "1234", NULL);
+    AVS_UNIT_ASSERT_NOT_NULL(info);
+    AVS_UNIT_ASSERT_EQUAL(g_addrinfo_cache.num_entries, 1);
+    avs_net_resolved_endpoint_t resolved;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_addrinfo_next(info, &resolved));
+    avs_net_addrinfo_delete(&info);
+
+    // replace the cached result with a known address
+    char host[64];
+    char port[16];
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_resolved_endpoint_get_host_port(
+            &resolved, host, sizeof(host), NULL, 0));
+    addrinfo_cache_entry_t *entry = g_addrinfo_cache.newest;
+    AVS_UNIT_ASSERT_NOT_NULL(entry);
+    entry->num_endpoints = 1;
+    entry->endpoints[0] = resolved;
+
+    info = avs_net_addrinfo_resolve(AVS_NET_UDP_SOCKET, AVS_NET_AF_UNSPEC,
+                                    "localhost", "4321", NULL);
+    AVS_UNIT_ASSERT_NOT_NULL(info);
+    avs_net_resolved_endpoint_t cached;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_addrinfo_next(info, &cached));
+    AVS_UNIT_ASSERT_EQUAL(avs_net_addrinfo_next(info, &cached),
+                          AVS_NET_ADDRINFO_END);
+    avs_net_addrinfo_rewind(info);
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_addrinfo_next(info, &cached));
+    avs_net_addrinfo_delete(&info);
+
+    char cached_host[64];
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_resolved_endpoint_get_host_port(
+            &cached, cached_host, sizeof(cached_host), port, sizeof(port)));
+    AVS_UNIT_ASSERT_EQUAL_STRING(cached_host, host);
+    AVS_UNIT_ASSERT_EQUAL_STRING(port, "4321");
+
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_addrinfo_cache_configure(NULL));
+}
@@ -0,0 +1,230 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <avs_commons_config.h>
+
+#include <avsystem/commons/unit/test.h>
+
+static void
+create_instrumented_udp_pair(avs_net_abstract_socket_t **out_receiver,
+                             avs_net_abstract_socket_t **out_sender) {
+    avs_net_socket_configuration_t config;
+    memset(&config, 0, sizeof(config));
+    config.address_family = AVS_NET_AF_INET4;
+    *out_receiver = NULL;
+    *out_sender = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_create(
+            out_receiver, AVS_NET_UDP_SOCKET, &config));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_instrument(out_receiver));
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_bind(*out_receiver, "127.0.0.1", "0"));
+    char port[NET_PORT_SIZE];
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_get_local_port(
+            *out_receiver, port, sizeof(port)));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_create(
+            out_sender, AVS_NET_UDP_SOCKET, &config));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_instrument(out_sender));
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_connect(*out_sender, "127.0.0.1", port));
+}
+
+static uint64_t histogram_sum(const avs_net_socket_op_stats_t *stats) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < AVS_NET_SOCKET_STATS_LATENCY_BUCKETS; ++i) {
+        sum += stats->latency_histogram[i];
+    }
+    return sum;
+}
+
+AVS_UNIT_TEST(socket_stats, latency_bucket) {
+    AVS_UNIT_ASSERT_EQUAL(latency_bucket(AVS_TIME_DURATION_ZERO), 0);
+    AVS_UNIT_ASSERT_EQUAL(
+            latency_bucket(avs_time_duration_from_scalar(1, AVS_TIME_US)), 1);
+    AVS_UNIT_ASSERT_EQUAL(
+            latency_bucket(avs_time_duration_from_scalar(3, AVS_TIME_US)), 2);
+    AVS_UNIT_ASSERT_EQUAL(
+            latency_bucket(avs_time_duration_from_scalar(4, AVS_TIME_US)), 3);
+    AVS_UNIT_ASSERT_EQUAL(
+            latency_bucket(avs_time_duration_from_scalar(1, AVS_TIME_HOUR)),
+            AVS_NET_SOCKET_STATS_LATENCY_BUCKETS - 1);
+    AVS_UNIT_ASSERT_EQUAL(latency_bucket(AVS_TIME_DURATION_INVALID),
+                          AVS_NET_SOCKET_STATS_LATENCY_BUCKETS - 1);
+}
+
+AVS_UNIT_TEST(socket_stats, udp_traffic_and_timeout) {
+    avs_net_abstract_socket_t *receiver;
+    avs_net_abstract_socket_t *sender;
+    create_instrumented_udp_pair(&receiver, &sender);
+
+    for (int i = 0; i < 3; ++i) {
+        AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_send(sender, "hello", 5));
+    }
+    char buf[16];
+    size_t received;
+    char host[NET_MAX_HOSTNAME_SIZE];
+    char port[NET_PORT_SIZE];
+    for (int i = 0; i < 3; ++i) {
+        AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_receive_from(
+                receiver, &received, buf, sizeof(buf), host, sizeof(host),
+                port, sizeof(port)));
+        AVS_UNIT_ASSERT_EQUAL(received, 5);
+    }
+
+    const avs_net_socket_opt_value_t timeout = {
+        .recv_timeout = avs_time_duration_from_scalar(50, AVS_TIME_MS)
+    };
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_set_opt(
+            receiver, AVS_NET_SOCKET_OPT_RECV_TIMEOUT, timeout));
+    AVS_UNIT_ASSERT_FAILED(
+            avs_net_socket_receive(receiver, &received, buf, sizeof(buf)));
+    // errno survives querying the poll wait time of the wrapped socket
+    AVS_UNIT_ASSERT_EQUAL(avs_net_socket_errno(receiver), ETIMEDOUT);
+
+    avs_net_socket_stats_t stats;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_get_stats(sender, &stats));
+    AVS_UNIT_ASSERT_EQUAL(stats.send.calls, 3);
+    AVS_UNIT_ASSERT_EQUAL(stats.send.errors, 0);
+    AVS_UNIT_ASSERT_EQUAL(stats.send.bytes, 15);
+    AVS_UNIT_ASSERT_EQUAL(histogram_sum(&stats.send), 3);
+    AVS_UNIT_ASSERT_EQUAL(stats.receive.calls, 0);
+    AVS_UNIT_ASSERT_EQUAL(stats.connect.calls, 1);
+
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_get_stats(receiver, &stats));
+    AVS_UNIT_ASSERT_EQUAL(stats.receive.calls, 4);
+    AVS_UNIT_ASSERT_EQUAL(stats.receive.errors, 1);
+    AVS_UNIT_ASSERT_EQUAL(stats.receive.timeouts, 1);
+    AVS_UNIT_ASSERT_EQUAL(stats.receive.bytes, 15);
+    AVS_UNIT_ASSERT_EQUAL(histogram_sum(&stats.receive), 4);
+    int64_t total_ms;
+    int64_t poll_wait_ms;
+    AVS_UNIT_ASSERT_SUCCESS(avs_time_duration_to_scalar(
+            &total_ms, AVS_TIME_MS, stats.receive.total_time));
+    AVS_UNIT_ASSERT_SUCCESS(avs_time_duration_to_scalar(
+            &poll_wait_ms, AVS_TIME_MS, stats.receive.poll_wait_time));
+    AVS_UNIT_ASSERT_TRUE(poll_wait_ms >= 40);
+    AVS_UNIT_ASSERT_TRUE(total_ms >= poll_wait_ms);
+
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_reset_stats(receiver));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_get_stats(receiver, &stats));
+    AVS_UNIT_ASSERT_EQUAL(stats.receive.calls, 0);
+    AVS_UNIT_ASSERT_EQUAL(histogram_sum(&stats.receive), 0);
+    AVS_UNIT_ASSERT_TRUE(avs_time_duration_equal(stats.receive.total_time,
+                                                 AVS_TIME_DURATION_ZERO));
+
+    avs_net_socket_cleanup(&sender);
+    avs_net_socket_cleanup(&receiver);
+}
+
+AVS_UNIT_TEST(socket_stats, tcp_accept) {
+    avs_net_abstract_socket_t *server = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&server, AVS_NET_TCP_SOCKET, NULL));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_instrument(&server));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_bind(server, "127.0.0.1", "0"));
+    char port[NET_PORT_SIZE];
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_get_local_port(server, port, sizeof(port)));
+
+    avs_net_abstract_socket_t *client = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&client, AVS_NET_TCP_SOCKET, NULL));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_connect(client, "127.0.0.1", port));
+
+    avs_net_abstract_socket_t *accepted = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&accepted, AVS_NET_TCP_SOCKET, NULL));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_instrument(&accepted));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_accept(server, accepted));
+
+    const avs_net_socket_const_iovec_t iov[] = {
+        { "hel", 3 },
+        { "lo", 2 }
+    };
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_send_vec(accepted, iov, AVS_ARRAY_SIZE(iov)));
+    char buf[8];
+    size_t received = 0;
+    while (received < 5) {
+        size_t bytes;
+        AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_receive(
+                client, &bytes, buf + received, sizeof(buf) - received));
+        received += bytes;
+    }
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(buf, "hello", 5);
+
+    avs_net_socket_stats_t stats;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_get_stats(server, &stats));
+    AVS_UNIT_ASSERT_EQUAL(stats.connect.calls, 1);
+    AVS_UNIT_ASSERT_EQUAL(stats.connect.errors, 0);
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_get_stats(accepted, &stats));
+    AVS_UNIT_ASSERT_EQUAL(stats.connect.calls, 0);
+    AVS_UNIT_ASSERT_EQUAL(stats.send.calls, 1);
+    AVS_UNIT_ASSERT_EQUAL(stats.send.bytes, 5);
+
+    avs_net_socket_cleanup(&accepted);
+    avs_net_socket_cleanup(&client);
+    avs_net_socket_cleanup(&server);
+}
+
+AVS_UNIT_TEST(socket_stats, not_instrumented) {
+    avs_net_abstract_socket_t *socket = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&socket, AVS_NET_UDP_SOCKET, NULL));
+    avs_net_socket_stats_t stats;
+    AVS_UNIT_ASSERT_FAILED(avs_net_socket_get_stats(socket, &stats));
+    AVS_UNIT_ASSERT_FAILED(avs_net_socket_reset_stats(socket));
+    avs_net_socket_cleanup(&socket);
+
+    avs_net_abstract_socket_t *null_socket = NULL;
+    AVS_UNIT_ASSERT_FAILED(avs_net_socket_instrument(&null_socket));
+}
+
+AVS_UNIT_TEST(socket_stats, poll_wait_accounted_after_first_query) {
+    avs_net_abstract_socket_t *socket = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&socket, AVS_NET_UDP_SOCKET, NULL));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_bind(socket, "127.0.0.1", "0"));
+    const avs_net_socket_opt_value_t timeout = {
+        .recv_timeout = avs_time_duration_from_scalar(50, AVS_TIME_MS)
+    };
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_set_opt(
+            socket, AVS_NET_SOCKET_OPT_RECV_TIMEOUT, timeout));
+
+    char buf[8];
+    size_t received;
+    char host[NET_MAX_HOSTNAME_SIZE];
+    char port[NET_PORT_SIZE];
+    AVS_UNIT_ASSERT_FAILED(avs_net_socket_receive_from(
+            socket, &received, buf, sizeof(buf), host, sizeof(host),
+            port, sizeof(port)));
+    avs_net_socket_opt_value_t value;
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_get_opt(
+            socket, AVS_NET_SOCKET_OPT_POLL_WAIT_TIME, &value));
+    AVS_UNIT_ASSERT_TRUE(avs_time_duration_equal(value.poll_wait_time,
+                                                 AVS_TIME_DURATION_ZERO));
+
+    AVS_UNIT_ASSERT_FAILED(avs_net_socket_receive_from(
+            socket, &received, buf, sizeof(buf), host, sizeof(host),
+            port, sizeof(port)));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_get_opt(
+            socket, AVS_NET_SOCKET_OPT_POLL_WAIT_TIME, &value));
+    int64_t poll_wait_ms;
+    AVS_UNIT_ASSERT_SUCCESS(avs_time_duration_to_scalar(
+            &poll_wait_ms, AVS_TIME_MS, value.poll_wait_time));
+    AVS_UNIT_ASSERT_TRUE(poll_wait_ms >= 40);
+
+    avs_net_socket_cleanup(&socket);
+}
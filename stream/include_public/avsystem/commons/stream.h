@@ -204,6 +204,30 @@ int avs_stream_read_reliably(avs_stream_abstract_t *stream,
  */
 int avs_stream_ignore_to_end(avs_stream_abstract_t *stream);
 
+/**
+ * Copies all data from @p src to @p dst until the message in @p src is
+ * finished (for the more informative reference about "finished message" see
+ * @ref avs_stream_read documentation).
+ *
+ * If @p src is a file stream that exposes its system file handle and @p dst is
+ * a network stream that supports it (e.g. a netbuf stream over a plain TCP
+ * socket), the file contents are passed directly to the socket, without
+ * copying them through a user-space buffer. Otherwise, the data is copied
+ * using @ref avs_stream_read and @ref avs_stream_write .
+ *
+ * Note that @ref avs_stream_finish_message is NOT called on @p dst .
+ *
+ * @param dst              Stream to write the data to.
+ * @param src              Stream to read the data from.
+ * @param out_bytes_copied Number of bytes copied. It is also meaningful in case
+ *                         of error. May be NULL.
+ *
+ * @returns 0 on success, negative value on error.
+ */
+int avs_stream_copy(avs_stream_abstract_t *dst,
+                    avs_stream_abstract_t *src,
+                    size_t *out_bytes_copied);
+
 /**
  * Peeks a single byte at specified offset (from the current stream position),
  * without consuming it.
@@ -32,11 +32,20 @@ typedef int (*avs_stream_file_offset_t)(avs_stream_abstract_t *stream,
                                         avs_off_t *out_position);
 typedef int (*avs_stream_file_seek_t)(avs_stream_abstract_t *stream,
                                       avs_off_t offset_from_start);
+/**
+ * Returns a pointer to the system file handle (e.g. an <c>int</c> file
+ * descriptor on POSIX systems) in @p out . Any data written to the stream is
+ * flushed, so that the handle may be used to access the whole file contents.
+ */
+typedef int (*avs_stream_file_get_system_t)(avs_stream_abstract_t *stream,
+                                            const void **out);
 
 typedef struct {
     avs_stream_file_length_t length;
     avs_stream_file_offset_t offset;
     avs_stream_file_seek_t seek;
+    /* Optional - may be NULL or not initialized at all */
+    avs_stream_file_get_system_t get_system;
 } avs_stream_v_table_extension_file_t;
 
 /**
@@ -34,9 +34,23 @@ typedef int (*avs_stream_net_getsock_t)(avs_stream_abstract_t *stream,
 typedef int (*avs_stream_net_setsock_t)(avs_stream_abstract_t *stream,
                                         avs_net_abstract_socket_t *socket);
 
+/**
+ * Sends @p length bytes of a file referred to by a system file handle,
+ * starting at @p offset , after any data previously written to the stream.
+ * Semantics of the arguments and the return value are the same as for
+ * @ref avs_net_socket_send_file .
+ */
+typedef int (*avs_stream_net_send_file_t)(avs_stream_abstract_t *stream,
+                                          const void *file_handle,
+                                          avs_off_t offset,
+                                          size_t length,
+                                          size_t *out_bytes_sent);
+
 typedef struct {
     avs_stream_net_getsock_t getsock;
     avs_stream_net_setsock_t setsock;
+    /* Optional - may be NULL or not initialized at all */
+    avs_stream_net_send_file_t send_file;
 } avs_stream_v_table_extension_net_t;
 
 avs_net_abstract_socket_t *
@@ -66,6 +66,13 @@ static int out_buffer_flush(buffered_netstream_t *stream) {
     return result;
 }
 
+static bool has_native_send_vec(avs_net_abstract_socket_t *socket) {
+    avs_net_socket_opt_value_t value;
+    return !avs_net_socket_get_opt(socket, AVS_NET_SOCKET_OPT_NATIVE_SEND_VEC,
+                                   &value)
+           && value.flag;
+}
+
 static int buffered_netstream_write_some(avs_stream_abstract_t *stream_,
                                          const void *data,
                                          size_t *inout_data_length) {
@@ -75,7 +82,28 @@ static int buffered_netstream_write_some(avs_stream_abstract_t *stream_,
     if (*inout_data_length < avs_buffer_space_left(stream->out_buffer)) {
         return avs_buffer_append_bytes(stream->out_buffer, data,
                                        *inout_data_length);
-    } else if ((result = out_buffer_flush(stream))) {
+    } else if (avs_buffer_data_size(stream->out_buffer) > 0
+               && has_native_send_vec(stream->socket)) {
+        // send buffered data along with the new chunk in a single call; the
+        // send_vec() fallback would copy both instead, so it is not used
+        const avs_net_socket_const_iovec_t iov[] = {
+            {
+                .buffer = avs_buffer_data(stream->out_buffer),
+                .buffer_length = avs_buffer_data_size(stream->out_buffer)
+            }, {
+                .buffer = data,
+                .buffer_length = *inout_data_length
+            }
+        };
+        WRAP_ERRNO(stream, result,
+                   avs_net_socket_send_vec(stream->socket, iov,
+                                           AVS_ARRAY_SIZE(iov)));
+        if (!result) {
+            avs_buffer_reset(stream->out_buffer);
+        }
+        return result;
+    } else if (avs_buffer_data_size(stream->out_buffer) > 0
+               && (result = out_buffer_flush(stream))) {
         return result;
     } else {
         WRAP_ERRNO(stream, result, avs_net_socket_send(stream->socket, data,
@@ -300,6 +328,27 @@ static int buffered_netstream_setsock(avs_stream_abstract_t *stream_,
     return 0;
 }
 
+static int buffered_netstream_send_file(avs_stream_abstract_t *stream_,
+                                        const void *file_handle,
+                                        avs_off_t offset,
+                                        size_t length,
+                                        size_t *out_bytes_sent) {
+    buffered_netstream_t *stream = (buffered_netstream_t *) stream_;
+    stream->errno_ = 0;
+    *out_bytes_sent = 0;
+    int result;
+    if (avs_buffer_data_size(stream->out_buffer) > 0
+            && (result = out_buffer_flush(stream))) {
+        return result;
+    }
+    result = avs_net_socket_send_file(stream->socket, file_handle, offset,
+                                      length, out_bytes_sent);
+    if (result < 0) {
+        stream->errno_ = avs_net_socket_errno(stream->socket);
+    }
+    return result;
+}
+
 static int buffered_netstream_errno(avs_stream_abstract_t *stream) {
     return ((buffered_netstream_t *) stream)->errno_;
 }
@@ -308,6 +357,7 @@ static const avs_stream_v_table_extension_net_t
 buffered_netstream_net_vtable = {
     buffered_netstream_getsock,
     buffered_netstream_setsock,
+    buffered_netstream_send_file
 };
 
 static const avs_stream_v_table_extension_nonblock_t
@@ -423,3 +473,7 @@ void avs_stream_netbuf_set_recv_timeout(avs_stream_abstract_t *str,
                            timeout_opt);
     stream->errno_ = 0;
 }
+
+#ifdef AVS_UNIT_TESTING
+#include "test/test_netbuf.c"
+#endif
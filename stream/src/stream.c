@@ -27,6 +27,8 @@
 #include <avsystem/commons/errno.h>
 #include <avsystem/commons/memory.h>
 #include <avsystem/commons/stream.h>
+#include <avsystem/commons/stream/stream_file.h>
+#include <avsystem/commons/stream/stream_net.h>
 #include <avsystem/commons/stream_v_table.h>
 
 #define MODULE_NAME avs_stream
@@ -201,6 +203,84 @@ int avs_stream_ignore_to_end(avs_stream_abstract_t *stream) {
     return message_finished ? count : -1;
 }
 
+/**
+ * Attempts to pass the remaining contents of a file stream @p src directly to
+ * the socket underlying @p dst . Returns a positive value if that is not
+ * possible and nothing has been sent.
+ */
+static int try_copy_file_to_net(avs_stream_abstract_t *dst,
+                                avs_stream_abstract_t *src,
+                                size_t *out_bytes_copied) {
+    const avs_stream_v_table_extension_file_t *file =
+            (const avs_stream_v_table_extension_file_t *)
+            avs_stream_v_table_find_extension(src,
+                                              AVS_STREAM_V_TABLE_EXTENSION_FILE);
+    const avs_stream_v_table_extension_net_t *net =
+            (const avs_stream_v_table_extension_net_t *)
+            avs_stream_v_table_find_extension(dst,
+                                              AVS_STREAM_V_TABLE_EXTENSION_NET);
+    if (!file || !file->get_system || !net || !net->send_file) {
+        return 1;
+    }
+
+    const void *file_handle;
+    avs_off_t offset;
+    avs_off_t length;
+    if (file->get_system(src, &file_handle)
+            || file->offset(src, &offset)
+            || file->length(src, &length)) {
+        return 1;
+    }
+    if (length <= offset) {
+        return 0;
+    }
+
+    size_t bytes_sent = 0;
+    int result = net->send_file(dst, file_handle, offset,
+                                (size_t) (length - offset), &bytes_sent);
+    if (result > 0) {
+        return result;
+    }
+    *out_bytes_copied = bytes_sent;
+    // the file handle is accessed independently of the stream cursor,
+    // so the cursor needs to be moved past the data consumed
+    if (file->seek(src, offset + (avs_off_t) bytes_sent) && !result) {
+        result = -1;
+    }
+    return result;
+}
+
+static int copy_through_buffer(avs_stream_abstract_t *dst,
+                               avs_stream_abstract_t *src,
+                               size_t *out_bytes_copied) {
+    char buf[512];
+    char message_finished = 0;
+    while (!message_finished) {
+        size_t bytes_read = 0;
+        if (avs_stream_read(src, &bytes_read, &message_finished,
+                            buf, sizeof(buf))
+                || avs_stream_write(dst, buf, bytes_read)) {
+            return -1;
+        }
+        *out_bytes_copied += bytes_read;
+    }
+    return 0;
+}
+
+int avs_stream_copy(avs_stream_abstract_t *dst,
+                    avs_stream_abstract_t *src,
+                    size_t *out_bytes_copied) {
+    size_t bytes_copied = 0;
+    int result = try_copy_file_to_net(dst, src, &bytes_copied);
+    if (result > 0) {
+        result = copy_through_buffer(dst, src, &bytes_copied);
+    }
+    if (out_bytes_copied) {
+        *out_bytes_copied = bytes_copied;
+    }
+    return result;
+}
+
 int avs_stream_getch(avs_stream_abstract_t *stream, char *message_finished) {
     char buf;
     size_t bytes_read;
@@ -14,6 +14,11 @@
  * limitations under the License.
  */
 
+/* for fileno() */
+#if !defined(_POSIX_C_SOURCE) && !defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #define AVS_STREAM_STREAM_FILE_C
 #include <avs_commons_config.h>
 
@@ -38,6 +43,9 @@ struct avs_file_stream_struct {
     uint8_t mode;
     int error_code;
     FILE *fp;
+#ifdef HAVE_FILENO
+    int fd;
+#endif
 };
 
 int avs_stream_file_length(avs_stream_abstract_t *stream,
@@ -220,10 +228,32 @@ static int stream_file_length(avs_stream_abstract_t *stream,
     return stream_file_seek(stream, offset);
 }
 
+#ifdef HAVE_FILENO
+static int stream_file_get_system(avs_stream_abstract_t *stream,
+                                  const void **out) {
+    avs_stream_file_t *file = (avs_stream_file_t *) stream;
+    if ((file->mode & AVS_STREAM_FILE_READ) == 0) {
+        file->error_code = EBADF;
+        return -1;
+    }
+    // make data buffered by stdio visible through the file descriptor
+    if ((file->mode & AVS_STREAM_FILE_WRITE) && fflush(file->fp)) {
+        file->error_code = EIO;
+        return -1;
+    }
+    file->error_code = 0;
+    *out = &file->fd;
+    return 0;
+}
+#else // HAVE_FILENO
+#define stream_file_get_system NULL
+#endif // HAVE_FILENO
+
 static const avs_stream_v_table_extension_file_t stream_file_ext_vtable = {
     stream_file_length,
     stream_file_offset,
-    stream_file_seek
+    stream_file_seek,
+    stream_file_get_system
 };
 
 static const avs_stream_v_table_extension_t stream_file_extensions[] = {
@@ -266,6 +296,9 @@ avs_stream_file_create(const char *path,
     if (!file->fp) {
         goto error;
     }
+#ifdef HAVE_FILENO
+    file->fd = fileno(file->fp);
+#endif
     file->mode = mode;
     return (avs_stream_abstract_t *) file;
 error:
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include <avsystem/commons/stream/stream_file.h>
+#include <avsystem/commons/unit/test.h>
+
+int mkstemp(char *filename_template);
+
+AVS_UNIT_TEST(netbuf, copy_from_file) {
+    char filename[] = "/tmp/test_netbuf-XXXXXX";
+    int fd = mkstemp(filename);
+    AVS_UNIT_ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    char data[100000];
+    for (size_t i = 0; i < sizeof(data); ++i) {
+        data[i] = (char) (i % 251);
+    }
+    avs_stream_abstract_t *file =
+            avs_stream_file_create(filename, AVS_STREAM_FILE_READ
+                                                     | AVS_STREAM_FILE_WRITE);
+    AVS_UNIT_ASSERT_NOT_NULL(file);
+    AVS_UNIT_ASSERT_SUCCESS(avs_stream_write(file, data, sizeof(data)));
+    AVS_UNIT_ASSERT_SUCCESS(avs_stream_file_seek(file, 0));
+
+    avs_net_socket_configuration_t config;
+    memset(&config, 0, sizeof(config));
+    config.address_family = AVS_NET_AF_INET4;
+    avs_net_abstract_socket_t *server = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&server, AVS_NET_TCP_SOCKET, &config));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_bind(server, "127.0.0.1", "0"));
+    char port[16];
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_get_local_port(server, port, sizeof(port)));
+    avs_net_abstract_socket_t *client = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&client, AVS_NET_TCP_SOCKET, NULL));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_connect(client, "127.0.0.1", port));
+    avs_net_abstract_socket_t *accepted = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(
+            avs_net_socket_create(&accepted, AVS_NET_TCP_SOCKET, NULL));
+    AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_accept(server, accepted));
+
+    avs_stream_abstract_t *netbuf = NULL;
+    AVS_UNIT_ASSERT_SUCCESS(avs_stream_netbuf_create(&netbuf, client, 64, 64));
+    // data buffered before the copy needs to be sent first
+    AVS_UNIT_ASSERT_SUCCESS(avs_stream_write(netbuf, "HDR", 3));
+    size_t bytes_copied;
+    AVS_UNIT_ASSERT_SUCCESS(avs_stream_copy(netbuf, file, &bytes_copied));
+    AVS_UNIT_ASSERT_EQUAL(bytes_copied, sizeof(data));
+    AVS_UNIT_ASSERT_SUCCESS(avs_stream_finish_message(netbuf));
+    // the file stream cursor is moved past the copied data
+    avs_off_t offset;
+    AVS_UNIT_ASSERT_SUCCESS(avs_stream_file_offset(file, &offset));
+    AVS_UNIT_ASSERT_EQUAL(offset, (avs_off_t) sizeof(data));
+
+    static char received[3 + sizeof(data)];
+    size_t total = 0;
+    while (total < sizeof(received)) {
+        size_t bytes_received;
+        AVS_UNIT_ASSERT_SUCCESS(avs_net_socket_receive(
+                accepted, &bytes_received, received + total,
+                sizeof(received) - total));
+        AVS_UNIT_ASSERT_TRUE(bytes_received > 0);
+        total += bytes_received;
+    }
+    AVS_UNIT_ASSERT_EQUAL_BYTES(received, "HDR");
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(received + 3, data, sizeof(data));
+
+    avs_stream_cleanup(&netbuf);
+    avs_net_socket_cleanup(&accepted);
+    avs_net_socket_cleanup(&server);
+    avs_stream_cleanup(&file);
+    unlink(filename);
+}
@@ -19,6 +19,7 @@
 #include <unistd.h>
 
 #include <avsystem/commons/memory.h>
+#include <avsystem/commons/stream/stream_membuf.h>
 #include <avsystem/commons/unit/test.h>
 
 int mkstemp(char *filename_template);
@@ -150,3 +151,33 @@ AVS_UNIT_TEST(stream_file, extensions_length) {
     avs_stream_cleanup(&stream);
     unlink(filename);
 }
+
+AVS_UNIT_TEST(stream_file, copy_to_membuf) {
+    char filename[sizeof(TEMPLATE)];
+    char data[1500];
+    char buf[sizeof(data)];
+    size_t bytes_copied;
+    size_t bytes_read;
+    char end_of_msg;
+    avs_stream_abstract_t *stream;
+    avs_stream_abstract_t *membuf;
+
+    for (size_t i = 0; i < sizeof(data); ++i) {
+        data[i] = (char) i;
+    }
+    AVS_UNIT_ASSERT_SUCCESS(make_temporary(filename));
+    AVS_UNIT_ASSERT_NOT_NULL((stream = avs_stream_file_create(filename, AVS_STREAM_FILE_READ | AVS_STREAM_FILE_WRITE)));
+    AVS_UNIT_ASSERT_SUCCESS(avs_stream_write(stream, data, sizeof(data)));
+    AVS_UNIT_ASSERT_SUCCESS(avs_stream_file_seek(stream, 100));
+
+    AVS_UNIT_ASSERT_NOT_NULL((membuf = avs_stream_membuf_create()));
+    AVS_UNIT_ASSERT_SUCCESS(avs_stream_copy(membuf, stream, &bytes_copied));
+    AVS_UNIT_ASSERT_EQUAL(bytes_copied, sizeof(data) - 100);
+    AVS_UNIT_ASSERT_SUCCESS(avs_stream_read(membuf, &bytes_read, &end_of_msg, buf, sizeof(buf)));
+    AVS_UNIT_ASSERT_EQUAL(bytes_read, sizeof(data) - 100);
+    AVS_UNIT_ASSERT_EQUAL_BYTES_SIZED(buf, data + 100, sizeof(data) - 100);
+
+    avs_stream_cleanup(&membuf);
+    avs_stream_cleanup(&stream);
+    unlink(filename);
+}
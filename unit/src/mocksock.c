@@ -167,7 +167,15 @@ static const avs_net_socket_v_table_t mock_vtable = {
     mock_local_port,
     mock_get_opt,
     mock_set_opt,
-    mock_errno
+    mock_errno,
+    NULL, // get_remote_endpoint
+    NULL, // receive_batch
+    NULL, // send_to_batch
+    NULL, // send_vec
+    NULL, // receive_vec
+    NULL, // send_file
+    NULL, // send_segmented
+    NULL // receive_segmented
 };
 
 static const char *cmd_type_to_string(mocksock_expected_command_type_t type) {
@@ -736,6 +744,12 @@ static int mock_get_opt(avs_net_abstract_socket_t *socket_,
         return 0;
     }
 
+    if (option_key == AVS_NET_SOCKET_OPT_NATIVE_SEND_VEC) {
+        // mock_vtable has no send_vec
+        out_option_value->flag = false;
+        return 0;
+    }
+
     assert_command_expected(socket->expected_commands,
             MOCKSOCK_COMMAND_GET_OPT);
 
@@ -234,6 +234,24 @@ ssize_t avs_hexlify(char *out_hex,
                     const void *input,
                     size_t input_size);
 
+/** Initial value to be passed to @ref avs_hash_fnv1a32 . */
+#define AVS_HASH_FNV1A32_INIT UINT32_C(2166136261)
+
+/**
+ * Updates a 32-bit FNV-1a hash with @p size bytes of @p data. Hashing a byte
+ * sequence in several parts yields the same value as hashing it at once.
+ *
+ * The hash is fast and well-distributed, but not suitable for cryptographic
+ * purposes.
+ *
+ * @param hash Hash of the preceding data, or @ref AVS_HASH_FNV1A32_INIT .
+ * @param data Data to hash.
+ * @param size Number of bytes of @p data to hash.
+ *
+ * @returns Updated hash value.
+ */
+uint32_t avs_hash_fnv1a32(uint32_t hash, const void *data, size_t size);
+
 #ifdef	__cplusplus
 }
 #endif
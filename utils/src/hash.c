@@ -0,0 +1,34 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <avs_commons_config.h>
+
+#include <avsystem/commons/utils.h>
+
+VISIBILITY_SOURCE_BEGIN
+
+uint32_t avs_hash_fnv1a32(uint32_t hash, const void *data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= ((const uint8_t *) data)[i];
+        hash *= UINT32_C(16777619);
+    }
+    return hash;
+}
+
+#ifdef AVS_UNIT_TESTING
+#include "test/hash.c"
+#endif // AVS_UNIT_TESTING
@@ -0,0 +1,35 @@
+/*
+ * Copyright 2017-2018 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <avsystem/commons/unit/test.h>
+#include <avsystem/commons/utils.h>
+
+AVS_UNIT_TEST(hash, fnv1a32_reference_values) {
+    AVS_UNIT_ASSERT_EQUAL(avs_hash_fnv1a32(AVS_HASH_FNV1A32_INIT, "", 0),
+                          UINT32_C(0x811C9DC5));
+    AVS_UNIT_ASSERT_EQUAL(avs_hash_fnv1a32(AVS_HASH_FNV1A32_INIT, "a", 1),
+                          UINT32_C(0xE40C292C));
+    AVS_UNIT_ASSERT_EQUAL(avs_hash_fnv1a32(AVS_HASH_FNV1A32_INIT, "foobar", 6),
+                          UINT32_C(0xBF9CF968));
+}
+
+AVS_UNIT_TEST(hash, fnv1a32_incremental) {
+    AVS_UNIT_ASSERT_EQUAL(
+            avs_hash_fnv1a32(avs_hash_fnv1a32(AVS_HASH_FNV1A32_INIT, "foo", 3),
+                             "bar", 3),
+            avs_hash_fnv1a32(AVS_HASH_FNV1A32_INIT, "foobar", 6));
+}